@@ -60,12 +60,16 @@
         UPREEMPT=0 # userland preemption
              MTP=0 # multiple kernel threads per process
          SHADOWD=0 # shadow page cleanup
+        LOCKSTAT=0 # kmutex/krwlock contention statistics
+      SCHEDTRACE=0 # scheduler event ring buffer (schedtrace kshell command)
+             SMP=0 # use every processor (run with ./weenix --smp <n>)
+         PROFILE=0 # sampling kernel profiler (profile kshell command)
 
 # Boolean options specified in this specified in this file that should be
 # included as definitions at compile time
-        COMPILE_CONFIG_BOOLS=" DRIVERS VFS S5FS VM FI DYNAMIC MOUNTING MTP SHADOWD GETCWD UPREEMPT"
+        COMPILE_CONFIG_BOOLS=" DRIVERS VFS S5FS VM FI DYNAMIC MOUNTING MTP SHADOWD GETCWD UPREEMPT LOCKSTAT SCHEDTRACE SMP PROFILE "
 # As above, but not booleans
-        COMPILE_CONFIG_DEFS=" NTERMS NDISKS DBG DISK_SIZE BOCHS_INSTALL_DIR"
+        COMPILE_CONFIG_DEFS=" NTERMS NDISKS DBG DISK_SIZE BOCHS_INSTALL_DIR "
 
 # Parameters for the hard disk we build (must be compatible!)
 # If the FS is too big for the disk, BAD things happen!
@@ -1,8 +1,13 @@
 #include "globals.h"
 #include "errno.h"
 
+#include "kernel.h"
+
 #include "util/string.h"
 #include "util/debug.h"
+#include "util/printf.h"
+
+#include "main/interrupt.h"
 
 #include "mm/mman.h"
 #include "mm/page.h"
@@ -12,16 +17,121 @@
 #include "proc/proc.h"
 
 #include "vm/vmmap.h"
+#include "vm/pagefault.h"
 
 #include "api/access.h"
 #include "api/syscall.h"
 
-/* copy_to_user and copy_from_user are used to copy to and from the
- * user space of the current process.  They first check that the range
- * of addresses has valid mappings, then call vmmap_read/write.
+/*
+ * User memory is mapped into the kernel's address space whenever the
+ * process is running, so the fast path of copy_to_user and
+ * copy_from_user is a plain memory copy. The copy loop has an entry
+ * in the exception table (the .ex_table section, see link.ld) for
+ * every instruction which may touch user memory. If one of them
+ * faults, uaccess_fault() (called from the page fault handler) first
+ * tries to resolve the fault through the process's vmmap, exactly as
+ * if userland had touched the page. If the address turns out to be
+ * invalid execution resumes at the fixup address, which makes the
+ * copy return -EFAULT.
+ *
+ * The slow path (uaccess_fastpath == 0) first checks that the range
+ * of addresses has valid mappings, then calls vmmap_read/write. It is
+ * kept around so the two can be compared, see the "uaccess" kshell
+ * command and /usr/bin/copybench.
+ */
+
+typedef struct uaccess_extable_entry {
+        uint32_t ue_insn;       /* address of instruction allowed to fault */
+        uint32_t ue_fixup;      /* where to continue if it does */
+} uaccess_extable_entry_t;
+
+int uaccess_fastpath = 1;
+uaccess_stats_t uaccess_stats;
+
+/* Copies n bytes from src to dst, returns 0 on success and non-zero
+ * if an access could not be resolved */
+int __uaccess_copy(void *dst, const void *src, size_t n);
+__asm__ (
+        ".pushsection .text\n"
+        ".global __uaccess_copy\n"
+        "__uaccess_copy:\n\t"
+        "pushl %esi\n\t"
+        "pushl %edi\n\t"
+        "movl 12(%esp), %edi\n\t"
+        "movl 16(%esp), %esi\n\t"
+        "movl 20(%esp), %ecx\n\t"
+        "movl %ecx, %edx\n\t"
+        "shrl $2, %ecx\n\t"
+        "andl $3, %edx\n\t"
+        "xorl %eax, %eax\n\t"
+        "cld\n"
+        "1:\trep movsl\n\t"
+        "movl %edx, %ecx\n"
+        "2:\trep movsb\n"
+        "3:\tpopl %edi\n\t"
+        "popl %esi\n\t"
+        "ret\n"
+        "4:\tmovl $1, %eax\n\t"
+        "jmp 3b\n\t"
+        ".pushsection .ex_table, \"a\"\n\t"
+        ".long 1b, 4b\n\t"
+        ".long 2b, 4b\n\t"
+        ".popsection\n\t"
+        ".popsection\n"
+);
+
+/*
+ * This is all the fast path needs to check up front, anything else is
+ * caught by the page fault handler.
  */
+int
+user_range_ok(const void *uaddr, size_t nbytes)
+{
+        uintptr_t start = (uintptr_t) uaddr;
+        uintptr_t end = start + nbytes;
+
+        return (end >= start) && (start >= USER_MEM_LOW) && (end <= USER_MEM_HIGH);
+}
+
+int
+uaccess_fault(regs_t *regs, uintptr_t vaddr, uint32_t cause)
+{
+        uaccess_extable_entry_t *ent;
+
+        for (ent = (uaccess_extable_entry_t *) &kernel_start_ex_table;
+             ent < (uaccess_extable_entry_t *) &kernel_end_ex_table; ++ent) {
+                if (ent->ue_insn == regs->r_eip)
+                        goto found;
+        }
+        return 0;
+
+found:
+        uaccess_stats.us_faults++;
+        if ((USER_MEM_LOW <= vaddr) && (USER_MEM_HIGH > vaddr)
+            && (0 == do_pagefault(vaddr, cause))) {
+                /* the page is there now, retry the instruction */
+                return 1;
+        }
+
+        dbg(DBG_VM, "bad user access to 0x%08x at eip 0x%08x, fixing up\n",
+            vaddr, regs->r_eip);
+        uaccess_stats.us_fixups++;
+        regs->r_eip = ent->ue_fixup;
+        return 1;
+}
+
 int copy_from_user(void *kaddr, const void *uaddr, size_t nbytes)
 {
+        if (uaccess_fastpath) {
+                uaccess_stats.us_fast++;
+                if (!user_range_ok(uaddr, nbytes)
+                    || __uaccess_copy(kaddr, uaddr, nbytes)) {
+                        return -EFAULT;
+                }
+                return 0;
+        }
+
+        uaccess_stats.us_slow++;
         if (!range_perm(curproc, uaddr, nbytes, PROT_READ)) {
                 return -EFAULT;
         }
@@ -30,12 +140,51 @@ int copy_from_user(void *kaddr, const void *uaddr, size_t nbytes)
 
 int copy_to_user(void *uaddr, const void *kaddr, size_t nbytes)
 {
+        if (uaccess_fastpath) {
+                uaccess_stats.us_fast++;
+                if (!user_range_ok(uaddr, nbytes)
+                    || __uaccess_copy(uaddr, kaddr, nbytes)) {
+                        return -EFAULT;
+                }
+                return 0;
+        }
+
+        uaccess_stats.us_slow++;
         if (!range_perm(curproc, uaddr, nbytes, PROT_WRITE)) {
                 return -EFAULT;
         }
         return vmmap_write(curproc->p_vmmap, uaddr, kaddr, nbytes);
 }
 
+int
+copy_buf(void *dst, const void *src, size_t nbytes)
+{
+        if ((uintptr_t) dst < USER_MEM_HIGH) {
+                return copy_to_user(dst, src, nbytes);
+        } else if ((uintptr_t) src < USER_MEM_HIGH) {
+                return copy_from_user(dst, src, nbytes);
+        } else {
+                memcpy(dst, src, nbytes);
+                return 0;
+        }
+}
+
+size_t
+uaccess_info(const void *arg, char *buf, size_t osize)
+{
+        size_t size = osize;
+
+        KASSERT(NULL == arg);
+
+        iprintf(&buf, &size, "mode:    %s\n", uaccess_fastpath ? "fast" : "slow");
+        iprintf(&buf, &size, "fast:    %u\n", uaccess_stats.us_fast);
+        iprintf(&buf, &size, "slow:    %u\n", uaccess_stats.us_slow);
+        iprintf(&buf, &size, "faults:  %u\n", uaccess_stats.us_faults);
+        iprintf(&buf, &size, "fixups:  %u\n", uaccess_stats.us_fixups);
+
+        return size;
+}
+
 /* Like strndup(), but gets the string from user space, ensuring
  * that the entire string (up to its length) has valid mappings.
  * The resulting string can be freed with kfree().
@@ -1,11 +1,17 @@
+#include "globals.h"
+
 #include "util/debug.h"
 
 #include "main/interrupt.h"
 #include "main/gdt.h"
+#include "main/fpu.h"
+
+#include "proc/sched.h"
 
 #include "api/exec.h"
 #include "api/binfmt.h"
 #include "api/syscall.h"
+#include "api/vdata.h"
 
 
 /* Enters userland from the kernel. Call this for a process that has up to now
@@ -16,6 +22,10 @@
 void userland_entry(const regs_t *regs)
 {
         intr_disable();
+#ifdef __SMP__
+        /* user code runs without the kernel lock */
+        smp_unlock_kernel();
+#endif
         intr_setipl(IPL_LOW);
         /* We "return from the interrupt" to get into userland */
         __asm__ __volatile__(
@@ -42,6 +52,9 @@ int do_execve(const char *filename, char *const *argv, char *const *envp, struct
         if (ret < 0) {
                 return ret;
         }
+        /* the new program starts with a clean FPU */
+        fpu_release(curthr);
+
         /* Make sure we "return" into the start of the newly loaded binary */
         regs->r_eip = eip;
         regs->r_useresp = esp;
@@ -54,6 +67,15 @@ void kernel_execve(const char *filename, char *const *argv, char *const *envp)
         int ret = binfmt_load(filename, argv, envp, &eip, &esp);
         KASSERT(0 == ret); /* Should never fail to load the first binary */
 
+        /* The first process was created before the clock was
+         * calibrated, so its vdata page has no clock parameters yet */
+        vdata_update(curproc);
+
+        userland_start(eip, esp);
+}
+
+void userland_start(uint32_t eip, uint32_t esp)
+{
         dbg(DBG_EXEC, "Entering userland with eip %#08x, esp %#08x\n", eip, esp);
 
         /* To enter userland, we build a set of saved registers to "trick" the processor
@@ -93,5 +115,7 @@ void kernel_execve(const char *filename, char *const *argv, char *const *envp)
         regs.r_edx = 0;
         regs.r_ebp = 0;
         regs.r_esp = 0;
+
+        sched_acct_leave();
         userland_entry(&regs);
 }
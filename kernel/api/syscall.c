@@ -7,11 +7,13 @@
 
 #include "proc/proc.h"
 #include "proc/kthread.h"
+#include "proc/futex.h"
 
 #include "util/init.h"
 #include "util/string.h"
 #include "util/debug.h"
 #include "util/list.h"
+#include "util/time.h"
 
 #include "mm/mman.h"
 #include "mm/mm.h"
@@ -21,6 +23,9 @@
 
 #include "fs/vfs_syscall.h"
 #include "fs/vnode.h"
+#include "fs/file.h"
+#include "fs/pipe.h"
+#include "fs/stat.h"
 
 #include "test/kshell/kshell.h"
 
@@ -30,6 +35,9 @@
 
 #include "api/syscall.h"
 #include "api/utsname.h"
+#include "api/memstat.h"
+#include "api/resource.h"
+#include "api/time.h"
 #include "api/access.h"
 #include "api/exec.h"
 
@@ -43,31 +51,128 @@ static __attribute__((unused)) void syscall_init(void)
 init_func(syscall_init);
 
 /*
- * this is one of the few sys_* functions you have to write. be sure to
- * check out the sys_* functions we have provided before trying to write
- * this one.
+ * Returns 1 if reads and writes on f may be handed the user's buffer
+ * directly. The file system read and write routines copy with
+ * copy_buf(), so for regular files data moves between the page cache
+ * and the user's pages in a single pass, for the whole request, and
+ * likewise for pipes between the pipe's buffer and the user's pages.
+ * Device drivers only know about kernel buffers, so everything else
+ * still goes through a kernel page. The caller must go on to use the
+ * same file, not look the descriptor up again: another thread could
+ * have put a device there by then.
+ */
+static int
+direct_io_ok(file_t *f)
+{
+        return S_ISREG(f->f_vnode->vn_mode) || S_ISFIFO(f->f_vnode->vn_mode);
+}
+
+/*
  *  - copy_from_user() the read_args_t
- *  - page_alloc() a temporary buffer
- *  - call do_read(), and copy_to_user() the read bytes
- *  - page_free() your buffer
+ *  - check that the buffer is in user memory
+ *  - fget() the file once, for the whole call
+ *  - for regular files and pipes, read straight into the user's buffer
+ *  - otherwise page_alloc() a temporary buffer, read up to a page into
+ *    it, copy_to_user() the read bytes and page_free() it
  *  - return the number of bytes actually read, or if anything goes wrong
  *    set curthr->kt_errno and return -1
  */
 static int
 sys_read(read_args_t *arg)
 {
-        NOT_YET_IMPLEMENTED("VM: sys_read");
-        return -1;
+        read_args_t kern_args;
+        file_t *f;
+        void *page;
+        int ret;
+
+        if (copy_from_user(&kern_args, arg, sizeof(kern_args)) < 0) {
+                curthr->kt_errno = EFAULT;
+                return -1;
+        }
+        if (!user_range_ok(kern_args.buf, kern_args.nbytes)) {
+                curthr->kt_errno = EFAULT;
+                return -1;
+        }
+        if ((0 > kern_args.fd) || (NULL == (f = fget(kern_args.fd)))) {
+                curthr->kt_errno = EBADF;
+                return -1;
+        }
+
+        if (direct_io_ok(f)) {
+                ret = do_read_file(f, kern_args.buf, kern_args.nbytes);
+        } else if (NULL == (page = page_alloc())) {
+                ret = -ENOMEM;
+        } else {
+                ret = do_read_file(f, page, MIN(kern_args.nbytes, PAGE_SIZE));
+                if ((ret > 0) && (copy_to_user(kern_args.buf, page, ret) < 0)) {
+                        ret = -EFAULT;
+                }
+                page_free(page);
+        }
+        fput(f);
+
+        if (ret < 0) {
+                curthr->kt_errno = -ret;
+                return -1;
+        }
+        return ret;
 }
 
 /*
  * This function is almost identical to sys_read.  See comments above.
+ * Writes to devices go through the temporary page one page at a time
+ * until everything is written or the device takes less than a page.
  */
 static int
 sys_write(write_args_t *arg)
 {
-        NOT_YET_IMPLEMENTED("VM: sys_write");
-        return -1;
+        write_args_t kern_args;
+        size_t done = 0, chunk;
+        file_t *f;
+        void *page;
+        int ret = 0;
+
+        if (copy_from_user(&kern_args, arg, sizeof(kern_args)) < 0) {
+                curthr->kt_errno = EFAULT;
+                return -1;
+        }
+        if (!user_range_ok(kern_args.buf, kern_args.nbytes)) {
+                curthr->kt_errno = EFAULT;
+                return -1;
+        }
+        if ((0 > kern_args.fd) || (NULL == (f = fget(kern_args.fd)))) {
+                curthr->kt_errno = EBADF;
+                return -1;
+        }
+
+        if (direct_io_ok(f)) {
+                ret = do_write_file(f, kern_args.buf, kern_args.nbytes);
+        } else if (NULL == (page = page_alloc())) {
+                ret = -ENOMEM;
+        } else {
+                do {
+                        chunk = MIN(kern_args.nbytes - done, PAGE_SIZE);
+                        if (copy_from_user(page, (char *) kern_args.buf + done, chunk) < 0) {
+                                ret = -EFAULT;
+                                break;
+                        }
+                        if ((ret = do_write_file(f, page, chunk)) <= 0) {
+                                break;
+                        }
+                        done += ret;
+                } while ((done < kern_args.nbytes) && ((size_t) ret == chunk));
+                page_free(page);
+                if (done > 0) {
+                        ret = done;
+                }
+        }
+        fput(f);
+
+        if (ret < 0) {
+                curthr->kt_errno = -ret;
+                return -1;
+        }
+        return ret;
 }
 
 /*
@@ -192,6 +297,25 @@ static int sys_dup2(const dup2_args_t *arg)
         } else return err;
 }
 
+static int sys_pipe(int *fds)
+{
+        int                     kern_fds[2];
+        int                     err;
+
+        if ((err = do_pipe(kern_fds)) < 0) {
+                curthr->kt_errno = -err;
+                return -1;
+        }
+
+        if ((err = copy_to_user(fds, kern_fds, sizeof(kern_fds))) < 0) {
+                do_close(kern_fds[0]);
+                do_close(kern_fds[1]);
+                curthr->kt_errno = -err;
+                return -1;
+        }
+        return 0;
+}
+
 static int sys_mkdir(mkdir_args_t *arg)
 {
         mkdir_args_t            kern_args;
@@ -447,6 +571,50 @@ static void *sys_mmap(mmap_args_t *arg)
 }
 
 
+#ifdef __MTP__
+static int sys_thr_create(thr_create_args_t *args)
+{
+        thr_create_args_t kargs;
+        int tid;
+
+        if (0 > copy_from_user(&kargs, args, sizeof(kargs))) {
+                curthr->kt_errno = EFAULT;
+                return -1;
+        }
+
+        if (0 > (tid = do_thr_create((uint32_t) kargs.tca_entry,
+                                     (uint32_t) kargs.tca_arg, kargs.tca_stacksz))) {
+                curthr->kt_errno = -tid;
+                return -1;
+        }
+        return tid;
+}
+
+static int sys_thr_join(thr_join_args_t *args)
+{
+        thr_join_args_t kargs;
+        void *retval;
+        int err;
+
+        if (0 > copy_from_user(&kargs, args, sizeof(kargs))) {
+                curthr->kt_errno = EFAULT;
+                return -1;
+        }
+
+        if (0 > (err = do_thr_join(kargs.tja_tid, &retval))) {
+                curthr->kt_errno = -err;
+                return -1;
+        }
+
+        if (NULL != kargs.tja_retval
+            && 0 > copy_to_user(kargs.tja_retval, &retval, sizeof(retval))) {
+                curthr->kt_errno = EFAULT;
+                return -1;
+        }
+        return 0;
+}
+#endif
+
 static pid_t sys_waitpid(waitpid_args_t *args)
 {
         int s, p;
@@ -526,6 +694,151 @@ static int sys_stat(stat_args_t *arg)
         return 0;
 }
 
+/*
+ * Copies out the memory counters of the process with the given pid,
+ * or of the calling process if pid is 0.
+ */
+static int
+sys_memstat(memstat_args_t *arg)
+{
+        memstat_args_t kern_args;
+        proc_t *p;
+
+        if (copy_from_user(&kern_args, arg, sizeof(kern_args)) < 0) {
+                curthr->kt_errno = EFAULT;
+                return -1;
+        }
+
+        if (0 == kern_args.pid) {
+                p = curproc;
+        } else if (NULL == (p = proc_lookup(kern_args.pid))) {
+                curthr->kt_errno = ESRCH;
+                return -1;
+        }
+
+        if (copy_to_user(kern_args.buf, &p->p_mem, sizeof(p->p_mem)) < 0) {
+                curthr->kt_errno = EFAULT;
+                return -1;
+        }
+        return 0;
+}
+
+static int
+sys_nanosleep(nanosleep_args_t *arg)
+{
+        nanosleep_args_t kern_args;
+        struct timespec req, rem;
+        int ret;
+
+        if (copy_from_user(&kern_args, arg, sizeof(kern_args)) < 0
+            || copy_from_user(&req, kern_args.req, sizeof(req)) < 0) {
+                curthr->kt_errno = EFAULT;
+                return -1;
+        }
+
+        if ((ret = do_nanosleep(&req, &rem)) < 0) {
+                if (-EINTR == ret && NULL != kern_args.rem
+                    && copy_to_user(kern_args.rem, &rem, sizeof(rem)) < 0) {
+                        ret = -EFAULT;
+                }
+                curthr->kt_errno = -ret;
+                return -1;
+        }
+        return 0;
+}
+
+static int
+sys_futex_wait(futex_wait_args_t *arg)
+{
+        futex_wait_args_t kern_args;
+        struct timespec timeout;
+        int err;
+
+        if (copy_from_user(&kern_args, arg, sizeof(kern_args)) < 0
+            || (NULL != kern_args.fwa_timeout
+                && copy_from_user(&timeout, kern_args.fwa_timeout,
+                                  sizeof(timeout)) < 0)) {
+                curthr->kt_errno = EFAULT;
+                return -1;
+        }
+
+        if ((err = do_futex_wait(kern_args.fwa_uaddr, kern_args.fwa_val,
+                                 (NULL == kern_args.fwa_timeout) ? NULL : &timeout)) < 0) {
+                curthr->kt_errno = -err;
+                return -1;
+        }
+        return 0;
+}
+
+static int
+sys_futex_wake(futex_wake_args_t *arg)
+{
+        futex_wake_args_t kern_args;
+        int ret;
+
+        if (copy_from_user(&kern_args, arg, sizeof(kern_args)) < 0) {
+                curthr->kt_errno = EFAULT;
+                return -1;
+        }
+
+        if ((ret = do_futex_wake(kern_args.fwk_uaddr, kern_args.fwk_n)) < 0) {
+                curthr->kt_errno = -ret;
+                return -1;
+        }
+        return ret;
+}
+
+static int
+sys_getrusage(getrusage_args_t *arg)
+{
+        getrusage_args_t kern_args;
+        struct rusage usage;
+        int err;
+
+        if (copy_from_user(&kern_args, arg, sizeof(kern_args)) < 0) {
+                curthr->kt_errno = EFAULT;
+                return -1;
+        }
+
+        if ((err = do_getrusage(kern_args.who, &usage)) < 0) {
+                curthr->kt_errno = -err;
+                return -1;
+        }
+
+        if (copy_to_user(kern_args.usage, &usage, sizeof(usage)) < 0) {
+                curthr->kt_errno = EFAULT;
+                return -1;
+        }
+        return 0;
+}
+
+static int
+sys_clock_gettime(clock_gettime_args_t *arg)
+{
+        clock_gettime_args_t kern_args;
+        struct timespec ts;
+        uint64_t ns;
+
+        if (copy_from_user(&kern_args, arg, sizeof(kern_args)) < 0) {
+                curthr->kt_errno = EFAULT;
+                return -1;
+        }
+        if (CLOCK_MONOTONIC != kern_args.clk_id) {
+                curthr->kt_errno = EINVAL;
+                return -1;
+        }
+
+        ns = ktime_get_ns();
+        ts.tv_sec = ns / 1000000000;
+        ts.tv_nsec = ns % 1000000000;
+
+        if (copy_to_user(kern_args.tp, &ts, sizeof(ts)) < 0) {
+                curthr->kt_errno = EFAULT;
+                return -1;
+        }
+        return 0;
+}
+
 static int sys_uname(struct utsname *arg)
 {
         static const char sysname[] = "Weenix";
@@ -625,6 +938,60 @@ cleanup:
         return 0;
 }
 
+static int sys_spawn(spawn_args_t *args)
+{
+        spawn_args_t kern_args;
+        spawn_action_t kern_actions[SPAWN_MAX_ACTIONS];
+        char *kern_filename = NULL;
+        char **kern_argv = NULL;
+        char **kern_envp = NULL;
+        int err;
+
+        curthr->kt_errno = 0;
+        if ((err = copy_from_user(&kern_args, args, sizeof(kern_args))) < 0) {
+                curthr->kt_errno = -err;
+                goto cleanup;
+        }
+
+        if (0 > kern_args.nactions || SPAWN_MAX_ACTIONS < kern_args.nactions) {
+                curthr->kt_errno = EINVAL;
+                goto cleanup;
+        }
+        if (kern_args.nactions
+            && (err = copy_from_user(kern_actions, kern_args.actions,
+                                     kern_args.nactions * sizeof(spawn_action_t))) < 0) {
+                curthr->kt_errno = -err;
+                goto cleanup;
+        }
+
+        if ((kern_filename = user_strdup(&kern_args.filename)) == NULL)
+                goto cleanup;
+        if (kern_args.argv.av_vec) {
+                if ((kern_argv = user_vecdup(&kern_args.argv)) == NULL)
+                        goto cleanup;
+        }
+        if (kern_args.envp.av_vec) {
+                if ((kern_envp = user_vecdup(&kern_args.envp)) == NULL)
+                        goto cleanup;
+        }
+
+        err = do_spawn(kern_filename, kern_argv, kern_envp,
+                       kern_actions, kern_args.nactions);
+        if (err < 0)
+                curthr->kt_errno = -err;
+
+cleanup:
+        if (kern_filename)
+                kfree(kern_filename);
+        if (kern_argv)
+                free_vector(kern_argv);
+        if (kern_envp)
+                free_vector(kern_envp);
+        if (curthr->kt_errno)
+                return -1;
+        return err;
+}
+
 static int sys_debug(argstr_t *arg)
 {
         argstr_t kern_args;
@@ -715,6 +1082,32 @@ static int syscall_dispatch(uint32_t sysnum, uint32_t args, regs_t *regs)
                         panic("thr_exit failed!\n");
                         return 0;
 
+#ifdef __MTP__
+                case SYS_thr_create:
+                        return sys_thr_create((thr_create_args_t *)args);
+
+                case SYS_thr_join:
+                        return sys_thr_join((thr_join_args_t *)args);
+
+                case SYS_thr_detach:
+                case SYS_thr_cancel: {
+                        int err = (SYS_thr_detach == sysnum)
+                                  ? do_thr_detach((int)args)
+                                  : do_thr_cancel((int)args);
+                        if (err < 0) {
+                                curthr->kt_errno = -err;
+                                return -1;
+                        }
+                        return 0;
+                }
+
+                case SYS_gettid:
+                        return curthr->kt_tid;
+#else
+                case SYS_gettid:
+                        return 0;
+#endif
+
                 case SYS_thr_yield:
                         sched_make_runnable(curthr);
                         sched_switch();
@@ -762,6 +1155,9 @@ static int syscall_dispatch(uint32_t sysnum, uint32_t args, regs_t *regs)
                 case SYS_dup2:
                         return sys_dup2((dup2_args_t *)args);
 
+                case SYS_pipe:
+                        return sys_pipe((int *)args);
+
                 case SYS_mkdir:
                         return sys_mkdir((mkdir_args_t *)args);
 
@@ -803,12 +1199,32 @@ static int syscall_dispatch(uint32_t sysnum, uint32_t args, regs_t *regs)
                 case SYS_execve:
                         return sys_execve((execve_args_t *)args, regs);
 
+                case SYS_spawn:
+                        return sys_spawn((spawn_args_t *)args);
+
                 case SYS_stat:
                         return sys_stat((stat_args_t *)args);
 
                 case SYS_uname:
                         return sys_uname((struct utsname *)args);
 
+                case SYS_memstat:
+                        return sys_memstat((memstat_args_t *)args);
+
+                case SYS_nanosleep:
+                        return sys_nanosleep((nanosleep_args_t *)args);
+
+                case SYS_clock_gettime:
+                        return sys_clock_gettime((clock_gettime_args_t *)args);
+
+                case SYS_futex_wait:
+                        return sys_futex_wait((futex_wait_args_t *)args);
+
+                case SYS_futex_wake:
+                        return sys_futex_wake((futex_wake_args_t *)args);
+                case SYS_getrusage:
+                        return sys_getrusage((getrusage_args_t *)args);
+
                 case SYS_debug:
                         return sys_debug((argstr_t *)args);
                 case SYS_kshell:
@@ -0,0 +1,78 @@
+#include "types.h"
+#include "globals.h"
+#include "errno.h"
+
+#include "util/debug.h"
+#include "util/string.h"
+#include "util/time.h"
+
+#include "main/interrupt.h"
+#include "main/fpu.h"
+
+#include "mm/mm.h"
+#include "mm/page.h"
+#include "mm/pagetable.h"
+
+#include "proc/proc.h"
+
+#include "api/vdata.h"
+
+int
+vdata_create(proc_t *p)
+{
+        struct vdata *vd;
+
+        KASSERT(VDATA_ADDR == USER_VDATA_ADDR);
+        KASSERT(NULL != p->p_pagedir);
+
+        if (NULL == (vd = page_alloc())) {
+                return -ENOMEM;
+        }
+        memset(vd, 0, PAGE_SIZE);
+
+        /* read only for the process; the kernel writes to it
+         * through its own mapping of the page. It is the kernel's
+         * page, so it is not counted in the process's memstat. */
+        if (pt_map(p->p_pagedir, USER_VDATA_ADDR, pt_virt_to_phys((uintptr_t) vd),
+                   PD_PRESENT | PD_WRITE | PD_USER,
+                   PT_PRESENT | PT_USER | PT_NORSS) < 0) {
+                page_free(vd);
+                return -ENOMEM;
+        }
+
+        p->p_vdata = vd;
+        vdata_update(p);
+        return 0;
+}
+
+void
+vdata_destroy(proc_t *p)
+{
+        KASSERT(NULL != p->p_vdata);
+
+        page_free(p->p_vdata);
+        p->p_vdata = NULL;
+}
+
+void
+vdata_update(proc_t *p)
+{
+        struct vdata *vd = p->p_vdata;
+        uint64_t base;
+        uint32_t mult, shift;
+
+        ktime_tsc_params(&base, &mult, &shift);
+
+        vd->vd_seq++;
+        __asm__ volatile("" ::: "memory");
+
+        vd->vd_pid = p->p_pid;
+        vd->vd_tsc_base = base;
+        vd->vd_tsc_mult = mult;
+        vd->vd_tsc_shift = shift;
+        vd->vd_sysenter = intr_sysenter_enabled();
+        vd->vd_sse2 = fpu_sse_enabled();
+
+        __asm__ volatile("" ::: "memory");
+        vd->vd_seq++;
+}
@@ -1,4 +1,5 @@
 #include "types.h"
+#include "errno.h"
 
 #include "main/interrupt.h"
 #include "main/io.h"
@@ -7,6 +8,7 @@
 #include "util/debug.h"
 #include "util/list.h"
 #include "util/delay.h"
+#include "util/time.h"
 
 #include "drivers/blockdev.h"
 #include "drivers/dev.h"
@@ -127,6 +129,12 @@ static struct ata_channel {
 #define ATA_SR_IDX  0x02 /* inlex */
 #define ATA_SR_ERR  0x01 /* Error */
 
+/* Control bits (for ATA_REG_CONTROL) */
+#define ATA_CTRL_SRST 0x04 /* Software reset */
+
+/* How long to wait for the interrupt which ends an operation */
+#define ATA_TIMEOUT_MSECS 5000
+
 /* Error codes (for ATA_REG_ERROR) */
 #define ATA_ER_BBK   0x80 /* Bad sector */
 #define ATA_ER_UNC   0x40 /* Uncorrectable data */
@@ -195,6 +203,22 @@ ata_pause(uint8_t channel)
         ndelay(400);
 }
 
+/* Resets the drives on a channel, which abandons whatever command they
+ * were running */
+static void
+ata_reset(uint8_t channel)
+{
+        int i;
+
+        outb(ATA_CHANNELS[channel].atac_ctrl + ATA_REG_CONTROL, ATA_CTRL_SRST);
+        udelay(5);
+        outb(ATA_CHANNELS[channel].atac_ctrl + ATA_REG_CONTROL, 0);
+        ata_pause(channel);
+        for (i = 0; i < 1000 && (ata_inb_altstatus(channel) & ATA_SR_BSY); ++i) {
+                udelay(10);
+        }
+}
+
 #define ATA_IDENT_BUFSIZE 128
 
 #define bd_to_ata(bd) (CONTAINER_OF((bd), ata_disk_t, ata_bdev))
@@ -413,7 +437,8 @@ ata_write(blockdev_t *bdev, const char *data, blocknum_t blocknum, unsigned int
  * @param data the buffer to write from or read into
  * @param blocknum which block on the disk to read or write
  * @param write true if writing, false if reading
- * @return 0 on sucess or <0 on error
+ * @return 0 on sucess or <0 on error (-EIO if the disk never
+ * signalled completion)
  */
 /*
  * In this function you will perform a disk operation using
@@ -549,8 +574,20 @@ ata_do_operation(ata_disk_t *adisk, char *data, blocknum_t blocknum, int write)
         /* Tell the DMA to start */
         dma_start(adisk->ata_channel);
 
-        /* Wait for operation to finish */
-        sched_sleep_on(&adisk->ata_waitq);
+        /* Wait for operation to finish. If the interrupt has been lost
+         * the disk will never wake us, so give up after a while and
+         * reset the channel. */
+        if (-ETIMEDOUT == sched_sleep_on_timeout(&adisk->ata_waitq,
+                                                 msecs_to_jiffies(ATA_TIMEOUT_MSECS))) {
+                dbg(DBG_DISK, "ATA timeout on block %u, resetting channel %d\n",
+                    blocknum, adisk->ata_channel);
+                dma_reset(adisk->ata_channel);
+                ata_reset(adisk->ata_channel);
+
+                intr_setipl(oldipl);
+                kmutex_unlock(&adisk->ata_mutex);
+                return -EIO;
+        }
 
         retval = 0;
 
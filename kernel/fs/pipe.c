@@ -0,0 +1,372 @@
+#include "kernel.h"
+#include "errno.h"
+#include "globals.h"
+
+#include "api/access.h"
+
+#include "fs/file.h"
+#include "fs/open.h"
+#include "fs/pipe.h"
+#include "fs/stat.h"
+#include "fs/vfs.h"
+#include "fs/vnode.h"
+
+#include "mm/page.h"
+#include "mm/slab.h"
+
+#include "util/debug.h"
+#include "util/init.h"
+#include "util/string.h"
+
+/* The two ends of a pipe are vnodes of pipe_fs, numbered after the
+ * address of the pipe, with the low bit saying which end it is */
+#define PIPE_READ_END           0
+#define PIPE_WRITE_END          1
+#define PIPE_VNO(p, end)        ((ino_t)(p) | (end))
+#define VNO_TO_PIPE(vno)        ((pipe_t *)((vno) & ~PIPE_WRITE_END))
+#define VNO_TO_END(vno)         ((vno) & PIPE_WRITE_END)
+
+static slab_allocator_t *pipe_allocator;
+
+static void pipe_read_vnode(vnode_t *vn);
+static void pipe_delete_vnode(vnode_t *vn);
+static int pipe_query_vnode(vnode_t *vn);
+static int pipe_read(vnode_t *vn, off_t offset, void *buf, size_t count);
+static int pipe_write(vnode_t *vn, off_t offset, const void *buf, size_t count);
+static int pipe_stat(vnode_t *vn, struct stat *ss);
+
+static fs_ops_t pipe_fs_ops = {
+        .read_vnode = pipe_read_vnode,
+        .delete_vnode = pipe_delete_vnode,
+        .query_vnode = pipe_query_vnode,
+        .umount = NULL
+};
+
+static fs_t pipe_fs = {
+        .fs_dev = "",
+        .fs_type = "pipe",
+        .fs_op = &pipe_fs_ops,
+        .fs_root = NULL,
+        .fs_i = NULL
+};
+
+static vnode_ops_t pipe_read_vops = {
+        .read = pipe_read,
+        .write = NULL,
+        .mmap = NULL,
+        .create = NULL,
+        .mknod = NULL,
+        .lookup = NULL,
+        .link = NULL,
+        .unlink = NULL,
+        .mkdir = NULL,
+        .rmdir = NULL,
+        .readdir = NULL,
+        .stat = pipe_stat,
+        .fillpage = NULL,
+        .dirtypage = NULL,
+        .cleanpage = NULL
+};
+
+static vnode_ops_t pipe_write_vops = {
+        .read = NULL,
+        .write = pipe_write,
+        .mmap = NULL,
+        .create = NULL,
+        .mknod = NULL,
+        .lookup = NULL,
+        .link = NULL,
+        .unlink = NULL,
+        .mkdir = NULL,
+        .rmdir = NULL,
+        .readdir = NULL,
+        .stat = pipe_stat,
+        .fillpage = NULL,
+        .dirtypage = NULL,
+        .cleanpage = NULL
+};
+
+static __attribute__((unused)) void
+pipe_init(void)
+{
+        pipe_allocator = slab_allocator_create("pipe", sizeof(pipe_t));
+        KASSERT(NULL != pipe_allocator);
+}
+init_func(pipe_init);
+
+static void
+pipe_free(pipe_t *p)
+{
+        int i;
+
+        for (i = 0; i < PIPE_NPAGES; ++i) {
+                if (NULL != p->p_pages[i]) {
+                        page_free(p->p_pages[i]);
+                }
+        }
+        slab_obj_free(pipe_allocator, p);
+}
+
+static uint32_t
+pipe_len(pipe_t *p)
+{
+        return p->p_wpos - p->p_rpos;
+}
+
+static void
+pipe_wake(ktqueue_t *q)
+{
+        if (!sched_queue_empty(q)) {
+                sched_broadcast_on(q);
+        }
+}
+
+/*
+ * Copies n bytes between buf and the ring, starting pos bytes into the
+ * pipe's data, into the ring if in is set and out of it otherwise.
+ * buf may be in user memory. Returns 0 or -EFAULT.
+ */
+static int
+pipe_copy(pipe_t *p, uint32_t pos, char *buf, size_t n, int in)
+{
+        char *data;
+        size_t chunk;
+        int err;
+
+        while (n > 0) {
+                data = p->p_pages[(pos / PAGE_SIZE) & (PIPE_NPAGES - 1)] + PAGE_OFFSET(pos);
+                chunk = MIN(n, PAGE_SIZE - PAGE_OFFSET(pos));
+                if (in) {
+                        err = copy_buf(data, buf, chunk);
+                } else {
+                        err = copy_buf(buf, data, chunk);
+                }
+                if (err < 0) {
+                        return err;
+                }
+                buf += chunk;
+                pos += chunk;
+                n -= chunk;
+        }
+        return 0;
+}
+
+static void
+pipe_read_vnode(vnode_t *vn)
+{
+        pipe_t *p = VNO_TO_PIPE(vn->vn_vno);
+
+        if (PIPE_WRITE_END == VNO_TO_END(vn->vn_vno)) {
+                vn->vn_ops = &pipe_write_vops;
+                p->p_writers = 1;
+        } else {
+                vn->vn_ops = &pipe_read_vops;
+                p->p_readers = 1;
+        }
+        vn->vn_mode = S_IFIFO;
+        vn->vn_len = 0;
+        vn->vn_i = p;
+}
+
+/* The last file open on one end has been closed: anyone waiting on the
+ * other end will now never be satisfied, so they are told to give up.
+ * The pipe goes once both ends have. */
+static void
+pipe_delete_vnode(vnode_t *vn)
+{
+        pipe_t *p = vn->vn_i;
+
+        if (PIPE_WRITE_END == VNO_TO_END(vn->vn_vno)) {
+                p->p_writers = 0;
+                sched_broadcast_on(&p->p_rq);
+        } else {
+                p->p_readers = 0;
+                sched_broadcast_on(&p->p_wq);
+        }
+        if (!p->p_readers && !p->p_writers) {
+                pipe_free(p);
+        }
+}
+
+static int
+pipe_query_vnode(vnode_t *vn)
+{
+        return 0;
+}
+
+/*
+ * Waits for there to be data, unless the write end has been closed,
+ * and reads as much of it as there is room for, up to count bytes.
+ * Returns the number of bytes read, 0 at end of file, or -EINTR if
+ * cancelled while waiting.
+ */
+static int
+pipe_read(vnode_t *vn, off_t offset, void *buf, size_t count)
+{
+        pipe_t *p = vn->vn_i;
+        uint32_t n;
+        int ret;
+
+        if (0 == count) {
+                return 0;
+        }
+        if (0 > (ret = kmutex_lock_cancellable(&p->p_rlock))) {
+                return ret;
+        }
+
+        while (0 == pipe_len(p) && p->p_writers) {
+                if (0 > (ret = sched_cancellable_sleep_on(&p->p_rq))) {
+                        goto out;
+                }
+        }
+
+        n = MIN(count, pipe_len(p));
+        if (0 > (ret = pipe_copy(p, p->p_rpos, buf, n, 0))) {
+                goto out;
+        }
+        p->p_rpos += n;
+        ret = n;
+
+        if (PIPE_SIZE - pipe_len(p) >= PIPE_WAKE_BYTES) {
+                pipe_wake(&p->p_wq);
+        }
+out:
+        kmutex_unlock(&p->p_rlock);
+        return ret;
+}
+
+/*
+ * Writes all count bytes, waiting for room as needed, unless the read
+ * end is closed first. Up to PIPE_BUF bytes go in at once. Returns the
+ * number of bytes written if any were, and otherwise -EPIPE if there
+ * is no reader or -EINTR if cancelled while waiting.
+ */
+static int
+pipe_write(vnode_t *vn, off_t offset, const void *buf, size_t count)
+{
+        pipe_t *p = vn->vn_i;
+        size_t done = 0;
+        uint32_t need, n;
+        int ret;
+
+        if (0 == count) {
+                return 0;
+        }
+        if (0 > (ret = kmutex_lock_cancellable(&p->p_wlock))) {
+                return ret;
+        }
+
+        need = (count <= PIPE_BUF) ? count : 1;
+        while (done < count) {
+                while (p->p_readers && PIPE_SIZE - pipe_len(p) < need) {
+                        pipe_wake(&p->p_rq);
+                        if (0 > (ret = sched_cancellable_sleep_on(&p->p_wq))) {
+                                goto out;
+                        }
+                }
+                if (!p->p_readers) {
+                        ret = -EPIPE;
+                        goto out;
+                }
+
+                n = MIN(count - done, PIPE_SIZE - pipe_len(p));
+                if (0 > (ret = pipe_copy(p, p->p_wpos, (char *) buf + done, n, 1))) {
+                        goto out;
+                }
+                p->p_wpos += n;
+                done += n;
+
+                if (pipe_len(p) >= PIPE_WAKE_BYTES) {
+                        pipe_wake(&p->p_rq);
+                }
+        }
+out:
+        if (0 != pipe_len(p)) {
+                pipe_wake(&p->p_rq);
+        }
+        kmutex_unlock(&p->p_wlock);
+        return (done > 0) ? (int) done : ret;
+}
+
+static int
+pipe_stat(vnode_t *vn, struct stat *ss)
+{
+        pipe_t *p = vn->vn_i;
+
+        memset(ss, 0, sizeof(struct stat));
+        ss->st_mode = vn->vn_mode;
+        ss->st_ino = (int) vn->vn_vno;
+        ss->st_nlink = 1;
+        ss->st_size = (int) pipe_len(p);
+        ss->st_blksize = PIPE_BUF;
+        return 0;
+}
+
+static file_t *
+pipe_file(vnode_t *vn, int mode)
+{
+        file_t *f;
+
+        if (NULL != (f = fget(-1))) {
+                f->f_mode = mode;
+                f->f_vnode = vn;
+        }
+        return f;
+}
+
+int
+do_pipe(int fds[2])
+{
+        pipe_t *p;
+        vnode_t *rvn, *wvn;
+        file_t *rf, *wf;
+        int i, ret;
+
+        if (NULL == (p = slab_obj_alloc(pipe_allocator))) {
+                return -ENOMEM;
+        }
+        memset(p, 0, sizeof(pipe_t));
+        for (i = 0; i < PIPE_NPAGES; ++i) {
+                if (NULL == (p->p_pages[i] = page_alloc())) {
+                        pipe_free(p);
+                        return -ENOMEM;
+                }
+        }
+        sched_queue_init(&p->p_rq);
+        sched_queue_init(&p->p_wq);
+        kmutex_init(&p->p_rlock);
+        kmutex_init(&p->p_wlock);
+
+        /* from here on the vnodes own the pipe, and putting both of them
+         * frees it */
+        rvn = vget(&pipe_fs, PIPE_VNO(p, PIPE_READ_END));
+        wvn = vget(&pipe_fs, PIPE_VNO(p, PIPE_WRITE_END));
+        if (NULL == (rf = pipe_file(rvn, FMODE_READ))) {
+                vput(rvn);
+                vput(wvn);
+                return -ENOMEM;
+        }
+        if (NULL == (wf = pipe_file(wvn, FMODE_WRITE))) {
+                fput(rf);
+                vput(wvn);
+                return -ENOMEM;
+        }
+
+        if (0 > (ret = fds[0] = get_empty_fd(curproc))) {
+                goto fail;
+        }
+        curproc->p_files[fds[0]] = rf;
+        if (0 > (ret = fds[1] = get_empty_fd(curproc))) {
+                curproc->p_files[fds[0]] = NULL;
+                goto fail;
+        }
+        curproc->p_files[fds[1]] = wf;
+
+        dbg(DBG_VFS, "pipe %p on fds %d and %d\n", p, fds[0], fds[1]);
+        return 0;
+
+fail:
+        fput(rf);
+        fput(wf);
+        return ret;
+}
@@ -25,6 +25,7 @@
 #include "fs/dirent.h"
 #include "util/debug.h"
 #include "mm/kmalloc.h"
+#include "api/access.h"
 
 #include "fs/ramfs/ramfs.h"
 
@@ -585,7 +586,8 @@ ramfs_read(vnode_t *file, off_t offset, void *buf, size_t count)
         KASSERT(!S_ISDIR(file->vn_mode));
 
         ret = MAX(0, MIN((off_t)count, inode->rf_size - offset));
-        memcpy(buf, inode->rf_mem + offset, ret);
+        if (copy_buf(buf, inode->rf_mem + offset, ret) < 0)
+                return -EFAULT;
 
         return ret;
 }
@@ -599,7 +601,8 @@ ramfs_write(vnode_t *file, off_t offset, const void *buf, size_t count)
         KASSERT(!S_ISDIR(file->vn_mode));
 
         ret = MIN((off_t)count, (off_t)PAGE_SIZE - offset);
-        memcpy(inode->rf_mem + offset, buf, ret);
+        if (copy_buf(inode->rf_mem + offset, buf, ret) < 0)
+                return -EFAULT;
 
         KASSERT(file->vn_len == inode->rf_size);
         file->vn_len = MAX(file->vn_len, offset + ret);
@@ -13,7 +13,7 @@
 #include "util/printf.h"
 #include "util/debug.h"
 
-#include "proc/kmutex.h"
+#include "proc/krwlock.h"
 
 #include "fs/s5fs/s5fs_subr.h"
 #include "fs/s5fs/s5fs.h"
@@ -159,8 +159,8 @@ s5fs_mount(struct fs *fs)
 
         pframe_pin(vp);
 
-        /*     init s5f_mutex: */
-        kmutex_init(&s5->s5f_mutex);
+        /*     init s5f_rwlock: */
+        krwlock_init(&s5->s5f_rwlock);
 
         /*     init s5f_fs: */
         s5->s5f_fs = fs;
@@ -386,10 +386,12 @@ s5fs_umount(fs_t *fs)
  */
 
 /*
- * You will need to lock the vnode's mutex before doing anything that can block.
+ * You will need to lock the vnode's rwlock before doing anything that can block.
  * pframe functions can block, so probably what you want to do
- * is just lock the mutex in the s5fs_* functions listed below, and then not
- * worry about the mutexes in s5fs_subr.c.
+ * is just lock the rwlock in the s5fs_* functions listed below, and then not
+ * worry about the locks in s5fs_subr.c. Functions which only look at the
+ * vnode (read, lookup, readdir, stat) take it shared, so they can run
+ * concurrently; functions which change it take it exclusive.
  *
  * Note that you will not be calling pframe functions directly, but
  * s5fs_subr.c functions will be, so you need to lock around them.
@@ -407,9 +409,9 @@ s5fs_umount(fs_t *fs)
 static int
 s5fs_read(vnode_t *vnode, off_t offset, void *buf, size_t len)
 {
-        kmutex_lock(&vnode->vn_mutex);
+        krwlock_rdlock(&vnode->vn_rwlock);
         int res = s5_read_file(vnode, offset, buf, len);
-        kmutex_unlock(&vnode->vn_mutex);
+        krwlock_unlock(&vnode->vn_rwlock);
         return res;
         /* NOT_YET_IMPLEMENTED("S5FS: s5fs_read"); */
         return -1;
@@ -419,9 +421,9 @@ s5fs_read(vnode_t *vnode, off_t offset, void *buf, size_t len)
 static int
 s5fs_write(vnode_t *vnode, off_t offset, const void *buf, size_t len)
 {
-        kmutex_lock(&vnode->vn_mutex);
+        krwlock_wrlock(&vnode->vn_rwlock);
         int res = s5_write_file(vnode, offset, buf, len);
-        kmutex_unlock(&vnode->vn_mutex);
+        krwlock_unlock(&vnode->vn_rwlock);
         return res;
         /* NOT_YET_IMPLEMENTED("S5FS: s5fs_write"); */
         return -1;
@@ -463,11 +465,11 @@ s5fs_create(vnode_t *dir, const char *name, size_t namelen, vnode_t **result)
 /* Like mkdir and mknod, but creating a regular data file. 
    Just change the type you pass in for alloc_inode()(?)
  	*/
-        kmutex_lock(&dir->vn_mutex);
+        krwlock_wrlock(&dir->vn_rwlock);
 
         int inode_num = s5_alloc_inode(dir->vn_fs, S5_TYPE_DATA, 0); /* Pull new inode from disk */
         if (inode_num == -ENOSPC) {
-            kmutex_unlock(&dir->vn_mutex);
+            krwlock_unlock(&dir->vn_rwlock);
             return inode_num;
         }
 
@@ -479,7 +481,7 @@ s5fs_create(vnode_t *dir, const char *name, size_t namelen, vnode_t **result)
         int link1 = s5_link(dir, new_file, name, namelen); /* Create dirent for new_dir in parent dir */
         if (link1 == -ENOSPC) {
             dbg_print("ERROR. No room on disk to create file %s\n", name);
-            kmutex_unlock(&dir->vn_mutex);
+            krwlock_unlock(&dir->vn_rwlock);
             /*s5_free_inode(new_file);
             vput(new_file);*/
             pframe_free(pf);
@@ -488,14 +490,14 @@ s5fs_create(vnode_t *dir, const char *name, size_t namelen, vnode_t **result)
 
         if (link1 == -EEXIST) {
             dbg_print("ERROR. File %s already exists.\n", name);
-            kmutex_unlock(&dir->vn_mutex);
+            krwlock_unlock(&dir->vn_rwlock);
             return -EEXIST;
         }
 
         *result = new_file;
 
         /*vput(dir);*/
-        kmutex_unlock(&dir->vn_mutex);
+        krwlock_unlock(&dir->vn_rwlock);
         return 0;
 
 
@@ -525,7 +527,7 @@ s5fs_mknod(vnode_t *dir, const char *name, size_t namelen, int mode, devid_t dev
         int inode_num = s5_alloc_inode(dir->vn_fs, type, devid);
         if (inode_num == -ENOSPC) return inode_num;
 
-        kmutex_lock(&dir->vn_mutex);
+        krwlock_wrlock(&dir->vn_rwlock);
 
         pframe_t *pf;
         int res = pframe_get(S5FS_TO_VMOBJ(VNODE_TO_S5FS(dir)), S5_INODE_BLOCK(inode_num), &pf);
@@ -536,14 +538,14 @@ s5fs_mknod(vnode_t *dir, const char *name, size_t namelen, int mode, devid_t dev
 
         if (link1 != 0) {
             dbg_print("ERROR. File %s already exists.\n", name);
-            kmutex_unlock(&dir->vn_mutex);
+            krwlock_unlock(&dir->vn_rwlock);
             return -EEXIST;
         }
 
         vput(new_dev);
 
         dbg_print("new dev linkcount: %d\n", VNODE_TO_S5INODE(new_dev)->s5_linkcount);
-        kmutex_unlock(&dir->vn_mutex);
+        krwlock_unlock(&dir->vn_rwlock);
         return 0;
 
         /* NOT_YET_IMPLEMENTED("S5FS: s5fs_mknod"); */
@@ -594,12 +596,12 @@ s5fs_lookup(vnode_t *base, const char *name, size_t namelen, vnode_t **result)
  * Either is fine.
  */
          dbg_print("Looking up %s\n", name);
-         kmutex_lock(&base->vn_mutex);
+         krwlock_rdlock(&base->vn_rwlock);
          int inum = s5_find_dirent(base, name, namelen);
 
          if (inum == -ENOENT) {
              dbg_print("ERROR. No dir entry with given name.\n");
-             kmutex_unlock(&base->vn_mutex);
+             krwlock_unlock(&base->vn_rwlock);
              return inum;
          }
          /* If you get here, dir entry has matching name. inum is its inode number. */
@@ -620,7 +622,7 @@ s5fs_lookup(vnode_t *base, const char *name, size_t namelen, vnode_t **result)
  */
 
         *result = vget(base->vn_fs, inum);
-        kmutex_unlock(&base->vn_mutex);
+        krwlock_unlock(&base->vn_rwlock);
         return 0;
 
 
@@ -642,9 +644,9 @@ s5fs_link(vnode_t *src, vnode_t *dir, const char *name, size_t namelen)
         /* Add a directory entry linking to the vnode
          * Dirty file blocks (and maybe the inode)
          */
-        /*kmutex_lock(&src->vn_mutex);*/
+        /*krwlock_wrlock(&src->vn_rwlock);*/
         int res = s5_link(src, dir, name, namelen);
-        /*kmutex_unlock(&src->vn_mutex);*/
+        /*krwlock_unlock(&src->vn_rwlock);*/
         return res;
         /* NOT_YET_IMPLEMENTED("S5FS: s5fs_link"); */
         return -1;
@@ -665,7 +667,7 @@ s5fs_unlink(vnode_t *dir, const char *name, size_t namelen)
          * Reduce link count
          * Dirty file blocks (and maybe the inode)
          */
-        /*kmutex_lock(&dir->vn_mutex);*/
+        /*krwlock_wrlock(&dir->vn_rwlock);*/
 
         /* Check to make sure you aren't trying to remove a directory */
         /* NOTE: This is redundant, but we can't put this check in remove_dirent(),
@@ -676,14 +678,14 @@ s5fs_unlink(vnode_t *dir, const char *name, size_t namelen)
             vnode_t *rm_file = vget(dir->vn_fs, dirent_ino);
             if (VNODE_TO_S5INODE(rm_file)->s5_type == S5_TYPE_DIR) {
                 vput(rm_file);
-                /*kmutex_unlock(&dir->vn_mutex);*/
+                /*krwlock_unlock(&dir->vn_rwlock);*/
                 return -EPERM;
             }
             vput(rm_file);
         }
 
         int res = s5_remove_dirent(dir, name, namelen);
-        /*kmutex_unlock(&dir->vn_mutex);*/
+        /*krwlock_unlock(&dir->vn_rwlock);*/
         return res;
         /* NOT_YET_IMPLEMENTED("S5FS: s5fs_unlink"); */
         return -1;
@@ -739,10 +741,10 @@ s5fs_mkdir(vnode_t *dir, const char *name, size_t namelen)
  *
  * You probably want to use s5_find_dirent(), s5_write_file(), and s5_dirty_inode().
  */
-        kmutex_lock(&dir->vn_mutex);
+        krwlock_wrlock(&dir->vn_rwlock);
         int inode_num = s5_alloc_inode(dir->vn_fs, S5_TYPE_DIR, 0);
         if (inode_num == -ENOSPC) {
-            kmutex_unlock(&dir->vn_mutex);
+            krwlock_unlock(&dir->vn_rwlock);
             return inode_num;
         }
 
@@ -754,7 +756,7 @@ s5fs_mkdir(vnode_t *dir, const char *name, size_t namelen)
 
         if (VNODE_TO_S5INODE(new_dir)->s5_linkcount != 1) { /* Only one linking to you is from the vget */
             dbg_print("ERROR. File %s already exists.\n", name);
-            kmutex_unlock(&dir->vn_mutex);
+            krwlock_unlock(&dir->vn_rwlock);
             return -EEXIST;
         }
 
@@ -774,7 +776,7 @@ s5fs_mkdir(vnode_t *dir, const char *name, size_t namelen)
         /*dbg_print("Child %s link count is %d\n", name, VNODE_TO_S5INODE(new_dir)->s5_linkcount);
         dbg_print("  Child %s ref count is %d\n", name, new_dir->vn_refcount);*/
 
-        kmutex_unlock(&dir->vn_mutex);
+        krwlock_unlock(&dir->vn_rwlock);
         return 0;
 
 /*
@@ -832,17 +834,17 @@ s5fs_rmdir(vnode_t *parent, const char *name, size_t namelen)
  * You probably want to use vget(), vput(), s5_read_file(),
  * s5_write_file(), and s5_dirty_inode().
  */
-        kmutex_lock(&parent->vn_mutex);
+        krwlock_wrlock(&parent->vn_rwlock);
         int dir_ino = s5_find_dirent(parent, name, namelen);
         if (dir_ino < 0) {
-            kmutex_unlock(&parent->vn_mutex);
+            krwlock_unlock(&parent->vn_rwlock);
             return dir_ino; /* If dir to remove not in parent dir, return errno */
         }
 
         /* Check to make sure vnode to remove is directory type */
         vnode_t *dir_to_rm = vget(parent->vn_fs, dir_ino);
         if (VNODE_TO_S5INODE(dir_to_rm)->s5_type != S5_TYPE_DIR) {
-            kmutex_unlock(&parent->vn_mutex);
+            krwlock_unlock(&parent->vn_rwlock);
             return -ENOTDIR;
         }
 
@@ -854,7 +856,7 @@ s5fs_rmdir(vnode_t *parent, const char *name, size_t namelen)
             if (!name_match(dirent.s5d_name, ".", 1) && !name_match(dirent.s5d_name, "..", 2)) {
                 dbg_print("ERROR. Cannot delete non-empty directory, %s\n", name);
                 vput(dir_to_rm);
-                kmutex_unlock(&parent->vn_mutex);
+                krwlock_unlock(&parent->vn_rwlock);
                 return -EPERM;
             }
             offset += sizeof(s5_dirent_t);
@@ -879,7 +881,7 @@ s5fs_rmdir(vnode_t *parent, const char *name, size_t namelen)
         vput(dir_to_rm);
 
         int res = s5_remove_dirent(parent, name, namelen);
-        kmutex_unlock(&parent->vn_mutex);
+        krwlock_unlock(&parent->vn_rwlock);
         return res;
 
 /* Make sure vnode to remove is directory type */
@@ -918,9 +920,9 @@ s5fs_readdir(vnode_t *vnode, off_t offset, struct dirent *d)
  * bytes actually read, or 0 if the end of the file has been reached; on
  * failure, return -errno.
  */
-        kmutex_lock(&vnode->vn_mutex);
+        krwlock_rdlock(&vnode->vn_rwlock);
         if (offset == vnode->vn_len) {
-            kmutex_unlock(&vnode->vn_mutex);
+            krwlock_unlock(&vnode->vn_rwlock);
             return 0; /* Don't read dirent if EOF reached */
         }
 
@@ -942,7 +944,7 @@ typedef struct s5_dirent {
         d->d_ino = dirent_read.s5d_inode;
         d->d_off = offset+blocks_read;
         strncpy(d->d_name, dirent_read.s5d_name, S5_NAME_LEN-1);
-        kmutex_unlock(&vnode->vn_mutex);
+        krwlock_unlock(&vnode->vn_rwlock);
         return blocks_read;
         /* NOT_YET_IMPLEMENTED("S5FS: s5fs_readdir");*/
         return -1;
@@ -961,7 +963,7 @@ typedef struct s5_dirent {
 static int
 s5fs_stat(vnode_t *vnode, struct stat *ss)
 {
-        kmutex_lock(&vnode->vn_mutex);
+        krwlock_rdlock(&vnode->vn_rwlock);
 
         s5_inode_t *i = VNODE_TO_S5INODE(vnode);
 
@@ -972,7 +974,7 @@ s5fs_stat(vnode_t *vnode, struct stat *ss)
         ss->st_blksize = S5_BLOCK_SIZE;
         ss->st_blocks = s5_inode_blocks(vnode);
 
-        kmutex_unlock(&vnode->vn_mutex);
+        krwlock_unlock(&vnode->vn_rwlock);
 
         return 0;
 
@@ -1011,10 +1013,10 @@ s5fs_fillpage(vnode_t *vnode, off_t offset, void *pagebuf)
          *  If there is a disk block w/ data, copy it out from disk (read_block)
          *  Else, copy zeroes out
          */
-        /* kmutex_lock(&vnode->vn_mutex);*/
+        /* krwlock_rdlock(&vnode->vn_rwlock);*/
         int loc = s5_seek_to_block(vnode, offset, 0); /* Disk block to read data from */
         dbg_print("fillpage: SEEK TO BLOCK RETURNS %d\n", loc);
-        /* kmutex_unlock(&vnode->vn_mutex);*/
+        /* krwlock_unlock(&vnode->vn_rwlock);*/
 
         if (loc == 0) { /* If no disk block with data, copy out zeroes */
             memset(pagebuf, 0, S5_BLOCK_SIZE);
@@ -1024,9 +1026,9 @@ s5fs_fillpage(vnode_t *vnode, off_t offset, void *pagebuf)
         /* If you get here, there is a disk block with data */
         /* return vnode->vn_bdev->bd_ops->read_block(vnode->vn_bdev, (char *)pagebuf, loc, 1); */
         blockdev_t *bdev = FS_TO_S5FS(vnode->vn_fs)->s5f_bdev;
-        /* kmutex_lock(&vnode->vn_mutex);*/
+        /* krwlock_rdlock(&vnode->vn_rwlock);*/
         int block = bdev->bd_ops->read_block(bdev, pagebuf, loc, 1); /* read_block() will block */
-        /* kmutex_unlock(&vnode->vn_mutex);*/
+        /* krwlock_unlock(&vnode->vn_rwlock);*/
         return block;
 
         /* NOT_YET_IMPLEMENTED("S5FS: s5fs_fillpage"); */
@@ -1093,17 +1095,17 @@ s5fs_cleanpage(vnode_t *vnode, off_t offset, void *pagebuf)
          * Copy data out to disk (write_block)
          */
 
-        /* kmutex_lock(&vnode->vn_mutex);*/
+        /* krwlock_rdlock(&vnode->vn_rwlock);*/
         int loc = s5_seek_to_block(vnode, offset, 0);
         dbg_print("cleanpage: SEEK TO BLOCK RETURNS %d\n", loc);
-        /* kmutex_unlock(&vnode->vn_mutex);*/
+        /* krwlock_unlock(&vnode->vn_rwlock);*/
 
         /* If you get here, there is a disk block with data */
         /* return vnode->vn_bdev->bd_ops->write_block(vnode->vn_bdev, (char *)pagebuf, loc, 1); */
         blockdev_t *bdev = FS_TO_S5FS(vnode->vn_fs)->s5f_bdev;
-        /* kmutex_lock(&vnode->vn_mutex);*/
+        /* krwlock_rdlock(&vnode->vn_rwlock);*/
         int block = bdev->bd_ops->write_block(bdev, pagebuf, loc, 1); /* write_block() will block */
-        /* kmutex_unlock(&vnode->vn_mutex);*/
+        /* krwlock_unlock(&vnode->vn_rwlock);*/
         return block;
 
         /* NOT_YET_IMPLEMENTED("S5FS: s5fs_cleanpage"); */
@@ -1230,7 +1232,7 @@ s5fs_free_blocks(fs_t *fs) {
     uint32_t *freel = NULL;
     int tot = 0;
 
-    kmutex_lock(&s5fs->s5f_mutex);
+    krwlock_rdlock(&s5fs->s5f_rwlock);
     tot = su->s5s_nfree;
     freel = su->s5s_free_blocks;
     if ( freel[S5_NBLKS_PER_FNODE-1] !=  ~0u) tot += 1;
@@ -1243,6 +1245,6 @@ s5fs_free_blocks(fs_t *fs) {
 	/* Subtract out the last null */
 	if ( !freel[S5_NBLKS_PER_FNODE-1]!= ~0) tot--;
     }
-    kmutex_unlock(&s5fs->s5f_mutex);
+    krwlock_unlock(&s5fs->s5f_rwlock);
     return tot;
 }
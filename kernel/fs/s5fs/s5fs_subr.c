@@ -10,7 +10,7 @@
 #include "mm/kmalloc.h"
 #include "globals.h"
 #include "proc/sched.h"
-#include "proc/kmutex.h"
+#include "proc/krwlock.h"
 #include "errno.h"
 #include "util/string.h"
 #include "util/printf.h"
@@ -25,6 +25,7 @@
 #include "fs/s5fs/s5fs.h"
 #include "mm/mm.h"
 #include "mm/page.h"
+#include "api/access.h"
 
 #define dprintf(...) dbg(DBG_S5FS, __VA_ARGS__)
 
@@ -154,21 +155,21 @@ s5_seek_to_block(vnode_t *vnode, off_t seekptr, int alloc)
 
 
 /*
- * Locks the mutex for the whole file system
+ * Locks the whole file system exclusively, for changing the superblock
  */
 static void
 lock_s5(s5fs_t *fs)
 {
-        kmutex_lock(&fs->s5f_mutex);
+        krwlock_wrlock(&fs->s5f_rwlock);
 }
 
 /*
- * Unlocks the mutex for the whole file system
+ * Unlocks the whole file system
  */
 static void
 unlock_s5(s5fs_t *fs)
 {
-        kmutex_unlock(&fs->s5f_mutex);
+        krwlock_unlock(&fs->s5f_rwlock);
 }
 
 
@@ -190,59 +191,53 @@ unlock_s5(s5fs_t *fs)
  * use the vnode's pframe functions, which will eventually result in a
  * call to s5_seek_to_block().
  *
- * You will need pframe_dirty(), pframe_get(), memcpy().
+ * bytes may point into the current process's user address space (see
+ * sys_write()), so copy with copy_buf() rather than memcpy(), and pin
+ * each page while copying into it.
+ *
+ * You will need pframe_dirty(), pframe_get(), copy_buf().
  */
 int
 s5_write_file(vnode_t *vnode, off_t seek, const char *bytes, size_t len)
 {
-        /* Convert vnode to inode for easy access */
         s5_inode_t *inode = VNODE_TO_S5INODE(vnode);
+        size_t done = 0;
+        int ret = 0;
 
-        int block_num = S5_DATA_BLOCK(seek); /* Which of inode's direct blocks are you writing to? */
-        int offset = S5_DATA_OFFSET(seek); /* What is the offset within that block? */
-
-        /* This is the address where the data for the block you want to write starts */
-        int block_addr = inode->s5_direct_blocks[block_num];
-
-        /* Get first block into pframe */
-        pframe_t *pf;
-        int res = pframe_get(&vnode->vn_mmobj, block_num, &pf);
-
-        /* Write new bytes into that frame */
-        char *read_startaddr = (char *)pf->pf_addr + S5_DATA_OFFSET(seek);
-        memcpy((void *) read_startaddr, (void *)bytes, len);
-
-        /* Dirty pframe, which will call s5fs_dirtypage() */
-        res = pframe_dirty(pf);
-        if (res < 0 ) {
-            pframe_free(pf);
-            return res;
+        if ((size_t) seek + len > S5_MAX_FILE_BLOCKS * S5_BLOCK_SIZE) {
+                if ((size_t) seek >= S5_MAX_FILE_BLOCKS * S5_BLOCK_SIZE)
+                        return -EFBIG;
+                len = S5_MAX_FILE_BLOCKS * S5_BLOCK_SIZE - seek;
         }
 
-        dbg_print("vnode dir length before: %d\n", vnode->vn_len);
-        vnode->vn_len += len;
-        dbg_print("vnode dir length after: %d\n", vnode->vn_len);
-        VNODE_TO_S5INODE(vnode)->s5_size += len;
+        while (done < len) {
+                off_t pos = seek + done;
+                size_t chunk = MIN(len - done, (size_t)(S5_BLOCK_SIZE - S5_DATA_OFFSET(pos)));
+                pframe_t *pf;
 
-        return len;
+                if ((ret = pframe_get(&vnode->vn_mmobj, S5_DATA_BLOCK(pos), &pf)) < 0)
+                        break;
 
+                /* bytes may be a user buffer, so the copy can fault and
+                 * block; keep the page from being paged out meanwhile */
+                pframe_pin(pf);
+                if (0 == (ret = pframe_dirty(pf))) {
+                        ret = copy_buf((char *) pf->pf_addr + S5_DATA_OFFSET(pos),
+                                       bytes + done, chunk);
+                }
+                pframe_unpin(pf);
+                if (ret < 0)
+                        break;
+
+                done += chunk;
+                if (pos + (off_t) chunk > vnode->vn_len) {
+                        vnode->vn_len = pos + chunk;
+                        inode->s5_size = vnode->vn_len;
+                        s5_dirty_inode(VNODE_TO_S5FS(vnode), inode);
+                }
+        }
 
-        /* int pframe_dirty(pframe_t *pf) */
-/*
- * Indicates that a page is about to be modified. This should be called on a
- * page before any attempt to modify its contents. This marks the page dirty
- * (so that pageoutd knows to clean it before reclaiming the page frame)
- * and calls the dirtypage mmobj entry point.
- * The given page must not be busy.
- *
- * This routine can block at the mmobj operation level.
- *
- * @param pf the page to dirty
- * @return 0 on success, -errno on failure
- */
-
-        /* NOT_YET_IMPLEMENTED("S5FS: s5_write_file"); */
-        return -1;
+        return (done > 0) ? (int) done : ret;
 }
 
 /*
@@ -263,94 +258,41 @@ s5_write_file(vnode_t *vnode, off_t seek, const char *bytes, size_t len)
  * If the region to be read would extend past the end of the file, less
  * data will be read than was requested.
  *
- * You probably want to use pframe_get(), memcpy().
+ * As with s5_write_file(), dest may be a user buffer, in which case
+ * the data goes straight from the page cache to the user's pages.
+ *
+ * You probably want to use pframe_get(), copy_buf().
  */
 int
 s5_read_file(struct vnode *vnode, off_t seek, char *dest, size_t len)
 {
-        /* int pframe_get(struct mmobj *o, uint32_t pagenum, pframe_t **result) */
-/*
- * Find and return the pframe representing the page identified by the object
- * and page number. If the page is already resident in memory, then we return
- * the existing page. Otherwise, we allocate a new page and fill it (in which
- * case this routine may block).
- *
- * As long as this routine returns successfully, the returned page will be a
- * non-busy page that will be guaranteed to remain resident until the calling
- * context blocks without first pinning the page.
- *
- * This routine may block at the mmobj operation level.
- *
- * @param o the parent object of the page
- * @param pagenum the page number of this page in the object
- * @param result used to return the pframe (NULL if there's an error)
- * @return 0 on success, < 0 on failure.
- */
-
-/* Start of data in file is in addr of s5_directblocks */
-
-        /* If data block and offset are within correct range, then get addr of direct block from inode in vnode
-         * Create page frame. Read from memory using pframeget.
- memobj from vnode
-offset from inode (direct block)
-read into pframe you created
-
-If pageget was successful (it should be)
-handle case where you fall off block by reading too far
-then memcpy from pframe you got to destination
-pf_addr is start of data
-use data_offset macro to get offset
-address to read from is start of data plus offset
-return num bytes you read */
-
-        /* Here, seek is an offset in BYTES (not blocks), where you want to
-            start reading file from.
-         */
-
-        /* Convert vnode to inode for easy access */
         s5_inode_t *inode = VNODE_TO_S5INODE(vnode);
-        /* If seek > inode->s5_size, attempting to start reading past end of file data. Return -errno. */
-        if ((uint32_t) seek > inode->s5_size) {
-            dbg_print("ERROR! Attempting to start read past end of file.\n");
-            return -EFAULT; 
-        }
-        /* If seek + len are larger than one block, you'll need to bring in multiple pages */
+        size_t done = 0;
+        int ret = 0;
 
-        /* If you get here, start of read_file is within file data. */
+        if ((uint32_t) seek >= inode->s5_size)
+                return 0;
+        if (seek + len > inode->s5_size)
+                len = inode->s5_size - seek;
 
-        /* Get address of direct block from inode in vnode.
-           Create page frame.
-           Read into page frame you create using pframe_get().
-           memobj from vnode, offset from inode */
-        pframe_t *pf;
-        /*int res = pframe_get(&vnode->vn_mmobj, inode->s5_direct_blocks[S5_DATA_BLOCK(seek)], &pf);*/
-        int res = pframe_get(&vnode->vn_mmobj, S5_DATA_BLOCK(seek), &pf);
-        if (res != 0) {
-            dbg_print("ERROR! pframe_get() did not return successfully.\n");
-            return res;
-        }
+        while (done < len) {
+                off_t pos = seek + done;
+                size_t chunk = MIN(len - done, (size_t)(S5_BLOCK_SIZE - S5_DATA_OFFSET(pos)));
+                pframe_t *pf;
 
-        /* If pframe_get is successful (which it should be)
-           handle case where you read too far off the end of the file
-           i.e. reset the length to read as the length until the end of the file */
-        if ((seek + len) > inode->s5_size) {
-            len = inode->s5_size - seek;
-        }
+                if ((ret = pframe_get(&vnode->vn_mmobj, S5_DATA_BLOCK(pos), &pf)) < 0)
+                        break;
 
-        /* Use memcopy from pframe you got to destination.
-           pf_addr is start of data for that page frame
-           use S5_DATA_OFFSET() macro to get offset
-           address to read from is start of data plus offset */
-        char *read_startaddr = (char *)pf->pf_addr + S5_DATA_OFFSET(seek);
-        /* INSTEAD OF pf->pf_addr, USE inode->s5_directblocks[S5_DATA_BLOCK(seek)] ??? */
-        /* char *block_addr = inode->s5_direct_blocks[S5_DATA_BLOCK(seek)] + S5_DATA_OFFSET(seek); */
-        memcpy((void *) dest, (void *)read_startaddr, len);
+                pframe_pin(pf);
+                ret = copy_buf(dest + done, (char *) pf->pf_addr + S5_DATA_OFFSET(pos), chunk);
+                pframe_unpin(pf);
+                if (ret < 0)
+                        break;
 
-        /* Return the number of bytes you actually read from the file */
-        return len;
+                done += chunk;
+        }
 
-        /* NOT_YET_IMPLEMENTED("S5FS: s5_read_file"); */
-        return -1;
+        return (done > 0) ? (int) done : ret;
 }
 
 /*
@@ -42,22 +42,35 @@ int
 do_read(int fd, void *buf, size_t nbytes)
 {
         /* VFS {{{ */
-        file_t *f = NULL;
-        int ret = 0;
+        file_t *f;
+        int ret;
 
         if ((0 > fd) || (f = fget(fd)) == NULL) {
-                ret = -EBADF;
-                goto done;
+                return -EBADF;
         }
+        ret = do_read_file(f, buf, nbytes);
+        fput(f);
+
+        return ret;
+        /* VFS }}} */
+        return -1;
+}
+
+/* As do_read(), but on a file the caller already holds a reference to,
+ * so that it can decide how to read from it without the file behind the
+ * descriptor changing in the meantime. */
+int
+do_read_file(file_t *f, void *buf, size_t nbytes)
+{
+        /* VFS {{{ */
+        int ret;
 
         if (NULL == f->f_vnode->vn_ops->read || !(f->f_mode & FMODE_READ)) {
-                ret = -EBADF;
-                goto done;
+                return -EBADF;
         }
 
         if (S_ISDIR(f->f_vnode->vn_mode)) {
-                ret = -EISDIR;
-                goto done;
+                return -EISDIR;
         }
 
         /* We don't want f->f_pos to wrap around, so we make sure
@@ -67,15 +80,12 @@ do_read(int fd, void *buf, size_t nbytes)
                 nbytes = ((long long)1 << (sizeof(f->f_pos) * 8 - 1)) - 1 - f->f_pos;
         }
 
-        if (0 < (ret = f->f_vnode->vn_ops->read(f->f_vnode, f->f_pos, buf, nbytes))) {
+        /* pipes have no position to keep, however much goes through them */
+        if (0 < (ret = f->f_vnode->vn_ops->read(f->f_vnode, f->f_pos, buf, nbytes))
+            && !S_ISFIFO(f->f_vnode->vn_mode)) {
                 f->f_pos += ret;
         }
 
-done:
-        if (likely(NULL != f)) {
-                fput(f);
-        }
-
         return ret;
         /* VFS }}} */
         return -1;
@@ -93,17 +103,29 @@ int
 do_write(int fd, const void *buf, size_t nbytes)
 {
         /* VFS {{{ */
-        file_t *f = NULL;
-        int ret = 0;
+        file_t *f;
+        int ret;
 
         if ((0 > fd) || (f = fget(fd)) == NULL) {
-                ret = -EBADF;
-                goto done;
+                return -EBADF;
         }
+        ret = do_write_file(f, buf, nbytes);
+        fput(f);
+
+        return ret;
+        /* VFS }}} */
+        return -1;
+}
+
+/* As do_write(), on a file the caller holds a reference to */
+int
+do_write_file(file_t *f, const void *buf, size_t nbytes)
+{
+        /* VFS {{{ */
+        int ret;
 
         if (NULL == f->f_vnode->vn_ops->write || !(f->f_mode & FMODE_WRITE)) {
-                ret = -EBADF;
-                goto done;
+                return -EBADF;
         }
 
         if (f->f_mode & FMODE_APPEND) {
@@ -117,7 +139,8 @@ do_write(int fd, const void *buf, size_t nbytes)
                 nbytes = ((long long)1 << (sizeof(f->f_pos) * 8 - 1)) - 1 - f->f_pos;
         }
 
-        if (0 < (ret = f->f_vnode->vn_ops->write(f->f_vnode, f->f_pos, buf, nbytes))) {
+        if (0 < (ret = f->f_vnode->vn_ops->write(f->f_vnode, f->f_pos, buf, nbytes))
+            && !S_ISFIFO(f->f_vnode->vn_mode)) {
                 f->f_pos += ret;
 
                 KASSERT((S_ISCHR(f->f_vnode->vn_mode) || (S_ISBLK(f->f_vnode->vn_mode))
@@ -127,11 +150,6 @@ do_write(int fd, const void *buf, size_t nbytes)
                         "vn_len if necessary");
         }
 
-done:
-        if (likely(NULL != f)) {
-                fput(f);
-        }
-
         return ret;
         /* VFS }}} */
         return -1;
@@ -720,6 +738,8 @@ do_getdent(int fd, struct dirent *dirp)
  *      o EINVAL
  *        whence is not one of SEEK_SET, SEEK_CUR, SEEK_END; or the resulting
  *        file offset would be negative.
+ *      o ESPIPE
+ *        fd refers to a pipe.
  */
 int
 do_lseek(int fd, int offset, int whence)
@@ -732,6 +752,11 @@ do_lseek(int fd, int offset, int whence)
                 return -EBADF;
         }
 
+        if (S_ISFIFO(f->f_vnode->vn_mode)) {
+                fput(f);
+                return -ESPIPE;
+        }
+
         switch (whence) {
                 case SEEK_SET:
                         newpos = offset;
@@ -134,6 +134,9 @@ find:
                                 dbg(DBG_VNREF, "vget: wow, found vnode busy (0x%p, 0x%p ino %ld refcount %d)\n",
                                     vn, vn->vn_fs, (long)vn->vn_vno, vn->vn_refcount);
 
+                                /* not sched_wait_event(): vput() frees the
+                                 * vnode after waking us, so look it up
+                                 * again instead */
                                 sched_sleep_on(&vn->vn_waitq);
                                 goto find;
                         }
@@ -168,7 +171,7 @@ find:
         /*     members that can be initialized here: */
         vn->vn_fs = fs;
         vn->vn_vno = vno;
-        kmutex_init(&vn->vn_mutex);
+        krwlock_init(&vn->vn_rwlock);
         mmobj_init(&vn->vn_mmobj, &vnode_mmobj_ops);
         sched_queue_init(&vn->vn_waitq);
 
@@ -195,6 +198,8 @@ find:
         vn->vn_fs->fs_op->read_vnode(vn);
 
         vn->vn_flags &= ~VN_BUSY;
+        /* wake up anyone who tried to vget it while it was being brought in */
+        sched_broadcast_on(&vn->vn_waitq);
 
         /*     for special files: */
         if (S_ISCHR(vn->vn_mode) || S_ISBLK(vn->vn_mode))
@@ -259,8 +264,7 @@ vput(struct vnode *vn)
                          * not touch non-anonymous objects). Both of them should
                          * definately free the page, if they have it busy.
                          */
-                        while (pframe_is_busy(vp))
-                                sched_sleep_on(&(vp->pf_waitq));
+                        sched_wait_event(&vp->pf_waitq, !pframe_is_busy(vp));
                         pframe_free(vp);
                 } list_iterate_end();
 
@@ -691,6 +695,10 @@ vreadpage(mmobj_t *o, pframe_t *pf)
         KASSERT(NULL != o);
 
         vnode_t *v = mmobj_to_vnode(o);
+        /* lets do_pagefault() tell a major fault from a minor one */
+        if (NULL != curthr) {
+                curthr->kt_npageins++;
+        }
         return v->vn_ops->fillpage(v, (int)PN_TO_ADDR(pf->pf_pagenum), pf->pf_addr);
 }
 
@@ -5,6 +5,19 @@
 struct proc;
 struct argstr;
 struct argvec;
+struct regs;
+
+typedef struct uaccess_stats {
+        uint32_t us_fast;       /* copies done with the direct copy */
+        uint32_t us_slow;       /* copies done through vmmap_read/write */
+        uint32_t us_faults;     /* page faults taken inside the direct copy */
+        uint32_t us_fixups;     /* faults which made a copy fail */
+} uaccess_stats_t;
+
+/* Non-zero (the default) if copy_from_user/copy_to_user copy directly
+ * to and from user memory instead of going through the vmmap */
+extern int uaccess_fastpath;
+extern uaccess_stats_t uaccess_stats;
 
 int copy_from_user(void *kaddr, const void *uaddr, size_t nbytes);
 int copy_to_user(void *uaddr, const void *kaddr, size_t nbytes);
@@ -14,3 +27,38 @@ char **user_vecdup(struct argvec *uvec);
 
 int range_perm(struct proc *p, const void *vaddr, size_t len, int perm);
 int addr_perm(struct proc *p, const void *vaddr, int perm);
+
+/**
+ * Checks that [uaddr, uaddr + nbytes) lies entirely in the user
+ * portion of the address space. This says nothing about whether the
+ * range is mapped.
+ *
+ * @return 1 if it does, 0 if it does not
+ */
+int user_range_ok(const void *uaddr, size_t nbytes);
+
+/**
+ * Copies between two buffers, either of which may be in the current
+ * process's user address space. This lets file system read and write
+ * routines move data straight between the page cache and a user
+ * buffer, see sys_read(). Anything passed here as a user address must
+ * already have been checked with user_range_ok().
+ *
+ * @return 0 on success, -EFAULT if a user address could not be accessed
+ */
+int copy_buf(void *dst, const void *src, size_t nbytes);
+
+/**
+ * Called by the page fault handler for faults raised in kernel mode.
+ * If the faulting instruction is one of the user access routines the
+ * fault is either resolved or the routine is made to fail with
+ * -EFAULT.
+ *
+ * @param regs the registers at the time of the fault
+ * @param vaddr the address which was accessed
+ * @param cause the page fault error code
+ * @return 1 if the fault was handled, 0 if it came from anywhere else
+ */
+int uaccess_fault(struct regs *regs, uintptr_t vaddr, uint32_t cause);
+
+size_t uaccess_info(const void *arg, char *buf, size_t osize);
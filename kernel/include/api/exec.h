@@ -8,4 +8,8 @@ int do_execve(const char *filename, char *const *argv, char *const *envp, struct
 
 void kernel_execve(const char *filename, char *const *argv, char *const *envp);
 
+/* Enters userland at eip with the stack pointer esp, for a process
+ * whose program was just loaded with binfmt_load. Does not return. */
+void userland_start(uint32_t eip, uint32_t esp);
+
 void userland_entry(const struct regs *regs);
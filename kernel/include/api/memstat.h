@@ -0,0 +1,25 @@
+#pragma once
+
+/* Kernel and user header (via symlink) */
+
+#ifdef __KERNEL__
+#include "types.h"
+#else
+#include "sys/types.h"
+#endif
+
+/* Memory used by one process. Pages are counted while they are mapped
+ * into the process's page tables, so a page shared by several
+ * processes counts towards each of them. The vdata page belongs to the
+ * kernel and is not counted. */
+struct memstat {
+        uint32_t ms_rss_anon;   /* resident anonymous pages mapped */
+        uint32_t ms_rss_file;   /* resident file (page cache) pages mapped */
+        uint32_t ms_ptpages;    /* page table pages */
+        uint32_t ms_minflt;     /* faults resolved without reading a page in */
+        uint32_t ms_majflt;     /* faults which had to read a page in */
+};
+
+/* Fills in buf for the process with the given pid, 0 meaning the
+ * calling process */
+int memstat(pid_t pid, struct memstat *buf);
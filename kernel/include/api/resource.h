@@ -0,0 +1,23 @@
+#pragma once
+
+/* Kernel and user header (via symlink) */
+
+#ifdef __KERNEL__
+#include "api/time.h"
+#else
+#include "time.h"
+#endif
+
+/* Whose CPU time getrusage() reports */
+#define RUSAGE_SELF      0      /* all threads of the calling process */
+#define RUSAGE_CHILDREN  (-1)   /* children which have been waited for,
+                                 * and their children in turn */
+#define RUSAGE_THREAD    1      /* the calling thread */
+
+struct rusage {
+        struct timeval ru_utime;        /* time spent in user mode */
+        struct timeval ru_stime;        /* time spent in the kernel */
+};
+
+/* Fills in usage with the CPU time used by who */
+int getrusage(int who, struct rusage *usage);
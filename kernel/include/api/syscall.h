@@ -30,7 +30,7 @@
 #define SYS_sync                15
 #define SYS_nuke                16 /* NYI */
 #define SYS_dup                 17
-#define SYS_pipe                18 /* NYI */
+#define SYS_pipe                18
 #define SYS_ioctl               19 /* NYI */
 #define SYS_rmdir               21
 #define SYS_mkdir               22
@@ -40,12 +40,12 @@
 #define SYS_munmap              26
 #define SYS_rename              27 /* NYI */
 #define SYS_uname               28
-#define SYS_thr_create          29 /* NYI */
-#define SYS_thr_cancel          30
+#define SYS_thr_create          29 /* needs MTP */
+#define SYS_thr_cancel          30 /* needs MTP */
 #define SYS_thr_exit            31
 #define SYS_thr_yield           32
-#define SYS_thr_join            33 /* NYI */
-#define SYS_gettid              34 /* NYI */
+#define SYS_thr_join            33 /* needs MTP */
+#define SYS_gettid              34
 #define SYS_getpid              35
 #define SYS_errno               39
 #define SYS_halt                40
@@ -56,6 +56,14 @@
 #define SYS_mount               45
 #define SYS_umount              46
 #define SYS_stat                47
+#define SYS_memstat             48
+#define SYS_nanosleep           49
+#define SYS_clock_gettime       50
+#define SYS_spawn               51
+#define SYS_thr_detach          52 /* needs MTP */
+#define SYS_futex_wait          53
+#define SYS_futex_wake          54
+#define SYS_getrusage           55
 
 /*
  * ... what does the scouter say about his syscall?
@@ -67,6 +75,9 @@
 
 struct regs;
 struct stat;
+struct memstat;
+struct timespec;
+struct rusage;
 
 typedef struct argstr {
         const char *as_str;
@@ -126,12 +137,43 @@ typedef struct link_args {
         argstr_t from;
 } link_args_t;
 
+typedef struct thr_create_args {
+        void   *(*tca_entry)(void *);
+        void    *tca_arg;
+        size_t   tca_stacksz;   /* 0 for the default */
+} thr_create_args_t;
+
+typedef struct thr_join_args {
+        int      tja_tid;
+        void   **tja_retval;
+} thr_join_args_t;
+
 typedef struct execve_args {
         argstr_t filename;
         argvec_t argv;
         argvec_t envp;
 } execve_args_t;
 
+/* File actions for spawn, applied in order in the child before the
+ * program is loaded */
+#define SPAWN_DUP2              1       /* dup2(sa_fd, sa_newfd) */
+#define SPAWN_CLOSE             2       /* close(sa_fd) */
+#define SPAWN_MAX_ACTIONS       32
+
+typedef struct spawn_action {
+        int sa_op;
+        int sa_fd;
+        int sa_newfd;
+} spawn_action_t;
+
+typedef struct spawn_args {
+        argstr_t              filename;
+        argvec_t              argv;
+        argvec_t              envp;
+        const spawn_action_t *actions;
+        int                   nactions;
+} spawn_args_t;
+
 typedef struct rename_args {
         argstr_t oldname;
         argstr_t newname;
@@ -167,4 +209,35 @@ typedef struct stat_args {
         struct stat *buf;
 } stat_args_t;
 
+typedef struct memstat_args {
+        pid_t           pid;
+        struct memstat *buf;
+} memstat_args_t;
+
+typedef struct nanosleep_args {
+        const struct timespec *req;
+        struct timespec       *rem;
+} nanosleep_args_t;
+
+typedef struct futex_wait_args {
+        int                   *fwa_uaddr;
+        int                    fwa_val;
+        const struct timespec *fwa_timeout;     /* NULL for forever */
+} futex_wait_args_t;
+
+typedef struct futex_wake_args {
+        int                   *fwk_uaddr;
+        int                    fwk_n;
+} futex_wake_args_t;
+
+typedef struct getrusage_args {
+        int            who;
+        struct rusage *usage;
+} getrusage_args_t;
+
+typedef struct clock_gettime_args {
+        int              clk_id;
+        struct timespec *tp;
+} clock_gettime_args_t;
+
 struct utsname;
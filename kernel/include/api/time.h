@@ -0,0 +1,32 @@
+#pragma once
+
+/* Kernel and user header (via symlink) */
+
+#ifdef __KERNEL__
+#include "types.h"
+#else
+#include "sys/types.h"
+#endif
+
+typedef int clockid_t;
+
+/* Clocks for clock_gettime(). There is no real time clock, so the
+ * only one is the monotonic clock, which counts from boot. */
+#define CLOCK_MONOTONIC 1
+
+struct timespec {
+        long tv_sec;            /* seconds */
+        long tv_nsec;           /* nanoseconds, 0 to 999999999 */
+};
+
+struct timeval {
+        long tv_sec;            /* seconds */
+        long tv_usec;           /* microseconds, 0 to 999999 */
+};
+
+/* Sleeps for at least the time given by req. If the sleep is
+ * interrupted and rem is not NULL, the time left is stored in rem. */
+int nanosleep(const struct timespec *req, struct timespec *rem);
+
+/* Stores the current time of the given clock in tp. */
+int clock_gettime(clockid_t clk_id, struct timespec *tp);
@@ -0,0 +1,59 @@
+#pragma once
+
+/* Kernel and user header (via symlink) */
+
+#ifdef __KERNEL__
+#include "types.h"
+#else
+#include "sys/types.h"
+#endif
+
+/*
+ * Every process has a read-only page at VDATA_ADDR, just above the
+ * user memory managed by vmmap (USER_MEM_HIGH in mm/mm.h), which the
+ * kernel fills with data that libc can then read without making a
+ * system call.
+ *
+ * vd_seq works as a seqlock. The kernel makes it odd before it
+ * changes anything in the page and even again afterwards, so a reader
+ * which sees the same even value before and after reading the other
+ * fields knows it got a consistent copy. A reader which does not
+ * should make the system call instead.
+ */
+#define VDATA_ADDR      0xbffff000
+
+struct vdata {
+        volatile uint32_t vd_seq;       /* odd while being updated */
+        uint32_t        vd_pid;         /* the process's pid */
+        uint64_t        vd_tsc_base;    /* TSC reading at which the clock was 0 */
+        uint32_t        vd_tsc_mult;    /* see tsc_to_ns(); 0 if the TSC is */
+        uint32_t        vd_tsc_shift;   /* not calibrated */
+        uint32_t        vd_sysenter;    /* 1 if system calls may use SYSENTER */
+        uint32_t        vd_sse2;        /* 1 if SSE2 instructions may be used */
+};
+
+/* Converts a number of TSC cycles to nanoseconds, computing
+ * (cycles * mult) >> shift without overflowing 64 bits. */
+static inline uint64_t
+tsc_to_ns(uint64_t cycles, uint32_t mult, uint32_t shift)
+{
+        uint32_t hi = (uint32_t)(cycles >> 32);
+        uint32_t lo = (uint32_t) cycles;
+
+        return (((uint64_t) hi * mult) << (32 - shift))
+               + (((uint64_t) lo * mult) >> shift);
+}
+
+#ifdef __KERNEL__
+struct proc;
+
+/* Allocates and maps the vdata page of a new process. Returns 0 on
+ * success or -ENOMEM. */
+int vdata_create(struct proc *p);
+
+/* Frees the vdata page of a process which has been waited on. */
+void vdata_destroy(struct proc *p);
+
+/* Rewrites the contents of the process's vdata page. */
+void vdata_update(struct proc *p);
+#endif
@@ -11,8 +11,12 @@
 /*
  * kernel configuration parameters
  */
-#define DEFAULT_STACK_SIZE      (56*1024) /* size of stacks */
+#define DEFAULT_STACK_SIZE      (56*1024) /* size of stacks, the kshell "kstack"
+                                           * command shows how much is used */
+#define DEFAULT_USER_STACK_SIZE (256*1024) /* user stack of a thread made by
+                                           * thr_create with no size given */
 #define TICK_MSECS              10        /* msecs between clock interrupts */
+#define TIMESLICE_MSECS         50        /* msecs a user thread may run before it is preempted */
 
 /*
  * Memory-management-related:
@@ -29,6 +33,7 @@
 /*         Pageout-related: */
 #define PAGEOUTD_FREE_TARGET_SHIFT     5 /* 3.125% */
 #define PAGEOUTD_FREE_MIN_SHIFT        4 /* 6.25% */
+#define PAGEOUTD_WRITEBACK_MSECS    5000 /* max msecs between writebacks of dirty pages */
 
 
 /*
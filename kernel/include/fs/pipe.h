@@ -0,0 +1,59 @@
+#pragma once
+
+#include "limits.h"
+#include "types.h"
+
+#include "mm/page.h"
+
+#include "proc/kmutex.h"
+#include "proc/sched.h"
+
+/*
+ * Pipes. Each end of a pipe is a vnode of its own, belonging to no
+ * file system that can be reached by path, so that the reference
+ * counting which vnodes already do tells the pipe when the last file
+ * open on either end has been closed: a reader then sees end of file
+ * once the pipe is empty, and a writer gets EPIPE.
+ *
+ * The data goes in a ring of PIPE_NPAGES single pages, so no high
+ * order allocation is needed, and reads and writes copy straight
+ * between it and the user's buffer (see direct_io_ok() in
+ * api/syscall.c). A write of at most PIPE_BUF bytes goes in all at
+ * once, never mixed with other writes; a longer one goes in as space
+ * frees up.
+ *
+ * Sleepers are only woken once there is enough for them to do a
+ * worthwhile amount of work: a reader once PIPE_WAKE_BYTES have been
+ * written or the writer is done, a writer once PIPE_WAKE_BYTES are
+ * free. Without that, a reader and writer going as fast as each other
+ * switch back and forth for every few bytes.
+ */
+#define PIPE_NPAGES             16      /* must be a power of 2 */
+#define PIPE_SIZE               (PIPE_NPAGES * PAGE_SIZE)
+
+/* At least PIPE_BUF, so that a writer waiting for room for PIPE_BUF
+ * bytes is woken, and at most PIPE_SIZE - PIPE_BUF, so that a reader
+ * is woken before such a writer goes to sleep */
+#define PIPE_WAKE_BYTES         (PIPE_SIZE / 4)
+
+typedef struct pipe {
+        char           *p_pages[PIPE_NPAGES];
+        uint32_t        p_rpos;         /* bytes ever read */
+        uint32_t        p_wpos;         /* bytes ever written */
+        int             p_readers;      /* 1 while the read end is open */
+        int             p_writers;      /* 1 while the write end is open */
+        ktqueue_t       p_rq;           /* readers waiting for data */
+        ktqueue_t       p_wq;           /* writers waiting for room */
+        kmutex_t        p_rlock;        /* held for the whole of a read */
+        kmutex_t        p_wlock;        /* held for the whole of a write */
+} pipe_t;
+
+/**
+ * Creates a pipe and opens both ends of it.
+ *
+ * @param fds where to put the file descriptors of the read end and
+ * the write end, in that order
+ * @return 0 on success, -EMFILE if the process has no free file
+ * descriptors and -ENOMEM if there is not enough memory
+ */
+int do_pipe(int fds[2]);
@@ -11,7 +11,7 @@
 #else
 #include "config.h"
 
-#include "proc/kmutex.h"
+#include "proc/krwlock.h"
 #include "fs/vfs.h"
 #include "mm/page.h"
 #include "drivers/blockdev.h"
@@ -108,7 +108,7 @@ typedef struct s5_dirent {
 typedef struct s5fs {
         blockdev_t              *s5f_bdev;
         s5_super_t              *s5f_super;
-        kmutex_t                s5f_mutex;
+        krwlock_t               s5f_rwlock;
         fs_t                    *s5f_fs;
 } s5fs_t;
 
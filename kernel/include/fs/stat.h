@@ -32,6 +32,7 @@ struct stat {
 #define S_IFBLK         0x0400 /* block special */
 #define S_IFREG         0x0800 /* regular */
 #define S_IFLNK         0x1000 /* symlink */
+#define S_IFIFO         0x2000 /* pipe */
 
 #define _S_TYPE(m)      ((m) & 0xFF00)
 #define S_ISCHR(m)      (_S_TYPE(m) == S_IFCHR)
@@ -39,3 +40,4 @@ struct stat {
 #define S_ISBLK(m)      (_S_TYPE(m) == S_IFBLK)
 #define S_ISREG(m)      (_S_TYPE(m) == S_IFREG)
 #define S_ISLNK(m)      (_S_TYPE(m) == S_IFLNK)
+#define S_ISFIFO(m)     (_S_TYPE(m) == S_IFIFO)
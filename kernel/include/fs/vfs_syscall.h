@@ -7,9 +7,13 @@
 #include "fs/open.h"
 #include "fs/stat.h"
 
+struct file;
+
 int do_close(int fd);
 int do_read(int fd, void *buf, size_t nbytes);
 int do_write(int fd, const void *buf, size_t nbytes);
+int do_read_file(struct file *f, void *buf, size_t nbytes);
+int do_write_file(struct file *f, const void *buf, size_t nbytes);
 int do_dup(int fd);
 int do_dup2(int ofd, int nfd);
 int do_mknod(const char *path, int mode, unsigned devid);
@@ -12,7 +12,7 @@
 #include "drivers/blockdev.h"
 #include "drivers/bytedev.h"
 #include "util/list.h"
-#include "proc/kmutex.h"
+#include "proc/krwlock.h"
 #include "mm/mmobj.h"
 #include "mm/pframe.h"
 
@@ -215,10 +215,10 @@ typedef struct vnode {
         off_t              vn_len;
 
         /*
-         * A mutex used to synchronize reads and writes. This is only used by
-         * the underlying filesystem implementation.
+         * A reader-writer lock used to synchronize reads and writes. This is
+         * only used by the underlying filesystem implementation.
          */
-        kmutex_t           vn_mutex;
+        krwlock_t          vn_rwlock;
 
         /*
          * A generic pointer which the file system can use to store any extra
@@ -3,5 +3,13 @@
 #include "proc/kthread.h"
 #include "proc/proc.h"
 
+#ifdef __SMP__
+#include "main/smp.h"
+
+/* every CPU has its own current thread and process */
+#define curthr  (curcpu->cpu_thr)
+#define curproc (curcpu->cpu_proc)
+#else
 extern kthread_t *curthr;
 extern proc_t *curproc;
+#endif
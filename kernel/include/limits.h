@@ -16,3 +16,5 @@
 #define LONG_MIN  (-LONG_MAX - 1)
 
 #define UPTR_MAX  UINT_MAX
+
+#define PIPE_BUF  4096 /* writes to a pipe of up to this many bytes are atomic */
@@ -42,3 +42,27 @@ uint8_t apic_getipl();
  * originating from the APIC has been finished. This function
  * should only be called from the interrupt subsystem. */
 void apic_eoi();
+
+#ifdef __SMP__
+/* Stores the local APIC ids of up to max usable processors in apicids,
+ * the BSP's first, and returns how many there are. */
+int apic_getcpus(uint8_t *apicids, int max);
+
+/* Returns the id of the local APIC of the processor calling it. */
+uint8_t apic_getid(void);
+
+/* Enables the local APIC of an AP. */
+void apic_init_ap(void);
+
+/* Sends interrupt 'intr' to the processor whose local APIC has the
+ * given id. */
+void apic_send_ipi(uint8_t apicid, uint8_t intr);
+
+/* Sends an INIT IPI, which resets the processor and leaves it waiting
+ * for a startup IPI. */
+void apic_send_init(uint8_t apicid);
+
+/* Sends a startup IPI, which starts the processor in real mode at
+ * paddr (which must be page aligned and below 1mb). */
+void apic_send_startup(uint8_t apicid, uint32_t paddr);
+#endif
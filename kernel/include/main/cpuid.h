@@ -87,5 +87,19 @@ enum cpuid_requests {
 
 static inline void cpuid(int request, uint32_t *a, uint32_t *d)
 {
-        __asm__ volatile("cpuid":"=a"(*a), "=d"(*d):"0"(request));
+        __asm__ volatile("cpuid":"=a"(*a), "=d"(*d):"0"(request):"ebx", "ecx");
+}
+
+/* Writes a model specific register */
+static inline void wrmsr(uint32_t msr, uint64_t val)
+{
+        __asm__ volatile("wrmsr" :: "c"(msr), "A"(val));
+}
+
+/* Reads the processor's time stamp counter */
+static inline uint64_t rdtsc(void)
+{
+        uint64_t ret;
+        __asm__ volatile("rdtsc" : "=A"(ret));
+        return ret;
 }
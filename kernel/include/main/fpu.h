@@ -0,0 +1,42 @@
+#pragma once
+
+#include "types.h"
+
+struct kthread;
+
+/*
+ * The x87/SSE state of user threads is switched lazily. Whichever
+ * thread last used the FPU owns the registers; switching to any other
+ * thread sets CR0.TS, so that its first FPU instruction traps (#NM),
+ * and only then are the owner's registers saved and the new thread's
+ * loaded. A thread which never touches the FPU never takes the trap
+ * and never has a save area allocated.
+ *
+ * With SMP each CPU has its own owner, and a thread's registers are
+ * saved as soon as it is switched away from, since it may be picked
+ * up by another CPU; only the restore is still lazy.
+ */
+
+/* Enables the FPU (and SSE if the processor has FXSAVE and SSE2) and
+ * registers the #NM handler. */
+void fpu_init(void);
+
+#ifdef __SMP__
+/* Enables the FPU of an AP, once fpu_init() has run on the BSP. */
+void fpu_init_ap(void);
+#endif
+
+/* Returns 1 if userland may use SSE2 instructions. */
+int fpu_sse_enabled(void);
+
+/* Called by the scheduler just before switching to thr: lets thr use
+ * the FPU directly if its state is already loaded, and makes it trap
+ * otherwise. */
+void fpu_switch(struct kthread *thr);
+
+/* Throws away the FPU state of thr, which either has exited or (if it
+ * is curthr) is about to start a new program; its next FPU instruction
+ * will start from the initial state. */
+void fpu_release(struct kthread *thr);
+
+size_t fpu_info(const void *arg, char *buf, size_t osize);
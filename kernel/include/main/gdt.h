@@ -9,9 +9,14 @@
 #define GDT_KERNEL_DATA 0x10
 #define GDT_USER_TEXT   0x18
 #define GDT_USER_DATA   0x20
-#define GDT_TSS         0x28
+#define GDT_TSS         0x28    /* with SMP, the TSS of CPU n is at
+                                 * GDT_TSS + 8 * n */
 
 void gdt_init(void);
+#ifdef __SMP__
+/* Loads the GDT and the TSS of the given CPU, on that CPU */
+void gdt_init_ap(int cpu);
+#endif
 
 void gdt_set_kernel_stack(void *addr);
 
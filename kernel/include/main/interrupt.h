@@ -16,6 +16,10 @@
 #define INTR_DISK_PRIMARY 0xd0
 #define INTR_DISK_SECONDARY 0xd1
 
+/* Sent between CPUs (see main/smp.h) */
+#define INTR_IPI_RESCHED 0xf8
+#define INTR_IPI_TLB 0xf9
+
 /* NOTE: INTR_SYSCALL is not defined here, but is in syscall.h (it must be
  * in a userland-accessible header) */
 
@@ -31,6 +35,11 @@ typedef struct regs {
 
 void intr_init();
 
+#ifdef __SMP__
+/* Loads the interrupt table on an AP. */
+void intr_init_ap(void);
+#endif
+
 /* The function pointer which should be implemented by functions
  * which will handle interrupts. These handlers should be registered
  * with the interrupt subsystem via the intr_register function.
@@ -46,6 +55,14 @@ typedef void (*intr_handler_t)(regs_t *regs);
 intr_handler_t intr_register(uint8_t intr, intr_handler_t handler);
 int32_t intr_map(uint16_t irq, uint8_t intr);
 
+/* Sets up the SYSENTER entry point for system calls, if the processor
+ * has one. kstackp must point at the word holding the top of the
+ * current thread's kernel stack. */
+void intr_sysenter_init(uint32_t *kstackp);
+
+/* Returns 1 if userland may make system calls with SYSENTER. */
+int intr_sysenter_enabled(void);
+
 static inline void intr_enable()
 {
         __asm__ volatile("sti");
@@ -3,6 +3,12 @@
 #include "types.h"
 
 /* Starts the Programmable Interval Timer (PIT)
- * delivering periodic interrupts at 1000 Hz
- * (i.e., one every millisecond) to the given interrupt. */
+ * delivering periodic interrupts every TICK_MSECS
+ * milliseconds (see config.h) to the given interrupt. */
 void pit_starttimer(uint8_t intr);
+
+/* Measures the TSC frequency by timing a countdown on
+ * PIT channel 2. Interrupts should be blocked while it
+ * runs. Returns the number of TSC cycles per second, or 0
+ * if the PIT could not be used. */
+uint64_t pit_calibrate_tsc(void);
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "kernel.h"
+#include "types.h"
+
+#include "main/gdt.h"
+
+/*
+ * Symmetric multiprocessing. The BSP (the processor the machine boots
+ * on) starts every other processor listed in the ACPI MADT (the APs)
+ * with an INIT IPI followed by startup IPIs, and from then on each
+ * runs threads from its own run queue, taking threads from the others'
+ * when it runs out (see sched_pick()).
+ *
+ * The locking is coarse: the kernel lock is held by whichever CPU is
+ * running kernel code, so the kernel itself still runs on one CPU at
+ * a time, as it was written to, while user code runs on all of them.
+ * A CPU takes the lock on entry to the kernel and lets go of it on the
+ * way back to user mode or when it goes idle. The run queues and the
+ * page and slab allocators also have spin locks of their own, so that
+ * they can be used without the kernel lock once more of the kernel
+ * can.
+ */
+
+#define SMP_MAX_CPUS    8
+
+/* Where the APs' startup code is copied to: the startup IPI gives the
+ * page number, so it must be page aligned and below 1mb */
+#define SMP_TRAMPOLINE  0x8000
+
+struct kthread;
+struct proc;
+struct pagedir;
+
+typedef struct cpu {
+        struct kthread *cpu_thr;        /* the thread running here */
+        struct proc    *cpu_proc;       /* and its process */
+        struct pagedir *cpu_pagedir;    /* the page directory in cr3 */
+        struct kthread *cpu_idlethr;    /* runs when nothing else can */
+        struct kthread *cpu_fpu_owner;  /* whose state is in the FPU */
+
+        int             cpu_id;         /* index into cpus[] */
+        uint8_t         cpu_apicid;     /* local APIC id */
+        volatile int    cpu_online;     /* set once the CPU is running */
+        volatile int    cpu_idle;       /* halted waiting for work */
+
+        uint64_t        cpu_idle_cycles; /* cycles spent halted */
+        uint32_t        cpu_nswitches;  /* context switches */
+        uint32_t        cpu_nsteals;    /* threads taken from other CPUs */
+        uint32_t        cpu_nipis;      /* IPIs received */
+        uint32_t        cpu_nflushes;   /* TLB shootdowns done */
+} cpu_t;
+
+extern cpu_t cpus[SMP_MAX_CPUS];
+extern int smp_ncpus;                   /* CPUs running, 0 to smp_ncpus - 1 */
+
+/*
+ * Returns the index of the CPU this is running on. Each CPU has its
+ * own TSS, the nth at GDT_TSS + 8 * n, so the task register says which
+ * one this is. It reads as 0 until gdt_init() has run on the BSP.
+ *
+ * This is volatile so that the compiler does not reuse an earlier
+ * answer after a context switch, which may have moved the thread.
+ */
+static inline int smp_cpuid(void)
+{
+        uint16_t tr;
+
+        __asm__ volatile("str %0" : "=r"(tr));
+        return (tr < GDT_TSS) ? 0 : (tr - GDT_TSS) >> 3;
+}
+
+#define curcpu (&cpus[smp_cpuid()])
+
+/* Takes the kernel lock, spinning until the CPU holding it lets go,
+ * and doing any TLB shootdown that CPU asks for in the meantime. */
+void smp_lock_kernel(void);
+
+/* Lets go of the kernel lock. */
+void smp_unlock_kernel(void);
+
+/* Returns 1 if this CPU holds the kernel lock. */
+int smp_kernel_locked(void);
+
+/* Interrupts a CPU so that it looks at its run queue again: wakes it
+ * if it is idle, and gets it into the kernel (where it will act on
+ * kt_need_resched) if it is running user code. */
+void smp_resched(int cpu);
+
+/* Invalidates the TLB entries for [vlow, vhigh) on every CPU using the
+ * page directory pd, including this one, and waits for the others to
+ * be done. Called with the kernel lock held, after changing pd. */
+void smp_tlb_shootdown(struct pagedir *pd, uintptr_t vlow, uintptr_t vhigh);
+
+size_t smp_info(const void *arg, char *buf, size_t osize);
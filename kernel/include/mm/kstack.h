@@ -0,0 +1,51 @@
+#pragma once
+
+#include "types.h"
+
+/* Kernel stacks live in their own region of kernel virtual memory
+ * rather than in the linear map of physical memory. Every stack gets a
+ * fixed size slot whose lowest page is never mapped, so a thread that
+ * overruns its stack faults instead of silently corrupting whatever
+ * happened to be allocated below it, and the stack itself is built
+ * out of single pages so no high order allocation is needed. The
+ * region ends where the page table for temporary mappings begins.
+ *
+ * Such a fault cannot be reported. The processor pushes the page
+ * fault's frame onto the same overrun stack, which faults again; with
+ * no double fault task to move to a good stack, that becomes a triple
+ * fault and the machine resets. So an overflow stops the kernel dead
+ * rather than corrupting it, but leaves no panic message behind. */
+#define KSTACK_MEM_LOW        0xf8000000 /* inclusive */
+#define KSTACK_MEM_HIGH       0xffc00000 /* exclusive */
+
+#define KSTACK_SLOT_SIZE      (64 * 1024)
+#define KSTACK_SLOT_PAGES     (KSTACK_SLOT_SIZE / PAGE_SIZE)
+#define KSTACK_NSLOTS         ((KSTACK_MEM_HIGH - KSTACK_MEM_LOW) / KSTACK_SLOT_SIZE)
+
+/* Freed stacks are kept mapped for reuse, up to this many of each size */
+#define KSTACK_CACHE_MAX      16
+
+/* Unused stack memory is filled with this byte so that the deepest
+ * point a stack has ever reached (its high water mark) can be found
+ * by scanning up from the bottom */
+#define KSTACK_POISON         0xa5
+
+/* Sets up the page tables for the kernel stack region. Must be called
+ * before pt_template_init() so that every page directory shares them. */
+void kstack_init(void);
+
+/* Returns a page aligned stack of size bytes (a multiple of the page
+ * size, with room for a guard page in a slot), or NULL if there is not
+ * enough memory or no free slot. The stack is filled with KSTACK_POISON
+ * up to its old high water mark. */
+void *kstack_alloc(size_t size);
+
+/* Frees a stack returned by kstack_alloc(size). The stack must not be
+ * in use. */
+void kstack_free(void *stack, size_t size);
+
+/* Returns the number of bytes at the top of the given stack which have
+ * been written since it was allocated (its high water mark). */
+size_t kstack_used(const void *stack, size_t size);
+
+size_t kstack_info(const void *arg, char *buf, size_t osize);
@@ -5,7 +5,12 @@
 #define MM_POISON_FREE        0xDD
 
 #define USER_MEM_LOW          0x00400000 /* inclusive */
-#define USER_MEM_HIGH         0xc0000000 /* exclusive */
+#define USER_MEM_HIGH         0xbffff000 /* exclusive */
+
+/* The page from USER_MEM_HIGH to the kernel is the process's vdata
+ * page (see api/vdata.h). It is mapped when the process is created
+ * and is not part of the memory managed by vmmap. */
+#define USER_VDATA_ADDR       USER_MEM_HIGH
 
 #define PTR_SIZE (sizeof(void *))
 #define PTR_MASK (PTR_SIZE - 1)
@@ -17,11 +17,23 @@
 #define PT_SIZE           0x080
 #define PT_GLOBAL         0x100
 
+/* Software bit, ignored by the MMU: set in the ptflags of a user
+ * mapping of a file (page cache) page so that it is counted in the
+ * owning process's ms_rss_file rather than ms_rss_anon */
+#define PT_FILE           0x200
+
+/* Software bit: set for a user mapping of a page which is the kernel's
+ * rather than the process's, such as the vdata page, so that it is not
+ * counted in the process's resident pages at all */
+#define PT_NORSS          0x400
+
 typedef uint32_t pte_t;
 typedef uint32_t pde_t;
 
 typedef struct pagedir pagedir_t;
 
+struct memstat;
+
 /* Temporarily maps one page at the given physical address in at a
  * virtual address and returns that virtual address. Note that repeated
  * calls to this function will return the same virtual address, thereby
@@ -45,27 +57,56 @@ uintptr_t pt_virt_to_phys(uintptr_t vaddr);
 /* Maps the given physical page in at the given virtual page in the
  * given page directory. Creates a new page table if necessary and
  * places an entry in it in the page directory. vaddr must be in the
- * user address space. Both vaddr and paddr must be page aligned.
- * Note that the TLB is not flushed by this function. */
+ * user address space, or be the vdata page (USER_VDATA_ADDR). Both
+ * vaddr and paddr must be page aligned.
+ * Note that the TLB is not flushed by this function. This and the
+ * unmap functions below keep the memory counters (p_mem) of the
+ * process owning pd up to date. */
 int pt_map(pagedir_t *pd, uintptr_t vaddr, uintptr_t paddr, uint32_t pdflags, uint32_t ptflags);
 
 /* Unmaps the page for the given virtual page from the given page
  * directory. vaddr must be in the user address space. vaddr must
- * be page aligned. Note that the TLB is not flushed by this function. */
+ * be page aligned. Note that the TLB is not flushed by this function,
+ * except with SMP, where every other CPU using pd has to be told to
+ * flush it (see smp_tlb_shootdown()) and this one is too. */
 void pt_unmap(pagedir_t *pd, uintptr_t vaddr);
 
 /* Unmaps the given range of addresses [low, high). As with pt_unmap,
  * the addresses must be page aligned in the user address space */
 void pt_unmap_range(pagedir_t *pd, uintptr_t vlow, uintptr_t vhigh);
 
+/* Allocates empty page tables covering the kernel virtual addresses
+ * [vlow, vhigh), which must be 4mb aligned and must not overlap the
+ * linear map of physical memory. The page tables are shared by every
+ * page directory, so this must be called before pt_template_init(). */
+void pt_kern_region_init(uintptr_t vlow, uintptr_t vhigh);
+
+/* Maps (or unmaps) one page of a region set up by pt_kern_region_init.
+ * Since kernel page tables are shared the change is visible in every
+ * address space; the TLB entry for vaddr is flushed. */
+void pt_kern_map(uintptr_t vaddr, uintptr_t paddr);
+void pt_kern_unmap(uintptr_t vaddr);
+
+#ifdef __SMP__
+/* Maps (or unmaps) the physical page paddr, which must be in the
+ * first 4mb, at the same virtual address. The first 4mb share a page
+ * table in every page directory, so this is for code which runs just
+ * as paging is being turned on: the startup code of the other
+ * processors. */
+void pt_low_map(uintptr_t paddr);
+void pt_low_unmap(uintptr_t paddr);
+#endif
+
 /* Creates a new page directory which is initialized to contain
- * mappings for all kernel memory. If there is not enough memory
+ * mappings for all kernel memory. Pages mapped into it and unmapped
+ * from it are counted in ms, the memory counters of the process it is
+ * for, which may be NULL. If there is not enough memory
  * to allocate the directory NULL is returned. Note that destroying
  * a page diretory does not affect the TLB, it is assumed that the
  * page directory being destroyed is not currently in use. Destroying
  * a page directory frees all page tables for user memory referenced
  * by that page directory. */
-pagedir_t *pt_create_pagedir();
+pagedir_t *pt_create_pagedir(struct memstat *ms);
 void pt_destroy_pagedir(pagedir_t *pdir);
 
 /* Sets the page table in cr3 and performs other updates required by
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "types.h"
+
+/*
+ * Futexes let user space block on a word of its own memory. A futex is
+ * named by where the word lives rather than by its address: a word in
+ * a MAP_SHARED mapping by its offset in the mapped object, so that
+ * every process mapping the object (including the children of a
+ * fork) sees the same futex; and a word in private memory by the
+ * address space and address, since only threads of the process can
+ * see it.
+ */
+
+#define FUTEX_HASH_SIZE 64
+
+struct timespec;
+
+/**
+ * Sleeps until woken by do_futex_wake() on the same futex, unless the
+ * word at uaddr no longer holds val. The check and going to sleep are
+ * atomic with respect to do_futex_wake(), so a wakeup which follows a
+ * change to the word can never be missed.
+ *
+ * @param uaddr the user address of the word, which must be aligned
+ * @param val the value the caller expects the word to hold
+ * @param timeout how long to wait for at most, or NULL for forever
+ * @return 0 if woken, -EAGAIN if the word did not hold val,
+ * -ETIMEDOUT if the timeout ran out, -EINTR if the thread was
+ * cancelled, -EINVAL if uaddr is misaligned or timeout is invalid,
+ * or -EFAULT if uaddr is not mapped
+ */
+int do_futex_wait(int *uaddr, int val, const struct timespec *timeout);
+
+/**
+ * Wakes up to n threads waiting on the futex at uaddr, oldest first.
+ *
+ * @param uaddr the user address of the word
+ * @param n the most threads to wake
+ * @return the number of threads woken, -EINVAL if uaddr is misaligned
+ * or -EFAULT if uaddr is not mapped
+ */
+int do_futex_wake(int *uaddr, int n);
@@ -1,18 +1,26 @@
 #pragma once
 
 #include "proc/sched.h"
+#include "proc/lockstat.h"
 
 typedef struct kmutex {
         ktqueue_t       km_waitq;       /* wait queue */
         struct kthread *km_holder;      /* current holder */
+#ifdef __LOCKSTAT__
+        lockstat_t     *km_stat;        /* entry in the lock table */
+        uint64_t        km_locked_at;   /* tsc when last taken */
+#endif
 } kmutex_t;
 
 /**
- * Initializes the fields of the specified kmutex_t.
+ * Initializes the fields of the specified kmutex_t. The mutex is
+ * counted in the lock table under the name it is initialized as (see
+ * proc/lockstat.h).
  *
  * @param mtx the mutex to initialize
  */
-void kmutex_init(kmutex_t *mtx);
+#define kmutex_init(mtx) kmutex_init_named(mtx, #mtx)
+void kmutex_init_named(kmutex_t *mtx, const char *name);
 
 /**
  * Locks the specified mutex.
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "proc/sched.h"
+#include "proc/lockstat.h"
+
+/*
+ * A sleeping reader-writer lock. Any number of readers may hold it at
+ * once, or a single writer. Writers are preferred: once a writer is
+ * waiting, new readers wait behind it.
+ */
+typedef struct krwlock {
+        ktqueue_t       krw_rdq;        /* readers waiting */
+        ktqueue_t       krw_wrq;        /* writers waiting */
+        int             krw_readers;    /* number of readers holding the lock */
+        int             krw_wwaiting;   /* number of writers waiting for the lock */
+        struct kthread *krw_writer;     /* writer holding the lock */
+#ifdef __LOCKSTAT__
+        lockstat_t     *krw_stat;       /* entry in the lock table */
+        uint64_t        krw_locked_at;  /* tsc when last taken for writing */
+#endif
+} krwlock_t;
+
+/**
+ * Initializes the fields of the specified krwlock_t. Like a kmutex_t,
+ * it is counted in the lock table under the name it is initialized as.
+ *
+ * @param rw the lock to initialize
+ */
+#define krwlock_init(rw) krwlock_init_named(rw, #rw)
+void krwlock_init_named(krwlock_t *rw, const char *name);
+
+/**
+ * Locks the specified lock for reading.
+ *
+ * Note: This function may block.
+ *
+ * Note: These locks are not re-entrant
+ *
+ * @param rw the lock to lock
+ */
+void krwlock_rdlock(krwlock_t *rw);
+
+/**
+ * Locks the specified lock for reading, but puts the current thread
+ * into a cancellable sleep if the function blocks.
+ *
+ * @param rw the lock to lock
+ * @return 0 if the current thread now holds the lock and -EINTR if
+ * the sleep was cancelled and this thread does not hold the lock
+ */
+int  krwlock_rdlock_cancellable(krwlock_t *rw);
+
+/**
+ * Locks the specified lock for writing.
+ *
+ * Note: This function may block.
+ *
+ * Note: These locks are not re-entrant
+ *
+ * @param rw the lock to lock
+ */
+void krwlock_wrlock(krwlock_t *rw);
+
+/**
+ * Locks the specified lock for writing, but puts the current thread
+ * into a cancellable sleep if the function blocks.
+ *
+ * @param rw the lock to lock
+ * @return 0 if the current thread now holds the lock and -EINTR if
+ * the sleep was cancelled and this thread does not hold the lock
+ */
+int  krwlock_wrlock_cancellable(krwlock_t *rw);
+
+/**
+ * Unlocks the specified lock, which the current thread holds either
+ * for reading or for writing.
+ *
+ * @param rw the lock to unlock
+ */
+void krwlock_unlock(krwlock_t *rw);
@@ -23,11 +23,34 @@ typedef struct kthread {
         int             kt_cancelled;   /* 1 if this thread has been cancelled */
         ktqueue_t      *kt_wchan;       /* The queue that this thread is blocked on */
         int             kt_state;       /* this thread's state */
+        int             kt_wexclusive;  /* 1 if an exclusive waiter on kt_wchan */
         list_link_t     kt_qlink;       /* link on ktqueue */
         list_link_t     kt_plink;       /* link on proc thread list */
+        void           *kt_fpu;         /* FPU save area, NULL until first used */
+
+        int             kt_sched_class; /* SCHED_DAEMON or SCHED_FAIR */
+        uint64_t        kt_vruntime;    /* cycles run, for SCHED_FAIR */
+        uint64_t        kt_sched_start; /* tsc when last switched to */
+        uint64_t        kt_runnable_at; /* tsc when last made runnable */
+        uint64_t        kt_utime;       /* cycles run in user mode */
+        uint64_t        kt_stime;       /* cycles run in the kernel */
+        uint64_t        kt_acct_start;  /* tsc when kt_utime or kt_stime
+                                         * was last brought up to date */
+        uint32_t        kt_npageins;    /* file pages read in by this thread */
+#ifdef __SMP__
+        int             kt_cpu;         /* CPU it last ran on, whose run
+                                         * queue it goes back on */
+#endif
+#ifdef __UPREEMPT__
+        uint32_t        kt_ticks;       /* clock ticks since last switched to */
+        int             kt_need_resched; /* set by the clock when its slice is up */
+#endif
 #ifdef __MTP__
         int             kt_detached;    /* if the thread has been detached */
         ktqueue_t       kt_joinq;       /* thread waiting to join with this thread */
+        int             kt_tid;         /* id of the thread within its process */
+        void           *kt_ustack;      /* user stack mapped by thr_create, */
+        size_t          kt_ustacksz;    /* unmapped when the thread exits */
 #endif
 } kthread_t;
 
@@ -105,4 +128,18 @@ int kthread_detach(kthread_t *kthr);
  * @return 0 on sucess and <0 on error
  */
 int kthread_join(kthread_t *kthr, void **retval);
+
+/**
+ * These implement the thr_create, thr_join and thr_detach system
+ * calls, and thr_cancel. do_thr_create maps a user stack of stacksz bytes (rounded up
+ * to whole pages, DEFAULT_USER_STACK_SIZE if 0) for a new thread in the
+ * current process, which starts running entry(arg) in userland.
+ * Threads are named by their kt_tid.
+ *
+ * @return the new thread's id or 0 on success, and <0 on error
+ */
+int do_thr_create(uint32_t entry, uint32_t arg, size_t stacksz);
+int do_thr_join(int tid, void **retval);
+int do_thr_detach(int tid);
+int do_thr_cancel(int tid);
 #endif
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "types.h"
+
+struct kthread;
+
+/*
+ * Lock contention statistics, kept when the kernel is built with
+ * LOCKSTAT=1 (see Config.mk).
+ *
+ * Statistics are kept per lock name rather than per lock, so that the
+ * locks of every vnode are counted together, and so that locks can be
+ * freed without unregistering them. A lock's name is the member or
+ * variable it is initialized as, e.g. kmutex_init(&adisk->ata_mutex)
+ * counts towards "ata_mutex". Times are in TSC cycles.
+ */
+#define LOCKSTAT_NLOCKS         32      /* size of the lock table */
+#define LOCKSTAT_NTOP           10      /* locks shown by lockstat_info() */
+#define LOCKSTAT_COMM_LEN       16
+
+typedef struct lockstat {
+        char            ls_name[LOCKSTAT_COMM_LEN];
+        uint32_t        ls_nacquired;   /* times the lock was taken */
+        uint32_t        ls_ncontended;  /* times a thread had to wait for it */
+        uint64_t        ls_wait_total;  /* cycles spent waiting for it */
+        uint64_t        ls_wait_max;
+        uint64_t        ls_hold_total;  /* cycles it was held exclusively */
+
+        /* the thread holding the lock when it was last contended, or
+         * pid -1 if it was held by readers */
+        pid_t           ls_holder_pid;
+        char            ls_holder_comm[LOCKSTAT_COMM_LEN];
+} lockstat_t;
+
+/**
+ * Returns the lock table entry for the given name, adding it if there
+ * is none. The name may be the expression a lock was initialized with
+ * (see above). Does not block.
+ *
+ * @param name the name of the lock
+ * @return its entry in the lock table
+ */
+lockstat_t *lockstat_lookup(const char *name);
+
+/**
+ * Records that the current thread has to wait for a lock.
+ *
+ * @param ls the lock's entry
+ * @param holder the thread holding the lock, or NULL if readers do
+ */
+void lockstat_contended(lockstat_t *ls, struct kthread *holder);
+
+/**
+ * Records that the current thread has taken a lock.
+ *
+ * @param ls the lock's entry
+ * @param waited the cycles it waited for it, or 0
+ */
+void lockstat_acquired(lockstat_t *ls, uint64_t waited);
+
+/**
+ * Records that a lock taken exclusively has been released.
+ *
+ * @param ls the lock's entry
+ * @param held the cycles it was held for
+ */
+void lockstat_released(lockstat_t *ls, uint64_t held);
+
+/**
+ * Zeroes the statistics of every lock.
+ */
+void lockstat_reset(void);
+
+/**
+ * Provides the statistics of the most contended locks.
+ *
+ * @param arg must be NULL
+ * @param buf buffer to write to
+ * @param osize size of the buffer
+ * @return the remaining size of the buffer
+ */
+size_t lockstat_info(const void *arg, char *buf, size_t osize);
@@ -8,12 +8,17 @@
 
 #include "vm/vmmap.h"
 
+#include "api/memstat.h"
+
 #include "config.h"
 
 #define PROC_MAX_COUNT  65536
 #define PROC_NAME_LEN   256
+#define PROC_HASH_SIZE  256     /* buckets in the pid -> proc hash */
 
 struct regs;
+struct spawn_action;
+struct rusage;
 
 typedef struct proc {
         pid_t           p_pid;                 /* our pid */
@@ -28,9 +33,12 @@ typedef struct proc {
         ktqueue_t       p_wait;          /* queue for wait(2) */
 
         pagedir_t      *p_pagedir;
+        struct vdata   *p_vdata;         /* kernel address of the page
+                                          * mapped at VDATA_ADDR */
 
         list_link_t     p_list_link;     /* link on the list of all processes */
         list_link_t     p_child_link;    /* link on proc list of children */
+        list_link_t     p_hash_link;     /* link on the pid hash chain */
 
         /* VFS-related: */
         struct file    *p_files[NFILES]; /* open files */
@@ -42,6 +50,16 @@ typedef struct proc {
         struct vmmap   *p_vmmap;         /* list of areas mapped into
                                           * process' user address
                                           * space */
+        struct memstat  p_mem;           /* memory usage, kept up to
+                                          * date by the page table
+                                          * code and the fault handler */
+        uint64_t        p_utime;         /* user and system cycles of */
+        uint64_t        p_stime;         /* the exited threads */
+        uint64_t        p_cutime;        /* user and system cycles of */
+        uint64_t        p_cstime;        /* the children waited for */
+#ifdef __MTP__
+        int             p_nexttid;       /* kt_tid of the next thread */
+#endif
 } proc_t;
 
 /* Process states. */
@@ -127,6 +145,29 @@ pid_t do_waitpid(pid_t pid, int options, int *status);
  */
 int do_fork(struct regs *regs);
 
+/**
+ * This function implements the spawn system call: it creates a child
+ * of the current process running the given program, without copying
+ * the current address space the way fork followed by execve does. The
+ * child shares the parent's open files and working directory, and the
+ * file actions are applied to it before the program is loaded.
+ *
+ * @return the pid of the child, or -errno if it could not be created
+ * or the program could not be loaded (in which case there is no child)
+ */
+int do_spawn(const char *filename, char *const *argv, char *const *envp,
+             const struct spawn_action *actions, int nactions);
+
+/**
+ * This function implements the getrusage(2) system call, for the user
+ * and system time only.
+ *
+ * @param who RUSAGE_SELF, RUSAGE_CHILDREN or RUSAGE_THREAD
+ * @param usage filled in with the CPU time used
+ * @return 0 on success, or -EINVAL if who is not valid
+ */
+int do_getrusage(int who, struct rusage *usage);
+
 /**
  * Provides detailed debug information about a given process.
  *
@@ -146,3 +187,13 @@ size_t proc_info(const void *arg, char *buf, size_t osize);
  * @return the remaining size of the buffer
  */
 size_t proc_list_info(const void *arg, char *buf, size_t osize);
+
+/**
+ * Provides the memory usage of all processes, one per line.
+ *
+ * @param arg must be NULL
+ * @param buf buffer to write to
+ * @param osize size of the buffer
+ * @return the remaining size of the buffer
+ */
+size_t proc_memstat_info(const void *arg, char *buf, size_t osize);
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "types.h"
+
+struct vmmap;
+struct pagedir;
+
+typedef struct reaper_stats {
+        uint32_t rs_queued;     /* teardowns handed to the reaper */
+        uint32_t rs_done;       /* teardowns the reaper has finished */
+        uint32_t rs_sync;       /* teardowns done in place instead */
+        uint32_t rs_backlog;    /* teardowns waiting right now */
+        uint32_t rs_max_backlog;
+        uint64_t rs_total_cycles; /* sum of queue-to-finish times */
+        uint64_t rs_max_cycles;
+} reaper_stats_t;
+
+/**
+ * Hands an exited process's vmmap and/or page directory to the reaper
+ * thread, which destroys them later. Either may be NULL. This never
+ * blocks; if the reaper is not running (early in boot, during
+ * shutdown, or when called by the reaper itself) or no memory is
+ * available, the teardown is done immediately instead.
+ *
+ * @param map the vmmap to destroy, must no longer refer to a process
+ * @param pagedir the page directory to destroy, must not be in use
+ */
+void reaper_defer(struct vmmap *map, struct pagedir *pagedir);
+
+/**
+ * Finishes any queued teardowns, stops the reaper thread and waits
+ * for it. Must be called from the idle process.
+ */
+void reaper_shutdown(void);
+
+size_t reaper_info(const void *arg, char *buf, size_t osize);
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "types.h"
+
 #include "util/list.h"
 
 struct kthread;
@@ -8,18 +10,124 @@ typedef struct ktqueue {
         int             tq_size;
 } ktqueue_t;
 
+/*
+ * Scheduling classes, highest priority first. A thread in a class is
+ * only run when no thread of a higher class is runnable.
+ *
+ * SCHED_DAEMON is for kernel daemons (pageoutd, the reaper, ...),
+ * which sleep almost all the time and should run as soon as they are
+ * woken. Its threads are run first come first served.
+ *
+ * SCHED_FAIR is for everything else. Each thread accumulates virtual
+ * runtime (kt_vruntime, in TSC cycles) while it runs, and the
+ * runnable thread which has had the least is run next.
+ */
+#define SCHED_DAEMON    0
+#define SCHED_FAIR      1
+#define SCHED_NCLASSES  2
+
+struct sched_runq;
+typedef struct sched_class {
+        const char      *sc_name;
+        /* adds a runnable thread to the class's part of a run queue */
+        void           (*sc_enqueue)(struct sched_runq *rq, struct kthread *thr);
+        /* removes and returns the thread to run next from a run queue,
+         * or NULL */
+        struct kthread *(*sc_dequeue)(struct sched_runq *rq);
+        /* charges the thread for running for the given number of cycles */
+        void           (*sc_charge)(struct kthread *thr, uint64_t cycles);
+
+        /* statistics; the wait time of a thread is the time from when
+         * it is made runnable to when it is switched to */
+        uint32_t         sc_nswitches;
+        uint64_t         sc_wait_total;
+        uint64_t         sc_wait_max;
+} sched_class_t;
+
 /**
  * Switches execution between kernel threads.
  */
 void sched_switch(void);
 
+#ifdef __SMP__
 /**
- * Marks the given thread as runnable, and adds it to the run queue.
+ * The body of each CPU's idle thread, which is switched to when there
+ * is nothing else to run there: it halts with the kernel lock released
+ * until there is a thread to run.
+ *
+ * @param cpu the CPU it is the idle thread of
+ * @param arg the page the CPU booted on, which is freed now that it is
+ * no longer in use, or NULL
+ */
+void *sched_idle(int cpu, void *arg);
+#endif
+
+/**
+ * Marks the given thread as runnable, and adds it to the run queue of
+ * its scheduling class.
  *
  * @param thr the thread to make runnable
  */
 void sched_make_runnable(struct kthread *kt);
 
+/**
+ * Puts the current thread back on its run queue and switches to the
+ * next thread. Called on the way back to user mode when the clock has
+ * set kt_need_resched, i.e. the thread has used up its time slice
+ * (see util/time.c).
+ */
+void sched_preempt(void);
+
+/*
+ * CPU time accounting. A thread's time is charged, in TSC cycles, to
+ * kt_utime while it runs in user mode and to kt_stime while it runs in
+ * the kernel; the switch from one to the other happens on entry to and
+ * exit from the kernel (interrupts, faults and system calls) and time
+ * with no thread to run is counted as idle.
+ */
+
+/**
+ * Charges the time since the last update to the current thread's user
+ * time. Called on entry to the kernel from user mode.
+ */
+void sched_acct_enter(void);
+
+/**
+ * Charges the time since the last update to the current thread's
+ * system time. Called just before returning to user mode.
+ */
+void sched_acct_leave(void);
+
+/**
+ * Gets the user and system time of a thread, in cycles, including the
+ * time the current thread has been running in the kernel so far.
+ *
+ * @param thr the thread
+ * @param utime set to the user time
+ * @param stime set to the system time
+ */
+void sched_cputime(struct kthread *thr, uint64_t *utime, uint64_t *stime);
+
+/**
+ * Sets the scheduling class of a thread, which must not be on a run
+ * queue. New threads are in SCHED_FAIR.
+ *
+ * @param thr the thread
+ * @param cls SCHED_DAEMON or SCHED_FAIR
+ */
+void sched_set_class(struct kthread *thr, int cls);
+
+/**
+ * Provides the statistics of each scheduling class, the idle time and
+ * the virtual runtime of every thread.
+ *
+ * @param arg must be NULL
+ * @param buf buffer to write to
+ * @param osize size of the buffer
+ * @return the remaining size of the buffer
+ */
+size_t sched_info(const void *arg, char *buf, size_t osize);
+
 /**
  * Initializes a queue.
  *
@@ -43,6 +151,16 @@ int sched_queue_empty(ktqueue_t *q);
  */
 void sched_sleep_on(ktqueue_t *q);
 
+/**
+ * Like sched_sleep_on(), but sleeps as an exclusive waiter: a
+ * sched_wakeup_n() only wakes as many exclusive waiters as it is
+ * asked to. Use this when only one of the waiters can make progress
+ * per wakeup, e.g. when each waiter consumes a free page.
+ *
+ * @param q the queue to sleep on
+ */
+void sched_sleep_on_exclusive(ktqueue_t *q);
+
 /**
  * Causes the current thread to enter into a cancellable sleep on the
  * given queue.
@@ -52,6 +170,27 @@ void sched_sleep_on(ktqueue_t *q);
  */
 int sched_cancellable_sleep_on(ktqueue_t *q);
 
+/**
+ * Like sched_sleep_on(), but gives up waiting after the given number
+ * of clock ticks (see msecs_to_jiffies() in util/time.h).
+ *
+ * @param q the queue to sleep on
+ * @param ticks the most clock ticks to sleep for
+ * @return -ETIMEDOUT if the time ran out and 0 otherwise
+ */
+int sched_sleep_on_timeout(ktqueue_t *q, uint32_t ticks);
+
+/**
+ * Like sched_cancellable_sleep_on(), but gives up waiting after the
+ * given number of clock ticks.
+ *
+ * @param q the queue to sleep on
+ * @param ticks the most clock ticks to sleep for
+ * @return -EINTR if the thread was cancelled, -ETIMEDOUT if the time
+ * ran out and 0 otherwise
+ */
+int sched_cancellable_sleep_on_timeout(ktqueue_t *q, uint32_t ticks);
+
 /**
  * Wakes a single thread from sleep if there are any waiting on the
  * queue.
@@ -61,6 +200,16 @@ int sched_cancellable_sleep_on(ktqueue_t *q);
  */
 struct kthread *sched_wakeup_on(ktqueue_t *q);
 
+/**
+ * Wakes every non-exclusive thread sleeping on the queue and at most
+ * n exclusive ones, oldest first.
+ *
+ * @param q the queue to wake up threads from
+ * @param n the most exclusive waiters to wake
+ * @return the number of threads woken
+ */
+int sched_wakeup_n(ktqueue_t *q, int n);
+
 /**
  * Wake up all threads running on the queue.
  *
@@ -74,3 +223,32 @@ void sched_broadcast_on(ktqueue_t *q);
  * @param the thread to cancel sleep from
  */
 void sched_cancel(struct kthread *kthr);
+
+/**
+ * Records that a thread woken from a queue found the condition it was
+ * waiting for still false. Used by sched_wait_event().
+ */
+void sched_spurious_wakeup(void);
+
+/*
+ * Sleeps on q until cond is true. cond is evaluated before sleeping
+ * and again each time the thread is woken, so it must not refer to
+ * anything which may be freed while the thread sleeps. Wakeups after
+ * which cond is still false are counted as spurious (see the sched
+ * kshell command).
+ */
+#define __sched_wait_event(q, cond, sleep)                      \
+        do {                                                    \
+                if (!(cond)) {                                  \
+                        sleep(q);                               \
+                        while (!(cond)) {                       \
+                                sched_spurious_wakeup();        \
+                                sleep(q);                       \
+                        }                                       \
+                }                                               \
+        } while (0)
+
+#define sched_wait_event(q, cond)                               \
+        __sched_wait_event(q, cond, sched_sleep_on)
+#define sched_wait_event_exclusive(q, cond)                     \
+        __sched_wait_event(q, cond, sched_sleep_on_exclusive)
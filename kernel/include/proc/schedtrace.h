@@ -0,0 +1,83 @@
+#pragma once
+
+#include "types.h"
+
+struct kthread;
+
+/*
+ * Scheduler event tracing, compiled in when the kernel is built with
+ * SCHEDTRACE=1 (see Config.mk) and off until turned on with the
+ * schedtrace kshell command.
+ *
+ * Events go into a fixed size ring, overwriting the oldest ones. The
+ * ring is written with interrupts masked, so events from the clock
+ * interrupt (timeouts, wakeups by timers) do not tear ones from thread
+ * context. Its layout is fixed so that it can be copied out of a
+ * running or crashed kernel and decoded on the host by
+ * python/weenix/schedtrace.py; keep the two in step.
+ */
+#define SCHEDTRACE_NEVENTS      4096    /* must be a power of 2 */
+#define SCHEDTRACE_MAGIC        0x43525453 /* "STRC" */
+
+#define ST_SWITCH       1       /* se_thr switched to from se_cur */
+#define ST_SLEEP        2       /* se_thr went to sleep on queue se_arg */
+#define ST_WAKEUP       3       /* se_cur woke se_thr from queue se_arg */
+#define ST_RUNNABLE     4       /* se_cur made se_thr runnable in class se_arg */
+#define ST_TIMEOUT      5       /* se_thr's sleep on queue se_arg timed out */
+
+typedef struct schedtrace_event {
+        uint64_t        se_tsc;         /* rdtsc() when it happened */
+        uint32_t        se_type;        /* ST_* */
+        uint32_t        se_thr;         /* the thread it happened to */
+        uint32_t        se_cur;         /* the thread running at the time */
+        uint32_t        se_arg;         /* depends on se_type */
+        int32_t         se_pid;         /* pid of se_thr's process */
+        int32_t         se_curpid;      /* pid of se_cur's process */
+} schedtrace_event_t;
+
+typedef struct schedtrace {
+        uint32_t        st_magic;
+        uint32_t        st_nevents;     /* SCHEDTRACE_NEVENTS */
+        uint32_t        st_head;        /* events ever recorded; the next
+                                         * goes in st_head % st_nevents */
+        uint32_t        st_tsc_mult;    /* for converting cycles to ns, */
+        uint32_t        st_tsc_shift;   /* see tsc_to_ns() */
+        uint32_t        st_enabled;
+        uint32_t        st_pad[2];
+        schedtrace_event_t st_events[SCHEDTRACE_NEVENTS];
+} schedtrace_t;
+
+#ifdef __SCHEDTRACE__
+/**
+ * Adds an event to the ring if tracing is on. Does not block, and may
+ * be called from interrupt context.
+ *
+ * @param type the ST_* type of the event
+ * @param thr the thread it happened to
+ * @param arg depends on type (see above)
+ */
+void schedtrace_record(uint32_t type, struct kthread *thr, uint32_t arg);
+
+/**
+ * Turns tracing on or off. Turning it on empties the ring.
+ *
+ * @param on 1 to turn tracing on, 0 to turn it off
+ */
+void schedtrace_enable(int on);
+
+/**
+ * Provides the most recent events as text, oldest first, with times
+ * relative to the first one shown.
+ *
+ * @param arg the most events to show, as an int cast to a pointer
+ * @param buf buffer to write to
+ * @param osize size of the buffer
+ * @return the remaining size of the buffer
+ */
+size_t schedtrace_info(const void *arg, char *buf, size_t osize);
+
+#define SCHEDTRACE(type, thr, arg) \
+        schedtrace_record((type), (thr), (uint32_t)(arg))
+#else
+#define SCHEDTRACE(type, thr, arg) do { } while (0)
+#endif
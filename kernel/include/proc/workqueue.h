@@ -0,0 +1,171 @@
+#pragma once
+
+#include "types.h"
+
+#include "util/list.h"
+#include "util/time.h"
+
+#include "proc/sched.h"
+
+/*
+ * Workqueues run functions asynchronously in kernel threads. A work
+ * item is submitted to a workqueue, and one of the queue's worker
+ * threads later calls its function. A queue starts with one worker,
+ * and when work is waiting and every worker is busy, a worker starts
+ * another, up to the queue's limit. Workers are never stopped until
+ * the queue is destroyed.
+ *
+ * The caller owns the work items. A work item's function may free
+ * the item, since the worker does not touch it after the call.
+ */
+#define WORKQUEUE_MAX_WORKERS   8
+#define WORKQUEUE_NAME_LEN      16
+
+struct work;
+struct proc;
+struct kthread;
+typedef void (*work_func_t)(struct work *work);
+
+typedef struct work {
+        work_func_t     w_func;         /* called by a worker */
+        int             w_pending;      /* 1 if on a workqueue */
+        uint64_t        w_queued;       /* tsc when submitted */
+        list_link_t     w_link;         /* link on wq_pending */
+} work_t;
+
+typedef struct delayed_work {
+        work_t                  dw_work;
+        ktimer_t                dw_timer;       /* submits dw_work when it expires */
+        struct workqueue       *dw_wq;          /* the queue to submit to */
+} delayed_work_t;
+
+typedef struct workqueue {
+        char            wq_name[WORKQUEUE_NAME_LEN];
+        list_t          wq_pending;     /* work waiting for a worker */
+        ktqueue_t       wq_idleq;       /* idle workers sleep here */
+        ktqueue_t       wq_flushq;      /* threads waiting in workqueue_flush() */
+        struct proc    *wq_parent;      /* the process which created the queue */
+        int             wq_stopping;    /* set by workqueue_destroy() */
+
+        int             wq_max_workers;
+        int             wq_nworkers;
+        int             wq_nidle;       /* workers asleep on wq_idleq */
+        int             wq_nbusy;       /* workers running an item */
+        int             wq_npending;    /* items on wq_pending */
+        struct kthread *wq_workers[WORKQUEUE_MAX_WORKERS];
+
+        /* statistics; the latency of an item is the time from when it
+         * is submitted to when its function is called */
+        uint32_t        wq_nsubmitted;
+        uint32_t        wq_ndone;
+        uint32_t        wq_max_backlog;
+        uint64_t        wq_latency_total;
+        uint64_t        wq_latency_max;
+
+        list_link_t     wq_link;        /* link on the list of all queues */
+} workqueue_t;
+
+/**
+ * Initializes a work item.
+ *
+ * @param work the work item
+ * @param func the function workers will call with it
+ */
+void work_init(work_t *work, work_func_t func);
+
+/**
+ * Initializes a delayed work item.
+ *
+ * @param dwork the delayed work item
+ * @param func the function workers will call with &dwork->dw_work
+ */
+void delayed_work_init(delayed_work_t *dwork, work_func_t func);
+
+/**
+ * Initializes a workqueue and starts its first worker. The workers are
+ * children of the current process, which should be the idle process.
+ *
+ * @param wq the workqueue
+ * @param name the name of the queue, which names its workers
+ * @param max_workers the most workers the queue may have, at most
+ * WORKQUEUE_MAX_WORKERS
+ * @return 0 on success, -ENOMEM if the first worker could not be
+ * created
+ */
+int workqueue_init(workqueue_t *wq, const char *name, int max_workers);
+
+/**
+ * Runs every item still on the queue, stops the workers and waits for
+ * them. Must be called by the process which created the queue.
+ *
+ * @param wq the workqueue
+ */
+void workqueue_destroy(workqueue_t *wq);
+
+/**
+ * Queues a work item. Does not block, and may be called from an
+ * interrupt context.
+ *
+ * @param wq the workqueue
+ * @param work the work item
+ * @return 1 if the item was queued, 0 if it already was pending
+ */
+int workqueue_submit(workqueue_t *wq, work_t *work);
+
+/**
+ * Queues a delayed work item once the given number of clock ticks
+ * has passed (see msecs_to_jiffies() in util/time.h).
+ *
+ * @param wq the workqueue
+ * @param dwork the delayed work item
+ * @param ticks the number of ticks to wait
+ * @return 1 if the item was scheduled, 0 if it already was
+ */
+int workqueue_submit_delayed(workqueue_t *wq, delayed_work_t *dwork,
+                             uint32_t ticks);
+
+/**
+ * Takes a work item off its queue, if it has not been started yet.
+ * Its function may still be running when this returns; use
+ * workqueue_flush() to wait for it.
+ *
+ * @param wq the workqueue
+ * @param work the work item
+ * @return 1 if the item was pending and has been cancelled, 0 otherwise
+ */
+int workqueue_cancel(workqueue_t *wq, work_t *work);
+
+/**
+ * Like workqueue_cancel(), but also stops the timer of a delayed work
+ * item.
+ *
+ * @param dwork the delayed work item
+ * @return 1 if the item was scheduled or pending and has been
+ * cancelled, 0 otherwise
+ */
+int workqueue_cancel_delayed(delayed_work_t *dwork);
+
+/**
+ * Waits until the queue is empty and none of its workers is running
+ * an item. If work keeps being submitted this may never return.
+ *
+ * @param wq the workqueue
+ */
+void workqueue_flush(workqueue_t *wq);
+
+/**
+ * Returns true if the current thread is one of the queue's workers.
+ *
+ * @param wq the workqueue
+ */
+int workqueue_in_worker(workqueue_t *wq);
+
+/**
+ * Provides the statistics of every workqueue.
+ *
+ * @param arg must be NULL
+ * @param buf buffer to write to
+ * @param osize size of the buffer
+ * @return the remaining size of the buffer
+ */
+size_t workqueue_info(const void *arg, char *buf, size_t osize);
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "types.h"
+
+#include "main/interrupt.h"
+
+/*
+ * A sampling profiler, compiled in when the kernel is built with
+ * PROFILE=1 (see Config.mk) and run with the profile kshell command.
+ *
+ * While it runs, the clock interrupt handler takes a sample every
+ * pr_period ticks: the EIP it interrupted and, when that was kernel
+ * code, the return addresses of up to PROFILE_DEPTH - 1 callers found
+ * by following the saved frame pointers up the thread's kernel stack.
+ * Samples of user code are all counted as one stack whose only address
+ * is PROFILE_USER. Equal stacks share an entry in a fixed size hash
+ * table, so memory use does not grow with the length of the run; a
+ * sample for which there is no room left is only counted in
+ * pr_ndropped. With SMP, only the processor the clock interrupts (the
+ * BSP) is sampled.
+ *
+ * The table's layout is fixed so that it can be copied out of the
+ * kernel and symbolized on the host by python/weenix/profile.py; keep
+ * the two in step.
+ */
+#define PROFILE_NSTACKS         2048    /* must be a power of 2 */
+#define PROFILE_DEPTH           8
+#define PROFILE_MAGIC           0x464f5250 /* "PROF" */
+
+#define PROFILE_USER            0       /* the pc of user mode samples */
+
+typedef struct profile_stack {
+        uint32_t        ps_count;       /* samples of it, 0 if unused */
+        uint32_t        ps_depth;       /* number of pcs in ps_pcs */
+        uint32_t        ps_pcs[PROFILE_DEPTH]; /* innermost first */
+} profile_stack_t;
+
+typedef struct profile {
+        uint32_t        pr_magic;
+        uint32_t        pr_nstacks;     /* PROFILE_NSTACKS */
+        uint32_t        pr_depth;       /* PROFILE_DEPTH */
+        uint32_t        pr_enabled;
+        uint32_t        pr_period;      /* clock ticks between samples */
+        uint32_t        pr_tick_msecs;  /* TICK_MSECS */
+        uint32_t        pr_nsamples;    /* samples taken since started */
+        uint32_t        pr_ndropped;    /* of those, ones not in pr_stacks */
+        profile_stack_t pr_stacks[PROFILE_NSTACKS];
+} profile_t;
+
+#ifdef __PROFILE__
+/**
+ * Takes a sample if the profiler is running and it is time to. Called
+ * by the clock interrupt handler.
+ *
+ * @param regs the registers of the code the clock interrupted
+ */
+void profile_tick(regs_t *regs);
+
+/**
+ * Starts the profiler, throwing away the samples from any earlier run.
+ *
+ * @param hz how many samples to take a second, at most one per clock
+ * tick (1000 / TICK_MSECS)
+ */
+void profile_start(int hz);
+
+/**
+ * Stops the profiler, keeping its samples until it is started again.
+ */
+void profile_stop(void);
+
+/**
+ * Writes every stack in the table to the debug console (the serial
+ * port, see ./weenix), one per line between "profile: begin" and
+ * "profile: end" lines, where python/weenix/profile.py can find them
+ * in a log of the console.
+ *
+ * @return the number of stacks written
+ */
+int profile_dump(void);
+
+/**
+ * Provides the stacks sampled most often as text, one per line: the
+ * number of samples and then the pcs, innermost first.
+ *
+ * @param arg the most stacks to show, as an int cast to a pointer
+ * @param buf buffer to write to
+ * @param osize size of the buffer
+ * @return the remaining size of the buffer
+ */
+size_t profile_info(const void *arg, char *buf, size_t osize);
+
+#define PROFILE_TICK(regs) profile_tick(regs)
+#else
+#define PROFILE_TICK(regs) do { } while (0)
+#endif
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "kernel.h"
+#include "types.h"
+
+/*
+ * Spin locks, for data touched by more than one processor. With a
+ * single processor, masking interrupts (or raising the IPL) is already
+ * enough to keep everything else out, so without SMP they compile to
+ * nothing.
+ *
+ * A lock which an interrupt handler may take must be taken with
+ * spin_lock_irqsave(), which also disables interrupts on this
+ * processor; otherwise the handler could spin forever on a lock held
+ * by the code it interrupted.
+ */
+typedef struct spinlock {
+        volatile uint32_t sl_locked;
+} spinlock_t;
+
+#define SPINLOCK_INITIALIZER { 0 }
+
+#define EFLAGS_IF 0x200
+
+static inline void spinlock_init(spinlock_t *lock)
+{
+        lock->sl_locked = 0;
+}
+
+#ifdef __SMP__
+/* Takes the lock if it is free, returning 1 if it was taken */
+static inline int spin_trylock(spinlock_t *lock)
+{
+        return 0 == __sync_lock_test_and_set(&lock->sl_locked, 1);
+}
+
+static inline void spin_lock(spinlock_t *lock)
+{
+        while (!spin_trylock(lock)) {
+                /* wait without hammering the bus with locked writes */
+                while (lock->sl_locked) {
+                        __asm__ volatile("pause");
+                }
+        }
+}
+
+static inline void spin_unlock(spinlock_t *lock)
+{
+        __sync_lock_release(&lock->sl_locked);
+}
+
+/* Disables interrupts and takes the lock, returning the old eflags
+ * for spin_unlock_irqrestore() */
+static inline uint32_t spin_lock_irqsave(spinlock_t *lock)
+{
+        uint32_t flags;
+
+        __asm__ volatile("pushfl\n\t"
+                         "popl %0\n\t"
+                         "cli" : "=r"(flags) :: "memory");
+        spin_lock(lock);
+        return flags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t *lock, uint32_t flags)
+{
+        spin_unlock(lock);
+        if (flags & EFLAGS_IF) {
+                __asm__ volatile("sti" ::: "memory");
+        }
+}
+#else
+static inline int spin_trylock(spinlock_t *lock)
+{
+        return 1;
+}
+
+static inline void spin_lock(spinlock_t *lock)
+{
+}
+
+static inline void spin_unlock(spinlock_t *lock)
+{
+}
+
+static inline uint32_t spin_lock_irqsave(spinlock_t *lock)
+{
+        return 0;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t *lock, uint32_t flags)
+{
+}
+#endif
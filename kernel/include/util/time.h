@@ -0,0 +1,113 @@
+#pragma once
+
+#include "config.h"
+#include "types.h"
+
+#include "util/list.h"
+
+/* Number of clock interrupts since the clock was started, one every
+ * TICK_MSECS milliseconds. */
+extern volatile uint32_t jiffies;
+
+/* Converts a number of milliseconds to clock ticks, rounding up */
+#define msecs_to_jiffies(ms) (((ms) + TICK_MSECS - 1) / TICK_MSECS)
+
+/**
+ * Returns the time since the clock was started in nanoseconds. It is
+ * read from the TSC, calibrated against the PIT at boot, so it has
+ * the resolution of the TSC rather than of the clock tick. It never
+ * goes backwards.
+ */
+uint64_t ktime_get_ns(void);
+
+/**
+ * Converts a number of TSC cycles (e.g. a difference between two
+ * rdtsc() readings) to nanoseconds.
+ */
+uint64_t cycles_to_ns(uint64_t cycles);
+
+/**
+ * Gets the parameters ktime_get_ns() uses, so that the time can be
+ * computed the same way elsewhere (see api/vdata.h). mult is 0 if the
+ * TSC could not be calibrated.
+ */
+void ktime_tsc_params(uint64_t *base, uint32_t *mult, uint32_t *shift);
+
+/**
+ * Provides the TSC frequency, the uptime and timer statistics.
+ *
+ * @param arg must be NULL
+ * @param buf buffer to write to
+ * @param osize size of the buffer
+ * @return the remaining size of the buffer
+ */
+size_t time_info(const void *arg, char *buf, size_t osize);
+
+/*
+ * Kernel timers. A timer calls its function once the clock reaches
+ * its expiry time. The function is called from the clock interrupt
+ * handler, so it must not block; typically it just wakes a thread up.
+ * Adding and cancelling a timer take constant time.
+ */
+typedef void (*ktimer_func_t)(void *arg);
+
+typedef struct ktimer {
+        uint32_t        tm_expires;     /* jiffies at which the timer runs */
+        ktimer_func_t   tm_func;        /* called when the timer runs */
+        void           *tm_arg;         /* argument to tm_func */
+        list_link_t     tm_link;        /* link on a timer wheel slot */
+} ktimer_t;
+
+/**
+ * Initializes a timer, which is not pending until added.
+ *
+ * @param timer the timer
+ * @param func the function to call when the timer expires
+ * @param arg the argument to pass to func
+ */
+void ktimer_init(ktimer_t *timer, ktimer_func_t func, void *arg);
+
+/**
+ * Sets a timer to go off at the given time. If the time has already
+ * passed the timer goes off at the next clock tick. The timer must
+ * not be pending.
+ *
+ * @param timer the timer
+ * @param expires the value of jiffies at which to call the function
+ */
+void ktimer_add(ktimer_t *timer, uint32_t expires);
+
+/**
+ * Stops a pending timer from going off.
+ *
+ * @param timer the timer
+ * @return 1 if the timer was pending, 0 if it had already gone off or
+ * was never added
+ */
+int ktimer_cancel(ktimer_t *timer);
+
+#define ktimer_pending(timer) list_link_is_linked(&(timer)->tm_link)
+
+struct timespec;
+
+/**
+ * Converts a relative time to a number of clock ticks to sleep for,
+ * rounding up and adding a tick since the current one is partly over,
+ * so a sleep of that many ticks lasts at least as long as asked.
+ *
+ * @param ts the time, which must be valid
+ * @return the number of ticks, at most 0x7fffffff
+ */
+uint32_t timespec_to_jiffies(const struct timespec *ts);
+
+/**
+ * Puts the current thread to sleep for at least the given amount of
+ * time. The sleep can be cancelled.
+ *
+ * @param req how long to sleep
+ * @param rem if not NULL and the sleep is cancelled, set to the time
+ * which was left
+ * @return 0 on success, -EINVAL if req is invalid, or -EINTR if the
+ * sleep was cancelled
+ */
+int do_nanosleep(const struct timespec *req, struct timespec *rem);
@@ -8,4 +8,10 @@
 #define FAULT_RESERVED 0x08
 #define FAULT_EXEC     0x10
 
-void handle_pagefault(uintptr_t vaddr, uint32_t cause);
+int handle_pagefault(uintptr_t vaddr, uint32_t cause);
+
+/* Resolves a fault with handle_pagefault() and, if it was resolved,
+ * counts it in the current process's p_mem: as a major fault if a file
+ * page had to be read in to resolve it, and as a minor fault otherwise.
+ * Takes and returns the same as handle_pagefault(). */
+int do_pagefault(uintptr_t vaddr, uint32_t cause);
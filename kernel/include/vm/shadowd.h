@@ -2,3 +2,4 @@
 
 void shadowd_wakeup(void);
 void shadowd_alloc_sleep(void);
+void shadowd_exit(void);
@@ -2,6 +2,8 @@
 
 #include "main/io.h"
 #include "main/acpi.h"
+#include "main/apic.h"
+#include "main/smp.h"
 
 #include "mm/page.h"
 #include "mm/pagetable.h"
@@ -30,6 +32,15 @@
 #define LAPICSPUR (*(volatile uint32_t*)(apic->at_addr + 0xf0))
 #define LAPICTPR (*(volatile uint32_t*)(apic->at_addr + 0x80))
 #define LAPICERR (*(volatile uint32_t*)(apic->at_addr + 0x280))
+#define LAPICICRLO (*(volatile uint32_t*)(apic->at_addr + 0x300))
+#define LAPICICRHI (*(volatile uint32_t*)(apic->at_addr + 0x310))
+
+/* Interrupt command register (low half) fields */
+#define ICR_FIXED    0x00000000
+#define ICR_INIT     0x00000500
+#define ICR_STARTUP  0x00000600
+#define ICR_PENDING  0x00001000
+#define ICR_ASSERT   0x00004000
 
 #define LAPICTIMER (*(volatile uint32_t*)(apic->at_addr + 0x320))
 #define LAPICINITCNT (*(volatile uint32_t*)(apic->at_addr + 0x380))
@@ -66,6 +77,12 @@ static struct apic_table *apic = NULL;
 static struct lapic_table *lapic = NULL;
 static struct ioapic_table *ioapic = NULL;
 
+#ifdef __SMP__
+/* The local APIC ids of the enabled processors, the BSP's first */
+static uint8_t apic_cpu_ids[SMP_MAX_CPUS];
+static int apic_ncpus = 0;
+#endif
+
 static uint32_t __ioapic_getid(void)
 {
         IOREGSEL(ioapic) = IOAPICID(ioapic);
@@ -170,13 +187,27 @@ void apic_init()
                 uint8_t size = *(ptr + off + 1);
                 if (TYPE_LAPIC == type) {
                         KASSERT(sizeof(struct lapic_table) == size);
-                        KASSERT(NULL == lapic && "Weenix only supports a single local APIC");
-                        lapic = (struct lapic_table *)(ptr + off);
+                        struct lapic_table *l = (struct lapic_table *)(ptr + off);
                         dbgq(DBG_CORE, "LAPIC:\n");
-                        dbgq(DBG_CORE, "   id:         0x%.2x\n", (uint32_t)lapic->at_apicid);
-                        dbgq(DBG_CORE, "   processor:  0x%.3x\n", (uint32_t)lapic->at_procid);
-                        dbgq(DBG_CORE, "   enabled:    %i\n", lapic->at_flags & 0x1);
-                        KASSERT(lapic->at_flags & 0x1 && "The local APIC is disabled");
+                        dbgq(DBG_CORE, "   id:         0x%.2x\n", (uint32_t)l->at_apicid);
+                        dbgq(DBG_CORE, "   processor:  0x%.3x\n", (uint32_t)l->at_procid);
+                        dbgq(DBG_CORE, "   enabled:    %i\n", l->at_flags & 0x1);
+#ifdef __SMP__
+                        /* one per processor; ours is the BSP's */
+                        if (l->at_apicid == __lapic_getid()) {
+                                lapic = l;
+                        } else if (!(l->at_flags & 0x1)) {
+                                dbgq(DBG_CORE, "   (not usable)\n");
+                        } else if (apic_ncpus < SMP_MAX_CPUS - 1) {
+                                apic_cpu_ids[++apic_ncpus] = l->at_apicid;
+                        } else {
+                                dbgq(DBG_CORE, "   (more than %d processors, ignored)\n",
+                                     SMP_MAX_CPUS);
+                        }
+#else
+                        KASSERT(NULL == lapic && "Weenix only supports a single local APIC");
+                        lapic = l;
+#endif
                 } else if (TYPE_IOAPIC == type) {
                         KASSERT(sizeof(struct ioapic_table) == size);
                         KASSERT(NULL == ioapic && "Weenix only supports a single IO APIC");
@@ -193,6 +224,11 @@ void apic_init()
                 off += size;
         }
         KASSERT(NULL != lapic && "Could not find a local APIC device");
+        KASSERT(lapic->at_flags & 0x1 && "The local APIC is disabled");
+#ifdef __SMP__
+        apic_cpu_ids[0] = lapic->at_apicid;
+        apic_ncpus++;
+#endif
         KASSERT(NULL != ioapic && "Could not find an IO APIC");
 
         LAPICSPUR = LAPICSPUR | 0x100;
@@ -268,3 +304,63 @@ void apic_eoi()
 {
         LAPICEOI = 0x0;
 }
+
+#ifdef __SMP__
+int apic_getcpus(uint8_t *apicids, int max)
+{
+        int i;
+
+        for (i = 0; i < apic_ncpus && i < max; ++i) {
+                apicids[i] = apic_cpu_ids[i];
+        }
+        return i;
+}
+
+uint8_t apic_getid(void)
+{
+        return __lapic_getid();
+}
+
+void apic_init_ap(void)
+{
+        LAPICSPUR = LAPICSPUR | 0x100;
+}
+
+/* Sends an IPI with interrupts disabled, so that an interrupt handler
+ * sending one of its own cannot come in between writing the two halves
+ * of the command register */
+static void __lapic_send_ipi(uint8_t apicid, uint32_t icr)
+{
+        uint32_t flags;
+        __asm__ volatile("pushfl\n\t"
+                         "popl %0\n\t"
+                         "cli" : "=r"(flags));
+
+        while (LAPICICRLO & ICR_PENDING)
+                ;
+        LAPICICRHI = ((uint32_t)apicid) << 24;
+        LAPICICRLO = icr;
+        while (LAPICICRLO & ICR_PENDING)
+                ;
+
+        if (flags & 0x200) {
+                __asm__ volatile("sti");
+        }
+}
+
+void apic_send_ipi(uint8_t apicid, uint8_t intr)
+{
+        __lapic_send_ipi(apicid, ICR_ASSERT | ICR_FIXED | intr);
+}
+
+void apic_send_init(uint8_t apicid)
+{
+        __lapic_send_ipi(apicid, ICR_ASSERT | ICR_INIT);
+}
+
+void apic_send_startup(uint8_t apicid, uint32_t paddr)
+{
+        KASSERT(PAGE_ALIGNED(paddr) && paddr < 0x100000);
+        __lapic_send_ipi(apicid, ICR_STARTUP | (paddr >> PAGE_SHIFT));
+}
+#endif
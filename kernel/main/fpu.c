@@ -0,0 +1,289 @@
+#include "globals.h"
+#include "errno.h"
+#include "types.h"
+
+#include "main/cpuid.h"
+#include "main/fpu.h"
+#include "main/gdt.h"
+#include "main/interrupt.h"
+#include "main/smp.h"
+
+#include "mm/slab.h"
+
+#include "proc/kthread.h"
+#include "proc/proc.h"
+
+#include "util/debug.h"
+#include "util/printf.h"
+#include "util/string.h"
+
+#define INTR_DEVICE_NOT_AVAILABLE 0x07
+#define INTR_FPU_ERROR            0x10  /* #MF, unmasked x87 exception */
+#define INTR_SIMD_ERROR           0x13  /* #XM, unmasked SSE exception */
+
+#define CR0_MP          0x00000002      /* WAIT/FWAIT traps when TS is set */
+#define CR0_EM          0x00000004      /* no FPU, FPU instructions trap */
+#define CR0_TS          0x00000008      /* task switched, FPU instructions trap */
+#define CR0_NE          0x00000020      /* report FPU errors as #MF */
+#define CR4_OSFXSR      0x00000200      /* FXSAVE/FXRSTOR and SSE */
+#define CR4_OSXMMEXCPT  0x00000400      /* report SSE errors as #XM */
+
+/* FXSAVE wants a 512 byte area aligned to 16 bytes, FNSAVE 108 bytes.
+ * Slab objects are only word aligned, so each is allocated a little
+ * larger and kt_fpu rounded up. */
+#define FPU_AREA_SIZE   512
+#define FPU_AREA_ALIGN  16
+#define fpu_area(thr) \
+        ((void *)(((uintptr_t)(thr)->kt_fpu + FPU_AREA_ALIGN - 1) & ~(FPU_AREA_ALIGN - 1)))
+
+#define MXCSR_DEFAULT   0x1f80          /* all SSE exceptions masked */
+
+static slab_allocator_t *fpu_allocator;
+static int fpu_fxsr;                    /* 1 to use FXSAVE/FXRSTOR */
+static int fpu_sse;                     /* 1 if SSE2 is enabled */
+
+/* The thread whose state is in the FPU registers, if any */
+#ifdef __SMP__
+#define fpu_owner (curcpu->cpu_fpu_owner)
+#else
+static kthread_t *fpu_owner;
+#endif
+
+/* The state a thread starts with, copied to its save area on first use
+ * so that no registers leak from whichever thread used the FPU last */
+static uint8_t fpu_initstate[FPU_AREA_SIZE] __attribute__((aligned(FPU_AREA_ALIGN)));
+
+static uint32_t fpu_ntraps;             /* #NM traps taken */
+static uint32_t fpu_nswitches;          /* times the FPU changed owners */
+
+static inline uint32_t
+fpu_read_cr0(void)
+{
+        uint32_t cr0;
+        __asm__ volatile("movl %%cr0, %0" : "=r"(cr0));
+        return cr0;
+}
+
+static inline void
+fpu_write_cr0(uint32_t cr0)
+{
+        __asm__ volatile("movl %0, %%cr0" :: "r"(cr0));
+}
+
+static inline void
+fpu_clts(void)
+{
+        __asm__ volatile("clts");
+}
+
+static inline void
+fpu_stts(void)
+{
+        fpu_write_cr0(fpu_read_cr0() | CR0_TS);
+}
+
+static void
+fpu_save(void *area)
+{
+        if (fpu_fxsr) {
+                __asm__ volatile("fxsave (%0)" :: "r"(area) : "memory");
+        } else {
+                /* FNSAVE also reinitializes the FPU, which is fine
+                 * since the registers are about to be reloaded */
+                __asm__ volatile("fnsave (%0)" :: "r"(area) : "memory");
+        }
+}
+
+static void
+fpu_restore(const void *area)
+{
+        if (fpu_fxsr) {
+                __asm__ volatile("fxrstor (%0)" :: "r"(area));
+        } else {
+                __asm__ volatile("frstor (%0)" :: "r"(area));
+        }
+}
+
+/*
+ * The first FPU instruction of a thread which does not own the FPU
+ * lands here. The interrupted instruction is retried once we return,
+ * this time with the thread's own state loaded.
+ */
+static void
+fpu_nm_handler(regs_t *regs)
+{
+        fpu_ntraps++;
+        fpu_clts();
+        if (fpu_owner == curthr) {
+                return;
+        }
+
+        if (NULL != fpu_owner) {
+                fpu_save(fpu_area(fpu_owner));
+        }
+        fpu_owner = NULL;
+
+        if (NULL == curthr->kt_fpu) {
+                if (NULL == (curthr->kt_fpu = slab_obj_alloc(fpu_allocator))) {
+                        fpu_stts();
+                        if (GDT_USER_TEXT != (regs->r_cs & ~0x3)) {
+                                panic("no memory for the FPU state of the kernel\n");
+                        }
+                        dbg(DBG_THR, "no memory for the FPU state of thread "
+                            "0x%p (proc %d), killing it\n", curthr, curproc->p_pid);
+                        do_exit(ENOMEM);
+                }
+                memcpy(fpu_area(curthr), fpu_initstate, FPU_AREA_SIZE);
+        }
+
+        fpu_restore(fpu_area(curthr));
+        fpu_owner = curthr;
+        fpu_nswitches++;
+}
+
+/*
+ * An x87 or SSE instruction raised an exception which the thread had
+ * unmasked; CR0.NE and CR4.OSXMMEXCPT send those here as #MF and #XM.
+ * Only user code uses the FPU, so the process is killed, with EINVAL
+ * standing in for the SIGFPE that weenix does not have.
+ */
+static void
+fpu_error_handler(regs_t *regs)
+{
+        if (GDT_USER_TEXT != (regs->r_cs & ~0x3)) {
+                panic("FPU exception %u in the kernel at eip=0x%08x\n",
+                      regs->r_intr, regs->r_eip);
+        }
+        dbg(DBG_THR, "FPU exception %u at eip=0x%08x in thread 0x%p "
+            "(proc %d), killing it\n", regs->r_intr, regs->r_eip,
+            curthr, curproc->p_pid);
+        proc_kill(curproc, EINVAL);
+}
+
+/* Sets up the FPU of the processor this runs on */
+static void
+fpu_init_cpu(void)
+{
+        uint32_t cr0, cr4;
+
+        cr0 = fpu_read_cr0();
+        cr0 &= ~(CR0_EM | CR0_TS);
+        cr0 |= CR0_MP | CR0_NE;
+        fpu_write_cr0(cr0);
+
+        if (fpu_fxsr) {
+                __asm__ volatile("movl %%cr4, %0" : "=r"(cr4));
+                cr4 |= CR4_OSFXSR;
+                if (fpu_sse) {
+                        cr4 |= CR4_OSXMMEXCPT;
+                }
+                __asm__ volatile("movl %0, %%cr4" :: "r"(cr4));
+        }
+
+        __asm__ volatile("fninit");
+        if (fpu_sse) {
+                uint32_t mxcsr = MXCSR_DEFAULT;
+                __asm__ volatile("ldmxcsr %0" :: "m"(mxcsr));
+        }
+}
+
+void
+fpu_init(void)
+{
+        uint32_t a, d;
+
+        cpuid(CPUID_GETFEATURES, &a, &d);
+        KASSERT((d & CPUID_FEAT_EDX_FPU) && "weenix needs an FPU");
+
+        if (d & CPUID_FEAT_EDX_FXSR) {
+                fpu_fxsr = 1;
+                fpu_sse = (d & CPUID_FEAT_EDX_SSE2) ? 1 : 0;
+        }
+        fpu_init_cpu();
+        /* the XMM registers are not touched by FNINIT, but are zero at
+         * reset, and the kernel never uses them */
+        fpu_save(fpu_initstate);
+
+        fpu_allocator = slab_allocator_create("fpu", FPU_AREA_SIZE + FPU_AREA_ALIGN - 1);
+        KASSERT(NULL != fpu_allocator);
+
+        intr_register(INTR_DEVICE_NOT_AVAILABLE, fpu_nm_handler);
+        intr_register(INTR_FPU_ERROR, fpu_error_handler);
+        if (fpu_sse) {
+                intr_register(INTR_SIMD_ERROR, fpu_error_handler);
+        }
+        fpu_stts();
+
+        dbg(DBG_INIT, "FPU state saved with %s, SSE2 %s\n",
+            fpu_fxsr ? "FXSAVE" : "FNSAVE", fpu_sse ? "enabled" : "disabled");
+}
+
+#ifdef __SMP__
+void
+fpu_init_ap(void)
+{
+        fpu_init_cpu();
+        fpu_stts();
+}
+#endif
+
+int
+fpu_sse_enabled(void)
+{
+        return fpu_sse;
+}
+
+void
+fpu_switch(kthread_t *thr)
+{
+#ifdef __SMP__
+        /* the thread switched away from may be run next on another
+         * CPU, so its registers are saved now rather than when someone
+         * else here next uses the FPU */
+        if (NULL != fpu_owner && thr != fpu_owner) {
+                fpu_clts();
+                fpu_save(fpu_area(fpu_owner));
+                fpu_owner = NULL;
+        }
+#endif
+        if (thr == fpu_owner) {
+                fpu_clts();
+        } else {
+                fpu_stts();
+        }
+}
+
+void
+fpu_release(kthread_t *thr)
+{
+        if (fpu_owner == thr) {
+                fpu_owner = NULL;
+                if (thr == curthr) {
+                        fpu_stts();
+                }
+        }
+        if (NULL != thr->kt_fpu) {
+                slab_obj_free(fpu_allocator, thr->kt_fpu);
+                thr->kt_fpu = NULL;
+        }
+}
+
+size_t
+fpu_info(const void *arg, char *buf, size_t osize)
+{
+        size_t size = osize;
+
+        KASSERT(NULL == arg);
+
+        iprintf(&buf, &size, "save:     %s\n", fpu_fxsr ? "fxsave" : "fnsave");
+        iprintf(&buf, &size, "sse2:     %s\n", fpu_sse ? "yes" : "no");
+        iprintf(&buf, &size, "traps:    %u\n", fpu_ntraps);
+        iprintf(&buf, &size, "switches: %u\n", fpu_nswitches);
+        if (NULL != fpu_owner) {
+                iprintf(&buf, &size, "owner:    proc %d (%s)\n",
+                        fpu_owner->kt_proc->p_pid, fpu_owner->kt_proc->p_comm);
+        } else {
+                iprintf(&buf, &size, "owner:    none\n");
+        }
+        return size;
+}
@@ -1,4 +1,6 @@
 #include "main/gdt.h"
+#include "main/interrupt.h"
+#include "main/smp.h"
 
 #include "util/printf.h"
 #include "util/debug.h"
@@ -47,17 +49,37 @@ struct gdt_location {
         uint32_t gl_offset;
 } __attribute__((packed));
 
+/* Every CPU needs a TSS of its own, for the kernel stack of the thread
+ * it is running */
+#ifdef __SMP__
+#define GDT_NTSS        SMP_MAX_CPUS
+#define GDT_CPU         smp_cpuid()
+#else
+#define GDT_NTSS        1
+#define GDT_CPU         0
+#endif
+
 static struct gdt_entry gdt[GDT_COUNT];
-static struct tss_entry tss;
+static struct tss_entry tss[GDT_NTSS];
 static struct gdt_location gdtl = {
         .gl_size = GDT_COUNT * 8,
         .gl_offset = (uint32_t) &gdt
 };
 
+static void gdt_tss_load(int cpu)
+{
+        int segment = GDT_TSS + 8 * cpu;
+        __asm__ volatile("ltr %0" :: "m"(segment));
+
+        intr_sysenter_init(&tss[cpu].ts_esp0);
+}
+
 void gdt_init(void)
 {
         struct gdt_location *data = &gdtl;
+        int i;
 
+        KASSERT(GDT_TSS / 8 + GDT_NTSS <= GDT_COUNT);
         memset(&gdt[0], 0, sizeof(gdt));
 
         gdt_set_entry(GDT_KERNEL_TEXT, 0x0, 0xFFFFF, 0, 1, 0, 1);
@@ -67,22 +89,35 @@ void gdt_init(void)
 
         __asm__ volatile("lgdt (%0)" :: "p"(data));
 
-        gdt_set_entry(GDT_TSS, (uint32_t)&tss, sizeof(tss), 0, 1, 0, 0);
-        gdt[GDT_TSS / 8].ge_access &= ~(0b10000);
-        gdt[GDT_TSS / 8].ge_access |= 0b1;
-        gdt[GDT_TSS / 8].ge_flags &= ~(0b10000000);
+        for (i = 0; i < GDT_NTSS; ++i) {
+                uint32_t segment = GDT_TSS + 8 * i;
+                gdt_set_entry(segment, (uint32_t)&tss[i], sizeof(tss[i]), 0, 1, 0, 0);
+                gdt[segment / 8].ge_access &= ~(0b10000);
+                gdt[segment / 8].ge_access |= 0b1;
+                gdt[segment / 8].ge_flags &= ~(0b10000000);
 
-        memset(&tss, 0, sizeof(tss));
-        tss.ts_ss0 = GDT_KERNEL_DATA;
-        tss.ts_iopb = sizeof(tss);
+                memset(&tss[i], 0, sizeof(tss[i]));
+                tss[i].ts_ss0 = GDT_KERNEL_DATA;
+                tss[i].ts_iopb = sizeof(tss[i]);
+        }
 
-        int segment = GDT_TSS;
-        __asm__ volatile("ltr %0" :: "m"(segment));
+        gdt_tss_load(0);
+}
+
+#ifdef __SMP__
+void gdt_init_ap(int cpu)
+{
+        struct gdt_location *data = &gdtl;
+
+        KASSERT(0 < cpu && cpu < GDT_NTSS);
+        __asm__ volatile("lgdt (%0)" :: "p"(data));
+        gdt_tss_load(cpu);
 }
+#endif
 
 void gdt_set_kernel_stack(void *addr)
 {
-        tss.ts_esp0 = (uint32_t)addr;
+        tss[GDT_CPU].ts_esp0 = (uint32_t)addr;
 }
 
 void gdt_set_entry(uint32_t segment, uint32_t base, uint32_t limit,
@@ -123,7 +158,14 @@ size_t gdt_tss_info(const void *arg, char *buf, size_t osize)
         KASSERT(NULL == arg);
 
         iprintf(&buf, &size, "TSS:\n");
-        iprintf(&buf, &size, "kstack: %#.8x\n", tss.ts_esp0);
+#ifdef __SMP__
+        int i;
+        for (i = 0; i < smp_ncpus; ++i) {
+                iprintf(&buf, &size, "cpu %d kstack: %#.8x\n", i, tss[i].ts_esp0);
+        }
+#else
+        iprintf(&buf, &size, "kstack: %#.8x\n", tss[0].ts_esp0);
+#endif
 
         return size;
 }
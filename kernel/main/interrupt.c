@@ -1,4 +1,5 @@
 #include "types.h"
+#include "globals.h"
 
 #include "util/debug.h"
 #include "util/string.h"
@@ -7,11 +8,21 @@
 #include "main/apic.h"
 #include "main/interrupt.h"
 #include "main/gdt.h"
+#include "main/cpuid.h"
+#include "main/smp.h"
+
+#include "proc/sched.h"
+
+#include "api/syscall.h"
 
 #define MAX_INTERRUPTS          256
 
 #define INTR_SPURIOUS      0xef
 
+#define MSR_SYSENTER_CS         0x174
+#define MSR_SYSENTER_ESP        0x175
+#define MSR_SYSENTER_EIP        0x176
+
 /* Convenient definitions for intr_desc.attr */
 
 #define IDT_DESC_TRAP           0x01
@@ -322,6 +333,66 @@ INTR_NOERRCODE(253)
 INTR_NOERRCODE(254)
 INTR_NOERRCODE(255)
 
+/*
+ * The entry point for system calls made with SYSENTER. The processor
+ * saves nothing, it just loads the kernel code and stack segments, the
+ * stack pointer and the instruction pointer from MSRs and disables
+ * interrupts, so userland has to tell us where to go back to. Along
+ * with the system call number in eax and the argument pointer in edx,
+ * as for the interrupt, it passes its stack pointer in ecx and the
+ * return address in esi (see trap_sysenter() in weenix/trap.h). SYSEXIT
+ * wants those in ecx and edx, so neither survives a system call.
+ *
+ * From those we build the same regs_t as INTR_SYSCALL would and hand it
+ * to the same handler. One difference remains: interrupts are turned
+ * back on at once, so the system call runs with them on, where one
+ * coming through the interrupt gate runs with them off. On the way out
+ * we return to whatever r_eip and r_useresp say, which execve() may
+ * have changed.
+ *
+ * SYSEXIT does not restore EFLAGS, and a thread which slept in the
+ * system call may be switched back to by one running with interrupts
+ * off, so they are turned on again right before it. The STI takes
+ * effect only after the next instruction, so no interrupt can come in
+ * while we are still on the kernel stack with user registers loaded.
+ *
+ * The stack pointer MSR cannot follow the current thread's kernel stack
+ * without being rewritten on every context switch, so instead it points
+ * at the TSS's esp0 field, which does, and the first instruction loads
+ * the real stack pointer from there.
+ */
+extern void __intr_sysenter(void);
+__asm__ (
+        ".global __intr_sysenter\n"
+        "__intr_sysenter:\n\t"
+        "movl (%esp), %esp\n\t"
+        "sti\n\t"
+        "push $(" QUOTE(GDT_USER_DATA) " + 3)\n\t"    /* r_ss */
+        "push %ecx\n\t"                               /* r_useresp */
+        "push $0x202\n\t"                             /* r_eflags */
+        "push $(" QUOTE(GDT_USER_TEXT) " + 3)\n\t"    /* r_cs */
+        "push %esi\n\t"                               /* r_eip */
+        "push $0\n\t"                                 /* r_err */
+        "push $" QUOTE(INTR_SYSCALL) "\n\t"           /* r_intr */
+        "pusha\n\t"
+        "push %ds\n\t"
+        "push %es\n\t"
+        "movl %ss, %edx\n\t"
+        "movl %edx, %ds\n\t"
+        "movl %edx, %es\n\t"
+        "call __intr_handler\n\t"
+        "pop %es\n\t"
+        "pop %ds\n\t"
+        "popa\n\t"
+        "add $8, %esp\n\t"
+        "movl (%esp), %edx\n\t"                       /* r_eip */
+        "movl 12(%esp), %ecx\n\t"                     /* r_useresp */
+        "sti\n\t"
+        "sysexit\n"
+);
+
+static int intr_sysenter_ok = 0;
+
 typedef struct intr_desc {
         uint16_t baselo;
         uint16_t selector;
@@ -369,10 +440,55 @@ int32_t intr_map(uint16_t irq, uint8_t intr)
         return oldirq;
 }
 
+#ifdef __MTP__
+/*
+ * Exits the current thread, which was cancelled while running in
+ * userland (by another thread calling exit, say) and would otherwise
+ * only notice at its next system call, which may never come. Called on
+ * the way back to userland, once the interrupt has been handled and
+ * acknowledged: kthread_exit() may block, unmapping the thread's user
+ * stack for one, so interrupts are first let back in, which leaves the
+ * thread in the same state as one exiting from a system call. With
+ * SMP, the kernel lock passes to the next thread to run, as at any
+ * other context switch.
+ */
+static void intr_exit_cancelled(void)
+{
+        intr_setipl(IPL_LOW);
+        intr_enable();
+        kthread_exit(curthr->kt_retval);
+        panic("returned from kthread_exit\n");
+}
+#endif
+
 static __attribute__((used)) void __intr_handler(regs_t regs)
 {
         intr_handler_t handler = intr_handlers[regs.r_intr];
+
+#ifdef __SMP__
+        /* A TLB shootdown is handled without the kernel lock, since the
+         * CPU asking for it waits for it while holding the lock. */
+        if (INTR_IPI_TLB == regs.r_intr) {
+                handler(&regs);
+                return;
+        }
+
+        /* Everything else runs under the kernel lock. This CPU already
+         * holds it if it was running kernel code, and not if it was
+         * running user code or idle. */
+        int locked = 0;
+        if (!smp_kernel_locked()) {
+                smp_lock_kernel();
+                locked = 1;
+        }
+#endif
         _intr_regs = &regs;
+
+        /* the time since we last left the kernel was spent in user mode */
+        if (GDT_USER_TEXT == (regs.r_cs & ~0x3) && NULL != curthr) {
+                sched_acct_enter();
+        }
+
         if (NULL != handler) {
                 handler(&regs);
         } else {
@@ -384,6 +500,37 @@ static __attribute__((used)) void __intr_handler(regs_t regs)
         }
 
         _intr_regs = NULL;
+
+#ifdef __UPREEMPT__
+        /* The clock sets kt_need_resched once the current thread has
+         * used up its time slice. We only act on it when about to
+         * return to user mode, whether from an interrupt, a fault or
+         * a system call, so kernel code is never preempted. The
+         * interrupt has already been acknowledged, so the clock keeps
+         * ticking for whichever thread runs next. */
+        if (GDT_USER_TEXT == (regs.r_cs & ~0x3) && NULL != curthr
+            && curthr->kt_need_resched) {
+                sched_preempt();
+        }
+#endif
+
+        if (GDT_USER_TEXT == (regs.r_cs & ~0x3) && NULL != curthr) {
+                sched_acct_leave();
+#ifdef __MTP__
+                if (curthr->kt_cancelled) {
+                        intr_exit_cancelled();
+                }
+#endif
+        }
+
+#ifdef __SMP__
+        /* if we were preempted above, this may be another CPU than the
+         * one which took the lock, but whichever CPU we are on now took
+         * it to switch to us */
+        if (locked) {
+                smp_unlock_kernel();
+        }
+#endif
 }
 
 static void __intr_divide_by_zero_handler(regs_t *regs)
@@ -396,11 +543,6 @@ static void __intr_gpf_handler(regs_t *regs)
         panic("\nGeneral Protection Fault:\nError: 0x%.8x\n", regs->r_err);
 }
 
-static void __intr_timer_handler(regs_t *regs)
-{
-        panic("\nTimer Interrupt:\nError: 0x%.8x\n", regs->r_err);
-}
-
 static void __intr_inval_opcode_handler(regs_t *regs)
 {
         panic("\nInvalid opcode error at eip=0x%08x\n", regs->r_eip);
@@ -411,6 +553,47 @@ static void __intr_spurious(regs_t *regs)
         dbg(DBG_CORE, ("ignoring spurious interrupt\n"));
 }
 
+void intr_sysenter_init(uint32_t *kstackp)
+{
+        uint32_t a, d, family, model, stepping;
+
+        cpuid(CPUID_GETFEATURES, &a, &d);
+        family = (a >> 8) & 0xf;
+        model = (a >> 4) & 0xf;
+        stepping = a & 0xf;
+
+        /* The first Pentium Pros claim SEP but have no SYSENTER */
+        if (!(d & CPUID_FEAT_EDX_SEP)
+            || (6 == family && model < 3 && stepping < 3)) {
+                dbg(DBG_INIT, "no SYSENTER, system calls use int $%#x\n",
+                    INTR_SYSCALL);
+                return;
+        }
+
+        /* SYSENTER takes the stack segment to be the one after the code
+         * segment, and SYSEXIT takes the user segments to be the next
+         * two, which is how the GDT is laid out */
+        wrmsr(MSR_SYSENTER_CS, GDT_KERNEL_TEXT);
+        wrmsr(MSR_SYSENTER_ESP, (uint32_t) kstackp);
+        wrmsr(MSR_SYSENTER_EIP, (uint32_t) &__intr_sysenter);
+        intr_sysenter_ok = 1;
+}
+
+#ifdef __SMP__
+void intr_init_ap(void)
+{
+        intr_info_t *data = &intr_data;
+
+        __asm__("lidt (%0)" :: "p"(data));
+        apic_setspur(INTR_SPURIOUS);
+}
+#endif
+
+int intr_sysenter_enabled(void)
+{
+        return intr_sysenter_ok;
+}
+
 static void __intr_set_entry(uint8_t isr, uint32_t addr, int seg, int flags)
 {
         intr_table[isr].baselo = (uint16_t)((addr) & 0xffff);
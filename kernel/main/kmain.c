@@ -16,16 +16,19 @@
 #include "vm/vmmap.h"
 #include "vm/shadow.h"
 #include "vm/anon.h"
+#include "vm/shadowd.h"
 
 #include "main/acpi.h"
 #include "main/apic.h"
 #include "main/interrupt.h"
 #include "main/cpuid.h"
 #include "main/gdt.h"
+#include "main/fpu.h"
 
 #include "proc/sched.h"
 #include "proc/proc.h"
 #include "proc/kthread.h"
+#include "proc/reaper.h"
 
 #include "drivers/dev.h"
 #include "drivers/blockdev.h"
@@ -81,6 +84,7 @@ kmain()
         intr_init();
 
         gdt_init();
+        fpu_init();
 
         /* initialize slab allocators */
 #ifdef __VM__
@@ -190,7 +194,7 @@ idleproc_run(int arg1, void *arg2)
         /* Create other kernel threads (in order) */
         /* PROCS BLANK {{{ */
 #ifdef __SHADOWD__
-        /* TODO port this - alvin */
+        shadowd_exit();
 #endif
         /* PROCS BLANK }}} */
 
@@ -267,10 +271,14 @@ idleproc_run(int arg1, void *arg2)
         kthread_reapd_shutdown();
 #endif
 
+        /* Finish tearing down dead processes' address spaces before
+         * the file systems they refer to go away */
+        reaper_shutdown();
+
 
         /* PROCS BLANK {{{ */
 #ifdef __SHADOWD__
-        /* TODO port this - alvin */
+        shadowd_exit();
 #endif
         /* PROCS BLANK }}} */
 #ifdef __VFS__
@@ -1,5 +1,8 @@
+#include "config.h"
+
 #include "main/io.h"
 #include "main/interrupt.h"
+#include "main/cpuid.h"
 #include "util/delay.h"
 
 /* IRQ */
@@ -11,20 +14,65 @@
 #define PIT_DATA2 0x42
 #define PIT_CMD   0x43
 
+/* Channel 2 gate and output, shared with the PC speaker */
+#define PIT_GATE2          0x61
+#define PIT_GATE2_ENABLE   0x01 /* counting enabled */
+#define PIT_GATE2_SPEAKER  0x02 /* output routed to the speaker */
+#define PIT_GATE2_OUT      0x20 /* channel 2 output (read only) */
+
 #define CLOCK_TICK_RATE 1193182
 #undef HZ
-#define HZ 1000
+#define HZ (1000 / TICK_MSECS)
 
 #define LATCH (CLOCK_TICK_RATE / HZ)
 
+/* TSC calibration counts down this many msecs on channel 2, a few
+ * times over, and keeps the shortest run */
+#define CALIBRATE_MSECS 10
+#define CALIBRATE_LATCH (CLOCK_TICK_RATE / (1000 / CALIBRATE_MSECS))
+#define CALIBRATE_TRIES 3
+/* Give up on a run after this many cycles (about a second at 4 GHz) */
+#define CALIBRATE_MAX_CYCLES (1ULL << 32)
+
 void pit_starttimer(uint8_t intr)
 {
         intr_map(PIT_IRQ, intr);
 
         /* Shamelessly cribbed from "Understanding the Linux Kernel", pp 230 */
-        outb(0x34, PIT_CMD);
+        outb(PIT_CMD, 0x34);
         udelay(10);
-        outb(LATCH & 0xff, PIT_DATA0);
+        outb(PIT_DATA0, LATCH & 0xff);
         udelay(10);
-        outb(LATCH >> 8, PIT_DATA0);
+        outb(PIT_DATA0, LATCH >> 8);
+}
+
+uint64_t pit_calibrate_tsc(void)
+{
+        uint64_t start, cycles, best = 0;
+        uint8_t gate;
+        int i;
+
+        gate = inb(PIT_GATE2);
+        for (i = 0; i < CALIBRATE_TRIES; ++i) {
+                /* Channel 2 in mode 0 (interrupt on terminal count)
+                 * drives its output low when loaded and high once the
+                 * count runs out. */
+                outb(PIT_GATE2, (gate & ~PIT_GATE2_SPEAKER) | PIT_GATE2_ENABLE);
+                outb(PIT_CMD, 0xb0);
+                outb(PIT_DATA2, CALIBRATE_LATCH & 0xff);
+                outb(PIT_DATA2, CALIBRATE_LATCH >> 8);
+
+                start = rdtsc();
+                do {
+                        cycles = rdtsc() - start;
+                } while (!(inb(PIT_GATE2) & PIT_GATE2_OUT)
+                         && cycles < CALIBRATE_MAX_CYCLES);
+
+                if (cycles < CALIBRATE_MAX_CYCLES && (0 == best || cycles < best)) {
+                        best = cycles;
+                }
+        }
+        outb(PIT_GATE2, gate);
+
+        return best * CLOCK_TICK_RATE / CALIBRATE_LATCH;
 }
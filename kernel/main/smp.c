@@ -0,0 +1,407 @@
+#include "config.h"
+#include "globals.h"
+#include "kernel.h"
+#include "types.h"
+
+#include "main/apic.h"
+#include "main/cpuid.h"
+#include "main/fpu.h"
+#include "main/gdt.h"
+#include "main/interrupt.h"
+#include "main/smp.h"
+
+#include "mm/page.h"
+#include "mm/pagetable.h"
+#include "mm/tlb.h"
+
+#include "proc/kthread.h"
+#include "proc/proc.h"
+#include "proc/sched.h"
+
+#include "util/debug.h"
+#include "util/init.h"
+#include "util/printf.h"
+#include "util/spinlock.h"
+#include "util/string.h"
+#include "util/time.h"
+
+#ifdef __SMP__
+cpu_t cpus[SMP_MAX_CPUS];
+int smp_ncpus = 1;
+
+/*
+ * The kernel lock. The BSP boots holding it; from then on it is taken
+ * on every way into the kernel and let go of on the way back out to
+ * user mode (see __intr_handler() and userland_entry()) and while a
+ * CPU's idle thread waits for something to do (see sched_idle()).
+ * It is always taken with interrupts disabled.
+ */
+static spinlock_t smp_kernel_lock = { 1 };
+static volatile int smp_kernel_owner = 0;
+
+/*
+ * The TLB shootdown in progress, if any. Only the CPU holding the
+ * kernel lock starts one, so there is never more than one. Each CPU
+ * which has to flush its TLB has a bit in sd_pending, which it clears
+ * once it has.
+ */
+static struct {
+        pagedir_t               *sd_pd;
+        uintptr_t                sd_vlow;
+        uintptr_t                sd_vhigh;
+        volatile uint32_t        sd_pending;
+} smp_shootdown;
+
+/* Above this many pages the whole TLB is flushed instead */
+#define SMP_FLUSH_MAX_PAGES     32
+
+/* The CPU being started, read by smp_ap_start() */
+static volatile int smp_booting;
+
+/* Flushes [vlow, vhigh) from this CPU's TLB */
+static void
+smp_tlb_flush_range(uintptr_t vlow, uintptr_t vhigh)
+{
+        uint32_t npages = (vhigh - vlow) >> PAGE_SHIFT;
+
+        if (SMP_FLUSH_MAX_PAGES < npages) {
+                tlb_flush_all();
+        } else {
+                tlb_flush_range(vlow, npages);
+        }
+}
+
+/* Does this CPU's part of the shootdown in progress, if it has one */
+static void
+smp_tlb_flush(void)
+{
+        int self = smp_cpuid();
+
+        if (smp_shootdown.sd_pending & (1 << self)) {
+                smp_tlb_flush_range(smp_shootdown.sd_vlow, smp_shootdown.sd_vhigh);
+                cpus[self].cpu_nflushes++;
+                __sync_fetch_and_and(&smp_shootdown.sd_pending, ~(1 << self));
+        }
+}
+
+void
+smp_lock_kernel(void)
+{
+        /* the CPU holding the lock may be waiting for us to flush */
+        while (!spin_trylock(&smp_kernel_lock)) {
+                smp_tlb_flush();
+                __asm__ volatile("pause");
+        }
+        smp_kernel_owner = smp_cpuid();
+}
+
+void
+smp_unlock_kernel(void)
+{
+        KASSERT(smp_kernel_locked());
+        smp_kernel_owner = -1;
+        spin_unlock(&smp_kernel_lock);
+}
+
+int
+smp_kernel_locked(void)
+{
+        return smp_kernel_owner == smp_cpuid();
+}
+
+void
+smp_resched(int cpu)
+{
+        KASSERT(0 <= cpu && cpu < smp_ncpus);
+        apic_send_ipi(cpus[cpu].cpu_apicid, INTR_IPI_RESCHED);
+}
+
+void
+smp_tlb_shootdown(pagedir_t *pd, uintptr_t vlow, uintptr_t vhigh)
+{
+        int self = smp_cpuid();
+        uint32_t mask = 0;
+        int i;
+
+        KASSERT(smp_kernel_locked());
+        KASSERT(0 == smp_shootdown.sd_pending);
+
+        if (NULL == pd || pt_get() == pd) {
+                smp_tlb_flush_range(vlow, vhigh);
+        }
+
+        for (i = 0; i < SMP_MAX_CPUS; ++i) {
+                if (i != self && cpus[i].cpu_online
+                    && (NULL == pd || cpus[i].cpu_pagedir == pd)) {
+                        mask |= 1 << i;
+                }
+        }
+        if (0 == mask) {
+                return;
+        }
+
+        smp_shootdown.sd_pd = pd;
+        smp_shootdown.sd_vlow = vlow;
+        smp_shootdown.sd_vhigh = vhigh;
+        smp_shootdown.sd_pending = mask;
+        for (i = 0; i < SMP_MAX_CPUS; ++i) {
+                if (mask & (1 << i)) {
+                        apic_send_ipi(cpus[i].cpu_apicid, INTR_IPI_TLB);
+                }
+        }
+        while (smp_shootdown.sd_pending) {
+                __asm__ volatile("pause");
+        }
+}
+
+/* Interrupt handlers for the IPIs. Since their vectors are not mapped
+ * to an IRQ, __intr_handler() does not acknowledge them for us. */
+static void
+smp_resched_handler(regs_t *regs)
+{
+        curcpu->cpu_nipis++;
+        apic_eoi();
+}
+
+static void
+smp_tlb_handler(regs_t *regs)
+{
+        curcpu->cpu_nipis++;
+        smp_tlb_flush();
+        apic_eoi();
+}
+
+/*
+ * The code an AP starts in, copied to SMP_TRAMPOLINE. A startup IPI
+ * starts the processor in real mode with cs:ip at SMP_TRAMPOLINE:0;
+ * this gets it into protected mode with paging turned on, using the
+ * page directory, stack and entry point stored at the end by
+ * smp_init(). The trampoline page is mapped at its physical address
+ * while it runs, for the instructions after paging is turned on.
+ */
+#define TRAMP(sym) (SMP_TRAMPOLINE + (sym) - smp_tramp_start)
+
+__asm__(
+        ".text\n"
+        ".code16\n"
+        ".global smp_tramp_start, smp_tramp_end\n"
+        "smp_tramp_start:\n\t"
+        "cli\n\t"
+        "movw %cs, %ax\n\t"
+        "movw %ax, %ds\n\t"
+        "lgdtl smp_tramp_gdtl - smp_tramp_start\n\t"
+        "movl %cr0, %eax\n\t"
+        "orl $1, %eax\n\t"
+        "movl %eax, %cr0\n\t"
+        "ljmpl $0x8, $(" QUOTE(SMP_TRAMPOLINE) " + smp_tramp_32 - smp_tramp_start)\n"
+        ".code32\n"
+        "smp_tramp_32:\n\t"
+        "movw $0x10, %ax\n\t"
+        "movw %ax, %ds\n\t"
+        "movw %ax, %es\n\t"
+        "movw %ax, %fs\n\t"
+        "movw %ax, %gs\n\t"
+        "movw %ax, %ss\n\t"
+        "movl " QUOTE(SMP_TRAMPOLINE) " + smp_tramp_cr3 - smp_tramp_start, %eax\n\t"
+        "movl %eax, %cr3\n\t"
+        "movl %cr0, %eax\n\t"
+        "orl $0x80010000, %eax\n\t"     /* PG and WP */
+        "movl %eax, %cr0\n\t"
+        "movl " QUOTE(SMP_TRAMPOLINE) " + smp_tramp_stack - smp_tramp_start, %esp\n\t"
+        "movl " QUOTE(SMP_TRAMPOLINE) " + smp_tramp_entry - smp_tramp_start, %eax\n\t"
+        "jmp *%eax\n"
+        ".align 8\n"
+        "smp_tramp_gdt:\n\t"
+        ".quad 0\n\t"
+        ".quad 0x00cf9a000000ffff\n\t"  /* flat code */
+        ".quad 0x00cf92000000ffff\n"    /* flat data */
+        "smp_tramp_gdtl:\n\t"
+        ".word 3 * 8 - 1\n\t"
+        ".long " QUOTE(SMP_TRAMPOLINE) " + smp_tramp_gdt - smp_tramp_start\n"
+        ".align 4\n"
+        ".global smp_tramp_cr3, smp_tramp_stack, smp_tramp_entry\n"
+        "smp_tramp_cr3:\n\t"
+        ".long 0\n"
+        "smp_tramp_stack:\n\t"
+        ".long 0\n"
+        "smp_tramp_entry:\n\t"
+        ".long 0\n"
+        "smp_tramp_end:\n"
+);
+
+extern char smp_tramp_start[], smp_tramp_end[];
+extern char smp_tramp_cr3[], smp_tramp_stack[], smp_tramp_entry[];
+
+/*
+ * Where an AP goes from the trampoline, on its boot stack. Once it is
+ * set up it waits for the kernel lock and then becomes its idle thread,
+ * which frees the boot stack.
+ */
+static void
+smp_ap_start(void)
+{
+        int cpu = smp_booting;
+
+        /* until the TSS is loaded smp_cpuid() says we are the BSP */
+        gdt_init_ap(cpu);
+        intr_init_ap();
+        apic_init_ap();
+        intr_setipl(IPL_HIGH);
+        fpu_init_ap();
+
+        KASSERT(cpu == smp_cpuid());
+        KASSERT(apic_getid() == curcpu->cpu_apicid);
+        curcpu->cpu_online = 1;
+
+        smp_lock_kernel();
+        curthr = curcpu->cpu_idlethr;
+        curproc = curthr->kt_proc;
+        curthr->kt_sched_start = rdtsc();
+        curthr->kt_acct_start = curthr->kt_sched_start;
+        context_make_active(&curthr->kt_ctx);
+
+        panic("returned to smp_ap_start()!\n");
+}
+
+/* Busy waits for us microseconds, or until *flag is set */
+static void
+smp_delay(uint32_t us, volatile int *flag)
+{
+        uint64_t base;
+        uint32_t mult, shift;
+        uint64_t start = rdtsc();
+
+        /* if the TSC is not calibrated, 1 GHz is as good a guess as any */
+        ktime_tsc_params(&base, &mult, &shift);
+        uint64_t cycles = (0 == mult) ? (uint64_t) us * 1000
+                          : ((uint64_t) us * 1000 << shift) / mult;
+
+        while (rdtsc() - start < cycles && (NULL == flag || !*flag)) {
+                __asm__ volatile("pause");
+        }
+}
+
+/* Starts the given AP, following the INIT-SIPI-SIPI sequence from the
+ * Intel MultiProcessor Specification, and returns 1 if it came up. Its
+ * idle thread is only made here, so there is none for a CPU which
+ * never runs. */
+static int
+smp_boot_ap(int cpu, proc_t *idle)
+{
+        uint8_t apicid = cpus[cpu].cpu_apicid;
+        void *stack;
+
+        if (NULL == (stack = page_alloc())) {
+                return 0;
+        }
+        if (NULL == (cpus[cpu].cpu_idlethr = kthread_create(idle, sched_idle, cpu, stack))) {
+                page_free(stack);
+                return 0;
+        }
+        cpus[cpu].cpu_idlethr->kt_cpu = cpu;
+        *(uint32_t *) TRAMP(smp_tramp_stack) = (uint32_t) stack + PAGE_SIZE;
+        smp_booting = cpu;
+
+        apic_send_init(apicid);
+        smp_delay(10000, NULL);
+        apic_send_startup(apicid, SMP_TRAMPOLINE);
+        smp_delay(200, &cpus[cpu].cpu_online);
+        if (!cpus[cpu].cpu_online) {
+                apic_send_startup(apicid, SMP_TRAMPOLINE);
+        }
+        smp_delay(1000000, &cpus[cpu].cpu_online);
+
+        if (!cpus[cpu].cpu_online) {
+                /* INIT puts it back to waiting for a SIPI, so it cannot
+                 * come up late on a stack and idle thread that are gone */
+                dbg(DBG_INIT, "CPU %d (APIC 0x%.2x) did not start\n", cpu, apicid);
+                apic_send_init(apicid);
+                smp_delay(10000, NULL);
+                cpus[cpu].cpu_online = 0;
+                kthread_destroy(cpus[cpu].cpu_idlethr);
+                cpus[cpu].cpu_idlethr = NULL;
+                page_free(stack);
+                return 0;
+        }
+        return 1;
+}
+
+static __attribute__((unused)) void
+smp_init(void)
+{
+        uint8_t apicids[SMP_MAX_CPUS];
+        proc_t *idle = proc_lookup(PID_IDLE);
+        int ncpus = apic_getcpus(apicids, SMP_MAX_CPUS);
+        int i;
+
+        KASSERT(NULL != idle && 0 < ncpus);
+        KASSERT(apic_getid() == apicids[0] && "the BSP comes first");
+
+        intr_register(INTR_IPI_RESCHED, smp_resched_handler);
+        intr_register(INTR_IPI_TLB, smp_tlb_handler);
+
+        for (i = 0; i < ncpus; ++i) {
+                cpus[i].cpu_id = i;
+                cpus[i].cpu_apicid = apicids[i];
+        }
+
+        /* every running CPU, including this one, idles in an idle thread
+         * of its own from now on (see sched_switch()); the APs get theirs
+         * as they are started */
+        cpus[0].cpu_idlethr = kthread_create(idle, sched_idle, 0, NULL);
+        KASSERT(NULL != cpus[0].cpu_idlethr);
+        cpus[0].cpu_idlethr->kt_cpu = 0;
+        cpus[0].cpu_online = 1;
+
+        if (1 < ncpus) {
+                uint32_t cr3;
+                __asm__ volatile("movl %%cr3, %0" : "=r"(cr3));
+
+                pt_low_map(SMP_TRAMPOLINE);
+                memcpy((void *) SMP_TRAMPOLINE, smp_tramp_start,
+                       smp_tramp_end - smp_tramp_start);
+                *(uint32_t *) TRAMP(smp_tramp_cr3) = cr3;
+                *(uint32_t *) TRAMP(smp_tramp_entry) = (uint32_t) smp_ap_start;
+
+                /* the CPUs are numbered in the order they come up, so
+                 * smp_ncpus stops at the first one that does not */
+                for (i = 1; i < ncpus && smp_boot_ap(i, idle); ++i) {
+                        smp_ncpus++;
+                }
+                pt_low_unmap(SMP_TRAMPOLINE);
+        }
+
+        dbg(DBG_INIT, "%d of %d processors running\n", smp_ncpus, ncpus);
+}
+init_func(smp_init);
+init_depends(time_init);
+init_depends(sched_init);
+
+size_t
+smp_info(const void *arg, char *buf, size_t osize)
+{
+        size_t size = osize;
+        cpu_t *c;
+
+        KASSERT(NULL == arg);
+
+        iprintf(&buf, &size, "%3s %4s %5s %9s %7s %7s %7s %12s  %s\n",
+                "CPU", "APIC", "STATE", "SWITCHES", "STEALS", "IPIS",
+                "FLUSHES", "IDLE (us)", "RUNNING");
+        for (c = cpus; c < cpus + smp_ncpus; ++c) {
+                iprintf(&buf, &size, "%3d 0x%.2x %5s %9u %7u %7u %7u %12llu  ",
+                        c->cpu_id, (uint32_t) c->cpu_apicid,
+                        c->cpu_idle ? "idle" : "busy", c->cpu_nswitches,
+                        c->cpu_nsteals, c->cpu_nipis, c->cpu_nflushes,
+                        cycles_to_ns(c->cpu_idle_cycles) / 1000);
+                if (NULL == c->cpu_thr || c->cpu_thr == c->cpu_idlethr) {
+                        iprintf(&buf, &size, "-\n");
+                } else {
+                        iprintf(&buf, &size, "%d (%s)\n", c->cpu_proc->p_pid,
+                                c->cpu_proc->p_comm);
+                }
+        }
+        iprintf(&buf, &size, "kernel lock held by CPU %d\n", smp_kernel_owner);
+        return size;
+}
+#endif
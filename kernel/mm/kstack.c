@@ -0,0 +1,224 @@
+#include "types.h"
+#include "kernel.h"
+
+#include "mm/page.h"
+#include "mm/pagetable.h"
+#include "mm/kstack.h"
+
+#include "boot/config.h"
+
+#include "util/debug.h"
+#include "util/printf.h"
+#include "util/string.h"
+
+/*
+ * A slot is mapped (holds a live or cached stack) if its npages is
+ * non-zero. The stack starts one page above the bottom of the slot, the
+ * page below it being the guard; anything above the stack in the slot
+ * stays unmapped as well and the next slot starts with its own guard.
+ */
+typedef struct kstack_slot {
+        uint8_t ks_npages;
+        uint8_t ks_live;
+} kstack_slot_t;
+
+/* The freed stacks of one size (in pages) */
+typedef struct kstack_cache {
+        int      kc_count;
+        uint32_t kc_slots[KSTACK_CACHE_MAX];
+        uint32_t kc_nlive;
+        size_t   kc_maxused;    /* largest high water mark seen */
+} kstack_cache_t;
+
+static kstack_slot_t  kstack_slots[KSTACK_NSLOTS];
+static kstack_cache_t kstack_caches[KSTACK_SLOT_PAGES];
+static uint32_t       kstack_rotor = 0;
+
+static uint32_t kstack_nalloc = 0;      /* calls to kstack_alloc */
+static uint32_t kstack_nhit = 0;        /* ... satisfied from a cache */
+static uint32_t kstack_nfail = 0;       /* ... that returned NULL */
+static uint32_t kstack_nmapped = 0;     /* slots holding a stack */
+
+#define slot_to_stack(slot) \
+        ((char *)(KSTACK_MEM_LOW + (slot) * KSTACK_SLOT_SIZE + PAGE_SIZE))
+#define stack_to_slot(stack) \
+        (((uintptr_t)(stack) - PAGE_SIZE - KSTACK_MEM_LOW) / KSTACK_SLOT_SIZE)
+
+/* Physical memory is linearly mapped from kernel_start, see pt_init() */
+#define phys_to_virt(paddr) \
+        ((void *)((paddr) - KERNEL_PHYS_BASE + (uintptr_t)&kernel_start))
+
+void
+kstack_init(void)
+{
+        KASSERT(0 == KSTACK_SLOT_SIZE % PAGE_SIZE);
+        KASSERT(KSTACK_SLOT_PAGES <= 255);
+
+        pt_kern_region_init(KSTACK_MEM_LOW, KSTACK_MEM_HIGH);
+        dbg(DBG_MM, "%u kernel stack slots at 0x%08x-0x%08x\n",
+            KSTACK_NSLOTS, KSTACK_MEM_LOW, KSTACK_MEM_HIGH);
+}
+
+/*
+ * Unmaps and frees the first npages pages of the stack in the given slot.
+ */
+static void
+kstack_unmap(uint32_t slot, uint32_t npages)
+{
+        char *stack = slot_to_stack(slot);
+        uint32_t i;
+
+        for (i = 0; i < npages; ++i) {
+                uintptr_t vaddr = (uintptr_t)stack + i * PAGE_SIZE;
+                void *page = phys_to_virt(pt_virt_to_phys(vaddr));
+                pt_kern_unmap(vaddr);
+                page_free(page);
+        }
+}
+
+/*
+ * Finds an unmapped slot and backs a stack of npages pages in it with
+ * single pages. Returns the slot, or -1 if there is no free slot or not
+ * enough memory.
+ */
+static int
+kstack_map(uint32_t npages)
+{
+        uint32_t i, slot;
+
+        for (i = 0; i < KSTACK_NSLOTS; ++i) {
+                slot = (kstack_rotor + i) % KSTACK_NSLOTS;
+                if (0 == kstack_slots[slot].ks_npages) {
+                        break;
+                }
+        }
+        if (KSTACK_NSLOTS == i) {
+                return -1;
+        }
+
+        char *stack = slot_to_stack(slot);
+        for (i = 0; i < npages; ++i) {
+                void *page;
+                if (NULL == (page = page_alloc())) {
+                        kstack_unmap(slot, i);
+                        return -1;
+                }
+                pt_kern_map((uintptr_t)stack + i * PAGE_SIZE,
+                            pt_virt_to_phys((uintptr_t)page));
+        }
+
+        kstack_rotor = (slot + 1) % KSTACK_NSLOTS;
+        kstack_slots[slot].ks_npages = npages;
+        ++kstack_nmapped;
+        return slot;
+}
+
+void *
+kstack_alloc(size_t size)
+{
+        uint32_t npages = size >> PAGE_SHIFT;
+        KASSERT(PAGE_ALIGNED(size) && 0 < npages);
+        KASSERT(size + PAGE_SIZE <= KSTACK_SLOT_SIZE);
+
+        kstack_cache_t *cache = &kstack_caches[npages];
+        int slot;
+
+        ++kstack_nalloc;
+        if (0 < cache->kc_count) {
+                /* already poisoned when it was freed */
+                slot = cache->kc_slots[--cache->kc_count];
+                ++kstack_nhit;
+        } else if (0 <= (slot = kstack_map(npages))) {
+                memset(slot_to_stack(slot), KSTACK_POISON, size);
+        } else {
+                ++kstack_nfail;
+                return NULL;
+        }
+
+        KASSERT(npages == kstack_slots[slot].ks_npages);
+        KASSERT(!kstack_slots[slot].ks_live);
+        kstack_slots[slot].ks_live = 1;
+        ++cache->kc_nlive;
+        return slot_to_stack(slot);
+}
+
+void
+kstack_free(void *stack, size_t size)
+{
+        uint32_t npages = size >> PAGE_SHIFT;
+        uint32_t slot = stack_to_slot(stack);
+        KASSERT(slot < KSTACK_NSLOTS && stack == slot_to_stack(slot));
+        KASSERT(kstack_slots[slot].ks_live);
+        KASSERT(npages == kstack_slots[slot].ks_npages);
+
+        kstack_cache_t *cache = &kstack_caches[npages];
+        size_t used = kstack_used(stack, size);
+        if (used > cache->kc_maxused) {
+                cache->kc_maxused = used;
+        }
+
+        kstack_slots[slot].ks_live = 0;
+        --cache->kc_nlive;
+
+        if (KSTACK_CACHE_MAX > cache->kc_count) {
+                /* only the part above the high water mark was touched */
+                memset((char *)stack + size - used, KSTACK_POISON, used);
+                cache->kc_slots[cache->kc_count++] = slot;
+        } else {
+                kstack_unmap(slot, npages);
+                kstack_slots[slot].ks_npages = 0;
+                --kstack_nmapped;
+        }
+}
+
+size_t
+kstack_used(const void *stack, size_t size)
+{
+        const uint32_t poison = KSTACK_POISON * 0x01010101U;
+        const uint32_t *word = stack;
+        const uint32_t *end = (const uint32_t *)((const char *)stack + size);
+
+        while (word < end && poison == *word) {
+                ++word;
+        }
+        return (const char *)end - (const char *)word;
+}
+
+size_t
+kstack_info(const void *arg, char *buf, size_t osize)
+{
+        size_t size = osize;
+        uint32_t npages, slot;
+
+        KASSERT(NULL == arg);
+
+        /* bring the high water marks up to date with the live stacks */
+        for (slot = 0; slot < KSTACK_NSLOTS; ++slot) {
+                if (kstack_slots[slot].ks_live) {
+                        npages = kstack_slots[slot].ks_npages;
+                        size_t used = kstack_used(slot_to_stack(slot), npages * PAGE_SIZE);
+                        if (used > kstack_caches[npages].kc_maxused) {
+                                kstack_caches[npages].kc_maxused = used;
+                        }
+                }
+        }
+
+        iprintf(&buf, &size, "slots:  %u of %u mapped (%u bytes each)\n",
+                kstack_nmapped, KSTACK_NSLOTS, KSTACK_SLOT_SIZE);
+        iprintf(&buf, &size, "allocs: %u (%u from cache, %u failed)\n",
+                kstack_nalloc, kstack_nhit, kstack_nfail);
+        iprintf(&buf, &size, "%8s %6s %6s %16s\n",
+                "SIZE", "LIVE", "CACHED", "HIGH WATER");
+        for (npages = 1; npages < KSTACK_SLOT_PAGES; ++npages) {
+                kstack_cache_t *cache = &kstack_caches[npages];
+                if (0 == cache->kc_nlive && 0 == cache->kc_count) {
+                        continue;
+                }
+                iprintf(&buf, &size, "%8u %6u %6i %8u (%3u%%)\n",
+                        npages * PAGE_SIZE, cache->kc_nlive, cache->kc_count,
+                        cache->kc_maxused,
+                        cache->kc_maxused * 100 / (npages * PAGE_SIZE));
+        }
+
+        return size;
+}
@@ -10,6 +10,7 @@
 #include "util/list.h"
 #include "util/debug.h"
 #include "util/string.h"
+#include "util/spinlock.h"
 
 #include "vm/shadowd.h"
 
@@ -21,6 +22,10 @@ GDB_DEFINE_HOOK(page_free, void *addr, int npages)
 static list_t pagegroup_list;
 static uintptr_t page_freecount;
 
+/* With SMP, protects the free lists (see main/smp.h; the kernel lock
+ * makes this redundant for now) */
+static spinlock_t page_lock = SPINLOCK_INITIALIZER;
+
 struct pagegroup {
         list_t       pg_freelist[PAGE_NSIZES];
         void        *pg_map[PAGE_NSIZES];
@@ -335,7 +340,9 @@ _page_free_order(void *addr, int order)
 void *
 page_alloc(void)
 {
+        uint32_t flags = spin_lock_irqsave(&page_lock);
         void *addr =  _page_alloc_order(0);
+        spin_unlock_irqrestore(&page_lock, flags);
         GDB_CALL_HOOK(page_alloc, addr, 1);
         return addr;
 }
@@ -348,7 +355,9 @@ void
 page_free(void *addr)
 {
         GDB_CALL_HOOK(page_free, addr, 1);
+        uint32_t flags = spin_lock_irqsave(&page_lock);
         _page_free_order(addr, 0);
+        spin_unlock_irqrestore(&page_lock, flags);
 }
 
 /*
@@ -367,7 +376,9 @@ page_alloc_n(uint32_t npages)
         if (order == PAGE_NSIZES)
                 panic("Implementation does not permit allocating %u pages!\n", npages);
 
+        uint32_t flags = spin_lock_irqsave(&page_lock);
         void *addr = _page_alloc_order(order);
+        spin_unlock_irqrestore(&page_lock, flags);
         GDB_CALL_HOOK(page_alloc, addr, npages);
         return addr;
 }
@@ -388,7 +399,9 @@ page_free_n(void *start, uint32_t npages)
                 panic("Implementation does not permit allocating %u pages!\n", npages);
 
         GDB_CALL_HOOK(page_free, start, npages);
+        uint32_t flags = spin_lock_irqsave(&page_lock);
         _page_free_order(start, order);
+        spin_unlock_irqrestore(&page_lock, flags);
 }
 
 /*
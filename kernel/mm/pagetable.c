@@ -6,6 +6,7 @@
 #include "globals.h"
 
 #include "main/interrupt.h"
+#include "main/smp.h"
 
 #include "mm/mm.h"
 #include "mm/page.h"
@@ -20,16 +21,25 @@
 
 #include "vm/pagefault.h"
 
+#include "api/access.h"
+#include "api/memstat.h"
+
 #include "boot/config.h"
 
 #define PT_ENTRY_COUNT    (PAGE_SIZE / sizeof (uint32_t))
+#define CR0_WP            0x00010000
 #define PT_VADDR_SIZE     (PAGE_SIZE * PT_ENTRY_COUNT)
 
 struct pagedir {
         pde_t      pd_physical[PT_ENTRY_COUNT];
         uintptr_t *pd_virtual[PT_ENTRY_COUNT];
+        struct memstat *pd_mem;  /* the owning process's memory counters,
+                                  * or NULL if it has none */
 };
 
+/* The pd_mem pointer takes a page directory past two pages */
+#define PAGEDIR_NPAGES    ((sizeof(pagedir_t) + PAGE_SIZE - 1) / PAGE_SIZE)
+
 /* for a given virtual memory address these macros will
  * calculate the index into the page directory and page
  * tables for that memory location as well as the offset
@@ -42,7 +52,11 @@ struct pagedir {
         (((uint32_t)(vaddr)) & (~PAGE_MASK))
 
 /* the virtual address of the page directory in cr3 */
+#ifdef __SMP__
+#define current_pagedir (curcpu->cpu_pagedir)
+#else
 static pagedir_t *current_pagedir = NULL;
+#endif
 static pagedir_t *template_pagedir = NULL;
 
 static uint32_t phys_map_count = 1;
@@ -104,13 +118,41 @@ pt_get(void)
         return current_pagedir;
 }
 
+/* Adds delta to the resident page count matching pte, if it is present */
+static void
+pt_account(struct memstat *ms, pte_t pte, int delta)
+{
+        if (NULL == ms || !(PT_PRESENT & pte) || (PT_NORSS & pte)) {
+                return;
+        }
+        if (PT_FILE & pte) {
+                ms->ms_rss_file += delta;
+        } else {
+                ms->ms_rss_anon += delta;
+        }
+}
+
+/* Uncounts every present entry in pt[from, to) */
+static void
+pt_account_range(struct memstat *ms, pte_t *pt, uint32_t from, uint32_t to)
+{
+        if (NULL == ms) {
+                return;
+        }
+        for (; from < to; ++from) {
+                pt_account(ms, pt[from], -1);
+        }
+}
+
 int
 pt_map(pagedir_t *pd, uintptr_t vaddr, uintptr_t paddr, uint32_t pdflags, uint32_t ptflags)
 {
         KASSERT(PAGE_ALIGNED(vaddr) && PAGE_ALIGNED(paddr));
-        KASSERT(USER_MEM_LOW <= vaddr && USER_MEM_HIGH > vaddr);
+        KASSERT(USER_MEM_LOW <= vaddr
+                && (USER_MEM_HIGH > vaddr || USER_VDATA_ADDR == vaddr));
 
         int index = vaddr_to_pdindex(vaddr);
+        struct memstat *ms = pd->pd_mem;
 
         pte_t *pt;
         if (!(PT_PRESENT & pd->pd_physical[index])) {
@@ -121,6 +163,9 @@ pt_map(pagedir_t *pd, uintptr_t vaddr, uintptr_t paddr, uint32_t pdflags, uint32
                         memset(pt, 0, PAGE_SIZE);
                         pd->pd_physical[index] = pt_virt_to_phys((uintptr_t)pt) | pdflags;
                         pd->pd_virtual[index] = pt;
+                        if (NULL != ms) {
+                                ms->ms_ptpages++;
+                        }
                 }
         } else {
                 /* Be sure to add additional pagedir flags if necessary */
@@ -131,7 +176,9 @@ pt_map(pagedir_t *pd, uintptr_t vaddr, uintptr_t paddr, uint32_t pdflags, uint32
         index = vaddr_to_ptindex(vaddr);
 
         KASSERT((ptflags & ~PAGE_MASK) == ptflags);
+        pt_account(ms, pt[index], -1);
         pt[index] = paddr | ptflags;
+        pt_account(ms, pt[index], 1);
 
         return 0;
 }
@@ -148,7 +195,11 @@ pt_unmap(pagedir_t *pd, uintptr_t vaddr)
                 pte_t *pt = (pte_t *)pd->pd_virtual[index];
 
                 index = vaddr_to_ptindex(vaddr);
+                pt_account(pd->pd_mem, pt[index], -1);
                 pt[index] = 0;
+#ifdef __SMP__
+                smp_tlb_shootdown(pd, vaddr, vaddr + PAGE_SIZE);
+#endif
         }
 }
 
@@ -156,15 +207,20 @@ void
 pt_unmap_range(pagedir_t *pd, uintptr_t vlow, uintptr_t vhigh)
 {
         uint32_t index;
+        struct memstat *ms = pd->pd_mem;
 
         KASSERT(vlow < vhigh);
         KASSERT(PAGE_ALIGNED(vlow) && PAGE_ALIGNED(vhigh));
         KASSERT(USER_MEM_LOW <= vlow && USER_MEM_HIGH >= vhigh);
+#ifdef __SMP__
+        uintptr_t vlow_orig = vlow, vhigh_orig = vhigh;
+#endif
 
         index = vaddr_to_ptindex(vlow);
         if (PT_PRESENT & pd->pd_physical[vaddr_to_pdindex(vlow)] && index != 0) {
                 pte_t *pt = (pte_t *)pd->pd_virtual[vaddr_to_pdindex(vlow)];
                 size_t size = (PT_ENTRY_COUNT - index) * sizeof(*pt);
+                pt_account_range(ms, pt, index, PT_ENTRY_COUNT);
                 memset(&pt[index], 0, size);
         }
         vlow += PAGE_SIZE * ((PT_ENTRY_COUNT - index) % PT_ENTRY_COUNT);
@@ -173,32 +229,123 @@ pt_unmap_range(pagedir_t *pd, uintptr_t vlow, uintptr_t vhigh)
         if (PT_PRESENT & pd->pd_physical[vaddr_to_pdindex(vhigh)] && index != 0) {
                 pte_t *pt = (pte_t *)pd->pd_virtual[vaddr_to_pdindex(vhigh)];
                 size_t size = index * sizeof(*pt);
+                pt_account_range(ms, pt, 0, index);
                 memset(&pt[0], 0, size);
         }
         vhigh -= PAGE_SIZE * index;
 
+        /* The page tables are only freed once no TLB (or cached page
+         * directory entry) can refer to them any more */
         uint32_t i;
         for (i = vaddr_to_pdindex(vlow); i < vaddr_to_pdindex(vhigh); ++i) {
                 if (PT_PRESENT & pd->pd_physical[i]) {
+                        if (NULL != ms) {
+                                pt_account_range(ms, (pte_t *) pd->pd_virtual[i],
+                                                 0, PT_ENTRY_COUNT);
+                                ms->ms_ptpages--;
+                        }
+                        pd->pd_physical[i] = 0;
+                }
+        }
+#ifdef __SMP__
+        smp_tlb_shootdown(pd, vlow_orig, vhigh_orig);
+#endif
+        for (i = vaddr_to_pdindex(vlow); i < vaddr_to_pdindex(vhigh); ++i) {
+                if (0 == pd->pd_physical[i] && NULL != pd->pd_virtual[i]) {
                         page_free(pd->pd_virtual[i]);
                         pd->pd_virtual[i] = NULL;
-                        pd->pd_physical[i] = 0;
                 }
         }
 }
 
 
-pagedir_t *
-pt_create_pagedir()
+void
+pt_kern_region_init(uintptr_t vlow, uintptr_t vhigh)
 {
-        KASSERT(sizeof(pagedir_t) == PAGE_SIZE * 2);
+        KASSERT(NULL == template_pagedir && "kernel regions must exist before the template");
+        KASSERT(0 == vlow % PT_VADDR_SIZE && 0 == vhigh % PT_VADDR_SIZE);
+        KASSERT((uintptr_t)&kernel_start <= vlow && vlow < vhigh);
+        KASSERT(vaddr_to_pdindex(vhigh - 1) < PT_ENTRY_COUNT - 1);
+
+        uint32_t i;
+        for (i = vaddr_to_pdindex(vlow); i <= vaddr_to_pdindex(vhigh - 1); ++i) {
+                KASSERT(!(PD_PRESENT & current_pagedir->pd_physical[i])
+                        && "kernel region overlaps the physical memory map");
+
+                pte_t *pt = page_alloc();
+                KASSERT(NULL != pt && "no memory for kernel region page tables");
+                memset(pt, 0, PAGE_SIZE);
+
+                current_pagedir->pd_physical[i] = pt_virt_to_phys((uintptr_t)pt)
+                                                  | PD_PRESENT | PD_WRITE;
+                current_pagedir->pd_virtual[i] = pt;
+        }
+}
 
+void
+pt_kern_map(uintptr_t vaddr, uintptr_t paddr)
+{
+        KASSERT(PAGE_ALIGNED(vaddr) && PAGE_ALIGNED(paddr));
+        KASSERT((uintptr_t)&kernel_start <= vaddr);
+
+        uint32_t index = vaddr_to_pdindex(vaddr);
+        KASSERT(PD_PRESENT & current_pagedir->pd_physical[index]);
+
+        pte_t *pt = current_pagedir->pd_virtual[index];
+        pt[vaddr_to_ptindex(vaddr)] = paddr | PT_PRESENT | PT_WRITE;
+        tlb_flush(vaddr);
+}
+
+void
+pt_kern_unmap(uintptr_t vaddr)
+{
+        KASSERT(PAGE_ALIGNED(vaddr));
+        KASSERT((uintptr_t)&kernel_start <= vaddr);
+
+        uint32_t index = vaddr_to_pdindex(vaddr);
+        KASSERT(PD_PRESENT & current_pagedir->pd_physical[index]);
+
+        pte_t *pt = current_pagedir->pd_virtual[index];
+        pt[vaddr_to_ptindex(vaddr)] = 0;
+#ifdef __SMP__
+        smp_tlb_shootdown(NULL, vaddr, vaddr + PAGE_SIZE);
+#else
+        tlb_flush(vaddr);
+#endif
+}
+
+#ifdef __SMP__
+void
+pt_low_map(uintptr_t paddr)
+{
+        KASSERT(PAGE_ALIGNED(paddr) && PT_VADDR_SIZE > paddr && 0 != paddr);
+
+        pte_t *pt = (pte_t *) current_pagedir->pd_virtual[0];
+        pt[vaddr_to_ptindex(paddr)] = paddr | PT_PRESENT | PT_WRITE;
+        tlb_flush(paddr);
+}
+
+void
+pt_low_unmap(uintptr_t paddr)
+{
+        KASSERT(PAGE_ALIGNED(paddr) && PT_VADDR_SIZE > paddr && 0 != paddr);
+
+        pte_t *pt = (pte_t *) current_pagedir->pd_virtual[0];
+        pt[vaddr_to_ptindex(paddr)] = 0;
+        smp_tlb_shootdown(NULL, paddr, paddr + PAGE_SIZE);
+}
+#endif
+
+pagedir_t *
+pt_create_pagedir(struct memstat *ms)
+{
         pagedir_t *pdir;
-        if (NULL == (pdir = page_alloc_n(2))) {
+        if (NULL == (pdir = page_alloc_n(PAGEDIR_NPAGES))) {
                 return NULL;
         }
 
         memcpy(pdir, template_pagedir, sizeof(*pdir));
+        pdir->pd_mem = ms;
         return pdir;
 }
 
@@ -217,7 +364,7 @@ pt_destroy_pagedir(pagedir_t *pdir)
                         page_free(pdir->pd_virtual[i]);
                 }
         }
-        page_free_n(pdir, 2);
+        page_free_n(pdir, PAGEDIR_NPAGES);
 }
 
 static void
@@ -228,10 +375,12 @@ _pt_fault_handler(regs_t *regs)
         __asm__ volatile("movl %%cr2, %0" : "=r"(vaddr));
         uint32_t cause = regs->r_err;
 
-        /* Check if pagefault was in user space (otherwise, BAD!) */
+        /* Check if pagefault was in user space (otherwise, BAD!), the
+         * only kernel faults we tolerate are those taken by the user
+         * access routines, which have an exception table entry */
         if (cause & FAULT_USER) {
-                handle_pagefault(vaddr, cause);
-        } else {
+                do_pagefault(vaddr, cause);
+        } else if (!uaccess_fault(regs, vaddr, cause)) {
                 panic("\nPage faulted while accessing 0x%08x\n", vaddr);
         }
 }
@@ -281,8 +430,7 @@ pt_init(void)
         memset(pagedir, 0, sizeof(*pagedir));
 
         /* set up the necessary stuff for temporary mappings */
-        final_page = (pde_t *)((char *)pagedir + sizeof(*pagedir));
-        KASSERT(PAGE_ALIGNED(final_page));
+        final_page = (pde_t *)PAGE_ALIGN_UP((char *)pagedir + sizeof(*pagedir));
         memset(final_page, 0, PAGE_SIZE);
         temppdir[PT_ENTRY_COUNT - 1] = ((uintptr_t)final_page
                                         - (uintptr_t)&kernel_start + KERNEL_PHYS_BASE) | PT_PRESENT | PT_WRITE;
@@ -305,6 +453,13 @@ pt_init(void)
          * permanant page table */
         pt_set(pagedir);
 
+        /* make the kernel honor read-only user mappings, otherwise
+         * copy_to_user would silently write through copy-on-write pages
+         * instead of faulting on them */
+        uint32_t cr0;
+        __asm__ volatile("movl %%cr0, %0" : "=r"(cr0));
+        __asm__ volatile("movl %0, %%cr0" :: "r"(cr0 | CR0_WP));
+
         uintptr_t physmax = phys_detect_highmem();
         dbgq(DBG_MM, "Highest usable physical memory: 0x%08x\n", physmax);
         dbgq(DBG_MM, "Available memory: 0x%08x\n", physmax - KERNEL_PHYS_BASE);
@@ -331,7 +486,7 @@ pt_template_init()
         memset(current_pagedir->pd_virtual[0], 0, PAGE_SIZE);
         tlb_flush_all();
 
-        template_pagedir = page_alloc_n(2);
+        template_pagedir = page_alloc_n(PAGEDIR_NPAGES);
         KASSERT(NULL != template_pagedir);
         memcpy(template_pagedir, current_pagedir, sizeof(*template_pagedir));
 
@@ -3,9 +3,11 @@
 #include "errno.h"
 
 #include "proc/proc.h"
+#include "proc/workqueue.h"
 
 #include "util/debug.h"
 #include "util/string.h"
+#include "util/time.h"
 
 #include "mm/mmobj.h"
 #include "mm/page.h"
@@ -96,22 +98,45 @@ static list_t pframe_hash[PF_HASH_SIZE];
 static uint32_t nfreepages_min = 0;
 static uint32_t nfreepages_target = 0;
 
-/*   pageoutd sleeps on this queue */
-static proc_t *pageoutd = NULL;
-static kthread_t *pageoutd_thr = NULL;
-static ktqueue_t pageoutd_waitq;
+/*   pageoutd runs on its own workqueue: pageoutd_work reclaims pages
+ *   when memory runs short, and pageoutd_writeback_work writes dirty
+ *   pages back once nothing has needed pageoutd for a while */
+static workqueue_t pageoutd_wq;
+static work_t pageoutd_work;
+static delayed_work_t pageoutd_writeback_work;
+static int pageoutd_running = 0;
 
 /* threads waiting for pageoutd to run sleep on this queue */
 static ktqueue_t alloc_waitq;
 
 /* Pageout daemon functions */
-static void *pageoutd_run(int arg1, void *arg2);
+static void pageoutd_run(work_t *work);
+static void pageoutd_writeback_run(work_t *work);
 static void pageoutd_exit(void);
-#define pageoutd_wakeup()        (sched_broadcast_on(&pageoutd_waitq))
+#define pageoutd_wakeup()                                               \
+        do {                                                            \
+                if (pageoutd_running)                                   \
+                        workqueue_submit(&pageoutd_wq, &pageoutd_work); \
+        } while (0)
 #define pageoutd_needed()        \
 	((page_free_count() <= nfreepages_min) && (!list_empty(&alloc_list)))
 #define pageoutd_target_met()    (page_free_count() >= nfreepages_target)
 
+/*
+ * Returns true if there is a free page for an allocator to take, and
+ * wakes pageoutd otherwise. Allocators wait on alloc_waitq until this
+ * holds; they wait exclusively, since pageoutd only wakes as many as
+ * it has freed pages for.
+ */
+static int
+pageoutd_done(void)
+{
+        if (!pageoutd_needed())
+                return 1;
+        pageoutd_wakeup();
+        return 0;
+}
+
 
 /*
  * Initialize the pinned and allocated counts and lists. Then, make a pframe
@@ -152,9 +177,6 @@ pframe_shutdown()
         /* Stop pageoutd and wait for it */
         pageoutd_exit();
 
-        int pid = pageoutd->p_pid;
-        int child = do_waitpid(-1, 0, NULL);
-        KASSERT(pid == child && "waited on process other than pageoutd");
         KASSERT(0 == npinned && "WARNING: FOUND PINNED "
                 "PAGES!!!!!!!!!! SOMETHING IS BROKEN!!\n");
 
@@ -308,12 +330,7 @@ pframe_get(struct mmobj *o, uint32_t pagenum, pframe_t **result)
         /* If found in memory */
         if (*result != NULL) {
           /* If page is busy, wait for it to become unbusy and try again */
-          while (pframe_is_busy(*result)) {
-            sched_sleep_on(&(*result)->pf_waitq);
-            /* When you wake up, you will check again to see if page is busy.
-             *   You only exit the loop once the page is no longer busy.
-             */
-          }
+          sched_wait_event(&(*result)->pf_waitq, !pframe_is_busy(*result));
           /*  Make sure page hasn't been freed before you return it. */
           if (pframe_get_resident(o, pagenum) != NULL) {
             /* Page is not busy and result holds contents of page */
@@ -323,11 +340,8 @@ pframe_get(struct mmobj *o, uint32_t pagenum, pframe_t **result)
 
         /* If you get here, page isn't currently in memory */
 
-        /* Wake pageoutd if we are low on memory */
-        if (pageoutd_needed()) {
-            pageoutd_wakeup();
-            sched_sleep_on(&alloc_waitq);
-        }
+        /* Wait for pageoutd if we are low on memory */
+        sched_wait_event_exclusive(&alloc_waitq, pageoutd_done());
 
         /* Allocate a new page and fill it */
         *result = pframe_alloc(o, pagenum);
@@ -617,38 +631,69 @@ pframe_remove_from_pts(pframe_t *pf)
 /* ------------------------------------------------------------------ */
 
 /*
- * Initialize the pageout daemon process. This function is called
- * by pframe_init and simply starts up a new thread with the
- * appropriate function as its first call.
+ * Initialize the pageout daemon's workqueue, whose single worker runs
+ * both kinds of pageout work, one at a time, and start the writeback
+ * timer.
  */
 static __attribute__((unused)) void
 pageoutd_init(void)
 {
-        /* initialize pageoutd_waitq: */
-        sched_queue_init(&pageoutd_waitq);
+        work_init(&pageoutd_work, pageoutd_run);
+        delayed_work_init(&pageoutd_writeback_work, pageoutd_writeback_run);
 
-        /* create and schedule pageoutd: */
         KASSERT(curproc && (PID_IDLE == curproc->p_pid)
                 && "should be calling this from idleproc");
-        pageoutd = proc_create("pageoutd");
-        KASSERT(NULL != pageoutd);
-        pageoutd_thr = kthread_create(pageoutd, pageoutd_run, 0, NULL);
-        KASSERT(NULL != pageoutd_thr);
-
-        sched_make_runnable(pageoutd_thr);
+        if (0 > workqueue_init(&pageoutd_wq, "pageoutd", 1)) {
+                panic("could not start pageoutd\n");
+        }
+        pageoutd_running = 1;
+        workqueue_submit_delayed(&pageoutd_wq, &pageoutd_writeback_work,
+                                 msecs_to_jiffies(PAGEOUTD_WRITEBACK_MSECS));
 }
 init_func(pageoutd_init);
-init_depends(sched_init);
+init_depends(workqueue_sysinit);
 
 /*
- * Just cancel pageoutd
+ * Stops pageoutd and waits for it. Work already queued still runs,
+ * but none is queued from now on, including the next writeback.
  */
 static void
 pageoutd_exit()
 {
-        KASSERT(NULL != pageoutd_thr);
-        kthread_cancel(pageoutd_thr, (void *) 0);
-        pageoutd_thr = NULL;
+        KASSERT(pageoutd_running);
+        pageoutd_running = 0;
+        workqueue_cancel_delayed(&pageoutd_writeback_work);
+        workqueue_destroy(&pageoutd_wq);
+}
+
+/*
+ * Writes dirty pages back, so that data does not stay in memory
+ * indefinitely and pages are already clean (and quick to reclaim) when
+ * memory runs short. Busy pages are skipped rather than waited for;
+ * they will be dealt with next time. Since pframe_clean() blocks, we
+ * start over after each page, like pframe_clean_all(), but clean no
+ * more pages than were allocated to begin with, so pages dirtied again
+ * while we work cannot keep us going forever.
+ */
+static void
+pageoutd_writeback(void)
+{
+        pframe_t *pf;
+        int budget = nallocated;
+
+list_start:
+        list_iterate_begin(&alloc_list, pf, pframe_t, pf_link) {
+                if (budget <= 0) {
+                        return;
+                }
+                if (pframe_is_dirty(pf) && !pframe_is_busy(pf)) {
+                        budget--;
+                        if (pframe_clean(pf) < 0) {
+                                return;
+                        }
+                        goto list_start;
+                }
+        } list_iterate_end();
 }
 
 /*
@@ -657,45 +702,65 @@ pageoutd_exit()
  * page is busy before yanking it. If the page you select is dirty, make sure
  * to clean it before yanking it. Finally, go back to sleep after having paged
  * out the appropriate page.
- * Both arguments unused.
+ * Each run puts the next writeback off for another
+ * PAGEOUTD_WRITEBACK_MSECS, so it only happens when nothing has woken
+ * pageoutd for that long.
  */
-static void *
-pageoutd_run(int arg1, void *arg2)
+static void
+pageoutd_run(work_t *work)
 {
-        while (1) {
-                KASSERT(nallocated >= 0);
-                while ((!pageoutd_target_met()) && (!list_empty(&alloc_list))) {
-                        pframe_t *pf;
-
-                        /* obtain least-recently-requested page: */
-                        pf = list_head(&alloc_list, pframe_t, pf_link);
-
-                        if (pframe_is_busy(pf)) {
-                                sched_sleep_on(&pf->pf_waitq);
-                        } else if (pframe_is_dirty(pf)) {
-                                pframe_clean(pf);
-                        } else {
-                                /* it's not busy, it's clean, and it's
-                                 * least-recently-requested; reclaim it: */
-                                pframe_free(pf);
-                        }
+        KASSERT(nallocated >= 0);
+        dbg(DBG_PFRAME, "PAGEOUT DEMAON: Waking up\n");
+        dbg(DBG_PFRAME, "PAGEOUT DEMAON: "
+            "nfreepages_target=|%d| "
+            "nfreepages_min=|%d| "
+            "page_free_count=|%d|\n", nfreepages_target, nfreepages_min, page_free_count());
+
+        while ((!pageoutd_target_met()) && (!list_empty(&alloc_list))) {
+                pframe_t *pf;
+
+                /* obtain least-recently-requested page: */
+                pf = list_head(&alloc_list, pframe_t, pf_link);
+
+                if (pframe_is_busy(pf)) {
+                        sched_sleep_on(&pf->pf_waitq);
+                } else if (pframe_is_dirty(pf)) {
+                        pframe_clean(pf);
+                } else {
+                        /* it's not busy, it's clean, and it's
+                         * least-recently-requested; reclaim it: */
+                        pframe_free(pf);
                 }
+        }
 
-                /*   release the thundering herd... */
+        /* wake one allocator per page above the minimum, or all
+         * of them if there is nothing left to page out */
+        if (list_empty(&alloc_list)) {
                 sched_broadcast_on(&alloc_waitq);
+        } else if (page_free_count() > nfreepages_min) {
+                sched_wakeup_n(&alloc_waitq,
+                               page_free_count() - nfreepages_min);
+        }
 
-                dbg(DBG_PFRAME, "PAGEOUT DEMAON: Falling asleep\n");
-                dbg(DBG_PFRAME, "PAGEOUT DEMAON: "
-                    "nfreepages_target=|%d| "
-					"nfreepages_min=|%d| "
-					"page_free_count=|%d|\n", nfreepages_target, nfreepages_min, page_free_count());
-                if (sched_cancellable_sleep_on(&pageoutd_waitq))
-                        kthread_exit((void *)0);
-                dbg(DBG_PFRAME, "PAGEOUT DEMAON: Waking up\n");
-                dbg(DBG_PFRAME, "PAGEOUT DEMAON: "
-                    "nfreepages_target=|%d| "
-					"nfreepages_min=|%d| "
-					"page_free_count=|%d|\n", nfreepages_target, nfreepages_min, page_free_count());
+        if (pageoutd_running) {
+                workqueue_cancel_delayed(&pageoutd_writeback_work);
+                workqueue_submit_delayed(&pageoutd_wq, &pageoutd_writeback_work,
+                                         msecs_to_jiffies(PAGEOUTD_WRITEBACK_MSECS));
+        }
+        dbg(DBG_PFRAME, "PAGEOUT DEMAON: Falling asleep\n");
+}
+
+/*
+ * Runs when pageoutd has not been woken for PAGEOUTD_WRITEBACK_MSECS,
+ * and queues itself to run again as long after that.
+ */
+static void
+pageoutd_writeback_run(work_t *work)
+{
+        dbg(DBG_PFRAME, "PAGEOUT DEMAON: Writing back\n");
+        pageoutd_writeback();
+        if (pageoutd_running) {
+                workqueue_submit_delayed(&pageoutd_wq, &pageoutd_writeback_work,
+                                         msecs_to_jiffies(PAGEOUTD_WRITEBACK_MSECS));
         }
-        return NULL;
 }
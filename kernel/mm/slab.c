@@ -20,6 +20,7 @@
 #include "util/gdb.h"
 #include "util/string.h"
 #include "util/debug.h"
+#include "util/spinlock.h"
 
 #ifdef SLAB_REDZONE
 #define front_rz(obj)           (*(uintptr_t*)(obj))
@@ -51,6 +52,7 @@ struct slab_allocator {
         struct slab             *sa_slabs;      /* head of slab list */
         int                      sa_order;      /* npages = (1 << order) */
         int                      sa_slab_nobjs; /* number of objs per slab */
+        spinlock_t               sa_lock;       /* for SMP, see below */
 };
 
 struct slab_bufctl {
@@ -173,6 +175,7 @@ _allocator_init(struct slab_allocator *allocator, const char *name, size_t size)
         allocator->sa_name = name;
         allocator->sa_objsize = size;
         allocator->sa_slabs = NULL;
+        spinlock_init(&allocator->sa_lock);
         _calc_slab_size(allocator);
 
         /* Add cache to global cache list. */
@@ -259,11 +262,17 @@ _slab_allocator_grow(struct slab_allocator *allocator)
         return 1;
 }
 
+/*
+ * With SMP each allocator has a spin lock, taken with interrupts
+ * disabled since interrupt handlers allocate too. The kernel lock makes
+ * it redundant for now (see main/smp.h).
+ */
 void *
 slab_obj_alloc(struct slab_allocator *allocator)
 {
         struct slab *slab;
         void *obj;
+        uint32_t flags = spin_lock_irqsave(&allocator->sa_lock);
 
         /* Find a slab with a free object. */
         for (;;) {
@@ -272,8 +281,10 @@ slab_obj_alloc(struct slab_allocator *allocator)
                         slab = slab->s_next;
                 if (slab && (slab->s_inuse < allocator->sa_slab_nobjs))
                         break;
-                if (!_slab_allocator_grow(allocator))
+                if (!_slab_allocator_grow(allocator)) {
+                        spin_unlock_irqrestore(&allocator->sa_lock, flags);
                         return NULL;
+                }
         }
 
         /*
@@ -293,6 +304,7 @@ slab_obj_alloc(struct slab_allocator *allocator)
         dbg(DBG_MM, "Allocated object 0x%p from \"%s\" (0x%p), "
             "slab 0x%p, inuse %d\n", obj, allocator->sa_name,
             allocator, allocator, slab->s_inuse);
+        spin_unlock_irqrestore(&allocator->sa_lock, flags);
 
 #ifdef SLAB_REDZONE
         VERIFY_REDZONES(allocator, obj);
@@ -325,6 +337,7 @@ slab_obj_free(struct slab_allocator *allocator, void *obj)
         obj_bufctl(allocator, obj)->sb_free = 1;
 #endif
 
+        uint32_t flags = spin_lock_irqsave(&allocator->sa_lock);
         slab = obj_bufctl(allocator, obj)->sb_slab;
 
         /* Place this object back on the slab's free list. */
@@ -335,6 +348,7 @@ slab_obj_free(struct slab_allocator *allocator, void *obj)
 
         dbg(DBG_MM, "Freed object 0x%p from \"%s\" (0x%p), slab 0x%p, inuse %d\n",
             obj, allocator->sa_name, allocator, slab, slab->s_inuse);
+        spin_unlock_irqrestore(&allocator->sa_lock, flags);
 }
 
 /*
@@ -354,6 +368,7 @@ slab_allocators_reclaim(int target)
 
         /* Go through all caches */
         for (a = slab_allocators; NULL != a; a = a->sa_next) {
+                uint32_t flags = spin_lock_irqsave(&a->sa_lock);
                 prev = &(a->sa_slabs);
                 s = a->sa_slabs;
                 while (NULL != s) {
@@ -370,10 +385,12 @@ slab_allocators_reclaim(int target)
                         }
                         /* Check if target was met */
                         if ((target > 0) && (npages_freed >= target)) {
+                                spin_unlock_irqrestore(&a->sa_lock, flags);
                                 return npages_freed;
                         }
                         s = next;
                 }
+                spin_unlock_irqrestore(&a->sa_lock, flags);
         }
         return npages_freed;
 }
@@ -0,0 +1,184 @@
+#include "globals.h"
+#include "errno.h"
+#include "types.h"
+
+#include "util/debug.h"
+#include "util/init.h"
+#include "util/list.h"
+#include "util/time.h"
+
+#include "proc/futex.h"
+#include "proc/kthread.h"
+#include "proc/proc.h"
+#include "proc/sched.h"
+
+#include "mm/mm.h"
+#include "mm/mman.h"
+#include "mm/mmobj.h"
+#include "mm/page.h"
+
+#include "vm/vmmap.h"
+
+#include "api/access.h"
+#include "api/time.h"
+
+typedef struct futex_key {
+        void           *fk_obj;         /* mmobj_t if fk_shared, else vmmap_t */
+        uint32_t        fk_off;         /* byte offset in the mmobj, or address */
+        int             fk_shared;
+} futex_key_t;
+
+/*
+ * A thread waiting on a futex. It lives on the waiter's stack, and
+ * sits in its futex's hash chain until it is woken or gives up. Each
+ * waiter sleeps on its own queue, so that do_futex_wake() wakes
+ * exactly the threads waiting on the right futex even when several
+ * futexes share a chain.
+ */
+typedef struct futex_waiter {
+        futex_key_t     fw_key;
+        int             fw_woken;
+        ktqueue_t       fw_waitq;
+        list_link_t     fw_link;
+} futex_waiter_t;
+
+static list_t futex_hash[FUTEX_HASH_SIZE];
+
+static list_t *
+futex_chain(const futex_key_t *key)
+{
+        uint32_t h = ((uint32_t) key->fk_obj >> 4) ^ (key->fk_off >> 2);
+        return &futex_hash[h % FUTEX_HASH_SIZE];
+}
+
+static void
+futex_init(void)
+{
+        int i;
+
+        for (i = 0; i < FUTEX_HASH_SIZE; ++i) {
+                list_init(&futex_hash[i]);
+        }
+}
+init_func(futex_init);
+
+/*
+ * Finds the key of the futex at uaddr. A shared key holds a reference
+ * to its mmobj (dropped with futex_put_key()), so that the object
+ * cannot go away and be reused by a different futex while a thread
+ * waits on it.
+ */
+static int
+futex_get_key(int *uaddr, futex_key_t *key)
+{
+        vmarea_t *vma;
+        uint32_t vfn = ADDR_TO_PN(uaddr);
+
+        if (0 != (uint32_t) uaddr % sizeof(int)) {
+                return -EINVAL;
+        }
+        if (NULL == (vma = vmmap_lookup(curproc->p_vmmap, vfn))) {
+                return -EFAULT;
+        }
+
+        if (vma->vma_flags & MAP_SHARED) {
+                key->fk_obj = vma->vma_obj;
+                key->fk_off = (vma->vma_off + vfn - vma->vma_start) * PAGE_SIZE
+                              + PAGE_OFFSET(uaddr);
+                key->fk_shared = 1;
+                vma->vma_obj->mmo_ops->ref(vma->vma_obj);
+        } else {
+                key->fk_obj = curproc->p_vmmap;
+                key->fk_off = (uint32_t) uaddr;
+                key->fk_shared = 0;
+        }
+        return 0;
+}
+
+static void
+futex_put_key(futex_key_t *key)
+{
+        if (key->fk_shared) {
+                mmobj_t *obj = key->fk_obj;
+                obj->mmo_ops->put(obj);
+        }
+}
+
+int
+do_futex_wait(int *uaddr, int val, const struct timespec *timeout)
+{
+        futex_waiter_t fw;
+        uint32_t ticks = 0;
+        int cur, ret;
+
+        if (NULL != timeout) {
+                if (timeout->tv_sec < 0 || timeout->tv_nsec < 0
+                    || timeout->tv_nsec >= 1000000000) {
+                        return -EINVAL;
+                }
+                ticks = timespec_to_jiffies(timeout);
+        }
+        if (0 > (ret = futex_get_key(uaddr, &fw.fw_key))) {
+                return ret;
+        }
+
+        /* Go on the chain before reading the word: reading it may fault
+         * and block, and a wakeup which comes in meanwhile must still
+         * find us. */
+        fw.fw_woken = 0;
+        sched_queue_init(&fw.fw_waitq);
+        list_link_init(&fw.fw_link);
+        list_insert_tail(futex_chain(&fw.fw_key), &fw.fw_link);
+
+        if (0 <= (ret = copy_from_user(&cur, uaddr, sizeof(cur)))
+            && !fw.fw_woken) {
+                if (cur != val) {
+                        ret = -EAGAIN;
+                } else if (NULL == timeout) {
+                        ret = sched_cancellable_sleep_on(&fw.fw_waitq);
+                } else {
+                        ret = sched_cancellable_sleep_on_timeout(&fw.fw_waitq, ticks);
+                }
+                /* a wakeup which raced with the timeout or a cancel has
+                 * been consumed, so report it */
+                if (fw.fw_woken) {
+                        ret = 0;
+                }
+        }
+
+        if (list_link_is_linked(&fw.fw_link)) {
+                list_remove(&fw.fw_link);
+        }
+        futex_put_key(&fw.fw_key);
+        return ret;
+}
+
+int
+do_futex_wake(int *uaddr, int n)
+{
+        futex_key_t key;
+        futex_waiter_t *fw;
+        list_t *chain;
+        int ret, woken = 0;
+
+        if (0 > (ret = futex_get_key(uaddr, &key))) {
+                return ret;
+        }
+
+        chain = futex_chain(&key);
+        list_iterate_begin(chain, fw, futex_waiter_t, fw_link) {
+                if (woken >= n) {
+                        break;
+                }
+                if (fw->fw_key.fk_obj == key.fk_obj
+                    && fw->fw_key.fk_off == key.fk_off) {
+                        list_remove(&fw->fw_link);
+                        fw->fw_woken = 1;
+                        sched_wakeup_on(&fw->fw_waitq);
+                        ++woken;
+                }
+        } list_iterate_end();
+
+        futex_put_key(&key);
+        return woken;
+}
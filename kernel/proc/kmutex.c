@@ -3,6 +3,8 @@
 
 #include "util/debug.h"
 
+#include "main/cpuid.h"
+
 #include "proc/kthread.h"
 #include "proc/kmutex.h"
 
@@ -12,13 +14,48 @@
  * thread context.
  */
 
+/*
+ * Lock statistics. kmutex_stat_contended() is called before sleeping
+ * and returns the time, which is passed on to kmutex_stat_acquired(),
+ * or 0 if the lock was not contended.
+ */
+#ifdef __LOCKSTAT__
+static uint64_t
+kmutex_stat_contended(kmutex_t *mtx)
+{
+        lockstat_contended(mtx->km_stat, mtx->km_holder);
+        return rdtsc();
+}
+
+static void
+kmutex_stat_acquired(kmutex_t *mtx, uint64_t start)
+{
+        mtx->km_locked_at = rdtsc();
+        lockstat_acquired(mtx->km_stat, start ? mtx->km_locked_at - start : 0);
+}
+
+static void
+kmutex_stat_released(kmutex_t *mtx)
+{
+        lockstat_released(mtx->km_stat, rdtsc() - mtx->km_locked_at);
+}
+#else
+#define kmutex_stat_contended(mtx)              0
+#define kmutex_stat_acquired(mtx, start)        ((void) (start))
+#define kmutex_stat_released(mtx)
+#endif
+
 void
-kmutex_init(kmutex_t *mtx)
+kmutex_init_named(kmutex_t *mtx, const char *name)
 {
         /* PROCS {{{ */
         mtx->km_holder = NULL;
         sched_queue_init(&mtx->km_waitq);
         /* PROCS }}} */
+#ifdef __LOCKSTAT__
+        mtx->km_stat = lockstat_lookup(name);
+        mtx->km_locked_at = 0;
+#endif
 }
 
 /*
@@ -30,16 +67,20 @@ kmutex_init(kmutex_t *mtx)
 void
 kmutex_lock(kmutex_t *mtx)
 {
+        uint64_t start = 0;
+
         /* PROCS {{{ */
         KASSERT(curthr && (curthr != mtx->km_holder) && "already owner!!");
         /* if someone owns the mutex, go to sleep */
         if (NULL != mtx->km_holder) {
+                start = kmutex_stat_contended(mtx);
                 sched_sleep_on(&mtx->km_waitq);
                 KASSERT(curthr && (curthr == mtx->km_holder));
         } else {
                 mtx->km_holder = curthr;
         }
         /* PROCS }}} */
+        kmutex_stat_acquired(mtx, start);
 }
 
 /*
@@ -49,10 +90,13 @@ kmutex_lock(kmutex_t *mtx)
 int
 kmutex_lock_cancellable(kmutex_t *mtx)
 {
+        uint64_t start = 0;
+
         /* PROCS {{{ */
         KASSERT(curthr && (curthr != mtx->km_holder) && "already owner!!");
         /* if someone owns the mutex, go to sleep */
         if (NULL != mtx->km_holder) {
+                start = kmutex_stat_contended(mtx);
                 if (sched_cancellable_sleep_on(&mtx->km_waitq)) {
                         KASSERT(curthr);
                         KASSERT(curthr != mtx->km_holder);
@@ -64,6 +108,7 @@ kmutex_lock_cancellable(kmutex_t *mtx)
                 mtx->km_holder = curthr;
         }
         /* PROCS }}} */
+        kmutex_stat_acquired(mtx, start);
         return 0;
 }
 
@@ -86,6 +131,7 @@ kmutex_unlock(kmutex_t *mtx)
 {
         /* PROCS {{{ */
         KASSERT(curthr && (curthr == mtx->km_holder) && "unlocking a mutex we don\'t own");
+        kmutex_stat_released(mtx);
         mtx->km_holder = sched_wakeup_on(&mtx->km_waitq);
         KASSERT(curthr != mtx->km_holder);
         /* PROCS }}} */
@@ -0,0 +1,183 @@
+#include "globals.h"
+#include "errno.h"
+
+#include "util/debug.h"
+
+#include "main/cpuid.h"
+
+#include "proc/kthread.h"
+#include "proc/krwlock.h"
+
+/*
+ * Like mutexes, reader-writer locks are only ever locked or unlocked
+ * from a thread context.
+ *
+ * Unlike kmutex_unlock(), unlocking does not hand the lock over to
+ * the threads it wakes. They recheck whether they can take it when
+ * they run, so a thread which is cancelled after being woken simply
+ * gives up, and passes the wakeup on (see krwlock_wake()).
+ */
+
+#define krwlock_can_read(rw)    \
+        (NULL == (rw)->krw_writer && 0 == (rw)->krw_wwaiting)
+#define krwlock_can_write(rw)   \
+        (NULL == (rw)->krw_writer && 0 == (rw)->krw_readers)
+
+/*
+ * Lock statistics, as for kmutexes (see kmutex.c). Only the time the
+ * lock is held for writing is counted.
+ */
+#ifdef __LOCKSTAT__
+static uint64_t
+krwlock_stat_contended(krwlock_t *rw)
+{
+        lockstat_contended(rw->krw_stat, rw->krw_writer);
+        return rdtsc();
+}
+
+static void
+krwlock_stat_acquired(krwlock_t *rw, uint64_t start)
+{
+        uint64_t now = rdtsc();
+
+        if (curthr == rw->krw_writer) {
+                rw->krw_locked_at = now;
+        }
+        lockstat_acquired(rw->krw_stat, start ? now - start : 0);
+}
+
+static void
+krwlock_stat_released(krwlock_t *rw)
+{
+        if (curthr == rw->krw_writer) {
+                lockstat_released(rw->krw_stat, rdtsc() - rw->krw_locked_at);
+        }
+}
+#else
+#define krwlock_stat_contended(rw)              0
+#define krwlock_stat_acquired(rw, start)        ((void) (start))
+#define krwlock_stat_released(rw)
+#endif
+
+void
+krwlock_init_named(krwlock_t *rw, const char *name)
+{
+        sched_queue_init(&rw->krw_rdq);
+        sched_queue_init(&rw->krw_wrq);
+        rw->krw_readers = 0;
+        rw->krw_wwaiting = 0;
+        rw->krw_writer = NULL;
+#ifdef __LOCKSTAT__
+        rw->krw_stat = lockstat_lookup(name);
+        rw->krw_locked_at = 0;
+#endif
+}
+
+/*
+ * Wakes whoever may be able to take the lock: the first waiting
+ * writer if the lock is free, or else every waiting reader if no
+ * writer holds or wants the lock.
+ */
+static void
+krwlock_wake(krwlock_t *rw)
+{
+        if (NULL != rw->krw_writer) {
+                return;
+        }
+        if (0 == rw->krw_readers && NULL != sched_wakeup_on(&rw->krw_wrq)) {
+                return;
+        }
+        if (0 == rw->krw_wwaiting) {
+                sched_broadcast_on(&rw->krw_rdq);
+        }
+}
+
+void
+krwlock_rdlock(krwlock_t *rw)
+{
+        uint64_t start = 0;
+
+        KASSERT(curthr && (curthr != rw->krw_writer) && "already owner!!");
+        if (!krwlock_can_read(rw)) {
+                start = krwlock_stat_contended(rw);
+                sched_wait_event(&rw->krw_rdq, krwlock_can_read(rw));
+        }
+        rw->krw_readers++;
+        krwlock_stat_acquired(rw, start);
+}
+
+int
+krwlock_rdlock_cancellable(krwlock_t *rw)
+{
+        uint64_t start = 0;
+
+        KASSERT(curthr && (curthr != rw->krw_writer) && "already owner!!");
+        if (!krwlock_can_read(rw)) {
+                start = krwlock_stat_contended(rw);
+        }
+        while (!krwlock_can_read(rw)) {
+                if (sched_cancellable_sleep_on(&rw->krw_rdq)) {
+                        KASSERT(curthr->kt_cancelled);
+                        krwlock_wake(rw);
+                        return -EINTR;
+                }
+        }
+        rw->krw_readers++;
+        krwlock_stat_acquired(rw, start);
+        return 0;
+}
+
+void
+krwlock_wrlock(krwlock_t *rw)
+{
+        uint64_t start = 0;
+
+        KASSERT(curthr && (curthr != rw->krw_writer) && "already owner!!");
+        if (!krwlock_can_write(rw)) {
+                start = krwlock_stat_contended(rw);
+        }
+        rw->krw_wwaiting++;
+        sched_wait_event(&rw->krw_wrq, krwlock_can_write(rw));
+        rw->krw_wwaiting--;
+        rw->krw_writer = curthr;
+        krwlock_stat_acquired(rw, start);
+}
+
+int
+krwlock_wrlock_cancellable(krwlock_t *rw)
+{
+        uint64_t start = 0;
+
+        KASSERT(curthr && (curthr != rw->krw_writer) && "already owner!!");
+        if (!krwlock_can_write(rw)) {
+                start = krwlock_stat_contended(rw);
+        }
+        rw->krw_wwaiting++;
+        while (!krwlock_can_write(rw)) {
+                if (sched_cancellable_sleep_on(&rw->krw_wrq)) {
+                        KASSERT(curthr->kt_cancelled);
+                        rw->krw_wwaiting--;
+                        krwlock_wake(rw);
+                        return -EINTR;
+                }
+        }
+        rw->krw_wwaiting--;
+        rw->krw_writer = curthr;
+        krwlock_stat_acquired(rw, start);
+        return 0;
+}
+
+void
+krwlock_unlock(krwlock_t *rw)
+{
+        KASSERT(curthr);
+        krwlock_stat_released(rw);
+        if (NULL != rw->krw_writer) {
+                KASSERT(curthr == rw->krw_writer && "unlocking a lock we don\'t own");
+                rw->krw_writer = NULL;
+        } else {
+                KASSERT(0 < rw->krw_readers && "unlocking a lock nobody holds");
+                rw->krw_readers--;
+        }
+        krwlock_wake(rw);
+}
@@ -8,24 +8,32 @@
 #include "util/list.h"
 #include "util/string.h"
 
+#include "main/cpuid.h"
+#include "main/fpu.h"
+
 #include "proc/kthread.h"
 #include "proc/proc.h"
 #include "proc/sched.h"
+#include "proc/workqueue.h"
 
 #include "mm/slab.h"
 #include "mm/page.h"
+#include "mm/kstack.h"
+
+#include "vm/mmap.h"
 
+#ifndef __SMP__
 kthread_t *curthr; /* global */
+#endif
 static slab_allocator_t *kthread_allocator = NULL;
 
 #ifdef __MTP__
 /* Stuff for the reaper daemon, which cleans up dead detached threads */
-static proc_t *reapd = NULL;
-static kthread_t *reapd_thr = NULL;
-static ktqueue_t reapd_waitq;
+static workqueue_t reapd_wq;
+static work_t reapd_work;
 static list_t kthread_reapd_deadlist; /* Threads to be cleaned */
 
-static void *kthread_reapd_run(int arg1, void *arg2);
+static void kthread_reapd_run(work_t *work);
 #endif
 
 void
@@ -33,10 +41,14 @@ kthread_init()
 {
         kthread_allocator = slab_allocator_create("kthread", sizeof(kthread_t));
         KASSERT(NULL != kthread_allocator);
+
+        kstack_init();
 }
 
 /**
- * Allocates a new kernel stack.
+ * Allocates a new kernel stack. Stacks come from the kernel stack
+ * region (see mm/kstack.h), which puts an unmapped guard page below
+ * each of them and recycles freed stacks.
  *
  * @return a newly allocated stack, or NULL if there is not enough
  * memory available
@@ -44,12 +56,7 @@ kthread_init()
 static char *
 alloc_stack(void)
 {
-        /* extra page for "magic" data */
-        char *kstack;
-        int npages = 1 + (DEFAULT_STACK_SIZE >> PAGE_SHIFT);
-        kstack = (char *)page_alloc_n(npages);
-
-        return kstack;
+        return (char *)kstack_alloc(DEFAULT_STACK_SIZE);
 }
 
 /**
@@ -60,7 +67,7 @@ alloc_stack(void)
 static void
 free_stack(char *stack)
 {
-        page_free_n(stack, 1 + (DEFAULT_STACK_SIZE >> PAGE_SHIFT));
+        kstack_free(stack, DEFAULT_STACK_SIZE);
 }
 
 /*
@@ -92,15 +99,35 @@ kthread_create(struct proc *p, kthread_func_t func, long arg1, void *arg2)
 #ifdef __MTP__
         nt->kt_detached = 0;
         sched_queue_init(&nt->kt_joinq);
+        nt->kt_tid = p->p_nexttid++;
+        nt->kt_ustack = NULL;
+        nt->kt_ustacksz = 0;
 #endif
         nt->kt_retval = (void *) 0;
         nt->kt_errno = 0;
         nt->kt_proc = p;
         nt->kt_cancelled = 0;
         nt->kt_wchan = NULL;
+        nt->kt_wexclusive = 0;
+        nt->kt_fpu = NULL;
         nt->kt_state = KT_RUN;
         nt->kt_qlink.l_next = NULL;
         nt->kt_qlink.l_prev = NULL;
+        nt->kt_sched_class = SCHED_FAIR;
+        nt->kt_vruntime = 0;
+        nt->kt_sched_start = rdtsc();
+        nt->kt_runnable_at = 0;
+        nt->kt_utime = 0;
+        nt->kt_stime = 0;
+        nt->kt_acct_start = nt->kt_sched_start;
+        nt->kt_npageins = 0;
+#ifdef __SMP__
+        nt->kt_cpu = smp_cpuid();
+#endif
+#ifdef __UPREEMPT__
+        nt->kt_ticks = 0;
+        nt->kt_need_resched = 0;
+#endif
         list_insert_before(&p->p_threads, &nt->kt_plink);
 
         dbg(DBG_THR, "created thread 0x%p of proc %d (0x%p)\n", nt, p->p_pid, p);
@@ -113,6 +140,7 @@ void
 kthread_destroy(kthread_t *t)
 {
         KASSERT(t && t->kt_kstack);
+        fpu_release(t);
         free_stack(t->kt_kstack);
         if (list_link_is_linked(&t->kt_plink))
                 list_remove(&t->kt_plink);
@@ -162,7 +190,17 @@ void
 kthread_exit(void *retval)
 {
         /* PROCS {{{ */
+        KASSERT(!curthr->kt_wchan);
+        KASSERT(!curthr->kt_qlink.l_next && !curthr->kt_qlink.l_prev);
+        KASSERT(curthr->kt_proc == curproc);
+
 #ifdef __MTP__
+        /* the user stack mapped by thr_create is ours alone */
+        if (NULL != curthr->kt_ustack) {
+                do_munmap(curthr->kt_ustack, curthr->kt_ustacksz);
+                curthr->kt_ustack = NULL;
+        }
+
         if (curthr->kt_detached) {
                 /* Need to move off the process thread
                  * list and onto the reaper list */
@@ -170,19 +208,21 @@ kthread_exit(void *retval)
                 list_insert_before(&kthread_reapd_deadlist, &curthr->kt_plink);
                 curthr->kt_proc = NULL; /* Just in case... */
                 /* Wake up the reaper */
-                sched_broadcast_on(&reapd_waitq);
+                workqueue_submit(&reapd_wq, &reapd_work);
         } else {
                 sched_broadcast_on(&curthr->kt_joinq);
         }
 #endif
 
+        /* the process keeps the CPU time of its exited threads */
+        uint64_t utime, stime;
+        sched_cputime(curthr, &utime, &stime);
+        curproc->p_utime += utime;
+        curproc->p_stime += stime;
+
         curthr->kt_state = KT_EXITED;
         curthr->kt_retval = retval;
 
-        KASSERT(!curthr->kt_wchan);
-        KASSERT(!curthr->kt_qlink.l_next && !curthr->kt_qlink.l_prev);
-        KASSERT(curthr->kt_proc == curproc);
-
         proc_thread_exited(retval);
         /* PROCS }}} */
 }
@@ -190,7 +230,9 @@ kthread_exit(void *retval)
 /*
  * The new thread will need its own context and stack. Think carefully
  * about which fields should be copied and which fields should be
- * freshly initialized.
+ * freshly initialized. (The clone should stay in thr's scheduling
+ * class and inherit its kt_vruntime, so that forking does not get a
+ * process extra CPU time.)
  *
  * You do not need to worry about this until VM.
  */
@@ -210,14 +252,44 @@ kthread_clone(kthread_t *thr)
 int
 kthread_detach(kthread_t *kthr)
 {
-        NOT_YET_IMPLEMENTED("MTP: kthread_detach");
+        KASSERT(NULL != kthr && kthr->kt_proc == curproc);
+
+        if (kthr->kt_detached || !sched_queue_empty(&kthr->kt_joinq)) {
+                return -EINVAL;
+        }
+        if (KT_EXITED == kthr->kt_state) {
+                /* nobody is going to join it now */
+                kthread_destroy(kthr);
+        } else {
+                kthr->kt_detached = 1;
+        }
         return 0;
 }
 
 int
 kthread_join(kthread_t *kthr, void **retval)
 {
-        NOT_YET_IMPLEMENTED("MTP: kthread_join");
+        KASSERT(NULL != kthr && kthr->kt_proc == curproc);
+
+        if (kthr == curthr) {
+                return -EDEADLK;
+        }
+        /* only one thread may wait for kthr, since the first one to
+         * see it exit frees it */
+        if (kthr->kt_detached || !sched_queue_empty(&kthr->kt_joinq)) {
+                return -EINVAL;
+        }
+
+        while (KT_EXITED != kthr->kt_state) {
+                if (0 > sched_cancellable_sleep_on(&kthr->kt_joinq)) {
+                        return -EINTR;
+                }
+        }
+
+        if (NULL != retval) {
+                *retval = kthr->kt_retval;
+        }
+        kthread_destroy(kthr);
         return 0;
 }
 
@@ -227,21 +299,39 @@ kthread_join(kthread_t *kthr, void **retval)
 static __attribute__((unused)) void
 kthread_reapd_init()
 {
-        NOT_YET_IMPLEMENTED("MTP: kthread_reapd_init");
+        list_init(&kthread_reapd_deadlist);
+        work_init(&reapd_work, kthread_reapd_run);
+
+        KASSERT(NULL != curproc && PID_IDLE == curproc->p_pid);
+        if (0 > workqueue_init(&reapd_wq, "reapd", 1)) {
+                panic("could not start reapd\n");
+        }
 }
 init_func(kthread_reapd_init);
-init_depends(sched_init);
+init_depends(workqueue_sysinit);
 
 void
 kthread_reapd_shutdown()
 {
-        NOT_YET_IMPLEMENTED("MTP: kthread_reapd_shutdown");
+        KASSERT(NULL != curproc && PID_IDLE == curproc->p_pid);
+        workqueue_destroy(&reapd_wq);
 }
 
-static void *
-kthread_reapd_run(int arg1, void *arg2)
+/*
+ * Frees detached threads once they have exited. A thread cannot free
+ * its own kernel stack, and since nobody will join a detached thread
+ * the job falls to us. A dying thread queues this work on its way out,
+ * so by the time it runs the dead threads have switched away for the
+ * last time. Any that die while it runs queue it again.
+ */
+static void
+kthread_reapd_run(work_t *work)
 {
-        NOT_YET_IMPLEMENTED("MTP: kthread_reapd_run");
-        return (void *) 0;
+        kthread_t *thr;
+
+        list_iterate_begin(&kthread_reapd_deadlist, thr, kthread_t, kt_plink) {
+                KASSERT(KT_EXITED == thr->kt_state);
+                kthread_destroy(thr);
+        } list_iterate_end();
 }
 #endif
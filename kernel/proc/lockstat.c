@@ -0,0 +1,172 @@
+#include "globals.h"
+#include "types.h"
+
+#include "proc/kthread.h"
+#include "proc/lockstat.h"
+#include "proc/proc.h"
+
+#include "util/debug.h"
+#include "util/printf.h"
+#include "util/string.h"
+#include "util/time.h"
+
+#ifdef __LOCKSTAT__
+/*
+ * The lock table. Entries are added as locks are initialized and never
+ * removed. The last entry is kept back for "(other)": once every other
+ * entry has been taken, further names are all counted there, so the
+ * locks which already have an entry keep it to themselves.
+ */
+#define LOCKSTAT_OTHER          (LOCKSTAT_NLOCKS - 1)
+
+static lockstat_t lockstat_table[LOCKSTAT_NLOCKS];
+static int lockstat_nlocks;     /* named entries in use */
+static int lockstat_overflow;   /* 1 once "(other)" is in use */
+
+/* The number of entries in use, "(other)" included, which is always
+ * the last of them */
+#define LOCKSTAT_NUSED          (lockstat_nlocks + lockstat_overflow)
+
+/* Strips an initializer expression like "&adisk->ata_mutex" down to
+ * the member name. */
+static const char *
+lockstat_basename(const char *name)
+{
+        const char *p, *base = name;
+
+        for (p = name; *p; ++p) {
+                if ('&' == *p || '.' == *p || '>' == *p || '(' == *p) {
+                        base = p + 1;
+                }
+        }
+        return base;
+}
+
+lockstat_t *
+lockstat_lookup(const char *name)
+{
+        lockstat_t *ls;
+        int i;
+
+        name = lockstat_basename(name);
+        for (i = 0; i < lockstat_nlocks; ++i) {
+                if (0 == strncmp(lockstat_table[i].ls_name, name,
+                                 LOCKSTAT_COMM_LEN - 1)) {
+                        return &lockstat_table[i];
+                }
+        }
+
+        if (LOCKSTAT_OTHER == lockstat_nlocks) {
+                ls = &lockstat_table[LOCKSTAT_OTHER];
+                if (!lockstat_overflow) {
+                        memset(ls, 0, sizeof(*ls));
+                        strncpy(ls->ls_name, "(other)", LOCKSTAT_COMM_LEN - 1);
+                        ls->ls_holder_pid = -1;
+                        lockstat_overflow = 1;
+                }
+                return ls;
+        }
+
+        ls = &lockstat_table[lockstat_nlocks++];
+        memset(ls, 0, sizeof(*ls));
+        strncpy(ls->ls_name, name, LOCKSTAT_COMM_LEN - 1);
+        ls->ls_holder_pid = -1;
+        return ls;
+}
+
+void
+lockstat_contended(lockstat_t *ls, kthread_t *holder)
+{
+        ls->ls_ncontended++;
+        if (NULL == holder) {
+                ls->ls_holder_pid = -1;
+                strncpy(ls->ls_holder_comm, "(readers)", LOCKSTAT_COMM_LEN);
+        } else {
+                ls->ls_holder_pid = holder->kt_proc->p_pid;
+                strncpy(ls->ls_holder_comm, holder->kt_proc->p_comm,
+                        LOCKSTAT_COMM_LEN - 1);
+                ls->ls_holder_comm[LOCKSTAT_COMM_LEN - 1] = '\0';
+        }
+}
+
+void
+lockstat_acquired(lockstat_t *ls, uint64_t waited)
+{
+        ls->ls_nacquired++;
+        ls->ls_wait_total += waited;
+        ls->ls_wait_max = MAX(ls->ls_wait_max, waited);
+}
+
+void
+lockstat_released(lockstat_t *ls, uint64_t held)
+{
+        ls->ls_hold_total += held;
+}
+
+void
+lockstat_reset(void)
+{
+        lockstat_t *ls;
+        int i;
+
+        for (i = 0; i < LOCKSTAT_NUSED; ++i) {
+                ls = &lockstat_table[i];
+                ls->ls_nacquired = 0;
+                ls->ls_ncontended = 0;
+                ls->ls_wait_total = 0;
+                ls->ls_wait_max = 0;
+                ls->ls_hold_total = 0;
+                ls->ls_holder_pid = -1;
+                ls->ls_holder_comm[0] = '\0';
+        }
+}
+
+size_t
+lockstat_info(const void *arg, char *buf, size_t osize)
+{
+        size_t size = osize;
+        char shown[LOCKSTAT_NLOCKS];
+        lockstat_t *ls, *top;
+        int i, n;
+
+        KASSERT(NULL == arg);
+
+        memset(shown, 0, sizeof(shown));
+        iprintf(&buf, &size, "%-15s %8s %8s %12s %12s %12s  %s\n",
+                "LOCK", "ACQUIRED", "WAITED", "WAIT (us)", "MAX (us)",
+                "HELD (us)", "LAST HOLDER");
+
+        /* the lock table is small, so pick the most contended lock
+         * LOCKSTAT_NTOP times */
+        for (n = 0; n < LOCKSTAT_NTOP; ++n) {
+                top = NULL;
+                for (i = 0; i < LOCKSTAT_NUSED; ++i) {
+                        ls = &lockstat_table[i];
+                        if (!shown[i] && (NULL == top
+                                          || ls->ls_ncontended > top->ls_ncontended
+                                          || (ls->ls_ncontended == top->ls_ncontended
+                                              && ls->ls_nacquired > top->ls_nacquired))) {
+                                top = ls;
+                        }
+                }
+                if (NULL == top || 0 == top->ls_nacquired) {
+                        break;
+                }
+                shown[top - lockstat_table] = 1;
+
+                iprintf(&buf, &size, "%-15s %8u %8u %12llu %12llu %12llu  ",
+                        top->ls_name, top->ls_nacquired, top->ls_ncontended,
+                        cycles_to_ns(top->ls_wait_total) / 1000,
+                        cycles_to_ns(top->ls_wait_max) / 1000,
+                        cycles_to_ns(top->ls_hold_total) / 1000);
+                if (0 == top->ls_ncontended) {
+                        iprintf(&buf, &size, "-\n");
+                } else {
+                        iprintf(&buf, &size, "%i %s\n", top->ls_holder_pid,
+                                top->ls_holder_comm);
+                }
+        }
+
+        return size;
+}
+#endif /* __LOCKSTAT__ */
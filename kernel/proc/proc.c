@@ -7,11 +7,14 @@
 #include "util/list.h"
 #include "util/string.h"
 #include "util/printf.h"
+#include "util/bits.h"
+#include "util/time.h"
 
 #include "proc/kthread.h"
 #include "proc/proc.h"
 #include "proc/sched.h"
 #include "proc/proc.h"
+#include "proc/reaper.h"
 
 #include "mm/slab.h"
 #include "mm/page.h"
@@ -25,50 +28,77 @@
 #include "fs/vfs_syscall.h"
 #include "fs/vnode.h"
 #include "fs/file.h"
+#include "api/vdata.h"
+#include "api/resource.h"
 
+#ifndef __SMP__
 proc_t *curproc = NULL; /* global */
+#endif
 static slab_allocator_t *proc_allocator = NULL;
 
 static list_t _proc_list;
 static proc_t *proc_initproc = NULL; /* Pointer to the init process (PID 1) */
 
+/* One bit per PID, set while the PID belongs to a process (including
+ * one which has exited but not been waited for) */
+static uint32_t _proc_pidmap[PROC_MAX_COUNT / 32];
+static pid_t next_pid = 0;
+
+/* pid -> proc_t, chained through p_hash_link */
+static list_t _proc_hash[PROC_HASH_SIZE];
+#define proc_hash(pid) (&_proc_hash[(uint32_t)(pid) % PROC_HASH_SIZE])
+
 void
 proc_init()
 {
+        int i;
+
         list_init(&_proc_list);
+        for (i = 0; i < PROC_HASH_SIZE; ++i)
+                list_init(&_proc_hash[i]);
         proc_allocator = slab_allocator_create("proc", sizeof(proc_t));
         KASSERT(proc_allocator != NULL);
 }
 
-static pid_t next_pid = 0;
-
 /**
- * Returns the next available PID.
+ * Returns the next available PID and marks it as in use. Starts at
+ * the PID after the last one handed out, so PIDs are not reused any
+ * sooner than necessary, and skips a whole word of the bitmap at a
+ * time when all of its PIDs are taken.
  *
- * Note: Where n is the number of running processes, this algorithm is
- * worst case O(n^2). As long as PIDs never wrap around it is O(n).
- *
- * @return the next available PID
+ * @return the next available PID, or -1 if there are none
  */
 static int
 _proc_getid()
 {
-        proc_t *p;
-        pid_t pid = next_pid;
-        while (1) {
-failed:
-                list_iterate_begin(&_proc_list, p, proc_t, p_list_link) {
-                        if (p->p_pid == pid) {
-                                if ((pid = (pid + 1) % PROC_MAX_COUNT) == next_pid) {
-                                        return -1;
-                                } else {
-                                        goto failed;
-                                }
-                        }
-                } list_iterate_end();
-                next_pid = (pid + 1) % PROC_MAX_COUNT;
-                return pid;
+        uint32_t pid = next_pid;
+        uint32_t n = 0;
+
+        while (n < PROC_MAX_COUNT) {
+                if (0xffffffff == _proc_pidmap[pid >> 5]) {
+                        n += 32 - (pid & 0x1f);
+                        pid = ((pid | 0x1f) + 1) % PROC_MAX_COUNT;
+                } else if (!bit_check(_proc_pidmap, pid)) {
+                        bit_flip(_proc_pidmap, pid);
+                        next_pid = (pid + 1) % PROC_MAX_COUNT;
+                        return pid;
+                } else {
+                        ++n;
+                        pid = (pid + 1) % PROC_MAX_COUNT;
+                }
         }
+        return -1;
+}
+
+/**
+ * Releases a PID returned by _proc_getid.
+ */
+static void
+_proc_putid(pid_t pid)
+{
+        KASSERT(0 <= pid && pid < PROC_MAX_COUNT);
+        KASSERT(bit_check(_proc_pidmap, pid));
+        bit_flip(_proc_pidmap, pid);
 }
 
 /*
@@ -93,8 +123,10 @@ proc_create(char *name)
         KASSERT(PID_IDLE != pid || list_empty(&_proc_list));
         KASSERT(PID_INIT != pid || PID_IDLE == curproc->p_pid);
 
-        if (NULL == (p = slab_obj_alloc(proc_allocator)))
+        if (NULL == (p = slab_obj_alloc(proc_allocator))) {
+                _proc_putid(pid);
                 return NULL;
+        }
 
         p->p_pid = (pid_t) pid;
 
@@ -105,15 +137,32 @@ proc_create(char *name)
         p->p_status = 0;
         p->p_state = PROC_RUNNING;
         sched_queue_init(&p->p_wait);
+        memset(&p->p_mem, 0, sizeof(p->p_mem));
+        p->p_utime = 0;
+        p->p_stime = 0;
+        p->p_cutime = 0;
+        p->p_cstime = 0;
+#ifdef __MTP__
+        p->p_nexttid = 0;
+#endif
 
-        if (NULL == (p->p_pagedir = pt_create_pagedir())) {
+        if (NULL == (p->p_pagedir = pt_create_pagedir(&p->p_mem))) {
+                slab_obj_free(proc_allocator, p);
+                _proc_putid(pid);
+                return NULL;
+        }
+        if (vdata_create(p) < 0) {
+                pt_destroy_pagedir(p->p_pagedir);
                 slab_obj_free(proc_allocator, p);
+                _proc_putid(pid);
                 return NULL;
         }
 #ifdef __VM__
         if (NULL == (p->p_vmmap = vmmap_create())) {
+                vdata_destroy(p);
                 pt_destroy_pagedir(p->p_pagedir);
                 slab_obj_free(proc_allocator, p);
+                _proc_putid(pid);
                 return NULL;
         }
 #endif
@@ -123,6 +172,7 @@ proc_create(char *name)
         }
 
         list_insert_before(&_proc_list, &p->p_list_link);
+        list_insert_head(proc_hash(p->p_pid), &p->p_hash_link);
 
         if (PID_INIT == p->p_pid) {
                 KASSERT(NULL == proc_initproc);
@@ -189,7 +239,11 @@ proc_cleanup(int status)
         KASSERT(NULL != curproc->p_pproc);
 
 #ifdef __VM__
-        vmmap_destroy(curproc->p_vmmap);
+        /* Destroying the address space can take a while, so leave it
+         * to the reaper and let our parent find out we are dead now */
+        curproc->p_vmmap->vmm_proc = NULL;
+        reaper_defer(curproc->p_vmmap, NULL);
+        curproc->p_vmmap = NULL;
 #endif
 
 #ifdef __VFS__
@@ -277,7 +331,7 @@ proc_t *
 proc_lookup(int pid)
 {
         proc_t *p;
-        list_iterate_begin(&_proc_list, p, proc_t, p_list_link) {
+        list_iterate_begin(proc_hash(pid), p, proc_t, p_hash_link) {
                 if (p->p_pid == pid) {
                         return p;
                 }
@@ -400,6 +454,9 @@ deadchild:
                 kthread_destroy(thr);
         } list_iterate_end();
 
+        curproc->p_cutime += p->p_utime + p->p_cutime;
+        curproc->p_cstime += p->p_stime + p->p_cstime;
+
         dbg(DBG_THR, "thread %p of proc %d cleaning up proc %d\n",
             curthr, curproc->p_pid, p->p_pid);
 
@@ -410,11 +467,15 @@ deadchild:
         pid = p->p_pid;
 
         KASSERT(NULL != p->p_pagedir);
-        pt_destroy_pagedir(p->p_pagedir);
+        vdata_destroy(p);
+        reaper_defer(NULL, p->p_pagedir);
+        p->p_pagedir = NULL;
 
         /* free proc */
         list_remove(&p->p_child_link);
         list_remove(&p->p_list_link);
+        list_remove(&p->p_hash_link);
+        _proc_putid(pid);
         slab_obj_free(proc_allocator, p);
 
         return pid;
@@ -422,6 +483,61 @@ deadchild:
         return 0;
 }
 
+/*
+ * Adds up the user and system time of the threads of a process, both
+ * those still running and those which have exited.
+ */
+static void
+proc_cputime(const proc_t *p, uint64_t *utime, uint64_t *stime)
+{
+        kthread_t *thr;
+        uint64_t u, s;
+
+        *utime = p->p_utime;
+        *stime = p->p_stime;
+        list_iterate_begin(&p->p_threads, thr, kthread_t, kt_plink) {
+                if (KT_EXITED != thr->kt_state) {
+                        sched_cputime(thr, &u, &s);
+                        *utime += u;
+                        *stime += s;
+                }
+        } list_iterate_end();
+}
+
+static void
+cycles_to_timeval(uint64_t cycles, struct timeval *tv)
+{
+        uint64_t us = cycles_to_ns(cycles) / 1000;
+
+        tv->tv_sec = us / 1000000;
+        tv->tv_usec = us % 1000000;
+}
+
+int
+do_getrusage(int who, struct rusage *usage)
+{
+        uint64_t utime, stime;
+
+        switch (who) {
+                case RUSAGE_SELF:
+                        proc_cputime(curproc, &utime, &stime);
+                        break;
+                case RUSAGE_CHILDREN:
+                        utime = curproc->p_cutime;
+                        stime = curproc->p_cstime;
+                        break;
+                case RUSAGE_THREAD:
+                        sched_cputime(curthr, &utime, &stime);
+                        break;
+                default:
+                        return -EINVAL;
+        }
+
+        cycles_to_timeval(utime, &usage->ru_utime);
+        cycles_to_timeval(stime, &usage->ru_stime);
+        return 0;
+}
+
 /*
  * Cancel all threads, join with them, and exit from the current
  * thread.
@@ -490,6 +606,13 @@ proc_info(const void *arg, char *buf, size_t osize)
         iprintf(&buf, &size, "status:       %i\n", p->p_status);
         iprintf(&buf, &size, "state:        %i\n", p->p_state);
 
+        uint64_t utime, stime;
+        proc_cputime(p, &utime, &stime);
+        iprintf(&buf, &size, "user time:    %llu us\n", cycles_to_ns(utime) / 1000);
+        iprintf(&buf, &size, "system time:  %llu us\n", cycles_to_ns(stime) / 1000);
+        iprintf(&buf, &size, "child time:   %llu us user, %llu us system\n",
+                cycles_to_ns(p->p_cutime) / 1000, cycles_to_ns(p->p_cstime) / 1000);
+
 #ifdef __VFS__
 #ifdef __GETCWD__
         if (NULL != p->p_cwd) {
@@ -507,6 +630,12 @@ proc_info(const void *arg, char *buf, size_t osize)
         iprintf(&buf, &size, "brk:          0x%p\n", p->p_brk);
 #endif
 
+        iprintf(&buf, &size, "rss anon:     %u pages\n", p->p_mem.ms_rss_anon);
+        iprintf(&buf, &size, "rss file:     %u pages\n", p->p_mem.ms_rss_file);
+        iprintf(&buf, &size, "page tables:  %u pages\n", p->p_mem.ms_ptpages);
+        iprintf(&buf, &size, "faults:       %u minor, %u major\n",
+                p->p_mem.ms_minflt, p->p_mem.ms_majflt);
+
         return size;
 }
 
@@ -551,3 +680,24 @@ proc_list_info(const void *arg, char *buf, size_t osize)
         } list_iterate_end();
         return size;
 }
+
+size_t
+proc_memstat_info(const void *arg, char *buf, size_t osize)
+{
+        size_t size = osize;
+        proc_t *p;
+
+        KASSERT(NULL == arg);
+        KASSERT(NULL != buf);
+
+        iprintf(&buf, &size, "%5s %-13s %8s %8s %6s %8s %8s\n",
+                "PID", "NAME", "ANON", "FILE", "PT", "MINFLT", "MAJFLT");
+
+        list_iterate_begin(&_proc_list, p, proc_t, p_list_link) {
+                iprintf(&buf, &size, " %3i  %-13s %8u %8u %6u %8u %8u\n",
+                        p->p_pid, p->p_comm, p->p_mem.ms_rss_anon,
+                        p->p_mem.ms_rss_file, p->p_mem.ms_ptpages,
+                        p->p_mem.ms_minflt, p->p_mem.ms_majflt);
+        } list_iterate_end();
+        return size;
+}
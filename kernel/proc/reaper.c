@@ -0,0 +1,159 @@
+/*
+ * The reaper daemon tears down the address spaces of exited
+ * processes. Destroying a vmmap puts every memory object the process
+ * had mapped (and with them whole shadow chains), and freeing a page
+ * directory walks every page table, so doing either in do_exit() or
+ * do_waitpid() makes exit and the parent's wakeup take time
+ * proportional to the size of the dead process. Instead they are
+ * queued on the reaper's workqueue and torn down by its worker.
+ */
+
+#include "types.h"
+#include "globals.h"
+#include "errno.h"
+
+#include "util/debug.h"
+#include "util/init.h"
+#include "util/list.h"
+#include "util/printf.h"
+
+#include "main/cpuid.h"
+
+#include "mm/slab.h"
+#include "mm/pagetable.h"
+
+#include "proc/proc.h"
+#include "proc/kthread.h"
+#include "proc/sched.h"
+#include "proc/reaper.h"
+#include "proc/workqueue.h"
+
+#include "vm/vmmap.h"
+
+typedef struct reaper_work {
+        work_t           rw_work;
+        vmmap_t         *rw_vmmap;
+        pagedir_t       *rw_pagedir;
+} reaper_work_t;
+
+/* The teardowns are done one at a time, as they would be in place,
+ * so one worker is enough. */
+#define REAPER_MAX_WORKERS      1
+
+static slab_allocator_t *reaper_work_allocator = NULL;
+static workqueue_t reaper_wq;
+static int reaper_running = 0;
+
+static reaper_stats_t reaper_stats;
+
+static void
+reaper_teardown(vmmap_t *map, pagedir_t *pagedir)
+{
+#ifdef __VM__
+        if (NULL != map) {
+                KASSERT(NULL == map->vmm_proc);
+                vmmap_destroy(map);
+        }
+#endif
+        if (NULL != pagedir) {
+                pt_destroy_pagedir(pagedir);
+        }
+}
+
+static void
+reaper_run(work_t *w)
+{
+        reaper_work_t *work = CONTAINER_OF(w, reaper_work_t, rw_work);
+        uint64_t elapsed;
+
+        reaper_teardown(work->rw_vmmap, work->rw_pagedir);
+
+        elapsed = rdtsc() - work->rw_work.w_queued;
+        reaper_stats.rs_total_cycles += elapsed;
+        if (elapsed > reaper_stats.rs_max_cycles) {
+                reaper_stats.rs_max_cycles = elapsed;
+        }
+        reaper_stats.rs_backlog--;
+        reaper_stats.rs_done++;
+
+        slab_obj_free(reaper_work_allocator, work);
+}
+
+void
+reaper_defer(vmmap_t *map, pagedir_t *pagedir)
+{
+        reaper_work_t *work;
+
+        if (NULL == map && NULL == pagedir) {
+                return;
+        }
+
+        if (!reaper_running || workqueue_in_worker(&reaper_wq)
+            || NULL == (work = slab_obj_alloc(reaper_work_allocator))) {
+                reaper_stats.rs_sync++;
+                reaper_teardown(map, pagedir);
+                return;
+        }
+
+        work_init(&work->rw_work, reaper_run);
+        work->rw_vmmap = map;
+        work->rw_pagedir = pagedir;
+
+        reaper_stats.rs_queued++;
+        if (++reaper_stats.rs_backlog > reaper_stats.rs_max_backlog) {
+                reaper_stats.rs_max_backlog = reaper_stats.rs_backlog;
+        }
+
+        workqueue_submit(&reaper_wq, &work->rw_work);
+}
+
+static __attribute__((unused)) void
+reaper_init(void)
+{
+        reaper_work_allocator = slab_allocator_create("reaper_work",
+                                sizeof(reaper_work_t));
+        KASSERT(NULL != reaper_work_allocator);
+
+        KASSERT(curproc && (PID_IDLE == curproc->p_pid)
+                && "should be calling this from idleproc");
+        if (0 > workqueue_init(&reaper_wq, "reaper", REAPER_MAX_WORKERS)) {
+                panic("could not start the reaper\n");
+        }
+        reaper_running = 1;
+}
+init_func(reaper_init);
+init_depends(workqueue_sysinit);
+
+/*
+ * Finishes whatever is still queued, so nothing is leaked at shutdown.
+ */
+void
+reaper_shutdown(void)
+{
+        KASSERT(PID_IDLE == curproc->p_pid);
+        KASSERT(reaper_running);
+
+        /* waiting for the worker tears its process down, which must
+         * not be queued behind it */
+        reaper_running = 0;
+        workqueue_destroy(&reaper_wq);
+}
+
+size_t
+reaper_info(const void *arg, char *buf, size_t osize)
+{
+        size_t size = osize;
+
+        KASSERT(NULL == arg);
+
+        iprintf(&buf, &size, "queued:      %u\n", reaper_stats.rs_queued);
+        iprintf(&buf, &size, "done:        %u\n", reaper_stats.rs_done);
+        iprintf(&buf, &size, "in place:    %u\n", reaper_stats.rs_sync);
+        iprintf(&buf, &size, "backlog:     %u (max %u)\n",
+                reaper_stats.rs_backlog, reaper_stats.rs_max_backlog);
+        iprintf(&buf, &size, "avg cycles:  %llu\n", (0 == reaper_stats.rs_done) ? 0ULL
+                : reaper_stats.rs_total_cycles / reaper_stats.rs_done);
+        iprintf(&buf, &size, "max cycles:  %llu\n", reaper_stats.rs_max_cycles);
+
+        return size;
+}
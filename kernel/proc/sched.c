@@ -1,3 +1,4 @@
+#include "config.h"
 #include "globals.h"
 #include "errno.h"
 
@@ -6,21 +7,121 @@
 #include "proc/sched.h"
 #include "proc/kthread.h"
 
+#include "main/cpuid.h"
+#include "main/fpu.h"
+
+#include "mm/page.h"
+
+#include "proc/proc.h"
+#include "proc/schedtrace.h"
+
 #include "util/init.h"
 #include "util/debug.h"
+#include "util/printf.h"
+#include "util/spinlock.h"
+#include "util/time.h"
+
+struct sched_runq;
+static void sched_daemon_enqueue(struct sched_runq *rq, kthread_t *thr);
+static kthread_t *sched_daemon_dequeue(struct sched_runq *rq);
+static void sched_daemon_charge(kthread_t *thr, uint64_t cycles);
+static void sched_fair_enqueue(struct sched_runq *rq, kthread_t *thr);
+static kthread_t *sched_fair_dequeue(struct sched_runq *rq);
+static void sched_fair_charge(kthread_t *thr, uint64_t cycles);
+
+static sched_class_t sched_classes[SCHED_NCLASSES] = {
+        [SCHED_DAEMON] = {
+                .sc_name = "daemon",
+                .sc_enqueue = sched_daemon_enqueue,
+                .sc_dequeue = sched_daemon_dequeue,
+                .sc_charge = sched_daemon_charge
+        },
+        [SCHED_FAIR] = {
+                .sc_name = "fair",
+                .sc_enqueue = sched_fair_enqueue,
+                .sc_dequeue = sched_fair_dequeue,
+                .sc_charge = sched_fair_charge
+        }
+};
+
+/*
+ * The daemon class is a plain FIFO queue.
+ *
+ * The fair class keeps its runnable threads in a ring of buckets,
+ * each covering SCHED_FAIR_BUCKET_CYCLES of virtual runtime, starting
+ * at the bucket with number rq_fair_cursor (bucket numbers are
+ * kt_vruntime >> SCHED_FAIR_BUCKET_SHIFT). Every queued thread lies
+ * in one of the SCHED_FAIR_NBUCKETS buckets from the cursor on, so the
+ * next thread to run is at the tail of the first non-empty bucket.
+ * Threads within a bucket are run in FIFO order.
+ *
+ * A thread whose vruntime is behind the cursor (because it has been
+ * asleep) is moved up to the cursor when it becomes runnable, so it
+ * gets to run soon but cannot use up all the CPU time it missed. A
+ * thread too far ahead of the cursor goes in the last bucket.
+ *
+ * With SMP every CPU has a run queue of its own. A thread goes back
+ * on the queue of the CPU it last ran on, and a CPU with nothing left
+ * on its own queue takes threads from the others'. The kernel lock
+ * already keeps the other CPUs out, so rq_lock is not needed yet; it
+ * is there for when the scheduler can run without the kernel lock.
+ */
+#define SCHED_FAIR_BUCKET_SHIFT 20
+#define SCHED_FAIR_NBUCKETS     64
+
+typedef struct sched_runq {
+        ktqueue_t       rq_daemon;
+        ktqueue_t       rq_fair[SCHED_FAIR_NBUCKETS];
+        uint64_t        rq_fair_cursor;
+        spinlock_t      rq_lock;
+} sched_runq_t;
+
+#ifdef __SMP__
+#define SCHED_NRUNQS    SMP_MAX_CPUS
+#else
+#define SCHED_NRUNQS    1
+#endif
+
+static sched_runq_t sched_runqs[SCHED_NRUNQS];
 
-static ktqueue_t kt_runq;
+/*
+ * Wait queue statistics: threads woken from wait queues, wakeups
+ * after which the waiter found its condition still false (see
+ * sched_wait_event()), and exclusive waiters which sched_wakeup_n()
+ * left asleep, each of which a broadcast would have woken.
+ */
+static uint32_t sched_nwakeups;
+static uint32_t sched_nspurious;
+static uint32_t sched_nskipped;
+
+/* Cycles spent in sched_switch() waiting for a thread to run */
+static uint64_t sched_idle_cycles;
 
 static __attribute__((unused)) void
 sched_init(void)
 {
-        sched_queue_init(&kt_runq);
+        sched_runq_t *rq;
+        int i;
+
+        for (rq = sched_runqs; rq < sched_runqs + SCHED_NRUNQS; ++rq) {
+                sched_queue_init(&rq->rq_daemon);
+                for (i = 0; i < SCHED_FAIR_NBUCKETS; ++i)
+                        sched_queue_init(&rq->rq_fair[i]);
+                rq->rq_fair_cursor = 0;
+                spinlock_init(&rq->rq_lock);
+        }
 }
 init_func(sched_init);
 
 
 
 /*** PRIVATE KTQUEUE MANIPULATION FUNCTIONS ***/
+/*
+ * Timers (see sched_sleep_on_timeout()) remove threads from their
+ * queues from the clock interrupt handler, so the queue functions
+ * block interrupts while they change a queue.
+ */
+
 /**
  * Enqueues a thread onto a queue.
  *
@@ -30,10 +131,15 @@ init_func(sched_init);
 static void
 ktqueue_enqueue(ktqueue_t *q, kthread_t *thr)
 {
+        uint8_t ipl = intr_getipl();
+        intr_setipl(IPL_HIGH);
+
         KASSERT(!thr->kt_wchan);
         list_insert_head(&q->tq_list, &thr->kt_qlink);
         thr->kt_wchan = q;
         q->tq_size++;
+
+        intr_setipl(ipl);
 }
 
 /**
@@ -47,17 +153,23 @@ ktqueue_dequeue(ktqueue_t *q)
 {
         kthread_t *thr;
         list_link_t *link;
+        uint8_t ipl = intr_getipl();
+        intr_setipl(IPL_HIGH);
 
-        if (list_empty(&q->tq_list))
+        if (list_empty(&q->tq_list)) {
+                intr_setipl(ipl);
                 return NULL;
+        }
 
         link = q->tq_list.l_prev;
         thr = list_item(link, kthread_t, kt_qlink);
         list_remove(link);
         thr->kt_wchan = NULL;
+        thr->kt_wexclusive = 0;
 
         q->tq_size--;
 
+        intr_setipl(ipl);
         return thr;
 }
 
@@ -70,10 +182,307 @@ ktqueue_dequeue(ktqueue_t *q)
 static void
 ktqueue_remove(ktqueue_t *q, kthread_t *thr)
 {
+        uint8_t ipl = intr_getipl();
+        intr_setipl(IPL_HIGH);
+
         KASSERT(thr->kt_qlink.l_next && thr->kt_qlink.l_prev);
         list_remove(&thr->kt_qlink);
         thr->kt_wchan = NULL;
+        thr->kt_wexclusive = 0;
         q->tq_size--;
+
+        intr_setipl(ipl);
+}
+
+/*** SCHEDULING CLASSES ***/
+static void
+sched_daemon_enqueue(sched_runq_t *rq, kthread_t *thr)
+{
+        ktqueue_enqueue(&rq->rq_daemon, thr);
+}
+
+static kthread_t *
+sched_daemon_dequeue(sched_runq_t *rq)
+{
+        return ktqueue_dequeue(&rq->rq_daemon);
+}
+
+static void
+sched_daemon_charge(kthread_t *thr, uint64_t cycles)
+{
+}
+
+static void
+sched_fair_enqueue(sched_runq_t *rq, kthread_t *thr)
+{
+        uint64_t bucket;
+
+        if ((thr->kt_vruntime >> SCHED_FAIR_BUCKET_SHIFT) < rq->rq_fair_cursor) {
+                thr->kt_vruntime = rq->rq_fair_cursor << SCHED_FAIR_BUCKET_SHIFT;
+        }
+
+        bucket = MIN(thr->kt_vruntime >> SCHED_FAIR_BUCKET_SHIFT,
+                     rq->rq_fair_cursor + SCHED_FAIR_NBUCKETS - 1);
+        ktqueue_enqueue(&rq->rq_fair[bucket % SCHED_FAIR_NBUCKETS], thr);
+}
+
+static kthread_t *
+sched_fair_dequeue(sched_runq_t *rq)
+{
+        int i;
+        ktqueue_t *q;
+
+        for (i = 0; i < SCHED_FAIR_NBUCKETS; ++i) {
+                q = &rq->rq_fair[(rq->rq_fair_cursor + i) % SCHED_FAIR_NBUCKETS];
+                if (!sched_queue_empty(q)) {
+                        rq->rq_fair_cursor += i;
+                        return ktqueue_dequeue(q);
+                }
+        }
+        return NULL;
+}
+
+static void
+sched_fair_charge(kthread_t *thr, uint64_t cycles)
+{
+        thr->kt_vruntime += cycles;
+}
+
+/*
+ * Charges the current thread for the time since it was last switched
+ * to or charged. Must be called with interrupts masked.
+ */
+static void
+sched_charge_curthr(uint64_t now)
+{
+        sched_class_t *cls = &sched_classes[curthr->kt_sched_class];
+
+        cls->sc_charge(curthr, now - curthr->kt_sched_start);
+        curthr->kt_sched_start = now;
+}
+
+void
+sched_acct_enter(void)
+{
+        uint64_t now = rdtsc();
+
+        curthr->kt_utime += now - curthr->kt_acct_start;
+        curthr->kt_acct_start = now;
+}
+
+void
+sched_acct_leave(void)
+{
+        uint64_t now = rdtsc();
+
+        curthr->kt_stime += now - curthr->kt_acct_start;
+        curthr->kt_acct_start = now;
+}
+
+void
+sched_cputime(kthread_t *thr, uint64_t *utime, uint64_t *stime)
+{
+        *utime = thr->kt_utime;
+        *stime = thr->kt_stime;
+        /* we are in the kernel, so that is where the current thread has
+         * been since its times were last brought up to date */
+        if (thr == curthr) {
+                *stime += rdtsc() - thr->kt_acct_start;
+        }
+}
+
+/*
+ * Returns the next thread to run from a run queue, taken from the
+ * highest priority class with a runnable thread, or NULL if there is
+ * none.
+ */
+static kthread_t *
+sched_pick_runq(sched_runq_t *rq)
+{
+        kthread_t *thr = NULL;
+        int i;
+
+        uint32_t flags = spin_lock_irqsave(&rq->rq_lock);
+        for (i = 0; i < SCHED_NCLASSES && NULL == thr; ++i) {
+                thr = sched_classes[i].sc_dequeue(rq);
+        }
+        spin_unlock_irqrestore(&rq->rq_lock, flags);
+        return thr;
+}
+
+#ifdef __SMP__
+/*
+ * Returns the next thread to run on this CPU: from its own run queue
+ * if there is one there, and otherwise taken from another CPU's.
+ */
+static kthread_t *
+sched_pick(void)
+{
+        kthread_t *thr;
+        int self = smp_cpuid();
+        int i, cpu;
+
+        if (NULL != (thr = sched_pick_runq(&sched_runqs[self]))) {
+                return thr;
+        }
+        for (i = 1; i < smp_ncpus; ++i) {
+                cpu = (self + i) % smp_ncpus;
+                if (NULL != (thr = sched_pick_runq(&sched_runqs[cpu]))) {
+                        curcpu->cpu_nsteals++;
+                        return thr;
+                }
+        }
+        return NULL;
+}
+
+/* Returns 1 if any run queue has a thread on it */
+static int
+sched_runnable(void)
+{
+        sched_runq_t *rq;
+        int i;
+
+        for (rq = sched_runqs; rq < sched_runqs + smp_ncpus; ++rq) {
+                if (!sched_queue_empty(&rq->rq_daemon)) {
+                        return 1;
+                }
+                for (i = 0; i < SCHED_FAIR_NBUCKETS; ++i) {
+                        if (!sched_queue_empty(&rq->rq_fair[i])) {
+                                return 1;
+                        }
+                }
+        }
+        return 0;
+}
+
+/*
+ * Gets a CPU to look at its run queue after a thread was put on the
+ * queue of cpu: cpu itself if it is idle, otherwise any idle CPU,
+ * which will take the thread from cpu's queue.
+ */
+static void
+sched_kick(int cpu)
+{
+        int self = smp_cpuid();
+        int i;
+
+        if (cpu != self && cpus[cpu].cpu_idle) {
+                smp_resched(cpu);
+                return;
+        }
+        for (i = 0; i < smp_ncpus; ++i) {
+                if (i != self && cpus[i].cpu_online && cpus[i].cpu_idle) {
+                        smp_resched(i);
+                        return;
+                }
+        }
+}
+
+void *
+sched_idle(int cpu, void *arg)
+{
+        uint64_t start;
+
+        KASSERT(cpu == smp_cpuid() && curthr == curcpu->cpu_idlethr);
+        intr_setipl(IPL_HIGH);
+        if (NULL != arg) {
+                page_free(arg);
+        }
+        for (;;) {
+                intr_disable();
+                if (!sched_runnable()) {
+                        /* whoever makes a thread runnable sees cpu_idle
+                         * and sends us an IPI, which the hlt is woken by
+                         * even if it comes in before it */
+                        start = rdtsc();
+                        curcpu->cpu_idle = 1;
+                        smp_unlock_kernel();
+                        intr_setipl(IPL_LOW);
+                        intr_wait();
+                        intr_disable();
+                        smp_lock_kernel();
+                        intr_setipl(IPL_HIGH);
+                        curcpu->cpu_idle = 0;
+                        curcpu->cpu_idle_cycles += rdtsc() - start;
+                        sched_idle_cycles += rdtsc() - start;
+                }
+                intr_enable();
+                sched_switch();
+        }
+        return NULL;
+}
+#else
+static kthread_t *
+sched_pick(void)
+{
+        return sched_pick_runq(&sched_runqs[0]);
+}
+#endif
+
+#ifdef __UPREEMPT__
+static uint32_t sched_npreempts;
+
+void
+sched_preempt(void)
+{
+        KASSERT(curthr->kt_need_resched);
+        curthr->kt_need_resched = 0;
+        sched_npreempts++;
+
+        sched_make_runnable(curthr);
+        sched_switch();
+}
+#endif
+
+void
+sched_set_class(kthread_t *thr, int cls)
+{
+        KASSERT(0 <= cls && SCHED_NCLASSES > cls);
+        KASSERT(NULL == thr->kt_wchan && "thread is on a queue");
+        thr->kt_sched_class = cls;
+}
+
+size_t
+sched_info(const void *arg, char *buf, size_t osize)
+{
+        size_t size = osize;
+        sched_class_t *cls;
+        proc_t *p;
+        kthread_t *thr;
+        int i;
+
+        KASSERT(NULL == arg);
+
+        iprintf(&buf, &size, "%-8s %10s %16s %16s\n",
+                "CLASS", "SWITCHES", "AVG WAIT", "MAX WAIT");
+        for (i = 0; i < SCHED_NCLASSES; ++i) {
+                cls = &sched_classes[i];
+                iprintf(&buf, &size, "%-8s %10u %16llu %16llu\n", cls->sc_name,
+                        cls->sc_nswitches, (0 == cls->sc_nswitches) ? 0ULL
+                        : cls->sc_wait_total / cls->sc_nswitches, cls->sc_wait_max);
+        }
+#ifdef __UPREEMPT__
+        iprintf(&buf, &size, "preemptions: %u (slice %u ms)\n",
+                sched_npreempts, TIMESLICE_MSECS);
+#endif
+
+        iprintf(&buf, &size, "wakeups: %u (spurious %u, exclusive waiters left asleep %u)\n",
+                sched_nwakeups, sched_nspurious, sched_nskipped);
+        iprintf(&buf, &size, "idle: %llu us\n",
+                cycles_to_ns(sched_idle_cycles) / 1000);
+
+        iprintf(&buf, &size, "\n%5s %-13s %-8s %16s\n",
+                "PID", "NAME", "CLASS", "VRUNTIME");
+        list_iterate_begin(proc_list(), p, proc_t, p_list_link) {
+                list_iterate_begin(&p->p_threads, thr, kthread_t, kt_plink) {
+                        iprintf(&buf, &size, " %3i  %-13s %-8s %16llu\n",
+                                p->p_pid, p->p_comm,
+                                sched_classes[thr->kt_sched_class].sc_name,
+                                thr->kt_vruntime);
+                } list_iterate_end();
+        } list_iterate_end();
+
+        return size;
 }
 
 /*** PUBLIC KTQUEUE MANIPULATION FUNCTIONS ***/
@@ -103,10 +512,26 @@ sched_sleep_on(ktqueue_t *q)
         /* PROCS {{{ */
         curthr->kt_state = KT_SLEEP;
         ktqueue_enqueue(q, curthr);
+        SCHEDTRACE(ST_SLEEP, curthr, q);
         sched_switch();
         /* PROCS }}} */
 }
 
+void
+sched_sleep_on_exclusive(ktqueue_t *q)
+{
+        curthr->kt_state = KT_SLEEP;
+        curthr->kt_wexclusive = 1;
+        ktqueue_enqueue(q, curthr);
+        SCHEDTRACE(ST_SLEEP, curthr, q);
+        sched_switch();
+}
+
+void
+sched_spurious_wakeup(void)
+{
+        sched_nspurious++;
+}
 
 /*
  * Similar to sleep on, but the sleep can be cancelled.
@@ -131,6 +556,7 @@ sched_cancellable_sleep_on(ktqueue_t *q)
 
         curthr->kt_state = KT_SLEEP_CANCELLABLE;
         ktqueue_enqueue(q, curthr);
+        SCHEDTRACE(ST_SLEEP, curthr, q);
         sched_switch();
 
         if (curthr->kt_cancelled)
@@ -141,6 +567,77 @@ sched_cancellable_sleep_on(ktqueue_t *q)
         return 0;
 }
 
+typedef struct sched_timeout {
+        kthread_t      *st_thr;
+        ktqueue_t      *st_q;           /* the queue the thread sleeps on */
+        int             st_expired;
+        ktimer_t        st_timer;
+} sched_timeout_t;
+
+/* Timer function for sched_sleep_timeout(). Runs from the clock
+ * interrupt, and wakes the thread up unless it already has been. A
+ * thread which has been woken but has not run yet is on a run queue,
+ * so kt_wchan alone does not say whether it is still asleep. */
+static void
+sched_timeout_expire(void *arg)
+{
+        sched_timeout_t *to = (sched_timeout_t *) arg;
+        kthread_t *thr = to->st_thr;
+
+        if (to->st_q == thr->kt_wchan) {
+                SCHEDTRACE(ST_TIMEOUT, thr, to->st_q);
+                ktqueue_remove(to->st_q, thr);
+                to->st_expired = 1;
+                sched_make_runnable(thr);
+        }
+}
+
+static int
+sched_sleep_timeout(ktqueue_t *q, uint32_t ticks, int cancellable)
+{
+        sched_timeout_t to;
+        uint8_t ipl;
+
+        if (cancellable && curthr->kt_cancelled) {
+                return -EINTR;
+        }
+
+        to.st_thr = curthr;
+        to.st_q = q;
+        to.st_expired = 0;
+        ktimer_init(&to.st_timer, sched_timeout_expire, &to);
+
+        /* the timer must not go off before we are on the queue */
+        ipl = intr_getipl();
+        intr_setipl(IPL_HIGH);
+
+        ktimer_add(&to.st_timer, jiffies + ticks);
+        curthr->kt_state = cancellable ? KT_SLEEP_CANCELLABLE : KT_SLEEP;
+        ktqueue_enqueue(q, curthr);
+        SCHEDTRACE(ST_SLEEP, curthr, q);
+        sched_switch();
+        ktimer_cancel(&to.st_timer);
+
+        intr_setipl(ipl);
+
+        if (cancellable && curthr->kt_cancelled) {
+                return -EINTR;
+        }
+        return to.st_expired ? -ETIMEDOUT : 0;
+}
+
+int
+sched_sleep_on_timeout(ktqueue_t *q, uint32_t ticks)
+{
+        return sched_sleep_timeout(q, ticks, 0);
+}
+
+int
+sched_cancellable_sleep_on_timeout(ktqueue_t *q, uint32_t ticks)
+{
+        return sched_sleep_timeout(q, ticks, 1);
+}
+
 kthread_t *
 sched_wakeup_on(ktqueue_t *q)
 {
@@ -151,14 +648,49 @@ sched_wakeup_on(ktqueue_t *q)
                 return NULL;
 
         ret = ktqueue_dequeue(q);
+        SCHEDTRACE(ST_WAKEUP, ret, q);
         KASSERT((ret->kt_state == KT_SLEEP)
                 || (ret->kt_state == KT_SLEEP_CANCELLABLE));
         sched_make_runnable(ret);
+        sched_nwakeups++;
         return ret;
         /* PROCS }}} */
         return NULL;
 }
 
+int
+sched_wakeup_n(ktqueue_t *q, int n)
+{
+        kthread_t *thr;
+        list_link_t *link, *prev;
+        int woken = 0;
+        uint8_t ipl = intr_getipl();
+        intr_setipl(IPL_HIGH);
+
+        /* oldest waiters are at the tail */
+        for (link = q->tq_list.l_prev; link != &q->tq_list; link = prev) {
+                prev = link->l_prev;
+                thr = list_item(link, kthread_t, kt_qlink);
+                if (thr->kt_wexclusive) {
+                        if (0 >= n) {
+                                sched_nskipped++;
+                                continue;
+                        }
+                        n--;
+                }
+                KASSERT((thr->kt_state == KT_SLEEP)
+                        || (thr->kt_state == KT_SLEEP_CANCELLABLE));
+                ktqueue_remove(q, thr);
+                SCHEDTRACE(ST_WAKEUP, thr, q);
+                sched_make_runnable(thr);
+                woken++;
+        }
+        sched_nwakeups += woken;
+
+        intr_setipl(ipl);
+        return woken;
+}
+
 void
 sched_broadcast_on(ktqueue_t *q)
 {
@@ -183,6 +715,7 @@ sched_cancel(struct kthread *kthr)
         kthr->kt_cancelled = 1;
         if (kthr->kt_state == KT_SLEEP_CANCELLABLE) {
                 KASSERT(kthr->kt_wchan);
+                SCHEDTRACE(ST_WAKEUP, kthr, kthr->kt_wchan);
                 ktqueue_remove(kthr->kt_wchan, kthr);
                 sched_make_runnable(kthr);
         }
@@ -201,7 +734,9 @@ sched_cancel(struct kthread *kthr)
  *
  * Once you have masked interrupts, you need to remove a thread from
  * the run queue and switch into its context from the currently
- * executing context.
+ * executing context. There is a run queue per scheduling class (see
+ * sched.h); take the thread from the highest priority class which
+ * has one, and charge the current thread for the time it has run.
  *
  * If there are no threads on the run queue (assuming you do not have
  * any bugs), then all kernel threads are waiting for an interrupt
@@ -232,18 +767,62 @@ sched_switch(void)
         uint8_t ipl = intr_getipl();
         intr_setipl(IPL_HIGH);
 
-        while (sched_queue_empty(&kt_runq)) {
-                intr_disable();
-                intr_setipl(IPL_LOW);
-                intr_wait();
-                intr_setipl(IPL_HIGH);
+        kthread_t *newthr;
+        sched_class_t *cls;
+
+        uint64_t now = rdtsc();
+        curthr->kt_stime += now - curthr->kt_acct_start;
+        sched_charge_curthr(now);
+
+        newthr = sched_pick();
+#ifdef __SMP__
+        /* once the CPU has an idle thread, it waits in there, so that
+         * no other CPU can pick up the thread whose stack it is on */
+        if (NULL == newthr && NULL != curcpu->cpu_idlethr) {
+                if (curthr == curcpu->cpu_idlethr) {
+                        intr_setipl(ipl);
+                        return;
+                }
+                newthr = curcpu->cpu_idlethr;
+        }
+#endif
+        if (NULL == newthr) {
+                do {
+                        intr_disable();
+                        intr_setipl(IPL_LOW);
+                        intr_wait();
+                        intr_setipl(IPL_HIGH);
+                } while (NULL == (newthr = sched_pick()));
+                sched_idle_cycles += rdtsc() - now;
         }
 
-        kthread_t *newthr = ktqueue_dequeue(&kt_runq);
         kthread_t *oldthr = curthr;
+        SCHEDTRACE(ST_SWITCH, newthr, 0);
         curthr = newthr;
         curproc = newthr->kt_proc;
 
+        newthr->kt_sched_start = rdtsc();
+        newthr->kt_acct_start = newthr->kt_sched_start;
+#ifdef __UPREEMPT__
+        newthr->kt_ticks = 0;
+        newthr->kt_need_resched = 0;
+#endif
+#ifdef __SMP__
+        newthr->kt_cpu = smp_cpuid();
+        curcpu->cpu_nswitches++;
+        if (newthr != curcpu->cpu_idlethr)
+#endif
+        {
+                cls = &sched_classes[newthr->kt_sched_class];
+                cls->sc_nswitches++;
+                if (newthr->kt_runnable_at < newthr->kt_sched_start) {
+                        uint64_t wait = newthr->kt_sched_start - newthr->kt_runnable_at;
+                        cls->sc_wait_total += wait;
+                        cls->sc_wait_max = MAX(cls->sc_wait_max, wait);
+                }
+        }
+
+        fpu_switch(newthr);
         context_switch(&oldthr->kt_ctx, &newthr->kt_ctx);
 
         intr_setipl(ipl);
@@ -270,9 +849,27 @@ sched_make_runnable(kthread_t *thr)
         uint8_t ipl = intr_getipl();
         intr_setipl(IPL_HIGH);
 
-        KASSERT(&kt_runq != thr->kt_wchan);
+        thr->kt_runnable_at = rdtsc();
+        if (thr == curthr) {
+                /* yielding; bring its vruntime up to date first so it
+                 * is queued in the right place */
+                sched_charge_curthr(thr->kt_runnable_at);
+        }
         thr->kt_state = KT_RUN;
-        ktqueue_enqueue(&kt_runq, thr);
+
+#ifdef __SMP__
+        int cpu = thr->kt_cpu;
+#else
+        int cpu = 0;
+#endif
+        sched_runq_t *rq = &sched_runqs[cpu];
+        uint32_t flags = spin_lock_irqsave(&rq->rq_lock);
+        sched_classes[thr->kt_sched_class].sc_enqueue(rq, thr);
+        spin_unlock_irqrestore(&rq->rq_lock, flags);
+        SCHEDTRACE(ST_RUNNABLE, thr, thr->kt_sched_class);
+#ifdef __SMP__
+        sched_kick(cpu);
+#endif
 
         intr_setipl(ipl);
         /* PROCS }}} */
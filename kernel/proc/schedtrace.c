@@ -0,0 +1,109 @@
+#include "globals.h"
+#include "types.h"
+
+#include "main/cpuid.h"
+#include "main/interrupt.h"
+
+#include "proc/kthread.h"
+#include "proc/proc.h"
+#include "proc/schedtrace.h"
+
+#include "util/debug.h"
+#include "util/printf.h"
+#include "util/string.h"
+#include "util/time.h"
+
+#ifdef __SCHEDTRACE__
+/* Not static, so that gdb can find it (see kernel/proc/schedtrace.py) */
+schedtrace_t schedtrace = {
+        .st_magic = SCHEDTRACE_MAGIC,
+        .st_nevents = SCHEDTRACE_NEVENTS
+};
+
+static const char *schedtrace_names[] = {
+        [ST_SWITCH] = "switch",
+        [ST_SLEEP] = "sleep",
+        [ST_WAKEUP] = "wakeup",
+        [ST_RUNNABLE] = "runnable",
+        [ST_TIMEOUT] = "timeout"
+};
+
+static int32_t
+schedtrace_pid(kthread_t *thr)
+{
+        return (NULL != thr && NULL != thr->kt_proc) ? thr->kt_proc->p_pid : -1;
+}
+
+void
+schedtrace_record(uint32_t type, kthread_t *thr, uint32_t arg)
+{
+        schedtrace_event_t *se;
+        uint8_t ipl;
+
+        if (!schedtrace.st_enabled) {
+                return;
+        }
+
+        ipl = intr_getipl();
+        intr_setipl(IPL_HIGH);
+
+        se = &schedtrace.st_events[schedtrace.st_head++ & (SCHEDTRACE_NEVENTS - 1)];
+        se->se_tsc = rdtsc();
+        se->se_type = type;
+        se->se_thr = (uint32_t) thr;
+        se->se_cur = (uint32_t) curthr;
+        se->se_arg = arg;
+        se->se_pid = schedtrace_pid(thr);
+        se->se_curpid = schedtrace_pid(curthr);
+
+        intr_setipl(ipl);
+}
+
+void
+schedtrace_enable(int on)
+{
+        uint64_t base;
+        uint8_t ipl = intr_getipl();
+        intr_setipl(IPL_HIGH);
+
+        if (on && !schedtrace.st_enabled) {
+                ktime_tsc_params(&base, &schedtrace.st_tsc_mult,
+                                 &schedtrace.st_tsc_shift);
+                schedtrace.st_head = 0;
+        }
+        schedtrace.st_enabled = on;
+
+        intr_setipl(ipl);
+}
+
+size_t
+schedtrace_info(const void *arg, char *buf, size_t osize)
+{
+        size_t size = osize;
+        uint32_t n = (uint32_t) arg, head, i;
+        uint64_t start;
+        schedtrace_event_t *se;
+
+        head = schedtrace.st_head;
+        n = MIN(n, MIN(head, SCHEDTRACE_NEVENTS));
+
+        iprintf(&buf, &size, "tracing %s, %u events recorded, showing the last %u\n",
+                schedtrace.st_enabled ? "on" : "off", head, n);
+        if (0 == n) {
+                return size;
+        }
+        iprintf(&buf, &size, "%10s %-8s %-16s %-16s %s\n",
+                "TIME (us)", "EVENT", "THREAD", "BY", "ARG");
+
+        start = schedtrace.st_events[(head - n) & (SCHEDTRACE_NEVENTS - 1)].se_tsc;
+        for (i = head - n; i != head; ++i) {
+                se = &schedtrace.st_events[i & (SCHEDTRACE_NEVENTS - 1)];
+                iprintf(&buf, &size, "%10llu %-8s %3d/0x%08x   %3d/0x%08x   0x%08x\n",
+                        cycles_to_ns(se->se_tsc - start) / 1000,
+                        schedtrace_names[se->se_type],
+                        se->se_pid, se->se_thr, se->se_curpid, se->se_cur,
+                        se->se_arg);
+        }
+        return size;
+}
+#endif /* __SCHEDTRACE__ */
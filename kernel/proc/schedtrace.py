@@ -0,0 +1,28 @@
+import gdb
+
+import weenix
+import weenix.proc
+import weenix.schedtrace
+
+class SchedTraceCommand(weenix.Command):
+	"""schedtrace
+	Prints the scheduler trace ring as one timeline per thread. The
+	kernel must be built with SCHEDTRACE=1, and tracing turned on
+	with the schedtrace kshell command."""
+
+	def __init__(self):
+		weenix.Command.__init__(self, "schedtrace", gdb.COMMAND_DATA)
+
+	def invoke(self, args, tty):
+		try:
+			val = gdb.parse_and_eval("schedtrace")
+		except gdb.error:
+			print "the kernel was not built with SCHEDTRACE=1"
+			return
+		data = gdb.selected_inferior().read_memory(val.address, val.type.sizeof)
+		names = dict()
+		for proc in weenix.proc.iter():
+			names[proc.pid()] = proc.name()
+		print weenix.schedtrace.timelines(weenix.schedtrace.Trace(bytes(data)), names)
+
+SchedTraceCommand()
@@ -0,0 +1,152 @@
+#include "types.h"
+#include "globals.h"
+#include "errno.h"
+
+#include "util/debug.h"
+
+#include "proc/proc.h"
+#include "proc/kthread.h"
+#include "proc/sched.h"
+#include "proc/reaper.h"
+
+#include "fs/file.h"
+#include "fs/vnode.h"
+#include "fs/vfs_syscall.h"
+
+#include "vm/vmmap.h"
+
+#include "api/binfmt.h"
+#include "api/exec.h"
+#include "api/syscall.h"
+
+/*
+ * A spawn in progress. It lives on the parent's stack: the parent
+ * sleeps until the child has applied the file actions and loaded the
+ * program (or failed to), so that errors are returned from spawn itself
+ * rather than showing up as an exit status.
+ */
+typedef struct spawn_req {
+        const char           *sr_filename;
+        char *const          *sr_argv;
+        char *const          *sr_envp;
+        const spawn_action_t *sr_actions;
+        int                   sr_nactions;
+
+        int                   sr_done;
+        int                   sr_err;
+        ktqueue_t             sr_waitq;
+} spawn_req_t;
+
+static int
+spawn_file_actions(const spawn_action_t *actions, int nactions)
+{
+        int i, ret = 0;
+
+        for (i = 0; i < nactions && 0 <= ret; ++i) {
+                switch (actions[i].sa_op) {
+#ifdef __VFS__
+                        case SPAWN_DUP2:
+                                ret = do_dup2(actions[i].sa_fd, actions[i].sa_newfd);
+                                break;
+                        case SPAWN_CLOSE:
+                                ret = do_close(actions[i].sa_fd);
+                                break;
+#endif
+                        default:
+                                ret = -EINVAL;
+                                break;
+                }
+        }
+        return (0 > ret) ? ret : 0;
+}
+
+/*
+ * The first thread of the spawned process, running in the process's
+ * (still empty) address space.
+ */
+static void *
+spawn_child(int arg1, void *arg2)
+{
+        spawn_req_t *req = arg2;
+        uint32_t eip, esp;
+        int err;
+
+        if (0 == (err = spawn_file_actions(req->sr_actions, req->sr_nactions))) {
+                err = binfmt_load(req->sr_filename, req->sr_argv, req->sr_envp,
+                                  &eip, &esp);
+        }
+
+        /* the parent may return (and req go away) as soon as it runs */
+        req->sr_err = err;
+        req->sr_done = 1;
+        sched_broadcast_on(&req->sr_waitq);
+
+        if (0 > err) {
+                do_exit(1);
+        }
+        userland_start(eip, esp);
+        return NULL;
+}
+
+int
+do_spawn(const char *filename, char *const *argv, char *const *envp,
+         const spawn_action_t *actions, int nactions)
+{
+        spawn_req_t req;
+        kthread_t *thr;
+        proc_t *p;
+
+        if (0 > nactions || SPAWN_MAX_ACTIONS < nactions) {
+                return -EINVAL;
+        }
+        if (NULL == (p = proc_create((char *)filename))) {
+                return -ENOMEM;
+        }
+
+        req.sr_filename = filename;
+        req.sr_argv = argv;
+        req.sr_envp = envp;
+        req.sr_actions = actions;
+        req.sr_nactions = nactions;
+        req.sr_done = 0;
+        req.sr_err = 0;
+        sched_queue_init(&req.sr_waitq);
+
+        if (NULL == (thr = kthread_create(p, spawn_child, 0, &req))) {
+                /* p never ran, take it apart the way proc_cleanup and
+                 * do_waitpid would */
+#ifdef __VM__
+                p->p_vmmap->vmm_proc = NULL;
+                reaper_defer(p->p_vmmap, NULL);
+                p->p_vmmap = NULL;
+#endif
+#ifdef __VFS__
+                if (p->p_cwd)
+                        vput(p->p_cwd);
+#endif
+                p->p_state = PROC_DEAD;
+                do_waitpid(p->p_pid, 0, NULL);
+                return -ENOMEM;
+        }
+
+#ifdef __VFS__
+        int fd;
+        for (fd = 0; fd < NFILES; ++fd) {
+                if (NULL != (p->p_files[fd] = curproc->p_files[fd])) {
+                        fref(p->p_files[fd]);
+                }
+        }
+#endif
+
+        dbg(DBG_PROC, "proc %d spawning %s as proc %d\n",
+            curproc->p_pid, filename, p->p_pid);
+
+        sched_make_runnable(thr);
+        sched_wait_event(&req.sr_waitq, req.sr_done);
+
+        if (0 > req.sr_err) {
+                do_waitpid(p->p_pid, 0, NULL);
+                return req.sr_err;
+        }
+        return p->p_pid;
+}
@@ -0,0 +1,130 @@
+#include "config.h"
+#include "globals.h"
+#include "errno.h"
+
+#include "util/debug.h"
+#include "util/list.h"
+
+#include "proc/kthread.h"
+#include "proc/proc.h"
+#include "proc/sched.h"
+
+#include "mm/mm.h"
+#include "mm/mman.h"
+#include "mm/page.h"
+
+#include "vm/vmmap.h"
+#include "vm/mmap.h"
+
+#include "api/access.h"
+#include "api/exec.h"
+
+#ifdef __MTP__
+/*
+ * The first thing a thread made by thr_create runs: its user stack is
+ * already set up, so all that is left is to get there.
+ */
+static void *
+thr_start(int eip, void *esp)
+{
+        userland_start((uint32_t) eip, (uint32_t) esp);
+        return NULL;
+}
+
+static kthread_t *
+thr_lookup(int tid)
+{
+        kthread_t *thr;
+
+        list_iterate_begin(&curproc->p_threads, thr, kthread_t, kt_plink) {
+                if (thr->kt_tid == tid) {
+                        return thr;
+                }
+        } list_iterate_end();
+        return NULL;
+}
+
+int
+do_thr_create(uint32_t entry, uint32_t arg, size_t stacksz)
+{
+        vmarea_t *vma;
+        kthread_t *thr;
+        int err;
+
+        if (0 == stacksz) {
+                stacksz = DEFAULT_USER_STACK_SIZE;
+        }
+        if (USER_MEM_HIGH - USER_MEM_LOW < stacksz) {
+                return -EINVAL;
+        }
+        uint32_t npages = ADDR_TO_PN(PAGE_ALIGN_UP(stacksz));
+
+        /* the stack goes wherever it fits, as high as possible so as
+         * to stay out of the way of brk */
+        if (0 > (err = vmmap_map(curproc->p_vmmap, NULL, 0, npages,
+                                 PROT_READ | PROT_WRITE, MAP_PRIVATE, 0,
+                                 VMMAP_DIR_HILO, &vma))) {
+                return err;
+        }
+        void *stack = PN_TO_ADDR(vma->vma_start);
+        size_t size = npages * PAGE_SIZE;
+
+        /* entry(arg) is called with a null return address, so falling
+         * off the end of entry faults rather than running off into
+         * whatever is on the stack */
+        uint32_t frame[2] = { 0, arg };
+        uint32_t esp = (uint32_t) stack + size - sizeof(frame);
+        if (0 > (err = copy_to_user((void *) esp, frame, sizeof(frame)))) {
+                do_munmap(stack, size);
+                return err;
+        }
+
+        if (NULL == (thr = kthread_create(curproc, thr_start, entry, (void *) esp))) {
+                do_munmap(stack, size);
+                return -ENOMEM;
+        }
+        thr->kt_ustack = stack;
+        thr->kt_ustacksz = size;
+        sched_set_class(thr, curthr->kt_sched_class);
+
+        dbg(DBG_THR, "proc %d created thread %d, stack 0x%p-0x%p\n",
+            curproc->p_pid, thr->kt_tid, stack, (char *) stack + size);
+
+        sched_make_runnable(thr);
+        return thr->kt_tid;
+}
+
+int
+do_thr_join(int tid, void **retval)
+{
+        kthread_t *thr;
+
+        if (NULL == (thr = thr_lookup(tid))) {
+                return -ESRCH;
+        }
+        return kthread_join(thr, retval);
+}
+
+int
+do_thr_cancel(int tid)
+{
+        kthread_t *thr;
+
+        if (NULL == (thr = thr_lookup(tid)) || KT_EXITED == thr->kt_state) {
+                return -ESRCH;
+        }
+        kthread_cancel(thr, (void *) -1);
+        return 0;
+}
+
+int
+do_thr_detach(int tid)
+{
+        kthread_t *thr;
+
+        if (NULL == (thr = thr_lookup(tid))) {
+                return -ESRCH;
+        }
+        return kthread_detach(thr);
+}
+#endif
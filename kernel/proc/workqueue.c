@@ -0,0 +1,338 @@
+/*
+ * Workqueues: see proc/workqueue.h.
+ *
+ * Work may be submitted from interrupt context (delayed work is
+ * submitted by a timer), so a queue's list of pending work and its
+ * counters are only changed with interrupts blocked. Workers sleep
+ * with interrupts blocked as well, so that no work can be submitted
+ * between a worker finding the queue empty and going to sleep.
+ */
+
+#include "types.h"
+#include "globals.h"
+#include "errno.h"
+#include "kernel.h"
+
+#include "util/debug.h"
+#include "util/init.h"
+#include "util/list.h"
+#include "util/printf.h"
+#include "util/string.h"
+#include "util/time.h"
+
+#include "main/cpuid.h"
+#include "main/interrupt.h"
+
+#include "proc/proc.h"
+#include "proc/kthread.h"
+#include "proc/sched.h"
+#include "proc/workqueue.h"
+
+static list_t workqueue_list;
+
+static int workqueue_spawn(workqueue_t *wq);
+
+static __attribute__((unused)) void
+workqueue_sysinit(void)
+{
+        list_init(&workqueue_list);
+}
+init_func(workqueue_sysinit);
+init_depends(sched_init);
+
+void
+work_init(work_t *work, work_func_t func)
+{
+        work->w_func = func;
+        work->w_pending = 0;
+        work->w_queued = 0;
+        list_link_init(&work->w_link);
+}
+
+static void
+workqueue_delayed_timer(void *arg)
+{
+        delayed_work_t *dwork = (delayed_work_t *) arg;
+
+        workqueue_submit(dwork->dw_wq, &dwork->dw_work);
+}
+
+void
+delayed_work_init(delayed_work_t *dwork, work_func_t func)
+{
+        work_init(&dwork->dw_work, func);
+        ktimer_init(&dwork->dw_timer, workqueue_delayed_timer, dwork);
+        dwork->dw_wq = NULL;
+}
+
+/*
+ * Runs the queue's work until the queue is empty, then sleeps until
+ * more is submitted. When cancelled it finishes whatever is still
+ * queued before exiting.
+ */
+static void *
+workqueue_worker(int arg1, void *arg2)
+{
+        workqueue_t *wq = (workqueue_t *) arg2;
+        work_t *work;
+        uint64_t latency;
+        int ret, spawn;
+        uint8_t ipl = intr_getipl();
+
+        intr_setipl(IPL_HIGH);
+        while (1) {
+                if (list_empty(&wq->wq_pending)) {
+                        if (0 == wq->wq_nbusy) {
+                                sched_broadcast_on(&wq->wq_flushq);
+                        }
+                        wq->wq_nidle++;
+                        ret = sched_cancellable_sleep_on(&wq->wq_idleq);
+                        wq->wq_nidle--;
+                        if (ret < 0 && list_empty(&wq->wq_pending)) {
+                                break;
+                        }
+                        continue;
+                }
+
+                work = list_head(&wq->wq_pending, work_t, w_link);
+                list_remove(&work->w_link);
+                work->w_pending = 0;
+                wq->wq_npending--;
+                wq->wq_nbusy++;
+
+                latency = rdtsc() - work->w_queued;
+                wq->wq_latency_total += latency;
+                wq->wq_latency_max = MAX(wq->wq_latency_max, latency);
+
+                /* more work is waiting than there are workers to take
+                 * it, so start another if we may */
+                spawn = wq->wq_npending > wq->wq_nidle;
+
+                intr_setipl(ipl);
+                if (spawn) {
+                        workqueue_spawn(wq);
+                }
+                work->w_func(work);
+                intr_setipl(IPL_HIGH);
+
+                wq->wq_nbusy--;
+                wq->wq_ndone++;
+        }
+
+        sched_broadcast_on(&wq->wq_flushq);
+        intr_setipl(ipl);
+        return NULL;
+}
+
+/*
+ * Starts another worker, unless the queue already has as many as it
+ * may. The worker is made a child of the process which created the
+ * queue, whichever thread starts it.
+ */
+static int
+workqueue_spawn(workqueue_t *wq)
+{
+        char name[WORKQUEUE_NAME_LEN + 4];
+        proc_t *p;
+        kthread_t *thr;
+
+        if (wq->wq_stopping || wq->wq_nworkers >= wq->wq_max_workers) {
+                return 0;
+        }
+
+        snprintf(name, sizeof(name), "%s/%d", wq->wq_name, wq->wq_nworkers);
+        if (NULL == (p = proc_create(name))) {
+                return -ENOMEM;
+        }
+        if (p->p_pproc != wq->wq_parent) {
+                list_remove(&p->p_child_link);
+                p->p_pproc = wq->wq_parent;
+                list_insert_before(&wq->wq_parent->p_children, &p->p_child_link);
+        }
+
+        thr = kthread_create(p, workqueue_worker, 0, wq);
+        KASSERT(NULL != thr);
+        sched_set_class(thr, SCHED_DAEMON);
+
+        KASSERT(WORKQUEUE_MAX_WORKERS > wq->wq_nworkers);
+        wq->wq_workers[wq->wq_nworkers++] = thr;
+        sched_make_runnable(thr);
+        return 0;
+}
+
+int
+workqueue_init(workqueue_t *wq, const char *name, int max_workers)
+{
+        KASSERT(0 < max_workers && WORKQUEUE_MAX_WORKERS >= max_workers);
+
+        memset(wq, 0, sizeof(*wq));
+        strncpy(wq->wq_name, name, WORKQUEUE_NAME_LEN - 1);
+        list_init(&wq->wq_pending);
+        sched_queue_init(&wq->wq_idleq);
+        sched_queue_init(&wq->wq_flushq);
+        wq->wq_parent = curproc;
+        wq->wq_max_workers = max_workers;
+
+        if (workqueue_spawn(wq) < 0) {
+                return -ENOMEM;
+        }
+        list_insert_tail(&workqueue_list, &wq->wq_link);
+        return 0;
+}
+
+void
+workqueue_destroy(workqueue_t *wq)
+{
+        kthread_t *thr;
+        pid_t pid, child;
+
+        KASSERT(curproc == wq->wq_parent);
+
+        wq->wq_stopping = 1;
+        while (0 < wq->wq_nworkers) {
+                thr = wq->wq_workers[--wq->wq_nworkers];
+                pid = thr->kt_proc->p_pid;
+                kthread_cancel(thr, NULL);
+
+                child = do_waitpid(pid, 0, NULL);
+                KASSERT(pid == child && "waited on process other than the worker");
+        }
+
+        KASSERT(list_empty(&wq->wq_pending));
+        list_remove(&wq->wq_link);
+}
+
+int
+workqueue_submit(workqueue_t *wq, work_t *work)
+{
+        uint8_t ipl = intr_getipl();
+        intr_setipl(IPL_HIGH);
+
+        if (work->w_pending) {
+                intr_setipl(ipl);
+                return 0;
+        }
+
+        work->w_pending = 1;
+        work->w_queued = rdtsc();
+        list_insert_tail(&wq->wq_pending, &work->w_link);
+
+        wq->wq_nsubmitted++;
+        wq->wq_npending++;
+        wq->wq_max_backlog = MAX(wq->wq_max_backlog, (uint32_t) wq->wq_npending);
+
+        sched_wakeup_on(&wq->wq_idleq);
+
+        intr_setipl(ipl);
+        return 1;
+}
+
+int
+workqueue_submit_delayed(workqueue_t *wq, delayed_work_t *dwork, uint32_t ticks)
+{
+        uint8_t ipl = intr_getipl();
+        intr_setipl(IPL_HIGH);
+
+        if (ktimer_pending(&dwork->dw_timer) || dwork->dw_work.w_pending) {
+                intr_setipl(ipl);
+                return 0;
+        }
+
+        dwork->dw_wq = wq;
+        if (0 == ticks) {
+                workqueue_submit(wq, &dwork->dw_work);
+        } else {
+                ktimer_add(&dwork->dw_timer, jiffies + ticks);
+        }
+
+        intr_setipl(ipl);
+        return 1;
+}
+
+int
+workqueue_cancel(workqueue_t *wq, work_t *work)
+{
+        uint8_t ipl = intr_getipl();
+        intr_setipl(IPL_HIGH);
+
+        if (!work->w_pending) {
+                intr_setipl(ipl);
+                return 0;
+        }
+
+        list_remove(&work->w_link);
+        work->w_pending = 0;
+        wq->wq_npending--;
+        if (list_empty(&wq->wq_pending) && 0 == wq->wq_nbusy) {
+                sched_broadcast_on(&wq->wq_flushq);
+        }
+
+        intr_setipl(ipl);
+        return 1;
+}
+
+int
+workqueue_cancel_delayed(delayed_work_t *dwork)
+{
+        int ret;
+        uint8_t ipl = intr_getipl();
+        intr_setipl(IPL_HIGH);
+
+        ret = ktimer_cancel(&dwork->dw_timer);
+        if (!ret && NULL != dwork->dw_wq) {
+                ret = workqueue_cancel(dwork->dw_wq, &dwork->dw_work);
+        }
+
+        intr_setipl(ipl);
+        return ret;
+}
+
+void
+workqueue_flush(workqueue_t *wq)
+{
+        uint8_t ipl = intr_getipl();
+        intr_setipl(IPL_HIGH);
+
+        KASSERT(!workqueue_in_worker(wq) && "flushing a workqueue from its own worker");
+        sched_wait_event(&wq->wq_flushq,
+                         list_empty(&wq->wq_pending) && 0 == wq->wq_nbusy);
+
+        intr_setipl(ipl);
+}
+
+int
+workqueue_in_worker(workqueue_t *wq)
+{
+        int i;
+
+        for (i = 0; i < wq->wq_nworkers; ++i) {
+                if (curthr == wq->wq_workers[i]) {
+                        return 1;
+                }
+        }
+        return 0;
+}
+
+size_t
+workqueue_info(const void *arg, char *buf, size_t osize)
+{
+        size_t size = osize;
+        workqueue_t *wq;
+
+        KASSERT(NULL == arg);
+
+        iprintf(&buf, &size, "%-15s %7s %5s %9s %9s %9s %12s %12s\n",
+                "QUEUE", "WORKERS", "IDLE", "SUBMITTED", "DONE", "BACKLOG",
+                "AVG WAIT us", "MAX WAIT us");
+        list_iterate_begin(&workqueue_list, wq, workqueue_t, wq_link) {
+                iprintf(&buf, &size, "%-15s %3i/%-3i %5i %9u %9u %4i/%-4u %12llu %12llu\n",
+                        wq->wq_name, wq->wq_nworkers, wq->wq_max_workers,
+                        wq->wq_nidle, wq->wq_nsubmitted, wq->wq_ndone,
+                        wq->wq_npending, wq->wq_max_backlog,
+                        (0 == wq->wq_ndone) ? 0ULL
+                        : cycles_to_ns(wq->wq_latency_total / wq->wq_ndone) / 1000,
+                        cycles_to_ns(wq->wq_latency_max) / 1000);
+        } list_iterate_end();
+
+        return size;
+}
@@ -6,6 +6,20 @@
 
 #include "proc/proc.h"
 #include "proc/kthread.h"
+#include "proc/sched.h"
+#include "proc/reaper.h"
+#include "proc/lockstat.h"
+#include "proc/schedtrace.h"
+#include "proc/workqueue.h"
+
+#include "api/access.h"
+
+#include "mm/page.h"
+#include "mm/kstack.h"
+
+#include "main/fpu.h"
+#include "main/interrupt.h"
+#include "main/smp.h"
 
 #ifdef __VFS__
 #include "fs/fcntl.h"
@@ -21,6 +35,8 @@
 #include "util/debug.h"
 #include "util/string.h"
 #include "util/printf.h"
+#include "util/profile.h"
+#include "util/time.h"
 
 int kshell_help(kshell_t *ksh, int argc, char **argv)
 {
@@ -66,6 +82,387 @@ int kshell_echo(kshell_t *ksh, int argc, char **argv)
         return 0;
 }
 
+int kshell_uaccess(kshell_t *ksh, int argc, char **argv)
+{
+        char buf[256];
+
+        if (argc > 2) {
+                kprintf(ksh, "Usage: uaccess [fast|slow]\n");
+                return 0;
+        } else if (argc == 2) {
+                if (0 == strcmp(argv[1], "fast")) {
+                        uaccess_fastpath = 1;
+                } else if (0 == strcmp(argv[1], "slow")) {
+                        uaccess_fastpath = 0;
+                } else {
+                        kprintf(ksh, "Usage: uaccess [fast|slow]\n");
+                        return 0;
+                }
+        }
+
+        uaccess_info(NULL, buf, sizeof(buf));
+        kprintf(ksh, "%s", buf);
+        return 0;
+}
+
+int kshell_reaper(kshell_t *ksh, int argc, char **argv)
+{
+        char buf[256];
+
+        reaper_info(NULL, buf, sizeof(buf));
+        kprintf(ksh, "%s", buf);
+        return 0;
+}
+
+/*
+ * "workqueue test" runs a workqueue of its own through its paces. The
+ * blocking items each hold a worker until the gate opens, so with all
+ * of them submitted at once the queue has to grow a worker per item.
+ */
+#define WQ_TEST_NBLOCK  4
+#define WQ_TEST_TICKS   100     /* longest to wait for the workers */
+
+typedef struct wq_test_work {
+        work_t          wt_work;
+        int             wt_runs;
+} wq_test_work_t;
+
+typedef struct wq_test_dwork {
+        delayed_work_t  wd_dwork;
+        int             wd_runs;
+} wq_test_dwork_t;
+
+static ktqueue_t wq_test_gate;          /* blocking items wait here */
+static ktqueue_t wq_test_progress;      /* the test waits here for them */
+static int wq_test_open;
+static int wq_test_started;
+
+static void wq_test_count(work_t *w)
+{
+        CONTAINER_OF(w, wq_test_work_t, wt_work)->wt_runs++;
+}
+
+static void wq_test_count_delayed(work_t *w)
+{
+        delayed_work_t *dw = CONTAINER_OF(w, delayed_work_t, dw_work);
+
+        CONTAINER_OF(dw, wq_test_dwork_t, wd_dwork)->wd_runs++;
+}
+
+static void wq_test_block(work_t *w)
+{
+        wq_test_count(w);
+        wq_test_started++;
+        sched_broadcast_on(&wq_test_progress);
+        sched_wait_event(&wq_test_gate, wq_test_open);
+}
+
+static int wq_test_check(kshell_t *ksh, const char *what, int ok)
+{
+        kprintf(ksh, "%-44s %s\n", what, ok ? "ok" : "FAILED");
+        return ok ? 0 : -1;
+}
+
+static int wq_test(kshell_t *ksh)
+{
+        workqueue_t wq;
+        wq_test_work_t block[WQ_TEST_NBLOCK], extra, after;
+        wq_test_dwork_t late, soon;
+        uint32_t deadline;
+        int i, ok, rv = 0;
+
+        sched_queue_init(&wq_test_gate);
+        sched_queue_init(&wq_test_progress);
+        wq_test_open = 0;
+        wq_test_started = 0;
+        if (0 > workqueue_init(&wq, "wqtest", WQ_TEST_NBLOCK)) {
+                kprintf(ksh, "could not start a workqueue\n");
+                return -ENOMEM;
+        }
+
+        for (i = 0; i < WQ_TEST_NBLOCK; ++i) {
+                work_init(&block[i].wt_work, wq_test_block);
+                block[i].wt_runs = 0;
+                workqueue_submit(&wq, &block[i].wt_work);
+        }
+        deadline = jiffies + WQ_TEST_TICKS;
+        while (wq_test_started < WQ_TEST_NBLOCK && (int32_t)(deadline - jiffies) > 0) {
+                sched_sleep_on_timeout(&wq_test_progress, deadline - jiffies);
+        }
+        rv |= wq_test_check(ksh, "grows a worker per blocked item",
+                            WQ_TEST_NBLOCK == wq_test_started
+                            && WQ_TEST_NBLOCK == wq.wq_nworkers);
+
+        /* every worker is busy, so this stays queued */
+        work_init(&extra.wt_work, wq_test_count);
+        extra.wt_runs = 0;
+        workqueue_submit(&wq, &extra.wt_work);
+        rv |= wq_test_check(ksh, "cancels a pending item",
+                            1 == workqueue_cancel(&wq, &extra.wt_work)
+                            && 0 == wq.wq_npending);
+        rv |= wq_test_check(ksh, "does not cancel a running item",
+                            0 == workqueue_cancel(&wq, &block[0].wt_work));
+
+        delayed_work_init(&late.wd_dwork, wq_test_count_delayed);
+        late.wd_runs = 0;
+        workqueue_submit_delayed(&wq, &late.wd_dwork, WQ_TEST_TICKS);
+        rv |= wq_test_check(ksh, "cancels a delayed item before it is due",
+                            1 == workqueue_cancel_delayed(&late.wd_dwork));
+
+        /* let the blocked items finish, and flush them along with one
+         * more submitted behind them */
+        work_init(&after.wt_work, wq_test_count);
+        after.wt_runs = 0;
+        wq_test_open = 1;
+        sched_broadcast_on(&wq_test_gate);
+        workqueue_submit(&wq, &after.wt_work);
+        workqueue_flush(&wq);
+        ok = (1 == after.wt_runs && 0 == wq.wq_nbusy && 0 == wq.wq_npending);
+        for (i = 0; i < WQ_TEST_NBLOCK; ++i) {
+                ok = ok && (1 == block[i].wt_runs);
+        }
+        rv |= wq_test_check(ksh, "flush waits for running and queued items", ok);
+        rv |= wq_test_check(ksh, "cancelled items never run",
+                            0 == extra.wt_runs && 0 == late.wd_runs);
+
+        /* flushing does not wait for timers, so give it time to be due */
+        delayed_work_init(&soon.wd_dwork, wq_test_count_delayed);
+        soon.wd_runs = 0;
+        workqueue_submit_delayed(&wq, &soon.wd_dwork, 2);
+        sched_sleep_on_timeout(&wq_test_progress, 5);
+        workqueue_flush(&wq);
+        rv |= wq_test_check(ksh, "runs a delayed item once it is due",
+                            1 == soon.wd_runs);
+
+        workqueue_destroy(&wq);
+        return rv;
+}
+
+int kshell_workqueue(kshell_t *ksh, int argc, char **argv)
+{
+        char buf[512];
+
+        if (argc == 2 && 0 == strcmp(argv[1], "test")) {
+                return wq_test(ksh);
+        } else if (argc > 1) {
+                kprintf(ksh, "Usage: workqueue [test]\n");
+                return 0;
+        }
+
+        workqueue_info(NULL, buf, sizeof(buf));
+        kprintf(ksh, "%s", buf);
+        return 0;
+}
+
+int kshell_memstat(kshell_t *ksh, int argc, char **argv)
+{
+        char *buf;
+        int ret;
+
+        if (NULL == (buf = page_alloc())) {
+                return -ENOMEM;
+        }
+        proc_memstat_info(NULL, buf, PAGE_SIZE);
+        ret = kshell_write_all(ksh, buf, strnlen(buf, PAGE_SIZE));
+        page_free(buf);
+        return (ret < 0) ? ret : 0;
+}
+
+int kshell_kstack(kshell_t *ksh, int argc, char **argv)
+{
+        char buf[512];
+
+        kstack_info(NULL, buf, sizeof(buf));
+        kprintf(ksh, "%s", buf);
+        return 0;
+}
+
+int kshell_fpu(kshell_t *ksh, int argc, char **argv)
+{
+        char buf[256];
+
+        fpu_info(NULL, buf, sizeof(buf));
+        kprintf(ksh, "%s", buf);
+        return 0;
+}
+
+int kshell_sched(kshell_t *ksh, int argc, char **argv)
+{
+        char *buf;
+        int ret;
+
+        if (NULL == (buf = page_alloc())) {
+                return -ENOMEM;
+        }
+        sched_info(NULL, buf, PAGE_SIZE);
+        ret = kshell_write_all(ksh, buf, strnlen(buf, PAGE_SIZE));
+        page_free(buf);
+        return (ret < 0) ? ret : 0;
+}
+
+int kshell_time(kshell_t *ksh, int argc, char **argv)
+{
+        char buf[256];
+
+        time_info(NULL, buf, sizeof(buf));
+        kprintf(ksh, "%s", buf);
+        return 0;
+}
+
+/* Timer function for kshell_timeout_test(): wakes up the sleeper */
+static void timeout_test_wake(void *arg)
+{
+        sched_wakeup_on((ktqueue_t *) arg);
+}
+
+#define TIMEOUT_TEST_TICKS 3
+
+static int timeout_test_one(kshell_t *ksh, const char *what, int wake_at,
+                            int expect)
+{
+        ktqueue_t q;
+        ktimer_t waker;
+        uint8_t ipl;
+        int ret;
+
+        sched_queue_init(&q);
+        ktimer_init(&waker, timeout_test_wake, &q);
+
+        /* so that the clock cannot tick between adding the two timers,
+         * and timers for the same tick run in the order they were added */
+        ipl = intr_getipl();
+        intr_setipl(IPL_HIGH);
+        if (wake_at > 0) {
+                ktimer_add(&waker, jiffies + wake_at);
+        }
+        ret = sched_sleep_on_timeout(&q, TIMEOUT_TEST_TICKS);
+        intr_setipl(ipl);
+        ktimer_cancel(&waker);
+
+        kprintf(ksh, "%-28s %-10s %s\n", what,
+                (0 == ret) ? "woken" : strerror(-ret),
+                (ret == expect) ? "ok" : "FAILED");
+        return (ret == expect) ? 0 : -1;
+}
+
+/*
+ * Sleeps with a timeout of TIMEOUT_TEST_TICKS three times: with nothing
+ * to wake it, so the time runs out; woken a tick before the timeout;
+ * and woken in the very tick the timeout goes off, just before it does.
+ * The last must count as a wakeup even though the timeout then finds
+ * the thread still waiting to run.
+ */
+int kshell_timeout_test(kshell_t *ksh, int argc, char **argv)
+{
+        int rv = 0;
+
+        KASSERT(NULL != ksh);
+
+        rv |= timeout_test_one(ksh, "no wakeup", 0, -ETIMEDOUT);
+        rv |= timeout_test_one(ksh, "wakeup a tick early",
+                               TIMEOUT_TEST_TICKS - 1, 0);
+        rv |= timeout_test_one(ksh, "wakeup in the same tick",
+                               TIMEOUT_TEST_TICKS, 0);
+        return rv;
+}
+
+#ifdef __LOCKSTAT__
+int kshell_lockstat(kshell_t *ksh, int argc, char **argv)
+{
+        char *buf;
+        int ret;
+
+        if (argc > 2 || (argc == 2 && 0 != strcmp(argv[1], "reset"))) {
+                kprintf(ksh, "Usage: lockstat [reset]\n");
+                return 0;
+        } else if (argc == 2) {
+                lockstat_reset();
+                return 0;
+        }
+
+        if (NULL == (buf = page_alloc())) {
+                return -ENOMEM;
+        }
+        lockstat_info(NULL, buf, PAGE_SIZE);
+        ret = kshell_write_all(ksh, buf, strnlen(buf, PAGE_SIZE));
+        page_free(buf);
+        return (ret < 0) ? ret : 0;
+}
+#endif
+
+#ifdef __SMP__
+int kshell_cpus(kshell_t *ksh, int argc, char **argv)
+{
+        char buf[1024];
+
+        smp_info(NULL, buf, sizeof(buf));
+        kprintf(ksh, "%s", buf);
+        return 0;
+}
+#endif
+
+#ifdef __SCHEDTRACE__
+int kshell_schedtrace(kshell_t *ksh, int argc, char **argv)
+{
+        char *buf;
+        int ret, n = 40;
+
+        if (2 == argc && 0 == strcmp(argv[1], "on")) {
+                schedtrace_enable(1);
+                return 0;
+        } else if (2 == argc && 0 == strcmp(argv[1], "off")) {
+                schedtrace_enable(0);
+                return 0;
+        } else if (argc > 2 || (2 == argc && (1 != sscanf(argv[1], "%d", &n) || n <= 0))) {
+                kprintf(ksh, "Usage: schedtrace [on | off | <count>]\n");
+                return 0;
+        }
+
+        if (NULL == (buf = page_alloc_n(4))) {
+                return -ENOMEM;
+        }
+        schedtrace_info((void *) n, buf, 4 * PAGE_SIZE);
+        ret = kshell_write_all(ksh, buf, strnlen(buf, 4 * PAGE_SIZE));
+        page_free_n(buf, 4);
+        return (ret < 0) ? ret : 0;
+}
+#endif
+
+#ifdef __PROFILE__
+int kshell_profile(kshell_t *ksh, int argc, char **argv)
+{
+        char *buf;
+        int ret, n = 20, hz = 1000 / TICK_MSECS;
+
+        if (argc >= 2 && argc <= 3 && 0 == strcmp(argv[1], "start")) {
+                if (3 == argc && (1 != sscanf(argv[2], "%d", &hz) || hz <= 0)) {
+                        kprintf(ksh, "Usage: profile start [<samples a second, "
+                                "at most %d>]\n", 1000 / TICK_MSECS);
+                        return 0;
+                }
+                profile_start(hz);
+                return 0;
+        } else if (2 == argc && 0 == strcmp(argv[1], "stop")) {
+                profile_stop();
+                return 0;
+        } else if (2 == argc && 0 == strcmp(argv[1], "dump")) {
+                kprintf(ksh, "wrote %d stacks to the debug console\n", profile_dump());
+                return 0;
+        } else if (argc > 2 || (2 == argc && (1 != sscanf(argv[1], "%d", &n) || n <= 0))) {
+                kprintf(ksh, "Usage: profile [start [<hz>] | stop | dump | <count>]\n");
+                return 0;
+        }
+
+        if (NULL == (buf = page_alloc_n(4))) {
+                return -ENOMEM;
+        }
+        profile_info((void *) n, buf, 4 * PAGE_SIZE);
+        ret = kshell_write_all(ksh, buf, strnlen(buf, 4 * PAGE_SIZE));
+        page_free_n(buf, 4);
+        return (ret < 0) ? ret : 0;
+}
+#endif
+
 #ifdef __VFS__
 int kshell_cat(kshell_t *ksh, int argc, char **argv)
 {
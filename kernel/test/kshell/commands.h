@@ -8,6 +8,27 @@
 KSHELL_CMD(help);
 KSHELL_CMD(exit);
 KSHELL_CMD(echo);
+KSHELL_CMD(uaccess);
+KSHELL_CMD(reaper);
+KSHELL_CMD(workqueue);
+KSHELL_CMD(memstat);
+KSHELL_CMD(kstack);
+KSHELL_CMD(fpu);
+KSHELL_CMD(sched);
+KSHELL_CMD(time);
+KSHELL_CMD(timeout_test);
+#ifdef __LOCKSTAT__
+KSHELL_CMD(lockstat);
+#endif
+#ifdef __SMP__
+KSHELL_CMD(cpus);
+#endif
+#ifdef __SCHEDTRACE__
+KSHELL_CMD(schedtrace);
+#endif
+#ifdef __PROFILE__
+KSHELL_CMD(profile);
+#endif
 #ifdef __VFS__
 KSHELL_CMD(cat);
 KSHELL_CMD(ls);
@@ -34,6 +34,40 @@ static __attribute__((unused)) void kshell_init()
         kshell_add_command("help", kshell_help,
                            "prints a list of available commands");
         kshell_add_command("echo", kshell_echo, "display a line of text");
+        kshell_add_command("uaccess", kshell_uaccess,
+                           "show or set (fast|slow) the user copy path");
+        kshell_add_command("reaper", kshell_reaper,
+                           "show address space reaper statistics");
+        kshell_add_command("workqueue", kshell_workqueue,
+                           "show workqueue statistics, or test workqueues");
+        kshell_add_command("memstat", kshell_memstat,
+                           "show memory usage of every process");
+        kshell_add_command("kstack", kshell_kstack,
+                           "show kernel stack usage and high water marks");
+        kshell_add_command("fpu", kshell_fpu,
+                           "show which thread owns the FPU and trap counts");
+        kshell_add_command("sched", kshell_sched,
+                           "show scheduler statistics");
+        kshell_add_command("time", kshell_time,
+                           "show the clock and timer statistics");
+        kshell_add_command("timeout_test", kshell_timeout_test,
+                           "tests sleeping with a timeout");
+#ifdef __LOCKSTAT__
+        kshell_add_command("lockstat", kshell_lockstat,
+                           "show or reset the most contended locks");
+#endif
+#ifdef __SMP__
+        kshell_add_command("cpus", kshell_cpus,
+                           "show what each processor is doing and its statistics");
+#endif
+#ifdef __SCHEDTRACE__
+        kshell_add_command("schedtrace", kshell_schedtrace,
+                           "turn scheduler tracing on or off, or show recent events");
+#endif
+#ifdef __PROFILE__
+        kshell_add_command("profile", kshell_profile,
+                           "start or stop the kernel profiler, or show or dump its samples");
+#endif
 #ifdef __VFS__
         kshell_add_command("cat", kshell_cat,
                            "concatenate files and print on the standard output");
@@ -0,0 +1,224 @@
+#include "globals.h"
+#include "types.h"
+#include "config.h"
+
+#include "main/gdt.h"
+#include "main/interrupt.h"
+
+#include "proc/kthread.h"
+
+#include "util/debug.h"
+#include "util/printf.h"
+#include "util/profile.h"
+#include "util/string.h"
+
+#ifdef __PROFILE__
+/* How many slots after the one a stack hashes to are tried before
+ * giving up on finding room for it */
+#define PROFILE_PROBES  32
+
+/* Not static, so that gdb can find it (see kernel/util/profile.py) */
+profile_t profile = {
+        .pr_magic = PROFILE_MAGIC,
+        .pr_nstacks = PROFILE_NSTACKS,
+        .pr_depth = PROFILE_DEPTH,
+        .pr_tick_msecs = TICK_MSECS
+};
+
+static uint32_t profile_countdown;      /* ticks until the next sample */
+
+/*
+ * Fills in pcs with the interrupted EIP and the return addresses found
+ * by following the frame pointers from regs->r_ebp, stopping at the
+ * first one which does not point further up the current thread's
+ * kernel stack (the outermost frame, or code interrupted before it set
+ * up its own). Returns the number of pcs.
+ */
+static uint32_t
+profile_backtrace(regs_t *regs, uint32_t *pcs)
+{
+        uint32_t depth = 0;
+        uint32_t *fp, *next;
+        uintptr_t lo, hi;
+
+        pcs[depth++] = regs->r_eip;
+        if (NULL == curthr) {
+                return depth;
+        }
+
+        lo = (uintptr_t) curthr->kt_kstack;
+        hi = lo + DEFAULT_STACK_SIZE;
+        fp = (uint32_t *) regs->r_ebp;
+        while (depth < PROFILE_DEPTH) {
+                if ((uintptr_t) fp < lo || (uintptr_t) fp > hi - 2 * sizeof(uint32_t)
+                    || 0 != ((uintptr_t) fp & (sizeof(uint32_t) - 1))) {
+                        break;
+                }
+                pcs[depth++] = fp[1];
+                next = (uint32_t *) fp[0];
+                if (next <= fp) {
+                        break;
+                }
+                fp = next;
+        }
+        return depth;
+}
+
+static void
+profile_add(uint32_t *pcs, uint32_t depth)
+{
+        uint32_t hash = depth, i, n;
+        profile_stack_t *ps;
+
+        for (i = 0; i < depth; ++i) {
+                hash = (hash ^ pcs[i]) * 0x01000193;
+        }
+        for (n = 0; n < PROFILE_PROBES; ++n) {
+                ps = &profile.pr_stacks[(hash + n) & (PROFILE_NSTACKS - 1)];
+                if (0 == ps->ps_count) {
+                        ps->ps_depth = depth;
+                        memcpy(ps->ps_pcs, pcs, depth * sizeof(uint32_t));
+                        ps->ps_count = 1;
+                        return;
+                }
+                if (ps->ps_depth == depth
+                    && 0 == memcmp(ps->ps_pcs, pcs, depth * sizeof(uint32_t))) {
+                        ps->ps_count++;
+                        return;
+                }
+        }
+        profile.pr_ndropped++;
+}
+
+void
+profile_tick(regs_t *regs)
+{
+        uint32_t pcs[PROFILE_DEPTH];
+        uint32_t depth;
+
+        if (!profile.pr_enabled || 0 != --profile_countdown) {
+                return;
+        }
+        profile_countdown = profile.pr_period;
+        profile.pr_nsamples++;
+
+        if (GDT_USER_TEXT == (regs->r_cs & ~0x3)) {
+                pcs[0] = PROFILE_USER;
+                depth = 1;
+        } else {
+                depth = profile_backtrace(regs, pcs);
+        }
+        profile_add(pcs, depth);
+}
+
+void
+profile_start(int hz)
+{
+        uint8_t ipl = intr_getipl();
+        intr_setipl(IPL_HIGH);
+
+        memset(profile.pr_stacks, 0, sizeof(profile.pr_stacks));
+        profile.pr_nsamples = 0;
+        profile.pr_ndropped = 0;
+        profile.pr_period = MAX(1, (1000 / TICK_MSECS) / MAX(1, hz));
+        profile_countdown = profile.pr_period;
+        profile.pr_enabled = 1;
+
+        intr_setipl(ipl);
+}
+
+void
+profile_stop(void)
+{
+        profile.pr_enabled = 0;
+}
+
+/* Formats a stack as a line of text, as described in profile.h */
+static size_t
+profile_stack_info(const void *arg, char *buf, size_t osize)
+{
+        const profile_stack_t *ps = arg;
+        size_t size = osize;
+        uint32_t i;
+
+        iprintf(&buf, &size, "%u", ps->ps_count);
+        for (i = 0; i < ps->ps_depth; ++i) {
+                iprintf(&buf, &size, " 0x%08x", ps->ps_pcs[i]);
+        }
+        iprintf(&buf, &size, "\n");
+        return size;
+}
+
+int
+profile_dump(void)
+{
+        int i, n = 0;
+
+        dbg_print("profile: begin %u samples every %u ms, %u dropped\n",
+                  profile.pr_nsamples, profile.pr_period * profile.pr_tick_msecs,
+                  profile.pr_ndropped);
+        for (i = 0; i < PROFILE_NSTACKS; ++i) {
+                if (0 != profile.pr_stacks[i].ps_count) {
+                        dbg_printinfo(profile_stack_info, &profile.pr_stacks[i]);
+                        n++;
+                }
+        }
+        dbg_print("profile: end\n");
+        return n;
+}
+
+size_t
+profile_info(const void *arg, char *buf, size_t osize)
+{
+        size_t size = osize;
+        uint32_t n = (uint32_t) arg, shown, count, lastcount = 0, bp;
+        int i, best, last = -1, nstacks = 0;
+        profile_stack_t *ps;
+
+        for (i = 0; i < PROFILE_NSTACKS; ++i) {
+                if (0 != profile.pr_stacks[i].ps_count) {
+                        nstacks++;
+                }
+        }
+        iprintf(&buf, &size, "profiler %s, %u samples every %u ms "
+                "(%u dropped), %d distinct stacks\n",
+                profile.pr_enabled ? "running" : "stopped", profile.pr_nsamples,
+                profile.pr_period * profile.pr_tick_msecs, profile.pr_ndropped,
+                nstacks);
+        if (0 == nstacks) {
+                return size;
+        }
+        iprintf(&buf, &size, "%8s %7s  %s\n", "SAMPLES", "PERCENT", "STACK");
+
+        /* Picks each stack in turn by count, highest first, breaking ties
+         * by position in the table, without needing anywhere to sort */
+        for (shown = 0; shown < n; ++shown) {
+                best = -1;
+                for (i = 0; i < PROFILE_NSTACKS; ++i) {
+                        count = profile.pr_stacks[i].ps_count;
+                        if (0 == count || (-1 != last && (count > lastcount
+                                           || (count == lastcount && i <= last)))) {
+                                continue;
+                        }
+                        if (-1 == best || count > profile.pr_stacks[best].ps_count) {
+                                best = i;
+                        }
+                }
+                if (-1 == best) {
+                        break;
+                }
+                ps = &profile.pr_stacks[best];
+                /* in hundredths of a percent, without overflowing */
+                bp = (ps->ps_count <= 0xffffffff / 10000)
+                     ? ps->ps_count * 10000 / profile.pr_nsamples
+                     : ps->ps_count / (profile.pr_nsamples / 10000);
+                iprintf(&buf, &size, "%8u %3u.%02u%%  ", ps->ps_count,
+                        bp / 100, bp % 100);
+                size = profile_stack_info(ps, buf, size);
+                buf += strlen(buf);
+                last = best;
+                lastcount = ps->ps_count;
+        }
+        return size;
+}
+#endif /* __PROFILE__ */
@@ -0,0 +1,39 @@
+import gdb
+
+import weenix
+import weenix.profile
+
+def _lookup(pc):
+	block = gdb.block_for_pc(pc)
+	while (block is not None and block.function is None):
+		block = block.superblock
+	return None if (block is None) else block.function.name
+
+class ProfileCommand(weenix.Command):
+	"""usage: profile [--folded]
+	Prints the kernel profiler's samples as a flat profile, or with
+	--folded as folded stacks for flame graph tools. The kernel must be
+	built with PROFILE=1, and the profiler run with the profile kshell
+	command."""
+
+	def __init__(self):
+		weenix.Command.__init__(self, "profile", gdb.COMMAND_DATA)
+
+	def invoke(self, args, tty):
+		args = gdb.string_to_argv(args)
+		if (len(args) > 1 or (len(args) == 1 and args[0] != "--folded")):
+			gdb.write("{0}\n".format(self.__doc__))
+			raise gdb.GdbError("invalid arguments")
+		try:
+			val = gdb.parse_and_eval("profile")
+		except gdb.error:
+			print "the kernel was not built with PROFILE=1"
+			return
+		data = gdb.selected_inferior().read_memory(val.address, val.type.sizeof)
+		prof = weenix.profile.Profile(bytes(data))
+		if (len(args) == 1):
+			gdb.write(weenix.profile.folded(prof, _lookup))
+		else:
+			gdb.write(weenix.profile.flat(prof, _lookup))
+
+ProfileCommand()
@@ -1,14 +1,356 @@
+#include "config.h"
 #include "globals.h"
+#include "errno.h"
+#include "kernel.h"
 
 #include "main/interrupt.h"
 #include "main/apic.h"
 #include "main/pit.h"
+#include "main/cpuid.h"
 
 #include "util/debug.h"
 #include "util/init.h"
+#include "util/list.h"
+#include "util/printf.h"
+#include "util/profile.h"
+#include "util/time.h"
 
 #include "proc/sched.h"
 #include "proc/kthread.h"
 
+#include "api/time.h"
+#include "api/vdata.h"
+
+volatile uint32_t jiffies = 0;
+
+/*
+ * The TSC is converted to nanoseconds with a multiply and a shift,
+ * ns = (cycles * tsc_mult) >> TSC_SHIFT (see tsc_to_ns()), to avoid a
+ * 64-bit division on every read. User processes do the same from the
+ * parameters in their vdata page. A shift of 22 keeps tsc_mult within
+ * 32 bits for any TSC faster than 1 MHz, and the rounding error around
+ * one part in a million up to 4 GHz. If calibration fails tsc_mult is
+ * 0 and time comes from jiffies instead.
+ */
+#define TSC_SHIFT 22
+
+static uint64_t tsc_hz;
+static uint64_t tsc_base;       /* TSC reading at which ktime is 0 */
+static uint32_t tsc_mult;
+
+static uint32_t timer_nadded;
+static uint32_t timer_ncancelled;
+static uint32_t timer_nrun;
+static uint32_t timer_ncascaded;
+
 #ifdef __UPREEMPT__
+/* Number of clock ticks a thread may run before it is preempted. */
+#define TIMESLICE_TICKS \
+        ((TIMESLICE_MSECS + TICK_MSECS - 1) / TICK_MSECS)
 #endif
+
+/*
+ * Pending timers are kept in a hierarchical timing wheel. The root
+ * wheel has a slot for each of the next TIMER_ROOT_SIZE ticks. Each
+ * slot of the first outer wheel covers a whole turn of the root wheel,
+ * each slot of the next covers a turn of the first outer wheel, and
+ * so on, so that the outer wheels together cover every possible
+ * expiry time.
+ *
+ * A timer goes in the slot of the innermost wheel that can hold it,
+ * which is a constant time list insertion, and cancelling it is just
+ * removing it from that list. Whenever the root wheel comes round to
+ * slot 0 the next slot of the first outer wheel is emptied, and its
+ * timers are put back into the wheel; since they now expire within
+ * one turn they all land in the root wheel. The same happens between
+ * each outer wheel and the next one out, so each timer is moved at
+ * most once per wheel.
+ *
+ * timer_jiffies is the next tick whose root slot has not been run.
+ * It lags jiffies only while the clock interrupt handler is running.
+ */
+#define TIMER_ROOT_BITS         8
+#define TIMER_ROOT_SIZE         (1 << TIMER_ROOT_BITS)
+#define TIMER_ROOT_MASK         (TIMER_ROOT_SIZE - 1)
+#define TIMER_OUTER_BITS        6
+#define TIMER_OUTER_SIZE        (1 << TIMER_OUTER_BITS)
+#define TIMER_OUTER_MASK        (TIMER_OUTER_SIZE - 1)
+#define TIMER_NOUTER            4
+
+/* The first tick which outer wheel n cannot hold */
+#define TIMER_OUTER_LIMIT(n) \
+        (1U << (TIMER_ROOT_BITS + ((n) + 1) * TIMER_OUTER_BITS))
+/* The slot of outer wheel n which covers the tick */
+#define TIMER_OUTER_INDEX(n, tick) \
+        (((tick) >> (TIMER_ROOT_BITS + (n) * TIMER_OUTER_BITS)) & TIMER_OUTER_MASK)
+
+static list_t timer_root[TIMER_ROOT_SIZE];
+static list_t timer_outer[TIMER_NOUTER][TIMER_OUTER_SIZE];
+static uint32_t timer_jiffies;
+
+/* Puts a timer into the right slot. Interrupts must be blocked. */
+static void
+timer_enqueue(ktimer_t *timer)
+{
+        uint32_t expires = timer->tm_expires;
+        uint32_t delta = expires - timer_jiffies;
+        list_t *slot;
+        int n;
+
+        if ((int32_t) delta < 0) {
+                /* already due, run it with the next tick */
+                slot = &timer_root[timer_jiffies & TIMER_ROOT_MASK];
+        } else if (delta < TIMER_ROOT_SIZE) {
+                slot = &timer_root[expires & TIMER_ROOT_MASK];
+        } else {
+                for (n = 0; n < TIMER_NOUTER - 1; ++n) {
+                        if (delta < TIMER_OUTER_LIMIT(n)) {
+                                break;
+                        }
+                }
+                slot = &timer_outer[n][TIMER_OUTER_INDEX(n, expires)];
+        }
+        list_insert_tail(slot, &timer->tm_link);
+}
+
+/* Empties the given slot of outer wheel n into the inner wheels and
+ * returns the slot number. */
+static uint32_t
+timer_cascade(int n, uint32_t index)
+{
+        list_t *slot = &timer_outer[n][index];
+        ktimer_t *timer;
+
+        while (!list_empty(slot)) {
+                timer = list_head(slot, ktimer_t, tm_link);
+                list_remove(&timer->tm_link);
+                timer_enqueue(timer);
+                timer_ncascaded++;
+        }
+        return index;
+}
+
+/* Runs every timer which has expired. Called from the clock interrupt
+ * handler. */
+static void
+timer_run(void)
+{
+        uint32_t index;
+        list_t *slot;
+        ktimer_t *timer;
+        int n;
+
+        while ((int32_t)(jiffies - timer_jiffies) >= 0) {
+                index = timer_jiffies & TIMER_ROOT_MASK;
+                if (0 == index) {
+                        for (n = 0; n < TIMER_NOUTER; ++n) {
+                                if (0 != timer_cascade(n,
+                                    TIMER_OUTER_INDEX(n, timer_jiffies))) {
+                                        break;
+                                }
+                        }
+                }
+                timer_jiffies++;
+
+                slot = &timer_root[index];
+                while (!list_empty(slot)) {
+                        timer = list_head(slot, ktimer_t, tm_link);
+                        list_remove(&timer->tm_link);
+                        timer_nrun++;
+                        timer->tm_func(timer->tm_arg);
+                }
+        }
+}
+
+void
+ktimer_init(ktimer_t *timer, ktimer_func_t func, void *arg)
+{
+        timer->tm_expires = 0;
+        timer->tm_func = func;
+        timer->tm_arg = arg;
+        list_link_init(&timer->tm_link);
+}
+
+void
+ktimer_add(ktimer_t *timer, uint32_t expires)
+{
+        uint8_t ipl = intr_getipl();
+        intr_setipl(IPL_HIGH);
+
+        KASSERT(!ktimer_pending(timer));
+        timer->tm_expires = expires;
+        timer_enqueue(timer);
+        timer_nadded++;
+
+        intr_setipl(ipl);
+}
+
+int
+ktimer_cancel(ktimer_t *timer)
+{
+        int pending;
+        uint8_t ipl = intr_getipl();
+        intr_setipl(IPL_HIGH);
+
+        if ((pending = ktimer_pending(timer))) {
+                list_remove(&timer->tm_link);
+                timer_ncancelled++;
+        }
+
+        intr_setipl(ipl);
+        return pending;
+}
+
+uint64_t
+cycles_to_ns(uint64_t cycles)
+{
+        return tsc_to_ns(cycles, tsc_mult, TSC_SHIFT);
+}
+
+void
+ktime_tsc_params(uint64_t *base, uint32_t *mult, uint32_t *shift)
+{
+        *base = tsc_base;
+        *mult = tsc_mult;
+        *shift = TSC_SHIFT;
+}
+
+uint64_t
+ktime_get_ns(void)
+{
+        if (0 == tsc_mult) {
+                return (uint64_t) jiffies * TICK_MSECS * 1000000;
+        }
+        return cycles_to_ns(rdtsc() - tsc_base);
+}
+
+size_t
+time_info(const void *arg, char *buf, size_t osize)
+{
+        size_t size = osize;
+        uint64_t ns = ktime_get_ns();
+
+        KASSERT(NULL == arg);
+
+        iprintf(&buf, &size, "tsc:         %llu kHz%s\n", tsc_hz / 1000,
+                (0 == tsc_mult) ? " (not calibrated, using jiffies)" : "");
+        iprintf(&buf, &size, "uptime:      %llu.%09llu s\n",
+                ns / 1000000000, ns % 1000000000);
+        iprintf(&buf, &size, "jiffies:     %u (%u ms/tick)\n", jiffies, TICK_MSECS);
+        iprintf(&buf, &size, "timers:      %u added, %u cancelled, %u run, %u cascaded\n",
+                timer_nadded, timer_ncancelled, timer_nrun, timer_ncascaded);
+
+        return size;
+}
+
+uint32_t
+timespec_to_jiffies(const struct timespec *ts)
+{
+        uint64_t ticks;
+
+        ticks = (uint64_t) ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+        ticks = (ticks + TICK_MSECS * 1000000ULL - 1) / (TICK_MSECS * 1000000ULL);
+        return (ticks >= 0x7fffffff) ? 0x7fffffff : (uint32_t) ticks + 1;
+}
+
+int
+do_nanosleep(const struct timespec *req, struct timespec *rem)
+{
+        ktqueue_t q;
+        uint32_t ticks, start, left;
+        int ret;
+
+        if (req->tv_sec < 0 || req->tv_nsec < 0 || req->tv_nsec >= 1000000000) {
+                return -EINVAL;
+        }
+
+        ticks = timespec_to_jiffies(req);
+
+        sched_queue_init(&q);
+        start = jiffies;
+        ret = sched_cancellable_sleep_on_timeout(&q, ticks);
+        if (-EINTR != ret) {
+                return 0;
+        }
+
+        if (NULL != rem) {
+                left = ticks - MIN(jiffies - start, ticks);
+                rem->tv_sec = left / (1000 / TICK_MSECS);
+                rem->tv_nsec = (left % (1000 / TICK_MSECS)) * TICK_MSECS * 1000000;
+        }
+        return -EINTR;
+}
+
+/*
+ * The clock interrupt handler. Besides counting ticks and running
+ * timers, it charges each tick to the running thread, and once the
+ * thread has run for a whole slice it sets kt_need_resched. Nothing is
+ * switched here: the thread is preempted when it next returns to user
+ * mode (see __intr_handler()), so kernel code never has to deal with
+ * being preempted.
+ */
+static void
+time_intr_handler(regs_t *regs)
+{
+        jiffies++;
+        timer_run();
+        PROFILE_TICK(regs);
+
+#ifdef __UPREEMPT__
+#ifdef __SMP__
+        /* The clock only interrupts the BSP, so it keeps time for every
+         * CPU; another CPU running user code has to be interrupted to
+         * notice that its slice is up. Its current thread cannot change
+         * under us, since switching threads takes the kernel lock. */
+        int i;
+        for (i = 0; i < smp_ncpus; ++i) {
+                kthread_t *thr = cpus[i].cpu_thr;
+                if (NULL == thr || thr == cpus[i].cpu_idlethr) {
+                        continue;
+                }
+                if (++thr->kt_ticks >= TIMESLICE_TICKS && !thr->kt_need_resched) {
+                        thr->kt_need_resched = 1;
+                        if (i != smp_cpuid()) {
+                                smp_resched(i);
+                        }
+                }
+        }
+#else
+        if (NULL != curthr && ++curthr->kt_ticks >= TIMESLICE_TICKS) {
+                curthr->kt_need_resched = 1;
+        }
+#endif
+#endif
+}
+
+static __attribute__((unused)) void
+time_init(void)
+{
+        int i, n;
+
+        for (i = 0; i < TIMER_ROOT_SIZE; ++i) {
+                list_init(&timer_root[i]);
+        }
+        for (n = 0; n < TIMER_NOUTER; ++n) {
+                for (i = 0; i < TIMER_OUTER_SIZE; ++i) {
+                        list_init(&timer_outer[n][i]);
+                }
+        }
+        timer_jiffies = jiffies;
+
+        uint8_t ipl = intr_getipl();
+        intr_setipl(IPL_HIGH);
+        tsc_hz = pit_calibrate_tsc();
+        tsc_base = rdtsc();
+        intr_setipl(ipl);
+        if (tsc_hz >= 1000000) {
+                tsc_mult = (uint32_t)((1000000000ULL << TSC_SHIFT) / tsc_hz);
+        }
+        dbg(DBG_INIT, "TSC runs at %llu kHz\n", tsc_hz / 1000);
+
+        intr_handler_t old = intr_register(INTR_PIT, time_intr_handler);
+        KASSERT(NULL == old);
+        pit_starttimer(INTR_PIT);
+}
+init_func(time_init);
+init_depends(sched_init);
@@ -17,8 +17,25 @@
 #include "vm/pagefault.h"
 #include "vm/vmmap.h"
 
+int
+do_pagefault(uintptr_t vaddr, uint32_t cause)
+{
+        uint32_t pageins = curthr->kt_npageins;
+        int ret;
+
+        if (0 == (ret = handle_pagefault(vaddr, cause))) {
+                if (curthr->kt_npageins != pageins) {
+                        curproc->p_mem.ms_majflt++;
+                } else {
+                        curproc->p_mem.ms_minflt++;
+                }
+        }
+        return ret;
+}
+
 /*
- * This gets called by _pt_fault_handler in mm/pagetable.c The
+ * This gets called (through do_pagefault()) by _pt_fault_handler in
+ * mm/pagetable.c The
  * calling function has already done a lot of error checking for
  * us. In particular it has checked that we are not page faulting
  * while in kernel mode. Make sure you understand why an
@@ -40,16 +57,36 @@
  * correctly.
  *
  * Finally call pt_map to have the new mapping placed into the
- * appropriate page table.
+ * appropriate page table. If the page you map belongs to a file
+ * (its pf_obj is the vnode's mmobj, not an anonymous or shadow
+ * object), add PT_FILE to the ptflags so pt_map counts it as a
+ * page cache page in the process's p_mem.
+ *
+ * You do not need to count the fault in curproc->p_mem:
+ * do_pagefault() does that once you return, as a major fault if
+ * looking the page up read it in from its file, and a minor one
+ * otherwise.
+ *
+ * This is also called for faults taken by the kernel itself while it
+ * is touching user memory on behalf of the process (the fast paths of
+ * copy_from_user and copy_to_user in api/access.c). In that case
+ * FAULT_USER is not set in cause. Resolve the fault exactly as above,
+ * but if the address is not valid do _NOT_ kill the process, just
+ * return -EFAULT; the caller will resume execution at the fixup
+ * address for the faulting instruction, which makes the copy fail
+ * with -EFAULT.
  *
  * @param vaddr the address that was accessed to cause the fault
  *
  * @param cause this is the type of operation on the memory
  *              address which caused the fault, possible values
  *              can be found in pagefault.h
+ * @return 0 if the fault was resolved, -EFAULT if it was a kernel
+ *         access to an invalid user address
  */
-void
+int
 handle_pagefault(uintptr_t vaddr, uint32_t cause)
 {
         NOT_YET_IMPLEMENTED("VM: handle_pagefault");
+        return -EFAULT;
 }
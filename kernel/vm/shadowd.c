@@ -10,9 +10,12 @@
 #include "proc/proc.h"
 #include "proc/sched.h"
 #include "proc/kthread.h"
+#include "proc/workqueue.h"
 
 #ifdef __SHADOWD__
-static ktqueue_t shadowd_waitq, kmem_alloc_waitq;
+static ktqueue_t kmem_alloc_waitq;
+static workqueue_t shadowd_wq;
+static work_t shadowd_work;
 static int shadowd_initialized = 0;
 
 void
@@ -22,7 +25,7 @@ shadowd_wakeup()
          * before it has been properly initialized then the system
          * does not have enough memory. */
         KASSERT(shadowd_initialized);
-        sched_broadcast_on(&shadowd_waitq);
+        workqueue_submit(&shadowd_wq, &shadowd_work);
 }
 
 void
@@ -36,9 +39,9 @@ shadowd_alloc_sleep()
 }
 
 /*
- * The shadow daemon main routine. This should periodically
- * traverese all the shadow object trees, removing any
- * unnecessary shadow objects.
+ * The shadow daemon's work, queued each time memory runs short. This
+ * traverses all the shadow object trees, removing any unnecessary
+ * shadow objects, then wakes whoever is waiting for memory.
  *
  * A shadow object is considered unnecessary if it is not top most
  * (directly descendant from a vmarea), and if it has only 1
@@ -51,95 +54,85 @@ shadowd_alloc_sleep()
  *
  */
 
-static void *
-shadowd(int arg1, void *arg2)
+static void
+shadowd(work_t *work)
 {
-        while (1) {
-                proc_t *p;
-                /* for each process, go through its vmareas */
-                list_iterate_begin(proc_list(), p, proc_t, p_list_link) {
-                        /* all of the dead process's shadow objects will be takenen care of by init */
-                        if (PROC_RUNNING == p->p_state) {
-                                vmarea_t *vma;
-                                list_iterate_begin(&p->p_vmmap->vmm_list, vma, vmarea_t, vma_plink) {
-                                        mmobj_t *last = vma->vma_obj, *o = last->mmo_shadowed;
-                                        /* ref last, so if all processes on this branch die while shadowd is
-                                         * sleeping, the branch won't get destroyed until shadowd() is done
-                                         * with it */
-                                        last->mmo_ops->ref(last);
-                                        while (NULL != o && NULL != o->mmo_shadowed) {
-                                                mmobj_t *shadow = o->mmo_shadowed;
-                                                /* iff the object has only one parent, and is not right under vm_area */
-                                                KASSERT(o != last);
-                                                if (o->mmo_refcount - o->mmo_nrespages == 1) {
-                                                        /* migrate all its pages to last, and remove it from the shadow tree */
-                                                        pframe_t *pf;
-                                                        list_iterate_begin(&o->mmo_respages, pf, pframe_t, pf_olink) {
-                                                                /* Because the operations that could be
-                                                                 * performed with an intermediate shadow object
-                                                                 * to make pages busy are non-blocking,
-                                                                 * we always expect to see non-busy pages. */
-                                                                KASSERT(!pframe_is_busy(pf));
-                                                                /* o has refcount 1+nrespages, so this won't delete it yet */
-                                                                pframe_migrate(pf, last);
-                                                        } list_iterate_end();
-                                                        last->mmo_shadowed = o->mmo_shadowed;
-                                                        /* Ref o's shadowed, so we don't accidentally delete it when we
-                                                         * finally put o */
-                                                        o->mmo_shadowed->mmo_ops->ref(o->mmo_shadowed);
-                                                        KASSERT(o->mmo_refcount == 1 && o->mmo_nrespages == 0);
-                                                        o->mmo_ops->put(o);
-                                                } else {
-                                                        KASSERT(o->mmo_refcount - o->mmo_nrespages == 2);
-                                                        o->mmo_ops->ref(o);
-                                                        last->mmo_ops->put(last);
-                                                        last = o;
-                                                }
-                                                o = shadow;
+        proc_t *p;
+        /* for each process, go through its vmareas */
+        list_iterate_begin(proc_list(), p, proc_t, p_list_link) {
+                /* all of the dead process's shadow objects will be takenen care of by init */
+                if (PROC_RUNNING == p->p_state) {
+                        vmarea_t *vma;
+                        list_iterate_begin(&p->p_vmmap->vmm_list, vma, vmarea_t, vma_plink) {
+                                mmobj_t *last = vma->vma_obj, *o = last->mmo_shadowed;
+                                /* ref last, so if all processes on this branch die while shadowd is
+                                 * sleeping, the branch won't get destroyed until shadowd() is done
+                                 * with it */
+                                last->mmo_ops->ref(last);
+                                while (NULL != o && NULL != o->mmo_shadowed) {
+                                        mmobj_t *shadow = o->mmo_shadowed;
+                                        /* iff the object has only one parent, and is not right under vm_area */
+                                        KASSERT(o != last);
+                                        if (o->mmo_refcount - o->mmo_nrespages == 1) {
+                                                /* migrate all its pages to last, and remove it from the shadow tree */
+                                                pframe_t *pf;
+                                                list_iterate_begin(&o->mmo_respages, pf, pframe_t, pf_olink) {
+                                                        /* Because the operations that could be
+                                                         * performed with an intermediate shadow object
+                                                         * to make pages busy are non-blocking,
+                                                         * we always expect to see non-busy pages. */
+                                                        KASSERT(!pframe_is_busy(pf));
+                                                        /* o has refcount 1+nrespages, so this won't delete it yet */
+                                                        pframe_migrate(pf, last);
+                                                } list_iterate_end();
+                                                last->mmo_shadowed = o->mmo_shadowed;
+                                                /* Ref o's shadowed, so we don't accidentally delete it when we
+                                                 * finally put o */
+                                                o->mmo_shadowed->mmo_ops->ref(o->mmo_shadowed);
+                                                KASSERT(o->mmo_refcount == 1 && o->mmo_nrespages == 0);
+                                                o->mmo_ops->put(o);
+                                        } else {
+                                                KASSERT(o->mmo_refcount - o->mmo_nrespages == 2);
+                                                o->mmo_ops->ref(o);
+                                                last->mmo_ops->put(last);
+                                                last = o;
                                         }
-                                        KASSERT(NULL != last);
-                                        last->mmo_ops->put(last);
-                                } list_iterate_end();
-                        }
-                } list_iterate_end();
-
-                sched_broadcast_on(&kmem_alloc_waitq);
-                if (sched_cancellable_sleep_on(&shadowd_waitq) < 0) {
-                        return (void *)0;
+                                        o = shadow;
+                                }
+                                KASSERT(NULL != last);
+                                last->mmo_ops->put(last);
+                        } list_iterate_end();
                 }
-        }
-}
+        } list_iterate_end();
 
-static proc_t *shadowd_proc;
-static kthread_t *shadowd_thr;
+        sched_broadcast_on(&kmem_alloc_waitq);
+}
 
 static __attribute__((unused)) void
 shadowd_init()
 {
-        sched_queue_init(&shadowd_waitq);
         sched_queue_init(&kmem_alloc_waitq);
+        work_init(&shadowd_work, shadowd);
 
         KASSERT(NULL != curproc && (PID_IDLE == curproc->p_pid));
-        shadowd_proc = proc_create("shadowd");
-        KASSERT(NULL != shadowd_proc);
-        shadowd_thr = kthread_create(shadowd_proc, shadowd, 0, NULL);
-        KASSERT(NULL != shadowd_thr);
-
-        sched_make_runnable(shadowd_thr);
+        if (0 > workqueue_init(&shadowd_wq, "shadowd", 1)) {
+                panic("could not start shadowd\n");
+        }
 
         shadowd_initialized = 1;
 }
 init_func(shadowd_init);
-init_depends(sched_init);
+init_depends(workqueue_sysinit);
 
 /*
- * Cancel the shadowd
+ * Stop the shadowd and wait for it. Must be called from the idle
+ * process, which started it.
  */
 void
 shadowd_exit()
 {
-        KASSERT(NULL != shadowd_thr);
-        kthread_cancel(shadowd_thr, (void *)0);
-        shadowd_thr = NULL;
+        KASSERT(shadowd_initialized);
+        shadowd_initialized = 0;
+        workqueue_destroy(&shadowd_wq);
 }
 #endif
@@ -63,7 +63,9 @@ vmmap_create(void)
 }
 
 /* Removes all vmareas from the address space and frees the
- * vmmap struct. */
+ * vmmap struct. For exited processes this runs in the reaper thread
+ * (see proc/reaper.c), so don't use curproc here; map->vmm_proc is
+ * NULL by then. */
 void
 vmmap_destroy(vmmap_t *map)
 {
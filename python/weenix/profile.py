@@ -0,0 +1,159 @@
+"""Symbolizes the samples of the kernel profiler (see
+kernel/include/util/profile.h) into a flat profile, or into folded
+stacks for flame graph tools such as flamegraph.pl.
+
+Inside gdb, 'kernel profile' reads the samples straight out of the
+kernel. On the host, without gdb, it reads either a copy of the table
+saved from gdb with
+
+	dump binary value profile.bin profile
+
+or a log of the debug console (./weenix prints it on stdout) with the
+output of the 'profile dump' kshell command in it, and looks up the
+addresses in the kernel image:
+
+	python python/weenix/profile.py [--folded] <dump or log> [weenix.dbg]
+"""
+
+import bisect
+import os
+import re
+import struct
+import subprocess
+import sys
+
+MAGIC = 0x464f5250
+USER = 0
+
+# must match profile_t and profile_stack_t
+_header = struct.Struct("<8I")
+
+_begin = re.compile(r"^profile: begin (\d+) samples every (\d+) ms, (\d+) dropped")
+_stack = re.compile(r"^\d+( 0x[0-9a-f]{8})+$")
+
+class Profile:
+
+	def __init__(self, data):
+		"""Reads the samples from data, either the profile_t itself or text
+		from the debug console."""
+		self.stacks = list()    # (count, [pc, ...]), innermost pc first
+		if (len(data) >= _header.size
+			and struct.unpack_from("<I", data, 0)[0] == MAGIC):
+			self._binary(data)
+		else:
+			self._text(data.decode("ascii", "replace"))
+
+	def _binary(self, data):
+		(magic, nstacks, depth, self.enabled, period, tick_msecs,
+		 self.samples, self.dropped) = _header.unpack_from(data, 0)
+		self.period_ms = period * tick_msecs
+		stack = struct.Struct("<{0}I".format(2 + depth))
+		for i in range(nstacks):
+			raw = stack.unpack_from(data, _header.size + i * stack.size)
+			if (raw[0] != 0):
+				self.stacks.append((raw[0], list(raw[2:2 + raw[1]])))
+
+	def _text(self, text):
+		"""Takes the last dump in the log, in case there are several."""
+		found = False
+		inside = False
+		for line in text.splitlines():
+			line = line.strip()
+			match = _begin.match(line)
+			if (match):
+				(self.samples, self.period_ms, self.dropped) = [int(x) for x in match.groups()]
+				self.stacks = list()
+				found = True
+				inside = True
+			elif (line == "profile: end"):
+				inside = False
+			elif (inside and _stack.match(line)):
+				fields = line.split()
+				self.stacks.append((int(fields[0]), [int(pc, 16) for pc in fields[1:]]))
+		if (not found):
+			raise ValueError("no profile found (is it a dump of 'profile'?)")
+		self.enabled = 0
+
+class Symbols:
+	"""The function symbols of an ELF file, as listed by nm."""
+
+	def __init__(self, elf):
+		out = subprocess.check_output(["nm", "-n", "--defined-only", elf])
+		self._addrs = list()
+		self._names = list()
+		for line in out.decode("ascii", "replace").splitlines():
+			fields = line.split()
+			if (len(fields) == 3 and fields[1] in "TtWw"):
+				self._addrs.append(int(fields[0], 16))
+				self._names.append(fields[2])
+
+	def __call__(self, pc):
+		i = bisect.bisect_right(self._addrs, pc) - 1
+		return self._names[i] if (i >= 0) else None
+
+def _frames(pcs, lookup):
+	"""Returns the names of the functions in a stack, innermost first.
+	Return addresses are looked up one byte back, so that a call which
+	is the last thing in a function is put in that function rather than
+	the one after it."""
+	res = list()
+	for (i, pc) in enumerate(pcs):
+		if (pc == USER):
+			res.append("[user]")
+			continue
+		name = lookup(pc if (i == 0) else pc - 1)
+		res.append(name if (name is not None) else "{0:#010x}".format(pc))
+	return res
+
+def flat(prof, lookup, count=40):
+	"""Returns the functions sampled most often as text: the samples in
+	which each was running (self) and in which it was anywhere on the
+	stack (total)."""
+	selfs = dict()
+	totals = dict()
+	for (n, pcs) in prof.stacks:
+		frames = _frames(pcs, lookup)
+		selfs[frames[0]] = selfs.get(frames[0], 0) + n
+		for name in set(frames):
+			totals[name] = totals.get(name, 0) + n
+
+	total = max(1, sum([n for (n, pcs) in prof.stacks]))
+	res = "{0} samples every {1} ms ({2} dropped), {3} distinct stacks\n".format(
+		prof.samples, prof.period_ms, prof.dropped, len(prof.stacks))
+	res += "{0:>8} {1:>7} {2:>8} {3:>7}  {4}\n".format(
+		"SELF", "%", "TOTAL", "%", "FUNCTION")
+	names = sorted(totals.keys(), key=lambda f: (-selfs.get(f, 0), -totals[f], f))
+	for name in names[:count]:
+		res += "{0:>8} {1:>6.2f}% {2:>8} {3:>6.2f}%  {4}\n".format(
+			selfs.get(name, 0), 100.0 * selfs.get(name, 0) / total,
+			totals[name], 100.0 * totals[name] / total, name)
+	return res
+
+def folded(prof, lookup):
+	"""Returns the stacks in the folded format of flame graph tools: one
+	line per stack, its functions outermost first and separated by ';',
+	then the number of samples."""
+	counts = dict()
+	for (n, pcs) in prof.stacks:
+		key = ";".join(reversed(_frames(pcs, lookup)))
+		counts[key] = counts.get(key, 0) + n
+	return "".join(["{0} {1}\n".format(k, counts[k]) for k in sorted(counts.keys())])
+
+if __name__ == "__main__":
+	args = sys.argv[1:]
+	fold = (len(args) > 0 and args[0] == "--folded")
+	if (fold):
+		args = args[1:]
+	if (len(args) < 1 or len(args) > 2):
+		sys.stderr.write("usage: {0} [--folded] <dump or log of profile> [weenix.dbg]\n"
+						 .format(sys.argv[0]))
+		sys.exit(1)
+	if (len(args) > 1):
+		elf = args[1]
+	else:
+		elf = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+						   "..", "..", "kernel", "weenix.dbg")
+	with open(args[0], "rb") as f:
+		prof = Profile(f.read())
+	symbols = Symbols(elf)
+	sys.stdout.write(folded(prof, symbols) if fold else flat(prof, symbols))
@@ -0,0 +1,124 @@
+"""Decodes the scheduler trace ring (see kernel/include/proc/schedtrace.h)
+and renders it as one timeline per thread.
+
+Inside gdb, 'kernel schedtrace' reads the ring straight out of the
+kernel. It can also be saved from gdb with
+
+	dump binary value schedtrace.bin schedtrace
+
+and decoded on the host, without gdb, with
+
+	python python/weenix/schedtrace.py schedtrace.bin
+"""
+
+import struct
+import sys
+
+MAGIC = 0x43525453
+
+SWITCH = 1
+SLEEP = 2
+WAKEUP = 3
+RUNNABLE = 4
+TIMEOUT = 5
+
+# must match schedtrace_t and schedtrace_event_t
+_header = struct.Struct("<8I")
+_event = struct.Struct("<Q4I2i")
+
+class Event:
+
+	def __init__(self, raw):
+		(self.tsc, self.type, self.thr, self.cur, self.arg,
+		 self.pid, self.curpid) = raw
+
+class Trace:
+
+	def __init__(self, data):
+		(magic, nevents, head, self._mult, self._shift,
+		 self.enabled, pad0, pad1) = _header.unpack_from(data, 0)
+		if (magic != MAGIC):
+			raise ValueError("not a scheduler trace (magic {0:#x})".format(magic))
+		self.recorded = head
+
+		# oldest first; the ring holds the last nevents of head events
+		self.events = list()
+		for i in range(max(0, head - nevents), head):
+			offset = _header.size + (i % nevents) * _event.size
+			self.events.append(Event(_event.unpack_from(data, offset)))
+
+	def us(self, cycles):
+		"""Converts TSC cycles to microseconds, like tsc_to_ns()."""
+		if (self._mult == 0):
+			return float(cycles)
+		hi = cycles >> 32
+		lo = cycles & 0xffffffff
+		ns = (((hi * self._mult) << (32 - self._shift))
+			  + ((lo * self._mult) >> self._shift))
+		return ns / 1000.0
+
+def _thread(pid, thr, names):
+	res = "{0}/{1:#010x}".format(pid, thr)
+	if (pid in names):
+		res += " ({0})".format(names[pid])
+	return res
+
+def timelines(trace, names=dict()):
+	"""Returns the trace as text, one timeline per thread. names maps pids
+	to process names, where they are known."""
+	if (len(trace.events) == 0):
+		return "no events recorded\n"
+
+	start = trace.events[0].tsc
+	lines = dict()          # thread -> [(tsc, text)]
+	pids = dict()
+	# thread -> tsc since which it has been running, runnable or asleep
+	running = dict()
+	runnable = dict()
+	asleep = dict()
+
+	def note(thr, tsc, text):
+		lines.setdefault(thr, list()).append((tsc, text))
+
+	def since(thr, when, tsc):
+		if (thr in when):
+			return " after {0:.1f} us".format(trace.us(tsc - when.pop(thr)))
+		return ""
+
+	for e in trace.events:
+		pids[e.thr] = e.pid
+		pids[e.cur] = e.curpid
+		if (e.type == SWITCH):
+			note(e.cur, e.tsc, "switched out" + since(e.cur, running, e.tsc))
+			note(e.thr, e.tsc, "running" + since(e.thr, runnable, e.tsc))
+			running[e.thr] = e.tsc
+		elif (e.type == SLEEP):
+			note(e.thr, e.tsc, "sleeps on {0:#010x}".format(e.arg))
+			asleep[e.thr] = e.tsc
+		elif (e.type == WAKEUP):
+			note(e.thr, e.tsc, "woken from {0:#010x} by {1}{2}".format(
+				e.arg, _thread(e.curpid, e.cur, names), since(e.thr, asleep, e.tsc)))
+		elif (e.type == TIMEOUT):
+			note(e.thr, e.tsc, "timed out on {0:#010x}{1}".format(
+				e.arg, since(e.thr, asleep, e.tsc)))
+		elif (e.type == RUNNABLE):
+			if (e.thr == e.cur):
+				note(e.thr, e.tsc, "yields")
+			runnable[e.thr] = e.tsc
+
+	res = "{0} events over {1:.1f} us{2}\n".format(
+		len(trace.events), trace.us(trace.events[-1].tsc - start),
+		"" if trace.recorded == len(trace.events)
+		else " (the {0} before were overwritten)".format(trace.recorded - len(trace.events)))
+	for thr in sorted(lines.keys(), key=lambda t: (pids[t], t)):
+		res += "\n{0}\n".format(_thread(pids[thr], thr, names))
+		for (tsc, text) in lines[thr]:
+			res += "  {0:>12.1f}  {1}\n".format(trace.us(tsc - start), text)
+	return res
+
+if __name__ == "__main__":
+	if (len(sys.argv) != 2):
+		sys.stderr.write("usage: {0} <dump of schedtrace>\n".format(sys.argv[0]))
+		sys.exit(1)
+	with open(sys.argv[1], "rb") as f:
+		sys.stdout.write(timelines(Trace(f.read())))
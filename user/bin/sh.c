@@ -14,6 +14,10 @@
 #include <sys/mman.h>
 #include <errno.h>
 #include <stdio.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include <weenix/syscall.h>
 
 #define ROOT            "/"
 
@@ -22,6 +26,7 @@
 
 #define ARGV_MAX        256
 #define REDIR_MAX       10
+#define PIPELINE_MAX    16
 
 typedef struct redirect {
         int             r_sfd;
@@ -62,6 +67,7 @@ DECL_CMD(cp);
 DECL_CMD(sync);
 DECL_CMD(check);
 DECL_CMD(repeat);
+DECL_CMD(bench);
 DECL_CMD(parallel);
 
 typedef struct {
@@ -89,6 +95,7 @@ static cmd_t builtin_cmds[] = {
         { "rmdir",    cmd_rmdir,    "remove a directory" },
         { "sync",     cmd_sync,     "sync filesystems" },
         { "repeat",   cmd_repeat,   "repeat a command" },
+        { "bench",    cmd_bench,    "time a repeated command" },
         { "parallel", cmd_parallel, "run multiple commands in parallel" },
         { NULL,       NULL,         NULL }
 };
@@ -1078,6 +1085,45 @@ DECL_CMD(repeat)
         return 0;
 }
 
+/* CPU time used so far by the shell and the children it has waited
+ * for, in microseconds */
+static unsigned long long bench_cputime(int user)
+{
+        struct rusage self, children;
+        struct timeval *s, *c;
+
+        getrusage(RUSAGE_SELF, &self);
+        getrusage(RUSAGE_CHILDREN, &children);
+        s = user ? &self.ru_utime : &self.ru_stime;
+        c = user ? &children.ru_utime : &children.ru_stime;
+        return (s->tv_sec + c->tv_sec) * 1000000ULL + s->tv_usec + c->tv_usec;
+}
+
+DECL_CMD(bench)
+{
+        struct timespec start, end;
+        unsigned long long ns, ustart, sstart;
+        long ntimes;
+
+        if (argc < 3 || (ntimes = strtol(argv[1], NULL, 10)) <= 0) {
+                fprintf(stderr, "usage: bench <ntimes> command [args ...]\n");
+                return 1;
+        }
+
+        ustart = bench_cputime(1);
+        sstart = bench_cputime(0);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        cmd_repeat(argc, argv, io);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        ns = (end.tv_sec - start.tv_sec) * 1000000000ULL + end.tv_nsec - start.tv_nsec;
+        printf("%ld commands in %llu ms, %llu commands/s\n", ntimes,
+               ns / 1000000, ntimes * 1000000000ULL / (ns ? ns : 1));
+        printf("cpu: %llu ms user, %llu ms system\n",
+               (bench_cputime(1) - ustart) / 1000, (bench_cputime(0) - sstart) / 1000);
+        return 0;
+}
+
 DECL_CMD(parallel)
 {
         int i, cmdbegin, ncmds = 0;
@@ -1147,27 +1193,6 @@ DECL_CMD(parallel)
         return status;
 }
 
-static int do_redirect(redirect_map_t *map)
-{
-        int             ii;
-        int             newfd, oldfd;
-
-        for (ii = 0; ii < map->rm_nfds; ii++) {
-                oldfd = map->rm_redir[ii].r_sfd;
-                newfd = map->rm_redir[ii].r_dfd;
-
-                dbg((stderr, "do_redirect: dup2(%d,%d)\n", oldfd, newfd));
-
-                if (dup2(oldfd, newfd) < 0) {
-                        fprintf(stderr, "do_redirect: dup2() failed: "
-                                "%s\n", strerror(errno));
-                        return -1;
-                }
-                close(oldfd);
-        }
-        return 0;
-}
-
 static void cleanup_redirects(redirect_map_t *map)
 {
         int             ii;
@@ -1219,36 +1244,53 @@ static int execute(int argc, char *argv[], redirect_map_t *map)
                 status = builtin_exec(cmd, argc, argv, &io);
                 destroy_ioenv(&io);
                 cleanup_redirects(map);
-                return 0;
+                return status;
         }
 
-        if (!(pid = fork())) {
-                if (do_redirect(map) < 0)
-                        exit(1);
+        /* the child gets the redirections as file actions rather
+         * than doing them itself after a fork */
+        spawn_action_t actions[2 * REDIR_MAX];
+        int nactions = 0, ii;
 
-                execve(argv[0], argv, my_envp);
-                if (errno == ENOENT) {
-                        char buf[256];
-                        snprintf(buf, 255, "/usr/bin/%s", argv[0]);
-                        execve(buf, argv, my_envp);
-                        fprintf(stderr, "sh: command not found: %s\n", argv[0]);
-                } else
-                        fprintf(stderr, "sh: exec failed for %s: %s\n",
-                                argv[0], strerror(errno));
-                exit(1);
-        } else {
-                if (0 > pid) {
-                        fprintf(stderr, "sh: fork failed errno = %d\n", errno);
+        for (ii = 0; ii < map->rm_nfds; ii++) {
+                int sfd = map->rm_redir[ii].r_sfd;
+                int dfd = map->rm_redir[ii].r_dfd;
+
+                actions[nactions].sa_op = SPAWN_DUP2;
+                actions[nactions].sa_fd = sfd;
+                actions[nactions].sa_newfd = dfd;
+                nactions++;
+                if (sfd != dfd) {
+                        actions[nactions].sa_op = SPAWN_CLOSE;
+                        actions[nactions].sa_fd = sfd;
+                        nactions++;
                 }
         }
 
+        pid = spawn(argv[0], argv, my_envp, actions, nactions);
+        if (0 > pid && errno == ENOENT) {
+                char buf[256];
+                snprintf(buf, 255, "/usr/bin/%s", argv[0]);
+                pid = spawn(buf, argv, my_envp, actions, nactions);
+                if (0 > pid && errno == ENOENT)
+                        fprintf(stderr, "sh: command not found: %s\n", argv[0]);
+        }
+        if (0 > pid && errno != ENOENT) {
+                fprintf(stderr, "sh: exec failed for %s: %s\n",
+                        argv[0], strerror(errno));
+        }
+
         cleanup_redirects(map);
-        int ret = wait(&status);
+        if (0 > pid)
+                return 1;
+
+        if (0 > waitpid(pid, 0, &status))
+                return 1;
         if (status == EFAULT) {
                 fprintf(stderr, "sh: child process accessed invalid memory\n");
         }
 
-        return ret;
+        return status;
 }
 
 #define sh_isredirect(ch) ((ch) == '>' || (ch) == '<')
@@ -1385,12 +1427,11 @@ static int parse_redirect_norm(char *line, redirect_map_t *map, int dfd,
         return 0;
 }
 
+/* Adds the redirections in line to map, after any already there */
 static int parse_redirects(char *line, redirect_map_t *map)
 {
         char    *tmp;
 
-        map->rm_nfds = 0;
-
         tmp = line;
         for (;;) {
                 char *start, *end;
@@ -1475,23 +1516,19 @@ static int parse_redirects(char *line, redirect_map_t *map)
         return 0;
 }
 
-static void parse(char *line)
+/* Splits line into arguments, after taking the redirections out of it
+ * and adding them to map. Returns the number of arguments, or -1 if a
+ * redirection could not be parsed. */
+static int parse_command(char *line, char *argv[], redirect_map_t *map)
 {
-        char            *argv[ARGV_MAX];
         int             argc;
         char            *tmp;
-        int             len;
-        redirect_map_t  map;
 
         argc = 0;
         tmp = line;
 
-        len = strlen(line);
-        if (line[len - 1] == '\n')
-                line[len - 1] = 0;
-
-        if (parse_redirects(line, &map) < 0)
-                return;
+        if (parse_redirects(line, map) < 0)
+                return -1;
 
         for (;;) {
                 /* Ignore leading whitespace.
@@ -1516,8 +1553,116 @@ static void parse(char *line)
         }
 
         argv[argc] = NULL;
+        return argc;
+}
+
+/*
+ * Runs the commands of a pipeline ("cmd1 | cmd2 | ..."), each in a
+ * child of its own as with the parallel builtin, with a pipe from the
+ * standard output of each to the standard input of the next, and waits
+ * for them all. Each child puts its pipe ends in place before parsing
+ * its command, so that redirections given for a command win over the
+ * pipes, and "2>&1" sends standard error down the pipe.
+ *
+ * The shell only ever holds the read end of the last pipe made and
+ * both ends of the new one, and closes them as soon as the children
+ * have them, so that each reader sees end of file once its writer is
+ * done.
+ */
+static void pipeline(char *line)
+{
+        char            *cmds[PIPELINE_MAX];
+        int             pids[PIPELINE_MAX];
+        int             ncmds, i, status;
+        int             in = -1, fds[2];
+        char            *tmp;
+
+        /* Split the line at each '|', making sure no command is empty */
+        cmds[0] = line;
+        ncmds = 1;
+        for (tmp = line; *tmp; tmp++) {
+                if (*tmp != '|')
+                        continue;
+                if (ncmds == PIPELINE_MAX) {
+                        fprintf(stderr, "sh: too many commands in pipeline\n");
+                        return;
+                }
+                *tmp = 0;
+                cmds[ncmds++] = tmp + 1;
+        }
+        for (i = 0; i < ncmds; i++) {
+                if (cmds[i][strspn(cmds[i], " \t")] == 0) {
+                        fprintf(stderr, "sh: empty command in pipeline\n");
+                        return;
+                }
+        }
+
+        for (i = 0; i < ncmds; i++) {
+                fds[0] = fds[1] = -1;
+                if (i < ncmds - 1 && pipe(fds) < 0) {
+                        fprintf(stderr, "sh: pipe failed: %s\n", strerror(errno));
+                        break;
+                }
+
+                fflush(NULL);
+                if (0 == (pids[i] = fork())) {
+                        char            *argv[ARGV_MAX];
+                        redirect_map_t  map;
+                        int             argc;
+
+                        map.rm_nfds = 0;
+                        if (fds[0] >= 0)
+                                close(fds[0]);
+                        if (in >= 0) {
+                                dup2(in, 0);
+                                close(in);
+                        }
+                        if (fds[1] >= 0) {
+                                dup2(fds[1], 1);
+                                close(fds[1]);
+                        }
+                        if ((argc = parse_command(cmds[i], argv, &map)) <= 0)
+                                exit(1);
+                        exit(execute(argc, argv, &map));
+                }
+
+                if (in >= 0)
+                        close(in);
+                if (fds[1] >= 0)
+                        close(fds[1]);
+                in = fds[0];
+
+                if (pids[i] < 0) {
+                        fprintf(stderr, "sh: fork failed: %s\n", strerror(errno));
+                        break;
+                }
+        }
+        if (in >= 0)
+                close(in);
+
+        /* Wait for each command that was started */
+        while (--i >= 0)
+                waitpid(pids[i], 0, &status);
+}
+
+static void parse(char *line)
+{
+        char            *argv[ARGV_MAX];
+        int             argc;
+        int             len;
+        redirect_map_t  map;
+
+        len = strlen(line);
+        if (line[len - 1] == '\n')
+                line[len - 1] = 0;
+
+        if (strchr(line, '|')) {
+                pipeline(line);
+                return;
+        }
 
-        if (!argc)
+        map.rm_nfds = 0;
+        if ((argc = parse_command(line, argv, &map)) <= 0)
                 return;
 
         execute(argc, argv, &map);
@@ -0,0 +1,21 @@
+/*
+ *   FILE: sleep.c
+ *  DESCR: sleep for a number of seconds
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+int main(int argc, char **argv)
+{
+        int secs;
+
+        if (argc != 2 || (secs = atoi(argv[1])) < 0) {
+                fprintf(stderr, "usage: %s seconds\n", argv[0]);
+                return 1;
+        }
+
+        sleep(secs);
+        return 0;
+}
@@ -30,6 +30,7 @@ void            pthread_exit(void *retval);
 int             pthread_join(pthread_t thr, void **retval);
 int             pthread_mutex_init(pthread_mutex_t *mtx,
                                    const pthread_mutexattr_t *);
+int             pthread_mutex_destroy(pthread_mutex_t *mtx);
 int             pthread_mutex_lock(pthread_mutex_t *mtx);
 int             pthread_mutex_trylock(pthread_mutex_t *mtx);
 int             pthread_mutex_unlock(pthread_mutex_t *mtx);
@@ -57,7 +58,6 @@ int             pthread_mutexattr_init(pthread_mutexattr_t *);
 int             pthread_mutexattr_destroy(pthread_mutexattr_t *);
 int             pthread_mutexattr_gettype(pthread_mutexattr_t *, int *);
 int             pthread_mutexattr_settype(pthread_mutexattr_t *, int);
-int             pthread_mutex_destroy(pthread_mutex_t *);
 int             pthread_attr_getstacksize(const pthread_attr_t *, size_t *);
 int             pthread_attr_getstackaddr(const pthread_attr_t *, void **);
 int             pthread_attr_getguardsize(const pthread_attr_t *, size_t *);
@@ -0,0 +1 @@
+../../../kernel/include/api/memstat.h
\ No newline at end of file
@@ -14,6 +14,8 @@
 #endif
 
 struct dirent;
+struct spawn_action;
+struct timespec;
 
 /* User exec-related */
 int     fork(void);
@@ -21,15 +23,36 @@ int     execl(const char *filename, const char *arg, ...); /* NYI */
 int     execle(const char *filename, const char *arg, ...); /* NYI */
 int     execv(const char *filename, char *const argv[]); /* NYI */
 int     execve(const char *filename, char *const argv[], char *const envp[]);
+/* Runs filename in a new child process without copying this one, after
+ * applying the file actions (see SPAWN_DUP2 and SPAWN_CLOSE in
+ * <weenix/syscall.h>) to it. Returns the child's pid. */
+pid_t   spawn(const char *filename, char *const argv[], char *const envp[],
+              const struct spawn_action *actions, int nactions);
 
 /* Kern-related */
 void    _exit(int status);
 pid_t   wait(int *status);
 pid_t   waitpid(pid_t pid, int options, int *status);
 void    thr_exit(int status);
+/* Threads of this process (the kernel must be built with MTP), named by
+ * the ids thr_create returns; see also <pthread/pthread.h> */
+int     thr_create(void *(*entry)(void *), void *arg, size_t stacksz);
+int     thr_join(int tid, void **retval);
+int     thr_detach(int tid);
+int     thr_cancel(int tid);
+void    thr_yield(void);
+int     gettid(void);
+/* Sleeps while *uaddr holds val, until woken by futex_wake on the same
+ * word (from any process, if the word is in a MAP_SHARED mapping) or
+ * until timeout (NULL for none) runs out */
+int     futex_wait(int *uaddr, int val, const struct timespec *timeout);
+/* Wakes up to n threads sleeping in futex_wait on uaddr, returns how
+ * many it woke */
+int     futex_wake(int *uaddr, int n);
 int     thr_errno(void);
 void    thr_set_errno(int n);
 void    yield(void);
+unsigned int sleep(unsigned int seconds);
 pid_t   getpid(void);
 int     halt(void);
 void    sync(void);
@@ -44,6 +67,7 @@ int     write(int fd, const void *buf, size_t nbytes);
 off_t   lseek(int fd, off_t offset, int whence);
 int     dup(int fd);
 int     dup2(int ofd, int nfd);
+int     pipe(int fds[2]);
 int     mkdir(const char *path, int mode);
 int     rmdir(const char *path);
 int     unlink(const char *path);
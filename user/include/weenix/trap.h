@@ -3,11 +3,14 @@
 #include "sys/types.h"
 #include "stddef.h"
 #include "weenix/syscall.h"
+#include "weenix/vdata.h"
 #include "errno.h"
 
 #define TRAP_INTR_STRING QUOTE(INTR_SYSCALL)
 
-static inline int trap(uint32_t num, uint32_t arg)
+/* Makes a system call through the system call interrupt, which always
+ * works. */
+static inline int trap_int(uint32_t num, uint32_t arg)
 {
         int ret;
         __asm__ volatile(
@@ -15,11 +18,41 @@ static inline int trap(uint32_t num, uint32_t arg)
                 : "=a"(ret)
                 : "a"(num), "d"(arg)
         );
-        /* Copy in errno */
+        return ret;
+}
+
+/* Makes a system call with SYSENTER, which is much cheaper than an
+ * interrupt but only usable if the kernel has set vd_sysenter. The
+ * kernel returns with SYSEXIT, which needs the stack pointer and return
+ * address, so they are passed in ecx and esi. ecx and edx are lost. */
+static inline int trap_sysenter(uint32_t num, uint32_t arg)
+{
+        int ret;
+        uint32_t eip;
         __asm__ volatile(
-                "int $" TRAP_INTR_STRING
-                : "=a"(errno)
-                : "a"(SYS_errno)
+                "movl %%esp, %%ecx\n\t"
+                "call 1f\n"
+                "1:\tpopl %%esi\n\t"
+                "addl $2f-1b, %%esi\n\t"
+                "sysenter\n"
+                "2:"
+                : "=a"(ret), "+d"(arg), "=&S"(eip)
+                : "0"(num)
+                : "ecx", "cc", "memory"
         );
         return ret;
 }
+
+static inline int trap(uint32_t num, uint32_t arg)
+{
+        int sysenter = ((const struct vdata *) VDATA_ADDR)->vd_sysenter;
+        int ret;
+
+        ret = sysenter ? trap_sysenter(num, arg) : trap_int(num, arg);
+        /* Copy in errno, which only means anything if the call failed */
+        if (ret < 0) {
+                errno = sysenter ? trap_sysenter(SYS_errno, 0)
+                        : trap_int(SYS_errno, 0);
+        }
+        return ret;
+}
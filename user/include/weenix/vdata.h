@@ -0,0 +1 @@
+../../../kernel/include/api/vdata.h
\ No newline at end of file
@@ -142,6 +142,16 @@ struct pgfree {
 #define pageround(foo) (((foo) + (malloc_pagemask))&(~(malloc_pagemask)))
 #define ptr2index(foo) (((u_long)(foo) >> malloc_pageshift)-malloc_origo)
 
+/* The threads of a process share the heap. The lock is the futex
+ * lock behind pthread mutexes, from pthread.c. */
+extern void __futex_lock(volatile int *state);
+extern void __futex_unlock(volatile int *state);
+
+static volatile int malloc_lock;
+
+#define THREAD_LOCK()   __futex_lock(&malloc_lock)
+#define THREAD_UNLOCK() __futex_unlock(&malloc_lock)
+
 #ifndef THREAD_LOCK
 #define THREAD_LOCK()
 #endif
@@ -1066,6 +1076,7 @@ malloc(size_t size)
         if (malloc_active++) {
                 wrtwarning("recursive call.\n");
                 malloc_active--;
+                THREAD_UNLOCK();
                 return (0);
         }
         if (!malloc_started) {
@@ -1091,6 +1102,7 @@ free(void *ptr)
         if (malloc_active++) {
                 wrtwarning("recursive call.\n");
                 malloc_active--;
+                THREAD_UNLOCK();
                 return;
         } else {
                 ifree(ptr);
@@ -1111,6 +1123,7 @@ realloc(void *ptr, size_t size)
         if (malloc_active++) {
                 wrtwarning("recursive call.\n");
                 malloc_active--;
+                THREAD_UNLOCK();
                 return (0);
         }
         if (ptr && !malloc_started) {
@@ -0,0 +1,212 @@
+/*
+ * POSIX threads on top of the thr_* system calls, which need a kernel
+ * built with MTP. A pthread_t names a kernel thread of this process by
+ * its thread id.
+ *
+ * Mutexes and condition variables are futexes: they are taken and
+ * released with atomic instructions alone when there is no contention,
+ * and only go into the kernel to sleep or to wake sleepers.
+ */
+
+#include "errno.h"
+#include "limits.h"
+#include "stdlib.h"
+#include "unistd.h"
+
+#include "pthread/pthread.h"
+
+struct pthread {
+        int             pt_tid;
+};
+
+/* pm_state is 0 if the mutex is unlocked, 1 if it is locked and 2 if
+ * it is locked and there may be threads sleeping on it */
+struct pthread_mutex {
+        volatile int    pm_state;
+};
+
+struct pthread_cond {
+        volatile int    pc_seq;         /* bumped by signal and broadcast */
+};
+
+/* What a new thread needs to get going, freed by the thread itself, so
+ * it does not matter whether it has been detached by the time it runs */
+struct pthread_start {
+        void         *(*ps_func)(void *);
+        void           *ps_arg;
+};
+
+static void *pthread_start(void *arg)
+{
+        struct pthread_start *ps = arg;
+        void *(*func)(void *) = ps->ps_func;
+        void *funcarg = ps->ps_arg;
+
+        free(ps);
+        pthread_exit(func(funcarg));
+        return NULL;
+}
+
+int pthread_create(pthread_t *thr, const pthread_attr_t *attr,
+                   void *(*func)(void *), void *arg)
+{
+        struct pthread_start *ps;
+        struct pthread *t;
+
+        if (NULL == (t = malloc(sizeof(*t))))
+                return ENOMEM;
+        if (NULL == (ps = malloc(sizeof(*ps)))) {
+                free(t);
+                return ENOMEM;
+        }
+        ps->ps_func = func;
+        ps->ps_arg = arg;
+
+        if (0 > (t->pt_tid = thr_create(pthread_start, ps, 0))) {
+                free(ps);
+                free(t);
+                return errno;
+        }
+        *thr = t;
+        return 0;
+}
+
+int pthread_join(pthread_t thr, void **retval)
+{
+        if (0 > thr_join(thr->pt_tid, retval))
+                return errno;
+        free(thr);
+        return 0;
+}
+
+int pthread_detach(pthread_t thr)
+{
+        if (0 > thr_detach(thr->pt_tid))
+                return errno;
+        free(thr);
+        return 0;
+}
+
+int pthread_cancel(pthread_t thr)
+{
+        if (0 > thr_cancel(thr->pt_tid))
+                return errno;
+        return 0;
+}
+
+void pthread_exit(void *retval)
+{
+        thr_exit((int) retval);
+}
+
+int pthread_equal(pthread_t t1, pthread_t t2)
+{
+        return t1->pt_tid == t2->pt_tid;
+}
+
+void pthread_yield(void)
+{
+        thr_yield();
+}
+
+int pthread_mutex_init(pthread_mutex_t *mtx, const pthread_mutexattr_t *attr)
+{
+        if (NULL == (*mtx = malloc(sizeof(**mtx))))
+                return ENOMEM;
+        (*mtx)->pm_state = 0;
+        return 0;
+}
+
+int pthread_mutex_destroy(pthread_mutex_t *mtx)
+{
+        free(*mtx);
+        *mtx = NULL;
+        return 0;
+}
+
+/* Takes the futex lock at state, which is used as pm_state is. This
+ * is also the lock malloc uses, which cannot use a pthread_mutex_t
+ * since those are allocated with malloc. */
+void __futex_lock(volatile int *state)
+{
+        int c;
+
+        if (0 == (c = __sync_val_compare_and_swap(state, 0, 1)))
+                return;
+
+        /* Mark the lock contended before sleeping, so the thread which
+         * releases it knows to wake someone. Since we cannot tell whether
+         * anyone else is still asleep once we have it, it stays marked. */
+        if (2 != c)
+                c = __sync_lock_test_and_set(state, 2);
+        while (0 != c) {
+                futex_wait((int *) state, 2, NULL);
+                c = __sync_lock_test_and_set(state, 2);
+        }
+}
+
+void __futex_unlock(volatile int *state)
+{
+        if (1 != __sync_fetch_and_sub(state, 1)) {
+                *state = 0;
+                futex_wake((int *) state, 1);
+        }
+}
+
+int pthread_mutex_lock(pthread_mutex_t *mtx)
+{
+        __futex_lock(&(*mtx)->pm_state);
+        return 0;
+}
+
+int pthread_mutex_trylock(pthread_mutex_t *mtx)
+{
+        return __sync_val_compare_and_swap(&(*mtx)->pm_state, 0, 1) ? EBUSY : 0;
+}
+
+int pthread_mutex_unlock(pthread_mutex_t *mtx)
+{
+        __futex_unlock(&(*mtx)->pm_state);
+        return 0;
+}
+
+int pthread_cond_init(pthread_cond_t *cond, const pthread_condattr_t *attr)
+{
+        if (NULL == (*cond = malloc(sizeof(**cond))))
+                return ENOMEM;
+        (*cond)->pc_seq = 0;
+        return 0;
+}
+
+int pthread_cond_destroy(pthread_cond_t *cond)
+{
+        free(*cond);
+        *cond = NULL;
+        return 0;
+}
+
+/* A signal which comes in between unlocking the mutex and going to
+ * sleep changes pc_seq, so futex_wait returns at once rather than
+ * missing it */
+int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mtx)
+{
+        int seq = (*cond)->pc_seq;
+
+        pthread_mutex_unlock(mtx);
+        futex_wait((int *) &(*cond)->pc_seq, seq, NULL);
+        return pthread_mutex_lock(mtx);
+}
+
+int pthread_cond_signal(pthread_cond_t *cond)
+{
+        __sync_fetch_and_add(&(*cond)->pc_seq, 1);
+        futex_wake((int *) &(*cond)->pc_seq, 1);
+        return 0;
+}
+
+int pthread_cond_broadcast(pthread_cond_t *cond)
+{
+        __sync_fetch_and_add(&(*cond)->pc_seq, 1);
+        futex_wake((int *) &(*cond)->pc_seq, INT_MAX);
+        return 0;
+}
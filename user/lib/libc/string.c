@@ -3,6 +3,64 @@
 #include "string.h"
 #include "errno.h"
 
+#include "weenix/vdata.h"
+
+/*
+ * memcpy and memset move 64 bytes at a time through the SSE registers
+ * when the kernel says they may be used. Not for short buffers though:
+ * the first SSE instruction a thread runs traps into the kernel to get
+ * it an FPU context, and aligning the destination costs a few bytes'
+ * worth of byte copies, which only pays off over a longer run.
+ */
+#define SSE2_MIN_BYTES  256
+
+#define sse2_enabled() (((const struct vdata *) VDATA_ADDR)->vd_sse2)
+
+/* The rest of libc is built for a plain i686, so the compiler has to be
+ * told these may use the SSE registers, or it cannot be told which of
+ * them the asm uses */
+#define __sse2 __attribute__((target("sse2")))
+
+/* Copies count & ~63 bytes to dest, which must be 16 byte aligned */
+static __sse2 void sse2_copy64(char *dest, const char *src, size_t count)
+{
+        for (; count >= 64; count -= 64, src += 64, dest += 64) {
+                __asm__ volatile(
+                        "movdqu   (%0), %%xmm0\n\t"
+                        "movdqu 16(%0), %%xmm1\n\t"
+                        "movdqu 32(%0), %%xmm2\n\t"
+                        "movdqu 48(%0), %%xmm3\n\t"
+                        "movdqa %%xmm0,   (%1)\n\t"
+                        "movdqa %%xmm1, 16(%1)\n\t"
+                        "movdqa %%xmm2, 32(%1)\n\t"
+                        "movdqa %%xmm3, 48(%1)"
+                        :: "r"(src), "r"(dest)
+                        : "memory", "xmm0", "xmm1", "xmm2", "xmm3");
+        }
+}
+
+/* Sets count & ~63 bytes at s, which must be 16 byte aligned, to c. The
+ * pattern is loaded along with each set of stores, since nothing says
+ * %xmm0 still holds it from one asm statement to the next; it is in the
+ * cache after the first time. */
+static __sse2 void sse2_set64(char *s, int c, size_t count)
+{
+        unsigned char pattern[16];
+        int i;
+
+        for (i = 0; i < 16; i++)
+                pattern[i] = c;
+        for (; count >= 64; count -= 64, s += 64) {
+                __asm__ volatile(
+                        "movdqu (%1), %%xmm0\n\t"
+                        "movdqa %%xmm0,   (%0)\n\t"
+                        "movdqa %%xmm0, 16(%0)\n\t"
+                        "movdqa %%xmm0, 32(%0)\n\t"
+                        "movdqa %%xmm0, 48(%0)"
+                        :: "r"(s), "r"(pattern) : "memory", "xmm0");
+        }
+}
+
 int memcmp(const void *cs, const void *ct, size_t count)
 {
         const unsigned char *su1, *su2;
@@ -18,6 +76,19 @@ void *memcpy(void *dest, const void *src, size_t count)
 {
         char *tmp = (char *) dest;
         const char *s = src;
+        size_t n;
+
+        if (count >= SSE2_MIN_BYTES && sse2_enabled()) {
+                while ((uintptr_t) tmp & 15) {
+                        *tmp++ = *s++;
+                        count--;
+                }
+                n = count & ~(size_t) 63;
+                sse2_copy64(tmp, s, n);
+                tmp += n;
+                s += n;
+                count -= n;
+        }
 
         while (count--)
                 *tmp++ = *s++;
@@ -72,6 +143,18 @@ char *strncpy(char *dest, const char *src, size_t count)
 void *memset(void *s, int c, size_t count)
 {
         char *xs = (char *) s;
+        size_t n;
+
+        if (count >= SSE2_MIN_BYTES && sse2_enabled()) {
+                while ((uintptr_t) xs & 15) {
+                        *xs++ = c;
+                        count--;
+                }
+                n = count & ~(size_t) 63;
+                sse2_set64(xs, c, n);
+                xs += n;
+                count -= n;
+        }
 
         while (count--)
                 *xs++ = c;
@@ -8,8 +8,15 @@
 #include "weenix/trap.h"
 
 #include "dirent.h"
+#include "sys/memstat.h"
+#include "sys/resource.h"
+#include "time.h"
+#include "weenix/vdata.h"
 
 static void *__curbrk = NULL;
+
+/* Read-only data the kernel keeps for this process, see weenix/vdata.h */
+static const struct vdata *const __vdata = (const struct vdata *) VDATA_ADDR;
 #define MAX_EXIT_HANDLERS 32
 
 static void     (*atexit_func[MAX_EXIT_HANDLERS])();
@@ -125,8 +132,53 @@ void thr_exit(int status)
         trap(SYS_thr_exit, (uint32_t) status);
 }
 
+int thr_create(void *(*entry)(void *), void *arg, size_t stacksz)
+{
+        thr_create_args_t args;
+
+        args.tca_entry = entry;
+        args.tca_arg = arg;
+        args.tca_stacksz = stacksz;
+        return trap(SYS_thr_create, (uint32_t) &args);
+}
+
+int thr_join(int tid, void **retval)
+{
+        thr_join_args_t args;
+
+        args.tja_tid = tid;
+        args.tja_retval = retval;
+        return trap(SYS_thr_join, (uint32_t) &args);
+}
+
+int thr_detach(int tid)
+{
+        return trap(SYS_thr_detach, (uint32_t) tid);
+}
+
+int thr_cancel(int tid)
+{
+        return trap(SYS_thr_cancel, (uint32_t) tid);
+}
+
+void thr_yield(void)
+{
+        trap(SYS_thr_yield, 0);
+}
+
+int gettid(void)
+{
+        return trap(SYS_gettid, 0);
+}
+
 pid_t getpid(void)
 {
+        uint32_t seq = __vdata->vd_seq;
+        pid_t pid = __vdata->vd_pid;
+
+        __asm__ volatile("" ::: "memory");
+        if (!(seq & 1) && seq == __vdata->vd_seq)
+                return pid;
         return trap(SYS_getpid, 0);
 }
 
@@ -231,6 +283,11 @@ int dup2(int ofd, int nfd)
         return trap(SYS_dup2, (uint32_t) &args);
 }
 
+int pipe(int fds[2])
+{
+        return trap(SYS_pipe, (uint32_t) fds);
+}
+
 int mkdir(const char *path, int mode)
 {
         mkdir_args_t args;
@@ -295,38 +352,32 @@ size_t get_free_mem(void)
         return (size_t) trap(SYS_get_free_mem, 0);
 }
 
-int execve(const char *filename, char *const argv[], char *const envp[])
+/* Builds the argvec for a NULL terminated vector of strings; the
+ * caller frees av_vec */
+static void build_argvec(argvec_t *vec, char *const strs[])
 {
-        execve_args_t           args;
-
         int i;
 
-        args.filename.as_len = strlen(filename);
-        args.filename.as_str = filename;
-
-        /* Build argv vector */
-        for (i = 0; argv[i] != NULL; i++)
+        for (i = 0; strs[i] != NULL; i++)
                 ;
-        args.argv.av_len = i;
-        args.argv.av_vec = malloc((args.argv.av_len + 1) * sizeof(argstr_t));
-        for (i = 0; argv[i] != NULL; i++) {
-                args.argv.av_vec[i].as_len = strlen(argv[i]);
-                args.argv.av_vec[i].as_str = argv[i];
+        vec->av_len = i;
+        vec->av_vec = malloc((vec->av_len + 1) * sizeof(argstr_t));
+        for (i = 0; strs[i] != NULL; i++) {
+                vec->av_vec[i].as_len = strlen(strs[i]);
+                vec->av_vec[i].as_str = strs[i];
         }
-        args.argv.av_vec[i].as_len = 0;
-        args.argv.av_vec[i].as_str = NULL;
+        vec->av_vec[i].as_len = 0;
+        vec->av_vec[i].as_str = NULL;
+}
 
-        /* Build envp vector */
-        for (i = 0; envp[i] != NULL; i++)
-                ;
-        args.envp.av_len = i;
-        args.envp.av_vec = malloc((args.envp.av_len + 1) * sizeof(argstr_t));
-        for (i = 0; envp[i] != NULL; i++) {
-                args.envp.av_vec[i].as_len = strlen(envp[i]);
-                args.envp.av_vec[i].as_str = envp[i];
-        }
-        args.envp.av_vec[i].as_len = 0;
-        args.envp.av_vec[i].as_str = NULL;
+int execve(const char *filename, char *const argv[], char *const envp[])
+{
+        execve_args_t           args;
+
+        args.filename.as_len = strlen(filename);
+        args.filename.as_str = filename;
+        build_argvec(&args.argv, argv);
+        build_argvec(&args.envp, envp);
 
         /* Note that we don't need to worry about freeing since we are going to exec
          * (so all our memory will be cleaned up) */
@@ -334,6 +385,26 @@ int execve(const char *filename, char *const argv[], char *const envp[])
         return trap(SYS_execve, (uint32_t) &args);
 }
 
+pid_t spawn(const char *filename, char *const argv[], char *const envp[],
+            const struct spawn_action *actions, int nactions)
+{
+        spawn_args_t            args;
+        pid_t                   pid;
+
+        args.filename.as_len = strlen(filename);
+        args.filename.as_str = filename;
+        build_argvec(&args.argv, argv);
+        build_argvec(&args.envp, envp);
+        args.actions = actions;
+        args.nactions = nactions;
+
+        pid = trap(SYS_spawn, (uint32_t) &args);
+
+        free(args.argv.av_vec);
+        free(args.envp.av_vec);
+        return pid;
+}
+
 void thr_set_errno(int n)
 {
         trap(SYS_set_errno, (uint32_t) n);
@@ -401,6 +472,105 @@ uname(struct utsname *buf)
         return trap(SYS_uname, (uint32_t) buf);
 }
 
+int
+memstat(pid_t pid, struct memstat *buf)
+{
+        memstat_args_t args;
+
+        args.pid = pid;
+        args.buf = buf;
+
+        return trap(SYS_memstat, (uint32_t) &args);
+}
+
+int
+nanosleep(const struct timespec *req, struct timespec *rem)
+{
+        nanosleep_args_t args;
+
+        args.req = req;
+        args.rem = rem;
+
+        return trap(SYS_nanosleep, (uint32_t) &args);
+}
+
+int
+clock_gettime(clockid_t clk_id, struct timespec *tp)
+{
+        clock_gettime_args_t args;
+        uint64_t base, tsc, ns;
+        uint32_t seq, mult, shift;
+
+        /* Work the time out from the TSC if the kernel has given us
+         * the parameters and isn't changing them right now */
+        if (CLOCK_MONOTONIC == clk_id) {
+                seq = __vdata->vd_seq;
+                __asm__ volatile("" ::: "memory");
+                base = __vdata->vd_tsc_base;
+                mult = __vdata->vd_tsc_mult;
+                shift = __vdata->vd_tsc_shift;
+                __asm__ volatile("rdtsc" : "=A"(tsc));
+                __asm__ volatile("" ::: "memory");
+                if (!(seq & 1) && seq == __vdata->vd_seq && 0 != mult) {
+                        ns = tsc_to_ns(tsc - base, mult, shift);
+                        tp->tv_sec = ns / 1000000000;
+                        tp->tv_nsec = ns % 1000000000;
+                        return 0;
+                }
+        }
+
+        args.clk_id = clk_id;
+        args.tp = tp;
+
+        return trap(SYS_clock_gettime, (uint32_t) &args);
+}
+
+int
+futex_wait(int *uaddr, int val, const struct timespec *timeout)
+{
+        futex_wait_args_t args;
+
+        args.fwa_uaddr = uaddr;
+        args.fwa_val = val;
+        args.fwa_timeout = timeout;
+
+        return trap(SYS_futex_wait, (uint32_t) &args);
+}
+
+int
+futex_wake(int *uaddr, int n)
+{
+        futex_wake_args_t args;
+
+        args.fwk_uaddr = uaddr;
+        args.fwk_n = n;
+
+        return trap(SYS_futex_wake, (uint32_t) &args);
+}
+
+int
+getrusage(int who, struct rusage *usage)
+{
+        getrusage_args_t args;
+
+        args.who = who;
+        args.usage = usage;
+
+        return trap(SYS_getrusage, (uint32_t) &args);
+}
+
+unsigned int
+sleep(unsigned int seconds)
+{
+        struct timespec req, rem;
+
+        req.tv_sec = seconds;
+        req.tv_nsec = 0;
+        if (nanosleep(&req, &rem) < 0)
+                return rem.tv_sec + (rem.tv_nsec > 0);
+        return 0;
+}
+
 int
 debug(const char *str)
 {
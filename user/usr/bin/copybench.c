@@ -0,0 +1,59 @@
+/*
+ * Measures the cost of moving data between the kernel and userland.
+ * Each iteration makes a uname() call, which copies five strings out
+ * to user memory. Run it once with the kernel in each copy mode
+ * ("uaccess fast" and "uaccess slow" in the kshell) to compare the
+ * two.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/utsname.h>
+
+#define DEFAULT_ITERS 10000
+
+static unsigned long long now_ns(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+        static struct utsname un;
+        unsigned long long start, end;
+        int iters = DEFAULT_ITERS;
+        int i;
+
+        if (argc > 1)
+                iters = atoi(argv[1]);
+        if (iters <= 0) {
+                fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+                return 1;
+        }
+
+        /* a bad pointer has to fail cleanly, not kill the kernel */
+        if (uname((struct utsname *) 0x1) >= 0 || errno != EFAULT) {
+                fprintf(stderr, "copybench: uname on a bad address did not "
+                        "return EFAULT\n");
+                return 1;
+        }
+
+        start = now_ns();
+        for (i = 0; i < iters; i++) {
+                if (uname(&un) < 0) {
+                        fprintf(stderr, "copybench: uname: errno %d\n", errno);
+                        return 1;
+                }
+        }
+        end = now_ns();
+
+        printf("%d calls, %llu ns/call\n", iters,
+               (end - start) / (unsigned long long) iters);
+        return 0;
+}
@@ -0,0 +1,94 @@
+/*
+ * Measures how the cost of creating a process grows with the number of
+ * processes in the system: builds up a population of zombie children
+ * (which keep their PIDs until they are waited for) in steps, and at
+ * each step times fork, exit and waitpid of a short lived child. With
+ * the default 1024 processes the machine needs more memory than the
+ * default 32mb, since every process keeps its kernel stack until it
+ * is reaped; the benchmark stops growing when fork fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_LIVE    1024
+#define DEFAULT_ITERS   200
+#define NSTEPS          4
+
+static unsigned long long now_ns(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Returns the number of zombies actually added */
+static int grow(int n)
+{
+        pid_t pid;
+        int i;
+
+        for (i = 0; i < n; ++i) {
+                if (0 == (pid = fork()))
+                        exit(0);
+                if (pid < 0)
+                        break;
+        }
+        return i;
+}
+
+static int run(int live, int iters)
+{
+        unsigned long long start, elapsed;
+        int status, i;
+        pid_t pid;
+
+        start = now_ns();
+        for (i = 0; i < iters; ++i) {
+                if (0 == (pid = fork()))
+                        exit(0);
+                if (pid < 0) {
+                        fprintf(stderr, "fork failed with %d processes\n", live);
+                        return -1;
+                }
+                waitpid(pid, 0, &status);
+        }
+        elapsed = now_ns() - start;
+
+        printf("%8d %12llu\n", live, elapsed / iters);
+        return 0;
+}
+
+int main(int argc, char **argv)
+{
+        int target = DEFAULT_LIVE;
+        int iters = DEFAULT_ITERS;
+        int live = 0;
+        int step, status;
+
+        if (argc > 1)
+                target = atoi(argv[1]);
+        if (argc > 2)
+                iters = atoi(argv[2]);
+        if (target < 0 || iters <= 0 || argc > 3) {
+                fprintf(stderr, "usage: %s [processes] [iterations]\n", argv[0]);
+                return 1;
+        }
+
+        printf("%8s %12s\n", "ZOMBIES", "FORK ns");
+        for (step = 0; step <= NSTEPS; ++step) {
+                int want = target * step / NSTEPS - live;
+                int got = grow(want);
+
+                live += got;
+                if (run(live, iters) < 0 || got < want)
+                        break;
+        }
+
+        while (wait(&status) > 0)
+                ;
+        return 0;
+}
@@ -0,0 +1,34 @@
+/*
+ * Prints the memory usage of a process (by default, itself): resident
+ * anonymous and file pages, page table pages and fault counts.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/memstat.h>
+
+int main(int argc, char **argv)
+{
+        struct memstat ms;
+        pid_t pid = 0;
+
+        if (argc > 2) {
+                fprintf(stderr, "usage: %s [pid]\n", argv[0]);
+                return 1;
+        } else if (argc == 2) {
+                pid = atoi(argv[1]);
+        }
+
+        if (memstat(pid, &ms) < 0) {
+                fprintf(stderr, "memstat: pid %d: errno %d\n", pid, errno);
+                return 1;
+        }
+
+        printf("rss anon:    %u pages\n", ms.ms_rss_anon);
+        printf("rss file:    %u pages\n", ms.ms_rss_file);
+        printf("page tables: %u pages\n", ms.ms_ptpages);
+        printf("faults:      %u minor, %u major\n", ms.ms_minflt, ms.ms_majflt);
+        return 0;
+}
@@ -0,0 +1,154 @@
+/*
+ * Measures pipe throughput between two processes, like
+ * "dd if=/dev/zero bs=<bs> count=<count> | dd of=/dev/null". A child
+ * writes count blocks of bs bytes into a pipe and this process reads
+ * them back out, PIPE_READ bytes at a time, until end of file.
+ *
+ * Given bs (and optionally count), it does a single run; otherwise it
+ * moves DEFAULT_TOTAL bytes with each of a range of block sizes.
+ * BYTES/READ is how much data each read() found waiting: the higher
+ * it is, the fewer times the reader and writer had to wake each other.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_TOTAL   (8 * 1024 * 1024)
+#define PIPE_READ       (64 * 1024)
+#define MAX_BS          (1024 * 1024)
+
+static char rbuf[PIPE_READ];
+
+static unsigned long long now_ns(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void writer(int fd, size_t bs, unsigned long count)
+{
+        unsigned long i;
+        char *wbuf;
+        int n;
+
+        if (NULL == (wbuf = malloc(bs))) {
+                fprintf(stderr, "pipebench: out of memory\n");
+                exit(1);
+        }
+        memset(wbuf, 'x', bs);
+        for (i = 0; i < count; ++i) {
+                if ((n = write(fd, wbuf, bs)) != (int) bs) {
+                        fprintf(stderr, "pipebench: write returned %d, errno %d\n",
+                                n, errno);
+                        exit(1);
+                }
+        }
+        exit(0);
+}
+
+/* Moves count blocks of bs bytes through a pipe, returning 0 and the
+ * time it took and number of reads it took, or -1 */
+static int run(size_t bs, unsigned long count,
+               unsigned long long *ns, unsigned long *nreads)
+{
+        unsigned long long start, total = 0;
+        int fds[2], n, status;
+        pid_t pid;
+
+        if (0 > pipe(fds)) {
+                fprintf(stderr, "pipebench: pipe: errno %d\n", errno);
+                return -1;
+        }
+
+        /* or the child would print whatever is waiting to go out too */
+        fflush(NULL);
+        start = now_ns();
+        if (0 > (pid = fork())) {
+                fprintf(stderr, "pipebench: fork: errno %d\n", errno);
+                close(fds[0]);
+                close(fds[1]);
+                return -1;
+        } else if (0 == pid) {
+                close(fds[0]);
+                writer(fds[1], bs, count);
+        }
+        close(fds[1]);
+
+        *nreads = 0;
+        while (0 < (n = read(fds[0], rbuf, sizeof(rbuf)))) {
+                total += n;
+                (*nreads)++;
+        }
+        *ns = now_ns() - start;
+        close(fds[0]);
+        waitpid(pid, 0, &status);
+
+        if (n < 0 || total != (unsigned long long) bs * count) {
+                fprintf(stderr, "pipebench: read %llu of %llu bytes (errno %d)\n",
+                        total, (unsigned long long) bs * count, (n < 0) ? errno : 0);
+                return -1;
+        }
+        return 0;
+}
+
+static int report(size_t bs, unsigned long count)
+{
+        unsigned long long ns, bytes = (unsigned long long) bs * count;
+        unsigned long nreads;
+
+        if (0 > run(bs, count, &ns, &nreads))
+                return -1;
+
+        /* hundredths, since there is no floating point printf */
+        unsigned long long rate = (0 == ns) ? 0 : bytes * 100000 / ns;
+        printf("%8lu %10llu %9llu %6llu.%02llu %11llu\n",
+               (unsigned long) bs, bytes, ns / 1000000,
+               rate / 100, rate % 100, bytes / (nreads ? nreads : 1));
+        return 0;
+}
+
+static void usage(const char *name)
+{
+        fprintf(stderr, "usage: %s [bs=<bytes (1-%d)> [count=<blocks>]]\n",
+                name, MAX_BS);
+        exit(1);
+}
+
+int main(int argc, char **argv)
+{
+        static const size_t sizes[] = { 64, 512, PIPE_BUF, 16384, 65536 };
+        long bs = 0, count = 0;
+        unsigned int i;
+        int arg;
+
+        for (arg = 1; arg < argc; ++arg) {
+                if (0 == strncmp(argv[arg], "bs=", 3))
+                        bs = strtol(argv[arg] + 3, NULL, 10);
+                else if (0 == strncmp(argv[arg], "count=", 6))
+                        count = strtol(argv[arg] + 6, NULL, 10);
+                else
+                        usage(argv[0]);
+        }
+        if ((0 == bs && 0 != count) || bs < 0 || bs > MAX_BS || count < 0)
+                usage(argv[0]);
+
+        printf("%8s %10s %9s %9s %11s\n",
+               "BS", "BYTES", "TIME (ms)", "MB/s", "BYTES/READ");
+        if (0 != bs) {
+                if (0 == count)
+                        count = (DEFAULT_TOTAL + bs - 1) / bs;
+                return (0 > report(bs, count)) ? 1 : 0;
+        }
+        for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+                if (0 > report(sizes[i], DEFAULT_TOTAL / sizes[i]))
+                        return 1;
+        }
+        return 0;
+}
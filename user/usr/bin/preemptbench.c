@@ -0,0 +1,121 @@
+/*
+ * Measures how responsive the system stays while CPU-bound processes
+ * run. It starts some spinners, which loop without making a system
+ * call (like spin) for a fixed time, and meanwhile repeatedly runs a
+ * trivial command the way the shell does, with fork() and wait(). Each
+ * round trip has to get the child through the run queue past the
+ * spinners, so its worst case is how long a shell user would wait for
+ * a prompt.
+ *
+ * Without preemption the first round trip waits for every spinner to
+ * finish. With UPREEMPT it should stay within about one time slice
+ * (TIMESLICE_MSECS) per spinner.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_NSPIN           2
+#define DEFAULT_SPIN_MSECS      2000
+#define MAX_NSPIN               16
+
+static inline unsigned long long rdtsc(void)
+{
+        unsigned long long ret;
+        __asm__ volatile("rdtsc" : "=A"(ret));
+        return ret;
+}
+
+static unsigned long long now_ns(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* The spinners must not make system calls, so they watch the TSC
+ * instead of the clock. This finds out how fast it runs. */
+static unsigned long long tsc_per_msec(void)
+{
+        unsigned long long start_ns, start_tsc;
+
+        start_ns = now_ns();
+        start_tsc = rdtsc();
+        while (now_ns() - start_ns < 10000000ULL);
+        return (rdtsc() - start_tsc) / 10;
+}
+
+static void print_time(const char *what, unsigned long long ns)
+{
+        printf("%-12s %12llu ns (%llu ms)\n", what, ns, ns / 1000000);
+}
+
+int main(int argc, char **argv)
+{
+        unsigned long long deadline_tsc, deadline, start, elapsed;
+        unsigned long long total = 0, worst = 0;
+        pid_t spinners[MAX_NSPIN];
+        int nspin = DEFAULT_NSPIN;
+        int msecs = DEFAULT_SPIN_MSECS;
+        int rounds = 0;
+        int i;
+        pid_t pid;
+
+        if (argc > 1)
+                nspin = atoi(argv[1]);
+        if (argc > 2)
+                msecs = atoi(argv[2]);
+        if (nspin < 0 || nspin > MAX_NSPIN || msecs <= 0 || argc > 3) {
+                fprintf(stderr, "usage: %s [spinners (0-%d) [spin_msecs]]\n",
+                        argv[0], MAX_NSPIN);
+                return 1;
+        }
+
+        deadline_tsc = rdtsc() + tsc_per_msec() * msecs;
+        deadline = now_ns() + msecs * 1000000ULL;
+
+        for (i = 0; i < nspin; ++i) {
+                if ((pid = fork()) < 0) {
+                        fprintf(stderr, "preemptbench: fork: errno %d\n",
+                                errno);
+                        nspin = i;
+                        break;
+                } else if (0 == pid) {
+                        while (rdtsc() < deadline_tsc);
+                        exit(0);
+                }
+                spinners[i] = pid;
+        }
+
+        while ((start = now_ns()) < deadline) {
+                if ((pid = fork()) < 0) {
+                        fprintf(stderr, "preemptbench: fork: errno %d\n",
+                                errno);
+                        break;
+                } else if (0 == pid) {
+                        exit(0);
+                }
+                waitpid(pid, 0, NULL);
+
+                elapsed = now_ns() - start;
+                total += elapsed;
+                if (elapsed > worst)
+                        worst = elapsed;
+                rounds++;
+        }
+
+        for (i = 0; i < nspin; ++i)
+                waitpid(spinners[i], 0, NULL);
+
+        printf("%d spinners for %d ms, %d fork/wait round trips\n",
+               nspin, msecs, rounds);
+        if (rounds > 0) {
+                print_time("avg latency:", total / rounds);
+                print_time("max latency:", worst);
+        }
+        return 0;
+}
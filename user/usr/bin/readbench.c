@@ -0,0 +1,81 @@
+/*
+ * Measures file read throughput. Writes a 1 MiB file and then reads it
+ * back whole, a number of times, with one read() call per pass. Give
+ * it a path on an s5fs file system: ramfs files cannot grow past a
+ * page, so it cannot be measured this way.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FILE_SIZE       (1024 * 1024)
+#define DEFAULT_FILE    "/readbench.dat"
+#define DEFAULT_ITERS   32
+
+static char buf[FILE_SIZE];
+
+static unsigned long long now_ns(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+        const char *path = DEFAULT_FILE;
+        unsigned long long start, ns;
+        int iters = DEFAULT_ITERS;
+        int fd, i, n;
+
+        if (argc > 1)
+                path = argv[1];
+        if (argc > 2)
+                iters = atoi(argv[2]);
+        if (iters <= 0 || argc > 3) {
+                fprintf(stderr, "usage: %s [file [iterations]]\n", argv[0]);
+                return 1;
+        }
+
+        if ((fd = open(path, O_RDWR | O_CREAT, 0)) < 0) {
+                fprintf(stderr, "readbench: open %s: errno %d\n", path, errno);
+                return 1;
+        }
+        memset(buf, 'w', sizeof(buf));
+        for (i = 0; i < FILE_SIZE; i += n) {
+                if ((n = write(fd, buf + i, FILE_SIZE - i)) <= 0) {
+                        fprintf(stderr, "readbench: write: errno %d "
+                                "after %d bytes\n", errno, i);
+                        close(fd);
+                        return 1;
+                }
+        }
+
+        start = now_ns();
+        for (i = 0; i < iters; i++) {
+                lseek(fd, 0, SEEK_SET);
+                if ((n = read(fd, buf, FILE_SIZE)) != FILE_SIZE) {
+                        fprintf(stderr, "readbench: read returned %d "
+                                "(errno %d)\n", n, errno);
+                        close(fd);
+                        return 1;
+                }
+        }
+        ns = now_ns() - start;
+        close(fd);
+        unlink(path);
+
+        printf("%s: %d x 1 MiB, %llu ns/MiB\n", path, iters,
+               ns / (unsigned long long) iters);
+        if (ns > 0) {
+                printf("%llu MB/s\n", (unsigned long long) iters * FILE_SIZE
+                       * 1000ULL / ns);
+        }
+        return 0;
+}
@@ -0,0 +1,136 @@
+/*
+ * Measures how CPU-bound work scales across processors (boot with
+ * ./weenix --smp <n> and a kernel built with SMP). Each round forks
+ * some workers, each doing the same fixed amount of computation with
+ * no system calls, and waits for all of them: with one CPU the wall
+ * time grows with the number of workers, with enough CPUs it stays
+ * that of a single worker. The number of workers doubles every round.
+ *
+ * speedup is how much more work got done per unit of wall time than
+ * with a single worker, and cpu/wall is the child CPU time (from
+ * getrusage()) over the wall time, i.e. how many processors were busy
+ * on average.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_MAX_WORKERS     4
+#define DEFAULT_WORK_MSECS      500
+#define MAX_WORKERS             32
+
+static unsigned long long now_ns(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned long long tv_ns(const struct timeval *tv)
+{
+        return tv->tv_sec * 1000000000ULL + tv->tv_usec * 1000ULL;
+}
+
+static unsigned long long children_cpu_ns(void)
+{
+        struct rusage ru;
+
+        if (0 > getrusage(RUSAGE_CHILDREN, &ru))
+                return 0;
+        return tv_ns(&ru.ru_utime) + tv_ns(&ru.ru_stime);
+}
+
+static void work(unsigned long iterations)
+{
+        volatile unsigned long x = 1;
+        unsigned long i;
+
+        for (i = 0; i < iterations; ++i)
+                x = x * 1103515245 + 12345;
+}
+
+/* Finds out how many iterations of work() take about msecs */
+static unsigned long calibrate(int msecs)
+{
+        unsigned long n = 1000;
+        unsigned long long elapsed;
+
+        for (;;) {
+                unsigned long long start = now_ns();
+                work(n);
+                elapsed = now_ns() - start;
+                if (elapsed > 50000000ULL)
+                        break;
+                n *= 2;
+        }
+        return (unsigned long)((unsigned long long)n * msecs * 1000000ULL / elapsed);
+}
+
+/* Runs nworkers workers at once and returns the wall time in ns */
+static unsigned long long run(int nworkers, unsigned long iterations)
+{
+        unsigned long long start = now_ns();
+        pid_t pids[MAX_WORKERS];
+        int i, n = 0;
+
+        for (i = 0; i < nworkers; ++i) {
+                if ((pids[n] = fork()) < 0) {
+                        fprintf(stderr, "smpbench: fork: errno %d\n", errno);
+                        break;
+                } else if (0 == pids[n]) {
+                        work(iterations);
+                        exit(0);
+                }
+                n++;
+        }
+        for (i = 0; i < n; ++i)
+                waitpid(pids[i], 0, NULL);
+        return now_ns() - start;
+}
+
+int main(int argc, char **argv)
+{
+        unsigned long long wall, cpu, single = 0;
+        unsigned long iterations;
+        int max = DEFAULT_MAX_WORKERS;
+        int msecs = DEFAULT_WORK_MSECS;
+        int n;
+
+        if (argc > 1)
+                max = atoi(argv[1]);
+        if (argc > 2)
+                msecs = atoi(argv[2]);
+        if (max <= 0 || max > MAX_WORKERS || msecs <= 0 || argc > 3) {
+                fprintf(stderr, "usage: %s [max_workers (1-%d) [work_msecs]]\n",
+                        argv[0], MAX_WORKERS);
+                return 1;
+        }
+
+        iterations = calibrate(msecs);
+        printf("%lu iterations (about %d ms) per worker\n", iterations, msecs);
+        printf("%8s %10s %10s %9s %9s\n",
+               "WORKERS", "WALL (ms)", "CPU (ms)", "CPU/WALL", "SPEEDUP");
+
+        for (n = 1; n <= max; n = (n < max && 2 * n > max) ? max : 2 * n) {
+                cpu = children_cpu_ns();
+                wall = run(n, iterations);
+                cpu = children_cpu_ns() - cpu;
+                if (1 == n)
+                        single = wall;
+
+                /* hundredths, since there is no floating point printf */
+                unsigned long long par = (0 == wall) ? 0 : cpu * 100 / wall;
+                unsigned long long speedup = (0 == wall) ? 0 : single * n * 100 / wall;
+                printf("%8d %10llu %10llu %6llu.%02llu %6llu.%02llu\n",
+                       n, wall / 1000000, cpu / 1000000,
+                       par / 100, par % 100, speedup / 100, speedup % 100);
+                if (n == max)
+                        break;
+        }
+        return 0;
+}
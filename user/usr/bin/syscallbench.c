@@ -0,0 +1,57 @@
+/*
+ * Measures the cost of entering and leaving the kernel: makes the
+ * cheapest system call there is, getpid, many times through the
+ * system call interrupt and then with SYSENTER, and prints the average
+ * time per call for each.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <weenix/syscall.h>
+#include <weenix/trap.h>
+#include <weenix/vdata.h>
+
+#define DEFAULT_ITERS   100000
+
+static unsigned long long now_ns(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void run(const char *what, int (*entry)(uint32_t, uint32_t), int iters)
+{
+        unsigned long long start, elapsed;
+        int i;
+
+        start = now_ns();
+        for (i = 0; i < iters; ++i)
+                entry(SYS_getpid, 0);
+        elapsed = now_ns() - start;
+
+        printf("%-10s %8llu ns/call\n", what, elapsed / iters);
+}
+
+int main(int argc, char **argv)
+{
+        const struct vdata *vd = (const struct vdata *) VDATA_ADDR;
+        int iters = DEFAULT_ITERS;
+
+        if (argc > 1)
+                iters = atoi(argv[1]);
+        if (iters <= 0 || argc > 2) {
+                fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+                return 1;
+        }
+
+        run("int:", trap_int, iters);
+        if (vd->vd_sysenter)
+                run("sysenter:", trap_sysenter, iters);
+        else
+                printf("sysenter:  not supported\n");
+        return 0;
+}
@@ -0,0 +1,101 @@
+/*
+ * Exercises the pthread library (and the kernel's MTP support under
+ * it): threads incrementing a counter under a mutex, a producer and
+ * consumer handing items over through a condition variable, join
+ * return values and detached threads.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <pthread/pthread.h>
+
+#define NTHREADS        8
+#define NINCS           1000
+#define NITEMS          100
+
+static pthread_mutex_t lock;
+static pthread_cond_t cond;
+static int counter;
+static int slot = -1;           /* the item being handed over, -1 if none */
+
+static void check(int err, const char *what)
+{
+        if (err) {
+                printf("threadtest: %s failed: errno %d\n", what, err);
+                exit(1);
+        }
+}
+
+static void *incr(void *arg)
+{
+        int i;
+
+        for (i = 0; i < NINCS; i++) {
+                pthread_mutex_lock(&lock);
+                counter++;
+                pthread_mutex_unlock(&lock);
+                if (0 == i % 100)
+                        pthread_yield();
+        }
+        return arg;
+}
+
+static void *consume(void *arg)
+{
+        int i, sum = 0;
+
+        for (i = 0; i < NITEMS; i++) {
+                pthread_mutex_lock(&lock);
+                while (-1 == slot)
+                        pthread_cond_wait(&cond, &lock);
+                sum += slot;
+                slot = -1;
+                pthread_cond_broadcast(&cond);
+                pthread_mutex_unlock(&lock);
+        }
+        return (void *) sum;
+}
+
+int main(int argc, char **argv)
+{
+        pthread_t thrs[NTHREADS], consumer;
+        void *ret;
+        int i, sum = 0;
+
+        check(pthread_mutex_init(&lock, NULL), "pthread_mutex_init");
+        check(pthread_cond_init(&cond, NULL), "pthread_cond_init");
+
+        for (i = 0; i < NTHREADS; i++)
+                check(pthread_create(&thrs[i], NULL, incr, (void *) i), "pthread_create");
+        for (i = 0; i < NTHREADS; i++) {
+                check(pthread_join(thrs[i], &ret), "pthread_join");
+                if ((int) ret != i) {
+                        printf("threadtest: thread %d returned %d\n", i, (int) ret);
+                        return 1;
+                }
+        }
+        printf("counter: %d (expected %d)\n", counter, NTHREADS * NINCS);
+
+        check(pthread_create(&consumer, NULL, consume, NULL), "pthread_create");
+        for (i = 0; i < NITEMS; i++) {
+                pthread_mutex_lock(&lock);
+                while (-1 != slot)
+                        pthread_cond_wait(&cond, &lock);
+                slot = i;
+                sum += i;
+                pthread_cond_broadcast(&cond);
+                pthread_mutex_unlock(&lock);
+        }
+        check(pthread_join(consumer, &ret), "pthread_join");
+        printf("handed over: %d (expected %d)\n", (int) ret, sum);
+
+        for (i = 0; i < NTHREADS; i++) {
+                check(pthread_create(&thrs[i], NULL, incr, NULL), "pthread_create");
+                check(pthread_detach(thrs[i]), "pthread_detach");
+        }
+
+        return (counter == NTHREADS * NINCS && (int) ret == sum) ? 0 : 1;
+}
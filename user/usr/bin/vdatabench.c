@@ -0,0 +1,81 @@
+/*
+ * Compares getpid() and clock_gettime() as libc does them, reading the
+ * vdata page, with making the system calls directly. Prints the
+ * average time per call for each.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <weenix/syscall.h>
+#include <weenix/trap.h>
+
+#define DEFAULT_ITERS   100000
+
+static unsigned long long now_ns(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void getpid_vdata(void)
+{
+        getpid();
+}
+
+static void getpid_trap(void)
+{
+        trap(SYS_getpid, 0);
+}
+
+static void clock_vdata(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+}
+
+static void clock_trap(void)
+{
+        struct timespec ts;
+        clock_gettime_args_t args;
+
+        args.clk_id = CLOCK_MONOTONIC;
+        args.tp = &ts;
+        trap(SYS_clock_gettime, (uint32_t) &args);
+}
+
+static void run(const char *what, void (*func)(void), int iters)
+{
+        unsigned long long start, elapsed;
+        int i;
+
+        start = now_ns();
+        for (i = 0; i < iters; ++i)
+                func();
+        elapsed = now_ns() - start;
+
+        printf("%-22s %8llu ns/call\n", what, elapsed / iters);
+}
+
+int main(int argc, char **argv)
+{
+        int iters = DEFAULT_ITERS;
+
+        if (argc > 1)
+                iters = atoi(argv[1]);
+        if (iters <= 0 || argc > 2) {
+                fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+                return 1;
+        }
+
+        run("getpid (vdata):", getpid_vdata, iters);
+        run("getpid (trap):", getpid_trap, iters);
+        run("clock_gettime (vdata):", clock_vdata, iters);
+        run("clock_gettime (trap):", clock_trap, iters);
+        return 0;
+}